@@ -13,21 +13,93 @@ class Vfs;
 
 /** Options used to create a resource pool. */
 struct PoolOptions {
-  /** The base-2 logarithm of the pool's page size.
+  /** The base-2 logarithm of the pool's default page size.
    *
    * The pool's page size can be computed as (1 << page_shift), or
-   * 2 ** page_shift. The pool can only be used to open stores whose page size
-   * matches the pool's page size.
+   * 2 ** page_shift. Stores use this page size unless StoreOptions::page_shift
+   * asks for a different one.
    */
   size_t page_shift;
 
-  /** Maximum number of store pages cached the page pool.
+  /** Maximum number of default-sized store pages cached the page pool.
    *
    * The page pool's peak memory usage is bounded by the page size and the
    * maximum number of pages. Each page requires a small bookkeeping overhead.
+   *
+   * The resulting memory budget is shared by all the page sizes used by the
+   * pool's stores. The budget starts out assigned to the default page size, and
+   * is moved between page sizes based on the misses that each page size sees.
    */
   size_t page_pool_size;
 
+  /** Maximum number of bytes used to cache compressed store pages.
+   *
+   * Store pages evicted from the page pool are compressed and kept in this
+   * second cache tier, if they compress well. Reading a page from the
+   * compressed cache is much faster than reading it from disk, so the tier
+   * helps when the working set is a few times larger than the page pool. The
+   * memory used by the tier is in addition to the page pool's memory. 0
+   * disables the tier. The tier only caches pages of the default page size.
+   */
+  size_t compressed_page_cache_size;
+
+  /** Milliseconds a store operation waits for pinned pages to be released.
+   *
+   * When every page in the page pool is pinned, an operation that needs another
+   * page waits for a concurrent transaction to release a page, and new
+   * transactions wait until the pool has room for their pages. Operations that
+   * wait longer than this fail with kPoolFull. Under bursty load, waiting turns
+   * transient overloads into latency instead of failed transactions.
+   *
+   * 0 disables waiting, so operations fail with kPoolFull right away. This is
+   * the default, and is the right choice for pools used by a single thread,
+   * where no other thread can release pinned pages.
+   */
+  size_t pinned_page_wait_ms;
+
+  /** If true, the page pools are partitioned by NUMA node.
+   *
+   * Each page pool entry is backed by the memory of one NUMA node, and page
+   * requests are served by the entries on the requesting thread's node, when
+   * possible. This cuts down remote memory accesses on multi-socket servers.
+   * Machines with a single NUMA node, and platforms that do not report NUMA
+   * nodes, get a single partition, which matches an unpartitioned pool.
+   */
+  bool numa_aware_page_pool;
+
+  /** Number of independent partitions that the resource pool is split into.
+   *
+   * This is lock striping. Each partition has its own page pools, its own
+   * share of the memory budget, and its own lock. Each store is assigned to a
+   * partition by hashing its path, and only uses that partition's resources.
+   * Threads working on stores in different partitions never contend for a lock
+   * or for the page pools' cache lines, so a multi-threaded service can scale
+   * by spreading its data across many stores. Stores whose paths hash to the
+   * same partition still share its lock. The price is that a store cannot use
+   * the memory budget of other partitions, even if they are idle.
+   *
+   * Partitions are not bound to threads or cores. Operations run on the
+   * calling thread while it holds the partition's lock.
+   *
+   * The partitions use the pool's VFS concurrently, so the VFS must be
+   * thread-safe. 1 (the default) disables partitioning, so all stores share
+   * the pool.
+   */
+  size_t partition_count;
+
+  /** Number of threads that run the pool's asynchronous operations.
+   *
+   * Operations such as Transaction::GetAsync() are queued to these threads, so
+   * the threads issuing them never block on I/O or on the pool's locks. An
+   * event loop can keep many operations in flight, and have their completion
+   * callbacks run on the threads. An operation whose store page is not cached
+   * releases its thread while the page is read, so the number of operations
+   * waiting for page reads is not limited by the number of threads. 0 (the
+   * default) runs asynchronous operations on the issuing thread, before the
+   * issuing call returns.
+   */
+  size_t async_thread_count;
+
   /** The platform services implementation used by the resource pool.
    *
    * All the stores that use the resource pool must perform their operations via
@@ -52,6 +124,66 @@ struct StoreOptions {
    * If this option is true, create_if_missing must also be true. */
   bool error_if_exists;
 
+  /** The base-2 logarithm of the store's page size.
+   *
+   * 0 selects the pool's default page size, PoolOptions::page_shift. Existing
+   * stores must be opened with the page size they were created with. Stores
+   * with different page sizes can share a resource pool, and its memory budget.
+   * Opening a store fails with Status::kInvalidArgument if the page size is too
+   * small to hold the store's header, or larger than 2 GB.
+   */
+  size_t page_shift;
+
+  /** If true, a newly created store will compress its pages on disk.
+   *
+   * Compression trades CPU time for disk bandwidth. Pages are only compressed
+   * on disk, and are cached uncompressed in the resource pool. The choice is
+   * recorded in the store, and this option is ignored when opening an existing
+   * store. Compression is most effective with page sizes above 4 KB.
+   *
+   * Compression does not save disk space. Each page keeps its full-size slot
+   * in the data file, and a compressed page only reads and writes the part of
+   * the slot that holds its compressed image.
+   */
+  bool compress_pages;
+
+  /** If true, the store's clean pages are read from a mapping of its data file.
+   *
+   * Page pool entries caching clean pages point into the mapping, instead of
+   * holding a copy of the page data, so a store that fits in the operating
+   * system's page cache is not cached twice, and the page cache is shared with
+   * other processes reading the same file. Modified pages are copied into page
+   * pool buffers. This option is ignored for stores that compress their pages,
+   * and on platforms that cannot map files.
+   */
+  bool map_data_file;
+
+  /** Page pool entries reserved for the store's pages.
+   *
+   * While the store has at most this many pages cached, its pages are not
+   * evicted to make room for other stores' pages. Reservations should add up to
+   * less than the page pool's size, so stores without a reservation can make
+   * progress.
+   */
+  size_t page_pool_min_pages;
+
+  /** Maximum number of page pool entries caching the store's pages.
+   *
+   * A store at this limit replaces its own cached pages before using pages that
+   * could cache other stores' data. Pinned pages may exceed the limit. 0 means
+   * that the store is only limited by the page pool's size.
+   */
+  size_t page_pool_max_pages;
+
+  /** The store's weight when sharing a page pool with other stores.
+   *
+   * Each store's share of the page pool is proportional to its weight. When the
+   * page pool is full, pages are evicted from stores that exceed their share
+   * before other stores' pages, so a store scanning through many pages does not
+   * push the other stores' pages out of the pool.
+   */
+  size_t page_pool_weight;
+
   /** Defaults. */
   StoreOptions();
 };
@@ -19,6 +19,12 @@ class Store;
  * Resource pools capture the bulk of a store's resource (memory, I/O) usage.
  * For best results, a system should have very few pools (ideally, one) that all
  * the stores use.
+ *
+ * A pool's stores and transactions can be used from multiple threads. Their
+ * operations are serialized by a pool-wide lock, which is released while an
+ * operation waits for pinned pages. See PoolOptions::pinned_page_wait_ms.
+ * Partitioned pools have a lock for each partition, so operations on stores in
+ * different partitions run in parallel. See PoolOptions::partition_count.
  */
 class Pool {
  public:
@@ -27,7 +33,9 @@ class Pool {
 
   /** Releases all resources held by this pool.
    *
-   * This closes all the databases opened using this resource pool. */
+   * This closes all the databases opened using this resource pool. No other
+   * thread may be using the pool's stores while it is released. Queued
+   * asynchronous operations are completed before the stores are closed. */
   void Release();
 
   /** Open (or create) a store. */
@@ -37,9 +45,21 @@ class Pool {
   /** The store page size supported by this resource pool. */
   size_t page_size() const;
 
-  /** The maximum number of store pages cached by the page pool. */
+  /** The memory budget of the page pool, in pages of the default size. */
   size_t page_pool_size() const;
 
+  /** Changes the memory budget of the page pool.
+   *
+   * Raising the budget takes effect lazily, as pages are allocated on demand.
+   * Lowering the budget evicts unpinned pages right away, writing back dirty
+   * pages, and returns their memory to the allocator. Pinned pages are dropped
+   * on page pool misses after they are unpinned, so the page pool may exceed
+   * the new budget for a while.
+   *
+   * @param page_pool_size the new memory budget, in pages of the default size
+   */
+  void SetPagePoolSize(size_t page_pool_size);
+
  private:
   friend class PoolImpl;
 
@@ -31,6 +31,12 @@ enum class Status : int {
 
   // The underlying data was corrupted.
   kDataCorrupted = 7,
+
+  // A concurrent transaction committed a conflicting change first.
+  kConflict = 8,
+
+  // The caller passed an argument that is not supported.
+  kInvalidArgument = 9,
 };
 
 }  // namespace berrydb
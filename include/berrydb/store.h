@@ -55,8 +55,16 @@ class Store {
    */
   static std::string LogFilePath(const std::string& store_path);
 
-  /** Starts a transaction against this store. */
-  Transaction* CreateTransaction();
+  /** Starts a transaction against this store.
+   *
+   * If the store's pool waits for pinned pages, this waits until the pool has
+   * room for the transaction's pages. See PoolOptions::pinned_page_wait_ms.
+   *
+   * @param  result receives the new transaction if the call succeeds
+   * @return        kSuccess, or kPoolFull if the pool did not have room for
+   *                the transaction before the wait timed out
+   */
+  Status CreateTransaction(Transaction** result);
 
   /** Obtains the root catalog for this store.
    *
@@ -7,12 +7,34 @@
 
 #include "berrydb/platform.h"
 
+// C++20 coroutine support is decided by the embedder's compiler settings, not
+// by the settings BerryDB was built with, so it cannot come from config.h.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define BERRYDB_HAVE_COROUTINES 1
+#include <atomic>
+#include <coroutine>
+#endif  // __has_include(<coroutine>)
+#endif  // defined(__cpp_impl_coroutine) && defined(__has_include)
+
 namespace berrydb {
 
 class Catalog;
 class Space;
 enum class Status : int;
 
+#if defined(BERRYDB_HAVE_COROUTINES)
+class TransactionAwaitable;
+#endif  // defined(BERRYDB_HAVE_COROUTINES)
+
+/** Called when an asynchronous transaction operation completes.
+ *
+ * @param context the pointer passed to the call that started the operation
+ * @param status  the result of the operation; the same as the result of the
+ *                synchronous version of the operation
+ */
+using TransactionCallback = void (*)(void* context, Status status);
+
 /**
  * An atomic and durable (once committed) unit of database operations.
  *
@@ -21,6 +43,22 @@ enum class Status : int;
  * to a (key-value name)space, its lifetime must not overlap with the lifetime
  * of any other transaction that either reads from or writes to the same catalog
  * or space.
+ *
+ * The operations that may perform I/O have asynchronous versions, which return
+ * right away and report their results via callbacks. The operations run on the
+ * pool's asynchronous operation threads, so an event loop can keep many of them
+ * in flight. See PoolOptions::async_thread_count. The arguments of an
+ * asynchronous operation, such as keys and values, must stay valid until the
+ * operation completes. Operations on the same transaction that are in flight at
+ * the same time may run in any order, so CommitAsync() should only be called
+ * after the transaction's other operations complete. A transaction must not be
+ * released while it has operations in flight.
+ *
+ * When compiled as C++20, the asynchronous operations can also be awaited by
+ * coroutines.
+ *
+ *     string_view value;
+ *     Status status = co_await transaction->GetAsync(space, key, &value);
  */
 class Transaction {
  public:
@@ -38,6 +76,9 @@ class Transaction {
    *
    * After this method is called, the transaction becomes invalid. No other
    * methods should be called.
+   *
+   * Returns kConflict, and rolls the transaction back, if a concurrent
+   * transaction committed a conflicting change first.
    */
   Status Commit();
 
@@ -49,6 +90,47 @@ class Transaction {
    */
   Status Rollback();
 
+  /** Asynchronous version of Get().
+   *
+   * @param callback called when the operation completes; may be called on one
+   *                 of the pool's asynchronous operation threads, or before
+   *                 this method returns
+   * @param context  passed to the callback
+   */
+  void GetAsync(Space* space, string_view key, string_view* value,
+                TransactionCallback callback, void* context);
+
+  /** Asynchronous version of Put(). See GetAsync() for the callback. */
+  void PutAsync(Space* space, string_view key, string_view value,
+                TransactionCallback callback, void* context);
+
+  /** Asynchronous version of Delete(). See GetAsync() for the callback. */
+  void DeleteAsync(Space* space, string_view key,
+                   TransactionCallback callback, void* context);
+
+  /** Asynchronous version of Commit(). See GetAsync() for the callback. */
+  void CommitAsync(TransactionCallback callback, void* context);
+
+  /** Asynchronous version of Rollback(). See GetAsync() for the callback. */
+  void RollbackAsync(TransactionCallback callback, void* context);
+
+#if defined(BERRYDB_HAVE_COROUTINES)
+  /** Awaitable versions of the asynchronous operations.
+   *
+   * co_await-ing the result starts the operation, suspends the coroutine until
+   * the operation completes, and produces the operation's status. The
+   * coroutine may be resumed on one of the pool's asynchronous operation
+   * threads. */
+  inline TransactionAwaitable GetAsync(
+      Space* space, string_view key, string_view* value) noexcept;
+  inline TransactionAwaitable PutAsync(
+      Space* space, string_view key, string_view value) noexcept;
+  inline TransactionAwaitable DeleteAsync(
+      Space* space, string_view key) noexcept;
+  inline TransactionAwaitable CommitAsync() noexcept;
+  inline TransactionAwaitable RollbackAsync() noexcept;
+#endif  // defined(BERRYDB_HAVE_COROUTINES)
+
   /** Creates a (key/value name)space.
    *
    * @param catalog will store the reference to the new (key/value name)space
@@ -105,6 +187,111 @@ class Transaction {
   ~Transaction() = default;
 };
 
+#if defined(BERRYDB_HAVE_COROUTINES)
+
+/** The result of the awaitable asynchronous operations of a Transaction.
+ *
+ * The operation is started when the awaitable is co_await-ed. */
+class TransactionAwaitable {
+ public:
+  /** The operations that can be awaited. */
+  enum class Operation { kGet, kPut, kDelete, kCommit, kRollback };
+
+  inline TransactionAwaitable(
+      Transaction* transaction, Operation operation, Space* space,
+      string_view key, string_view value, string_view* result) noexcept
+      : transaction_(transaction), operation_(operation), space_(space),
+        key_(key), value_(value), result_(result) {}
+
+  TransactionAwaitable(const TransactionAwaitable&) = delete;
+  TransactionAwaitable& operator=(const TransactionAwaitable&) = delete;
+
+  inline bool await_ready() const noexcept { return false; }
+
+  /** Starts the operation.
+   *
+   * @return false if the operation completed before this method returned, so
+   *         the coroutine does not need to be suspended
+   */
+  inline bool await_suspend(std::coroutine_handle<> coroutine) noexcept {
+    coroutine_ = coroutine;
+    switch (operation_) {
+      case Operation::kGet:
+        transaction_->GetAsync(space_, key_, result_, &Completed, this);
+        break;
+      case Operation::kPut:
+        transaction_->PutAsync(space_, key_, value_, &Completed, this);
+        break;
+      case Operation::kDelete:
+        transaction_->DeleteAsync(space_, key_, &Completed, this);
+        break;
+      case Operation::kCommit:
+        transaction_->CommitAsync(&Completed, this);
+        break;
+      case Operation::kRollback:
+        transaction_->RollbackAsync(&Completed, this);
+        break;
+    }
+    // Whoever gets here second, out of this method and the callback, resumes
+    // the coroutine.
+    return !finished_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  inline Status await_resume() const noexcept { return status_; }
+
+ private:
+  /** The callback passed to the asynchronous operation. */
+  static void Completed(void* context, Status status) noexcept {
+    TransactionAwaitable* awaitable =
+        static_cast<TransactionAwaitable*>(context);
+    awaitable->status_ = status;
+    if (awaitable->finished_.exchange(true, std::memory_order_acq_rel))
+      awaitable->coroutine_.resume();
+  }
+
+  Transaction* const transaction_;
+  const Operation operation_;
+  Space* const space_;
+  const string_view key_;
+  const string_view value_;
+  string_view* const result_;
+
+  std::coroutine_handle<> coroutine_;
+  Status status_;
+  /** Set by the first of await_suspend() and Completed() to finish. */
+  std::atomic<bool> finished_{false};
+};
+
+inline TransactionAwaitable Transaction::GetAsync(
+    Space* space, string_view key, string_view* value) noexcept {
+  return TransactionAwaitable(this, TransactionAwaitable::Operation::kGet,
+                              space, key, string_view(), value);
+}
+
+inline TransactionAwaitable Transaction::PutAsync(
+    Space* space, string_view key, string_view value) noexcept {
+  return TransactionAwaitable(this, TransactionAwaitable::Operation::kPut,
+                              space, key, value, nullptr);
+}
+
+inline TransactionAwaitable Transaction::DeleteAsync(
+    Space* space, string_view key) noexcept {
+  return TransactionAwaitable(this, TransactionAwaitable::Operation::kDelete,
+                              space, key, string_view(), nullptr);
+}
+
+inline TransactionAwaitable Transaction::CommitAsync() noexcept {
+  return TransactionAwaitable(this, TransactionAwaitable::Operation::kCommit,
+                              nullptr, string_view(), string_view(), nullptr);
+}
+
+inline TransactionAwaitable Transaction::RollbackAsync() noexcept {
+  return TransactionAwaitable(this, TransactionAwaitable::Operation::kRollback,
+                              nullptr, string_view(), string_view(), nullptr);
+}
+
+#endif  // defined(BERRYDB_HAVE_COROUTINES)
+
 }  // namespace berrydb
 
 #endif  // BERRYDB_INCLUDE_TRANSACTION_H_
@@ -5,6 +5,8 @@
 #ifndef BERRYDB_INCLUDE_VFS_H_
 #define BERRYDB_INCLUDE_VFS_H_
 
+#include <mutex>
+
 #include "berrydb/platform.h"
 
 namespace berrydb {
@@ -13,6 +15,33 @@ class BlockAccessFile;
 class RandomAccessFile;
 enum class Status : int;
 
+/** An asynchronous I/O operation on a BlockAccessFile.
+ *
+ * Requests are allocated by the caller, who can embed them in a structure
+ * describing the purpose of the I/O, such as a page pool entry, or can use the
+ * token to find that structure. A request is passed to one of the Submit*()
+ * methods, and must stay alive until PollCompletions() returns it.
+ */
+struct BlockIoRequest {
+  /** The kinds of operations that can be submitted. */
+  enum class Type { kRead, kWrite, kSync };
+
+  /** Opaque value reserved for the caller. Not used by the file. */
+  void* token;
+
+  /** The result of the operation. Set when the operation completes. */
+  Status status;
+
+  // The fields below are set by the Submit*() methods, and may be used by the
+  // file while the request is in flight.
+  Type type;
+  uint8_t* buffer;
+  size_t offset;
+  size_t byte_count;
+  /** Used by the file to queue the request. */
+  BlockIoRequest* next;
+};
+
 /** Pure virtual interface for platform services.
  *
  * The name "Vfs" was chosen because most of the services revolve around file
@@ -156,12 +185,23 @@ class RandomAccessFile {
 /** Interface for accessing files via block-based I/O.
  *
  * This interface is used for accessing store files. The block size is the store
- * page size.
+ * page size, capped to 4 KB, so pages may be read and written partially.
  *
  * The OpenForBlockAccess() API guarantees that the block size will
  * be a power of two. Implementations are encouraged to take advantage of this
  * guarantee to proxy the I/O calls directly to the operating system, without
  * performing any buffering.
+ *
+ * Reads, writes and syncs can also be performed asynchronously, so a single
+ * thread can keep many I/O operations in flight. The operations are started by
+ * SubmitRead(), SubmitWrite() and SubmitSync(), and their results are
+ * collected by PollCompletions(). The default implementation performs the
+ * operations synchronously, when they are submitted.
+ *
+ * Read() and Write() may be called concurrently from multiple threads, for
+ * non-overlapping byte ranges. Pools read pages without holding their locks.
+ * The asynchronous methods may also be called concurrently, so one thread can
+ * wait in PollCompletions() while other threads submit operations.
  */
 class BlockAccessFile {
  public:
@@ -210,6 +250,72 @@ class BlockAccessFile {
    */
   virtual Status Lock() = 0;
 
+  /** Maps the beginning of the file into memory, for reading.
+   *
+   * The mapping remains valid until the file is closed, and reflects the data
+   * written using Write(). This method may be called at most once per file.
+   *
+   * Mapping is optional. The default implementation returns nullptr, and so do
+   * implementations on platforms without memory-mapped files.
+   *
+   * @param  byte_count the number of bytes to be mapped; must be positive, a
+   *                    multiple of the block size, and must not exceed the file
+   *                    size
+   * @return            the address of the file's first byte in the mapping, or
+   *                    nullptr if the file cannot be mapped
+   */
+  virtual const uint8_t* MapForReading(size_t byte_count);
+
+  /** Starts reading a sequence of blocks from the file.
+   *
+   * The arguments have the same meaning and constraints as the arguments of
+   * Read(). The buffer must not be used until the request completes.
+   *
+   * @param request describes the operation while it is in flight, and receives
+   *                its result
+   */
+  virtual void SubmitRead(size_t offset, size_t byte_count, uint8_t* buffer,
+                          BlockIoRequest* request);
+
+  /** Starts writing a sequence of blocks to the file.
+   *
+   * The arguments have the same meaning and constraints as the arguments of
+   * Write(). The buffer must not be modified until the request completes.
+   * Operations that are in flight at the same time may be performed in any
+   * order, so overlapping reads and writes should not be in flight together.
+   *
+   * @param request describes the operation while it is in flight, and receives
+   *                its result
+   */
+  virtual void SubmitWrite(uint8_t* buffer, size_t offset, size_t byte_count,
+                           BlockIoRequest* request);
+
+  /** Starts evicting cached data for the file into persistent storage.
+   *
+   * The sync covers the writes that completed before it was submitted. It
+   * provides the same guarantees as Sync() once it completes.
+   *
+   * @param request describes the operation while it is in flight, and receives
+   *                its result
+   */
+  virtual void SubmitSync(BlockIoRequest* request);
+
+  /** Collects the requests whose operations completed.
+   *
+   * Each submitted request is returned exactly once. All the submitted
+   * requests must be collected before the file is closed.
+   *
+   * @param  completed receives the completed requests
+   * @param  max_count the maximum number of requests to collect; must be
+   *                   positive
+   * @param  wait      if true and no operation completed yet, blocks until an
+   *                   operation completes; returns right away if no operation
+   *                   is in flight
+   * @return           the number of requests stored in completed
+   */
+  virtual size_t PollCompletions(
+      BlockIoRequest** completed, size_t max_count, bool wait);
+
   /** Closes the file and releases its underlying resources.
    *
    * This call deallocates the memory used for the BlockAccessFile, invalidating
@@ -229,6 +335,19 @@ class BlockAccessFile {
   BlockAccessFile();
   /** Instances must be destroyed using Close(). */
   virtual ~BlockAccessFile() = 0;
+
+ private:
+  /** Performs a submitted request's operation, and queues it as completed.
+   *
+   * This is used by the default asynchronous I/O methods. */
+  void RunSynchronously(BlockIoRequest* request);
+
+  /** Guards the completed request list. */
+  std::mutex completed_mutex_;
+
+  /** Completed requests, used by the default asynchronous I/O methods. */
+  BlockIoRequest* completed_head_ = nullptr;
+  BlockIoRequest* completed_tail_ = nullptr;
 };
 
 /**
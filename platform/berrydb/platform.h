@@ -22,6 +22,7 @@
 #include "./platform/dcheck.h"
 #include "./platform/endianness.h"
 #include "./platform/hashing.h"
+#include "./platform/numa.h"
 #include "./platform/string_view.h"
 #include "./platform/types.h"
 
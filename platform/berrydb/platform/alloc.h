@@ -18,11 +18,34 @@
 #include <cstring>
 #endif  // DCHECK_IS_ON()
 
+#if defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+#include "./size_class_alloc.h"
+#endif  // defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+
 #include "./dcheck.h"
 #include "./types.h"
 
 namespace berrydb {
 
+/** The heap allocator underlying Allocate(). */
+inline void* AllocateHeapBlock(std::size_t size_in_bytes) {
+#if defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+  return SizeClassAllocator::Allocate(size_in_bytes);
+#else  // defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+  return std::malloc(size_in_bytes);
+#endif  // defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+}
+
+/** The heap allocator underlying Deallocate(). */
+inline void DeallocateHeapBlock(void* heap_block, std::size_t size_in_bytes) {
+#if defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+  SizeClassAllocator::Deallocate(heap_block, size_in_bytes);
+#else  // defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+  std::free(heap_block);
+  UNUSED(size_in_bytes);
+#endif  // defined(BERRYDB_PLATFORM_USE_SIZE_CLASS_ALLOCATOR)
+}
+
 /**
  * Dynamically allocates memory.
  *
@@ -33,7 +56,7 @@ inline void* Allocate(std::size_t size_in_bytes) {
   DCHECK(size_in_bytes > 0);
 
 #if DCHECK_IS_ON()
-  void* heap_block = std::malloc(size_in_bytes + sizeof(size_t));
+  void* heap_block = AllocateHeapBlock(size_in_bytes + sizeof(size_t));
 
   *static_cast<size_t*>(heap_block) = size_in_bytes;
   void* data = static_cast<void*>(static_cast<size_t*>(heap_block) + 1);
@@ -42,7 +65,7 @@ inline void* Allocate(std::size_t size_in_bytes) {
   // use-before-initialize bugs.
   std::memset(data, 0xCC, size_in_bytes);
 #else  // DCHECK_IS_ON()
-  void* data = std::malloc(size_in_bytes);
+  void* data = AllocateHeapBlock(size_in_bytes);
 #endif  // DCHECK_IS_ON()
 
   DCHECK_EQ(reinterpret_cast<uintptr_t>(data) & (sizeof(size_t) - 1), 0U);
@@ -68,12 +91,10 @@ inline void Deallocate(void* data, std::size_t size_in_bytes) {
   // Fill the heap block with a recognizable pattern, so it is easier to detect
   // use-after-free bugs.
   std::memset(data, 0xDD, size_in_bytes);
+  DeallocateHeapBlock(heap_block, size_in_bytes + sizeof(size_t));
 #else  // DCHECK_IS_ON()
-  void* heap_block = data;
+  DeallocateHeapBlock(data, size_in_bytes);
 #endif  // DCHECK_IS_ON()
-
-  free(heap_block);
-  UNUSED(size_in_bytes);
 }
 
 }  // namespace berrydb
@@ -13,6 +13,62 @@
 
 namespace berrydb {
 
+/** Reads a 16-bit unsigned integer from an aligned buffer.
+ *
+ * Consumers should assume that the integer is stored in a cross-platform
+ * manner, but not depend on that in testing. This lets the embedder choose
+ * portability or extra speed on big-endian platforms.
+ *
+ * @param  from memory holding the integer; must be 2-byte-aligned
+ * @return      the integer stored at the given location
+ */
+inline uint16_t LoadUint16(const uint8_t* from) noexcept {
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(from) & 1, 0U);
+  return *(reinterpret_cast<const uint16_t*>(from));
+}
+
+/** Stores a 16-bit unsigned integer to an aligned buffer.
+ *
+ * Consumers should assume that the integer is stored in a cross-platform
+ * manner, but not depend on that in testing. This lets the embedder choose
+ * portability or extra speed on big-endian platforms.
+ *
+ * @param  value the integer to be stored
+ * @param  to    memory that will hold the integer; must be 2-byte-aligned
+ */
+inline void StoreUint16(uint16_t value, uint8_t* to) noexcept {
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(to) & 1, 0U);
+  *(reinterpret_cast<uint16_t*>(to)) = value;
+}
+
+/** Reads a 32-bit unsigned integer from an aligned buffer.
+ *
+ * Consumers should assume that the integer is stored in a cross-platform
+ * manner, but not depend on that in testing. This lets the embedder choose
+ * portability or extra speed on big-endian platforms.
+ *
+ * @param  from memory holding the integer; must be 4-byte-aligned
+ * @return      the integer stored at the given location
+ */
+inline uint32_t LoadUint32(const uint8_t* from) noexcept {
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(from) & 3, 0U);
+  return *(reinterpret_cast<const uint32_t*>(from));
+}
+
+/** Stores a 32-bit unsigned integer to an aligned buffer.
+ *
+ * Consumers should assume that the integer is stored in a cross-platform
+ * manner, but not depend on that in testing. This lets the embedder choose
+ * portability or extra speed on big-endian platforms.
+ *
+ * @param  value the integer to be stored
+ * @param  to    memory that will hold the integer; must be 4-byte-aligned
+ */
+inline void StoreUint32(uint32_t value, uint8_t* to) noexcept {
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(to) & 3, 0U);
+  *(reinterpret_cast<uint32_t*>(to)) = value;
+}
+
 /** Reads a 64-bit unsigned integer from an aligned buffer.
  *
  * Consumers should assume that the integer is stored in a cross-platform
@@ -0,0 +1,133 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_PLATFORM_NUMA_H_
+#define BERRYDB_PLATFORM_NUMA_H_
+
+#include "./dcheck.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Embedders who want NUMA-aware page pools on other operating systems will want
+// to replace the functions below. The default implementation treats the
+// machine as a single NUMA node.
+
+#if defined(BERRYDB_PLATFORM_USE_NUMA) && defined(__linux__)
+#define BERRYDB_PLATFORM_LINUX_NUMA 1
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+#endif  // defined(BERRYDB_PLATFORM_USE_NUMA) && defined(__linux__)
+
+namespace berrydb {
+
+/**
+ * Number of NUMA nodes whose memory may be used by the process.
+ *
+ * @return at least 1; machines without NUMA have a single node
+ */
+inline size_t NumaNodeCount() {
+#if defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  // The file holds a list of node ranges, such as "0-1" or "0,2-3".
+  static const size_t node_count = []() -> size_t {
+    std::FILE* file = std::fopen("/sys/devices/system/node/online", "r");
+    if (file == nullptr)
+      return 1;
+    size_t max_node = 0;
+    unsigned long node;  // NOLINT(runtime/int): Matches the %lu specifier.
+    while (std::fscanf(file, "%lu", &node) == 1) {
+      if (node > max_node)
+        max_node = static_cast<size_t>(node);
+      if (std::fgetc(file) == EOF)
+        break;
+    }
+    std::fclose(file);
+    return max_node + 1;
+  }();
+  return node_count;
+#else  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  return 1;
+#endif  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+}
+
+/**
+ * The NUMA node of the CPU that runs the calling thread.
+ *
+ * Threads may migrate between CPUs at any time, so the result is a hint.
+ *
+ * @return a number below NumaNodeCount()
+ */
+inline size_t CurrentNumaNode() {
+#if defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  unsigned int cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+    return 0;
+  return static_cast<size_t>(node);
+#else  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  return 0;
+#endif  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+}
+
+/**
+ * Alignment that lets BindToNumaNode() cover an entire memory block.
+ *
+ * BindToNumaNode() can only move whole virtual memory pages, so callers that
+ * want a block to be bound in its entirety should align the block's start to
+ * this value, and make the block's size a multiple of it.
+ *
+ * @return the virtual memory page size if BindToNumaNode() is implemented, 1
+ *         otherwise
+ */
+inline size_t NumaBindAlignment() {
+#if defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  static const size_t os_page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return os_page_size;
+#else  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  return 1;
+#endif  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+}
+
+/**
+ * Asks for a memory block to be backed by a NUMA node's memory.
+ *
+ * This is a best-effort hint. Implementations may only move the parts of the
+ * block that cover entire virtual memory pages. Blocks that are not bound stay
+ * on the node of the thread that first touches them.
+ *
+ * @param data      the memory block
+ * @param size      number of bytes in the memory block
+ * @param numa_node the desired node; nodes at or above NumaNodeCount() are
+ *                  ignored
+ */
+inline void BindToNumaNode(void* data, std::size_t size, size_t numa_node) {
+#if defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  // Constants from <linux/mempolicy.h>, which is not always installed.
+  constexpr int kMpolPreferred = 1;
+  constexpr unsigned kMpolMfMove = 1 << 1;
+
+  unsigned long node_mask = 1;  // NOLINT(runtime/int): Matches mbind().
+  if (numa_node >= NumaNodeCount() || numa_node >= sizeof(node_mask) * 8)
+    return;
+  node_mask <<= numa_node;
+
+  uintptr_t os_page_size = static_cast<uintptr_t>(NumaBindAlignment());
+  uintptr_t start = (reinterpret_cast<uintptr_t>(data) + os_page_size - 1) &
+      ~(os_page_size - 1);
+  uintptr_t end = (reinterpret_cast<uintptr_t>(data) + size) &
+      ~(os_page_size - 1);
+  if (start >= end)
+    return;
+  syscall(SYS_mbind, start, end - start, kMpolPreferred, &node_mask,
+          sizeof(node_mask) * 8, kMpolMfMove);
+#else  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+  UNUSED(data);
+  UNUSED(size);
+  UNUSED(numa_node);
+#endif  // defined(BERRYDB_PLATFORM_LINUX_NUMA)
+}
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_PLATFORM_NUMA_H_
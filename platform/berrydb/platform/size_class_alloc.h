@@ -0,0 +1,275 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_PLATFORM_SIZE_CLASS_ALLOC_H_
+#define BERRYDB_PLATFORM_SIZE_CLASS_ALLOC_H_
+
+#include "./dcheck.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace berrydb {
+
+/** Memory allocator that serves blocks out of per-thread caches.
+ *
+ * Block sizes are rounded up to a small number of size classes. Each thread
+ * caches the freed blocks of each size class, and serves allocations out of its
+ * cache without any synchronization. Threads move blocks in batches between
+ * their caches and a central cache, so blocks freed by one thread can be reused
+ * by another thread. The malloc() heap is only used when the caches are empty,
+ * and for blocks above kMaxSize.
+ *
+ * Deallocate() requires the block size, which the platform allocator interface
+ * already passes in. So, unlike malloc(), the allocator does not need to find
+ * the size of a freed block.
+ *
+ * This is used by Allocate() and Deallocate() when BerryDB is built with
+ * BERRYDB_USE_SIZE_CLASS_ALLOCATOR.
+ */
+class SizeClassAllocator {
+ public:
+  /** Blocks above this size are served directly by malloc(). */
+  static constexpr size_t kMaxSize = 64 * 1024;
+
+  /** Number of size classes. See SizeClass(). */
+  static constexpr size_t kClassCount = 44;
+
+  /** Bytes of free blocks cached by a thread, in each size class. */
+  static constexpr size_t kThreadCacheBytes = 64 * 1024;
+
+  /** Bytes of free blocks kept in the central cache, in each size class. */
+  static constexpr size_t kCentralCacheBytes = 1024 * 1024;
+
+  /** The size class that serves blocks of a given size.
+   *
+   * Blocks of up to 128 bytes are rounded up to multiples of 16 bytes. Larger
+   * blocks are rounded up to quarters of powers of two, so at most 25% of a
+   * block is wasted.
+   *
+   * @param  size the requested block size; must be between 1 and kMaxSize
+   * @return      a number below kClassCount
+   */
+  static inline size_t SizeClass(size_t size) noexcept {
+    DCHECK_GT(size, 0U);
+    DCHECK_LE(size, kMaxSize);
+
+    if (size <= 128)
+      return (size - 1) >> 4;
+
+    // The size is in (2^shift, 2^(shift + 1)].
+    size_t shift = 7;
+    while (((size - 1) >> (shift + 1)) != 0)
+      ++shift;
+    size_t quarter = ((size - 1) - (static_cast<size_t>(1) << shift)) >>
+                     (shift - 2);
+    return 8 + ((shift - 7) << 2) + quarter;
+  }
+
+  /** The size of the blocks in a size class. Inverse of SizeClass(). */
+  static inline size_t ClassSize(size_t size_class) noexcept {
+    DCHECK_LT(size_class, kClassCount);
+
+    if (size_class < 8)
+      return (size_class + 1) << 4;
+
+    size_t shift = 7 + ((size_class - 8) >> 2);
+    size_t quarter = (size_class - 8) & 3;
+    return (static_cast<size_t>(1) << shift) + ((quarter + 1) << (shift - 2));
+  }
+
+  /** Allocates a memory block aligned to alignof(std::max_align_t). */
+  static inline void* Allocate(size_t size) noexcept {
+    if (size > kMaxSize)
+      return std::malloc(size);
+
+    size_t size_class = SizeClass(size);
+    ThreadCache* thread_cache = CurrentThreadCache();
+    if (thread_cache != nullptr) {
+      void* block = thread_cache->Pop(size_class);
+      if (block != nullptr)
+        return block;
+      return thread_cache->Refill(size_class);
+    }
+    return Central().Allocate(size_class);
+  }
+
+  /** Releases a block obtained from Allocate(size). */
+  static inline void Deallocate(void* block, size_t size) noexcept {
+    if (size > kMaxSize) {
+      std::free(block);
+      return;
+    }
+
+    size_t size_class = SizeClass(size);
+    ThreadCache* thread_cache = CurrentThreadCache();
+    if (thread_cache != nullptr) {
+      thread_cache->Push(size_class, block);
+      return;
+    }
+    Central().Deallocate(size_class, block);
+  }
+
+ private:
+  /** Free block on a cache list. The link is stored in the block. */
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  /** Singly linked list of free blocks in one size class. */
+  struct FreeList {
+    FreeBlock* head = nullptr;
+    size_t count = 0;
+
+    inline void Push(void* block) noexcept {
+      FreeBlock* free_block = new (block) FreeBlock();
+      free_block->next = head;
+      head = free_block;
+      ++count;
+    }
+    inline void* Pop() noexcept {
+      DCHECK(head != nullptr);
+      FreeBlock* free_block = head;
+      head = free_block->next;
+      --count;
+      return static_cast<void*>(free_block);
+    }
+  };
+
+  /** Number of blocks of a size class that a thread cache may hold. */
+  static inline size_t ThreadCacheLimit(size_t size_class) noexcept {
+    size_t limit = kThreadCacheBytes / ClassSize(size_class);
+    return (limit < 2) ? 2 : limit;
+  }
+
+  /** Free blocks shared by all threads. */
+  class CentralCache {
+   public:
+    /** Moves up to count blocks into a thread's free list. */
+    inline void Fetch(size_t size_class, size_t count,
+                      FreeList* list) noexcept {
+      std::lock_guard<std::mutex> lock(mutexes_[size_class]);
+      FreeList& central_list = lists_[size_class];
+      for (; count != 0 && central_list.head != nullptr; --count)
+        list->Push(central_list.Pop());
+    }
+
+    /** Moves count blocks out of a thread's free list. */
+    inline void Store(size_t size_class, size_t count,
+                      FreeList* list) noexcept {
+      size_t max_count = kCentralCacheBytes / ClassSize(size_class);
+      std::lock_guard<std::mutex> lock(mutexes_[size_class]);
+      FreeList& central_list = lists_[size_class];
+      for (; count != 0; --count) {
+        void* block = list->Pop();
+        if (central_list.count < max_count)
+          central_list.Push(block);
+        else
+          std::free(block);
+      }
+    }
+
+    /** Allocation path for threads whose cache was destroyed. */
+    inline void* Allocate(size_t size_class) noexcept {
+      {
+        std::lock_guard<std::mutex> lock(mutexes_[size_class]);
+        FreeList& central_list = lists_[size_class];
+        if (central_list.head != nullptr)
+          return central_list.Pop();
+      }
+      return std::malloc(ClassSize(size_class));
+    }
+
+    /** Deallocation path for threads whose cache was destroyed. */
+    inline void Deallocate(size_t size_class, void* block) noexcept {
+      FreeList list;
+      list.Push(block);
+      Store(size_class, 1, &list);
+    }
+
+   private:
+    std::mutex mutexes_[kClassCount];
+    FreeList lists_[kClassCount];
+  };
+
+  /** Free blocks owned by one thread. */
+  class ThreadCache {
+   public:
+    ThreadCache() noexcept = default;
+
+    /** Returns all the cached blocks to the central cache. */
+    ~ThreadCache() {
+      for (size_t size_class = 0; size_class < kClassCount; ++size_class) {
+        FreeList& list = lists_[size_class];
+        if (list.count != 0)
+          Central().Store(size_class, list.count, &list);
+      }
+      ThreadCacheDestroyed() = true;
+    }
+
+    /** Returns a cached block, or null if the cache is empty. */
+    inline void* Pop(size_t size_class) noexcept {
+      FreeList& list = lists_[size_class];
+      return (list.head == nullptr) ? nullptr : list.Pop();
+    }
+
+    /** Caches a block, spilling half the cache if it is full. */
+    inline void Push(size_t size_class, void* block) noexcept {
+      FreeList& list = lists_[size_class];
+      list.Push(block);
+      size_t limit = ThreadCacheLimit(size_class);
+      if (list.count > limit)
+        Central().Store(size_class, limit / 2, &list);
+    }
+
+    /** Allocation path taken when the cache is empty.
+     *
+     * Moves half a cache's worth of blocks from the central cache. */
+    void* Refill(size_t size_class) noexcept {
+      FreeList& list = lists_[size_class];
+      DCHECK_EQ(list.count, 0U);
+      Central().Fetch(size_class, ThreadCacheLimit(size_class) / 2, &list);
+      if (list.head != nullptr)
+        return list.Pop();
+      return std::malloc(ClassSize(size_class));
+    }
+
+   private:
+    FreeList lists_[kClassCount];
+  };
+
+  /** Set when the current thread's cache is destroyed, at thread exit.
+   *
+   * This is a trivially destructible thread-local, so it can be read by
+   * deallocations that run after the thread cache is destroyed. */
+  static inline bool& ThreadCacheDestroyed() noexcept {
+    static thread_local bool destroyed = false;
+    return destroyed;
+  }
+
+  /** The current thread's cache, or null if the thread is exiting. */
+  static inline ThreadCache* CurrentThreadCache() noexcept {
+    if (ThreadCacheDestroyed())
+      return nullptr;
+    static thread_local ThreadCache thread_cache;
+    return &thread_cache;
+  }
+
+  /** The central cache.
+   *
+   * The central cache is never destroyed, so it can serve the thread caches
+   * that are destroyed during process exit. */
+  static inline CentralCache& Central() noexcept {
+    alignas(CentralCache) static unsigned char storage[sizeof(CentralCache)];
+    static CentralCache* central = new (storage) CentralCache();
+    return *central;
+  }
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_PLATFORM_SIZE_CLASS_ALLOC_H_
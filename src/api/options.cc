@@ -7,9 +7,13 @@
 namespace berrydb {
 
 PoolOptions::PoolOptions()
-    : page_shift(15), page_pool_size(256), vfs(nullptr) { }
+    : page_shift(15), page_pool_size(256), compressed_page_cache_size(0),
+      pinned_page_wait_ms(0), numa_aware_page_pool(false), partition_count(1),
+      async_thread_count(0), vfs(nullptr) { }
 
 StoreOptions::StoreOptions()
-    : create_if_missing(true), error_if_exists(false) { }
+    : create_if_missing(true), error_if_exists(false), page_shift(0),
+      compress_pages(false), map_data_file(false), page_pool_min_pages(0),
+      page_pool_max_pages(0), page_pool_weight(1) { }
 
 }  // namespace berrydb
@@ -4,6 +4,8 @@
 
 #include "berrydb/pool.h"
 
+#include <mutex>
+
 #include "../pool_impl.h"
 #include "../store_impl.h"
 
@@ -19,19 +21,31 @@ void Pool::Release() {
 
 Status Pool::OpenStore(
       const std::string& path, const StoreOptions& options, Store** result) {
+  PoolImpl* pool = PoolImpl::FromApi(this)->StorePartition(path);
+  PoolImpl::Lock lock(pool);
   StoreImpl* store;
-  Status status = PoolImpl::FromApi(this)->OpenStore(path, options, &store);
+  Status status = pool->OpenStore(path, options, &store);
   if (status == Status::kSuccess)
     *result = store->ToApi();
   return status;
 }
 
 size_t Pool::page_size() const {
-  return PoolImpl::FromApi(this)->page_size();
+  const PoolImpl* pool = PoolImpl::FromApi(this);
+  std::lock_guard<std::mutex> lock(pool->mutex());
+  return pool->page_size();
 }
 
 size_t Pool::page_pool_size() const {
-  return PoolImpl::FromApi(this)->page_pool_size();
+  const PoolImpl* pool = PoolImpl::FromApi(this);
+  std::lock_guard<std::mutex> lock(pool->mutex());
+  return pool->page_pool_size();
+}
+
+void Pool::SetPagePoolSize(size_t page_pool_size) {
+  PoolImpl* pool = PoolImpl::FromApi(this);
+  PoolImpl::Lock lock(pool);
+  pool->SetPagePoolSize(page_pool_size);
 }
 
 }  // namespace berrydb
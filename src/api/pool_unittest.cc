@@ -11,6 +11,7 @@
 #include "berrydb/options.h"
 #include "berrydb/status.h"
 #include "berrydb/store.h"
+#include "berrydb/transaction.h"
 #include "berrydb/vfs.h"
 #include "../test/file_deleter.h"
 #include "../util/unique_ptr.h"
@@ -40,6 +41,18 @@ TEST_F(PoolTest, CreateOptions) {
   EXPECT_EQ(42U, pool->page_pool_size());
 }
 
+TEST_F(PoolTest, SetPagePoolSize) {
+  PoolOptions options;
+  options.page_shift = 12;
+  options.page_pool_size = 42;
+
+  UniquePtr<Pool> pool(Pool::Create(options));
+  pool->SetPagePoolSize(16);
+  EXPECT_EQ(16U, pool->page_pool_size());
+  pool->SetPagePoolSize(64);
+  EXPECT_EQ(64U, pool->page_pool_size());
+}
+
 TEST_F(PoolTest, ReleaseClosesStore) {
   PoolOptions pool_options;
   pool_options.page_shift = 12;
@@ -59,4 +72,29 @@ TEST_F(PoolTest, ReleaseClosesStore) {
   EXPECT_TRUE(store->IsClosed());
 }
 
+TEST_F(PoolTest, PartitionedPool) {
+  PoolOptions pool_options;
+  pool_options.page_shift = 12;
+  pool_options.page_pool_size = 16;
+  pool_options.partition_count = 4;
+  UniquePtr<Pool> pool(Pool::Create(pool_options));
+  EXPECT_EQ(16U, pool->page_pool_size());
+
+  Store* raw_store = nullptr;
+  ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+      kFileName, StoreOptions(), &raw_store));
+  UniquePtr<Store> store(raw_store);
+
+  Transaction* transaction = nullptr;
+  ASSERT_EQ(Status::kSuccess, store->CreateTransaction(&transaction));
+  EXPECT_EQ(Status::kSuccess, transaction->Commit());
+  transaction->Release();
+
+  pool->SetPagePoolSize(8);
+  EXPECT_EQ(8U, pool->page_pool_size());
+
+  pool.reset();
+  EXPECT_TRUE(store->IsClosed());
+}
+
 }  // namespace berrydb
@@ -5,17 +5,39 @@
 #include "berrydb/store.h"
 
 #include "../catalog_impl.h"
+#include "../pool_impl.h"
 #include "../store_impl.h"
 #include "../transaction_impl.h"
 
 namespace berrydb {
 
+namespace {
+
+/** The pool whose lock serializes the operations on a store.
+ *
+ * Closed stores do not use their pool, and may outlive it, so they are not
+ * locked. Other stores may start closing before the lock is acquired, so the
+ * operations check the store's state under the lock. */
+PoolImpl* LockablePool(Store* store) {
+  StoreImpl* impl = StoreImpl::FromApi(store);
+  if (impl->IsClosed())
+    return nullptr;
+  return impl->page_pool()->pool();
+}
+
+}  // anonymous namespace
+
 std::string Store::LogFilePath(const std::string &store_path) {
   return StoreImpl::LogFilePath(store_path);
 }
 
-Transaction* Store::CreateTransaction() {
-  return StoreImpl::FromApi(this)->CreateTransaction()->ToApi();
+Status Store::CreateTransaction(Transaction** result) {
+  PoolImpl::Lock lock(LockablePool(this));
+  TransactionImpl* transaction;
+  Status status = StoreImpl::FromApi(this)->CreateTransaction(&transaction);
+  if (status == Status::kSuccess)
+    *result = transaction->ToApi();
+  return status;
 }
 
 Catalog* Store::RootCatalog() {
@@ -23,6 +45,7 @@ Catalog* Store::RootCatalog() {
 }
 
 Status Store::Close() {
+  PoolImpl::Lock lock(LockablePool(this));
   return StoreImpl::FromApi(this)->Close();
 }
 
@@ -31,6 +54,7 @@ bool Store::IsClosed() {
 }
 
 void Store::Release() {
+  PoolImpl::Lock lock(LockablePool(this));
   StoreImpl::FromApi(this)->Release();
 }
 
@@ -85,7 +85,9 @@ TEST_F(StoreTest, CloseAbortsTransaction) {
   ASSERT_EQ(Status::kSuccess, pool_->OpenStore(kFileName, options, &raw_store));
   UniquePtr<Store> store(raw_store);
 
-  UniquePtr<Transaction> transaction(store->CreateTransaction());
+  Transaction* raw_transaction = nullptr;
+  ASSERT_EQ(Status::kSuccess, store->CreateTransaction(&raw_transaction));
+  UniquePtr<Transaction> transaction(raw_transaction);
   EXPECT_FALSE(transaction->IsCommitted());
   EXPECT_FALSE(transaction->IsRolledBack());
   EXPECT_FALSE(transaction->IsClosed());
@@ -4,35 +4,230 @@
 
 #include "berrydb/transaction.h"
 
+#include <new>
+
 #include "berrydb/status.h"
 #include "../catalog_impl.h"
+#include "../page_pool.h"
+#include "../pool_impl.h"
 #include "../space_impl.h"
+#include "../store_impl.h"
 #include "../transaction_impl.h"
+#include "../util/thread_pool.h"
 
 namespace berrydb {
 
+namespace {
+
+/** The pool whose lock serializes the operations on a transaction.
+ *
+ * Detached transactions do not use their pool, and may outlive it, so they
+ * are not locked. Other transactions may become closed before the lock is
+ * acquired, so the operations check the transaction's state under the lock. */
+PoolImpl* LockablePool(Transaction* transaction) {
+  TransactionImpl* impl = TransactionImpl::FromApi(transaction);
+  if (impl->IsDetached())
+    return nullptr;
+  return impl->store()->page_pool()->pool();
+}
+
+/** An asynchronous transaction operation, queued in a thread pool.
+ *
+ * Operations that need a store page which is not cached start reading the
+ * page, and are only queued once the read completes. */
+struct AsyncOperation {
+  enum class Type { kGet, kPut, kDelete, kCommit, kRollback };
+
+  ThreadPool::Task task;  // Must be the first member.
+  Type type;
+  Transaction* transaction;
+  Space* space;
+  string_view key;
+  string_view value;
+  string_view* result;
+  TransactionCallback callback;
+  void* context;
+  /** Caches the page that the operation starts at. */
+  AsyncPageFetch fetch;
+
+  /** True for the operations that start at the transaction's root page. */
+  bool UsesRootPage() const noexcept {
+    return type == Type::kGet || type == Type::kPut || type == Type::kDelete;
+  }
+
+  /** Performs the operation by calling its synchronous version. */
+  Status Perform() {
+    switch (type) {
+      case Type::kGet:
+        return transaction->Get(space, key, result);
+      case Type::kPut:
+        return transaction->Put(space, key, value);
+      case Type::kDelete:
+        return transaction->Delete(space, key);
+      case Type::kCommit:
+        return transaction->Commit();
+      case Type::kRollback:
+        break;
+    }
+    DCHECK(type == Type::kRollback);
+    return transaction->Rollback();
+  }
+
+  /** Performs the operation and reports its result. */
+  static void Run(ThreadPool::Task* task) {
+    AsyncOperation* operation = reinterpret_cast<AsyncOperation*>(task);
+    DCHECK_EQ(task, &operation->task);
+
+    Status status = operation->Perform();
+
+    // The operation is freed before the callback runs, so the callback can
+    // start new operations without growing the memory in use.
+    TransactionCallback callback = operation->callback;
+    void* context = operation->context;
+    operation->~AsyncOperation();
+    Deallocate(operation, sizeof(AsyncOperation));
+    callback(context, status);
+  }
+
+  /** Starts caching the operation's page, or performs the operation.
+   *
+   * If the page must be read, the thread is released until the read
+   * completes, instead of blocking for as long as the read takes. */
+  static void Start(ThreadPool::Task* task) {
+    AsyncOperation* operation = reinterpret_cast<AsyncOperation*>(task);
+    DCHECK_EQ(task, &operation->task);
+
+    {
+      PoolImpl::Lock lock(LockablePool(operation->transaction));
+      TransactionImpl* impl = TransactionImpl::FromApi(operation->transaction);
+      if (!impl->IsClosed()) {
+        operation->task.run = &AsyncOperation::ResumeAfterFetch;
+        operation->fetch.io.completion_task = &operation->task;
+        PagePool* page_pool = impl->store()->page_pool();
+        if (page_pool->StartStorePageFetch(
+                impl->store(), impl->root_page(), &operation->fetch)) {
+          return;
+        }
+      }
+    }
+    Run(task);
+  }
+
+  /** Finishes caching the operation's page, then performs the operation. */
+  static void ResumeAfterFetch(ThreadPool::Task* task) {
+    AsyncOperation* operation = reinterpret_cast<AsyncOperation*>(task);
+    DCHECK_EQ(task, &operation->task);
+
+    // The store's Close() waits for the read, so the transaction is not
+    // detached yet.
+    PagePool* page_pool =
+        TransactionImpl::FromApi(operation->transaction)->store()->page_pool();
+    {
+      PoolImpl::Lock lock(page_pool->pool());
+      // A failed read is reported by the operation, which reads the page again.
+      page_pool->FinishStorePageFetch(&operation->fetch);
+    }
+    Run(task);
+  }
+};
+
+/** Runs an asynchronous operation on its pool's threads, if it has any.
+ *
+ * Detached transactions are not associated with a pool, so their operations
+ * run right away, and fail with kAlreadyClosed. */
+void StartAsyncOperation(
+    AsyncOperation::Type type, Transaction* transaction, Space* space,
+    string_view key, string_view value, string_view* result,
+    TransactionCallback callback, void* context) {
+  DCHECK(callback != nullptr);
+
+  void* heap_block = Allocate(sizeof(AsyncOperation));
+  AsyncOperation* operation = new (heap_block) AsyncOperation();
+  operation->task.run = &AsyncOperation::Run;
+  operation->type = type;
+  operation->transaction = transaction;
+  operation->space = space;
+  operation->key = key;
+  operation->value = value;
+  operation->result = result;
+  operation->callback = callback;
+  operation->context = context;
+
+  TransactionImpl* impl = TransactionImpl::FromApi(transaction);
+  ThreadPool* thread_pool = impl->IsDetached() ?
+      nullptr : impl->store()->page_pool()->pool()->async_thread_pool();
+  if (thread_pool == nullptr) {
+    AsyncOperation::Run(&operation->task);
+    return;
+  }
+  if (operation->UsesRootPage())
+    operation->task.run = &AsyncOperation::Start;
+  thread_pool->Submit(&operation->task);
+}
+
+}  // anonymous namespace
+
 Status Transaction::Get(Space* space, string_view key, string_view* value) {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->Get(space, key, value);
 }
 
 Status Transaction::Put(Space* space, string_view key, string_view value) {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->Put(space, key, value);
 }
 
 Status Transaction::Delete(Space* space, string_view key) {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->Delete(space, key);
 }
 
 Status Transaction::Commit() {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->Commit();
 }
 
 Status Transaction::Rollback() {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->Rollback();
 }
 
+void Transaction::GetAsync(
+    Space* space, string_view key, string_view* value,
+    TransactionCallback callback, void* context) {
+  StartAsyncOperation(AsyncOperation::Type::kGet, this, space, key,
+                      string_view(), value, callback, context);
+}
+
+void Transaction::PutAsync(
+    Space* space, string_view key, string_view value,
+    TransactionCallback callback, void* context) {
+  StartAsyncOperation(AsyncOperation::Type::kPut, this, space, key, value,
+                      nullptr, callback, context);
+}
+
+void Transaction::DeleteAsync(
+    Space* space, string_view key, TransactionCallback callback,
+    void* context) {
+  StartAsyncOperation(AsyncOperation::Type::kDelete, this, space, key,
+                      string_view(), nullptr, callback, context);
+}
+
+void Transaction::CommitAsync(TransactionCallback callback, void* context) {
+  StartAsyncOperation(AsyncOperation::Type::kCommit, this, nullptr,
+                      string_view(), string_view(), nullptr, callback,
+                      context);
+}
+
+void Transaction::RollbackAsync(TransactionCallback callback, void* context) {
+  StartAsyncOperation(AsyncOperation::Type::kRollback, this, nullptr,
+                      string_view(), string_view(), nullptr, callback,
+                      context);
+}
+
 Status Transaction::CreateSpace(
     Catalog* catalog, string_view name, Space** result) {
+  PoolImpl::Lock lock(LockablePool(this));
   SpaceImpl* space;
   Status status = TransactionImpl::FromApi(this)->CreateSpace(
      CatalogImpl::FromApi(catalog), name, &space);
@@ -43,6 +238,7 @@ Status Transaction::CreateSpace(
 
 Status Transaction::CreateCatalog(
     Catalog* catalog, string_view name, Catalog** result) {
+  PoolImpl::Lock lock(LockablePool(this));
   CatalogImpl* new_catalog;
   Status status = TransactionImpl::FromApi(this)->CreateCatalog(
      CatalogImpl::FromApi(catalog), name, &new_catalog);
@@ -52,23 +248,28 @@ Status Transaction::CreateCatalog(
 }
 
 Status Transaction::Delete(Catalog* catalog, string_view name) {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->Delete(
       CatalogImpl::FromApi(catalog), name);
 }
 
 bool Transaction::IsClosed() {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->IsClosed();
 }
 
 bool Transaction::IsCommitted() {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->IsCommitted();
 }
 
 bool Transaction::IsRolledBack() {
+  PoolImpl::Lock lock(LockablePool(this));
   return TransactionImpl::FromApi(this)->IsRolledBack();
 }
 
 void Transaction::Release() {
+  PoolImpl::Lock lock(LockablePool(this));
   TransactionImpl::FromApi(this)->Release();
 }
 
@@ -0,0 +1,195 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/transaction.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/pool.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/vfs.h"
+#include "../test/file_deleter.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+/** Records the completion of an asynchronous operation. */
+class Completion {
+ public:
+  static void Callback(void* context, Status status) {
+    Completion* completion = static_cast<Completion*>(context);
+    std::lock_guard<std::mutex> lock(completion->mutex_);
+    completion->status_ = status;
+    completion->thread_id_ = std::this_thread::get_id();
+    completion->completed_ = true;
+    completion->completed_signal_.notify_all();
+  }
+
+  bool completed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return completed_;
+  }
+
+  /** Blocks until the operation completes, and returns its status. */
+  Status Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!completed_)
+      completed_signal_.wait(lock);
+    return status_;
+  }
+
+  std::thread::id thread_id() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return thread_id_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable completed_signal_;
+  bool completed_ = false;
+  Status status_;
+  std::thread::id thread_id_;
+};
+
+}  // namespace
+
+class TransactionTest : public ::testing::Test {
+ protected:
+  TransactionTest()
+      : data_file_deleter_(kFileName),
+        log_file_deleter_(Store::LogFilePath(kFileName)) { }
+
+  void OpenStore(size_t async_thread_count) {
+    PoolOptions pool_options;
+    pool_options.page_shift = 12;
+    pool_options.page_pool_size = 16;
+    pool_options.async_thread_count = async_thread_count;
+    pool_.reset(Pool::Create(pool_options));
+
+    Store* raw_store = nullptr;
+    ASSERT_EQ(Status::kSuccess,
+              pool_->OpenStore(kFileName, StoreOptions(), &raw_store));
+    store_.reset(raw_store);
+  }
+
+  const std::string kFileName = "test_transaction.berry";
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+  UniquePtr<Pool> pool_;
+  UniquePtr<Store> store_;
+};
+
+TEST_F(TransactionTest, AsyncWithoutThreadsCompletesInline) {
+  OpenStore(0);
+  Transaction* transaction = nullptr;
+  ASSERT_EQ(Status::kSuccess, store_->CreateTransaction(&transaction));
+
+  Completion completion;
+  transaction->CommitAsync(&Completion::Callback, &completion);
+  EXPECT_TRUE(completion.completed());
+  EXPECT_EQ(Status::kSuccess, completion.Wait());
+  EXPECT_EQ(std::this_thread::get_id(), completion.thread_id());
+  EXPECT_TRUE(transaction->IsCommitted());
+
+  transaction->Release();
+}
+
+TEST_F(TransactionTest, AsyncRunsOnPoolThreads) {
+  OpenStore(2);
+  Transaction* transaction = nullptr;
+  ASSERT_EQ(Status::kSuccess, store_->CreateTransaction(&transaction));
+
+  Completion completion;
+  transaction->RollbackAsync(&Completion::Callback, &completion);
+  EXPECT_EQ(Status::kSuccess, completion.Wait());
+  EXPECT_NE(std::this_thread::get_id(), completion.thread_id());
+  EXPECT_TRUE(transaction->IsRolledBack());
+
+  transaction->Release();
+}
+
+TEST_F(TransactionTest, StateIsReadableDuringAsyncOperation) {
+  OpenStore(2);
+  Transaction* transaction = nullptr;
+  ASSERT_EQ(Status::kSuccess, store_->CreateTransaction(&transaction));
+
+  // The state is polled while a pool thread commits the transaction.
+  Completion completion;
+  transaction->CommitAsync(&Completion::Callback, &completion);
+  while (!transaction->IsClosed())
+    std::this_thread::yield();
+  EXPECT_TRUE(transaction->IsCommitted());
+  EXPECT_EQ(Status::kSuccess, completion.Wait());
+
+  transaction->Release();
+}
+
+TEST_F(TransactionTest, AsyncOnClosedTransaction) {
+  OpenStore(2);
+  Transaction* transaction = nullptr;
+  ASSERT_EQ(Status::kSuccess, store_->CreateTransaction(&transaction));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  Completion completion;
+  string_view value;
+  transaction->GetAsync(nullptr, "key", &value, &Completion::Callback,
+                        &completion);
+  EXPECT_TRUE(completion.completed());
+  EXPECT_EQ(Status::kAlreadyClosed, completion.Wait());
+
+  transaction->Release();
+}
+
+TEST_F(TransactionTest, AsyncOperationsOnUncachedStore) {
+  OpenStore(1);
+  // Closing the store drops its pages from the pool, so the reopened store's
+  // root page is read by the operations.
+  store_.reset();
+  Store* raw_store = nullptr;
+  ASSERT_EQ(Status::kSuccess,
+            pool_->OpenStore(kFileName, StoreOptions(), &raw_store));
+  store_.reset(raw_store);
+
+  constexpr size_t kOperationCount = 8;
+  Transaction* transactions[kOperationCount];
+  Completion completions[kOperationCount];
+  string_view values[kOperationCount];
+  for (size_t i = 0; i < kOperationCount; ++i) {
+    ASSERT_EQ(Status::kSuccess, store_->CreateTransaction(&transactions[i]));
+    transactions[i]->GetAsync(nullptr, "key", &values[i],
+                              &Completion::Callback, &completions[i]);
+  }
+  for (size_t i = 0; i < kOperationCount; ++i) {
+    completions[i].Wait();
+    EXPECT_EQ(Status::kSuccess, transactions[i]->Rollback());
+    transactions[i]->Release();
+  }
+}
+
+TEST_F(TransactionTest, PoolReleaseFinishesAsyncOperations) {
+  OpenStore(1);
+  Transaction* transaction = nullptr;
+  ASSERT_EQ(Status::kSuccess, store_->CreateTransaction(&transaction));
+
+  Completion completion;
+  transaction->CommitAsync(&Completion::Callback, &completion);
+  pool_.reset();
+  EXPECT_TRUE(completion.completed());
+  EXPECT_EQ(Status::kSuccess, completion.Wait());
+  EXPECT_TRUE(transaction->IsCommitted());
+
+  transaction->Release();
+}
+
+}  // namespace berrydb
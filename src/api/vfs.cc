@@ -4,11 +4,89 @@
 
 #include "berrydb/vfs.h"
 
+#include <mutex>
+
+#include "berrydb/status.h"
+
 namespace berrydb {
 
 BlockAccessFile::BlockAccessFile() = default;
 BlockAccessFile::~BlockAccessFile() = default;
 
+const uint8_t* BlockAccessFile::MapForReading(size_t byte_count) {
+  UNUSED(byte_count);
+  return nullptr;
+}
+
+void BlockAccessFile::SubmitRead(
+    size_t offset, size_t byte_count, uint8_t* buffer,
+    BlockIoRequest* request) {
+  request->type = BlockIoRequest::Type::kRead;
+  request->buffer = buffer;
+  request->offset = offset;
+  request->byte_count = byte_count;
+  RunSynchronously(request);
+}
+
+void BlockAccessFile::SubmitWrite(
+    uint8_t* buffer, size_t offset, size_t byte_count,
+    BlockIoRequest* request) {
+  request->type = BlockIoRequest::Type::kWrite;
+  request->buffer = buffer;
+  request->offset = offset;
+  request->byte_count = byte_count;
+  RunSynchronously(request);
+}
+
+void BlockAccessFile::SubmitSync(BlockIoRequest* request) {
+  request->type = BlockIoRequest::Type::kSync;
+  request->buffer = nullptr;
+  request->offset = 0;
+  request->byte_count = 0;
+  RunSynchronously(request);
+}
+
+size_t BlockAccessFile::PollCompletions(
+    BlockIoRequest** completed, size_t max_count, bool wait) {
+  DCHECK_GT(max_count, 0U);
+  // All operations complete when they are submitted, so there is never a
+  // reason to wait.
+  UNUSED(wait);
+
+  std::lock_guard<std::mutex> lock(completed_mutex_);
+  size_t count = 0;
+  while (count < max_count && completed_head_ != nullptr) {
+    completed[count] = completed_head_;
+    completed_head_ = completed_head_->next;
+    ++count;
+  }
+  return count;
+}
+
+void BlockAccessFile::RunSynchronously(BlockIoRequest* request) {
+  switch (request->type) {
+    case BlockIoRequest::Type::kRead:
+      request->status = Read(
+          request->offset, request->byte_count, request->buffer);
+      break;
+    case BlockIoRequest::Type::kWrite:
+      request->status = Write(
+          request->buffer, request->offset, request->byte_count);
+      break;
+    case BlockIoRequest::Type::kSync:
+      request->status = Sync();
+      break;
+  }
+
+  request->next = nullptr;
+  std::lock_guard<std::mutex> lock(completed_mutex_);
+  if (completed_head_ == nullptr)
+    completed_head_ = request;
+  else
+    completed_tail_->next = request;
+  completed_tail_ = request;
+}
+
 RandomAccessFile::RandomAccessFile() = default;
 RandomAccessFile::~RandomAccessFile() = default;
 
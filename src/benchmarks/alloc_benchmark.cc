@@ -0,0 +1,92 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares the size-class allocator with malloc() on a multithreaded workload.
+//
+// Each thread keeps a window of live blocks, and replaces the oldest block in
+// the window on every step. The block sizes mimic BerryDB's allocations: small
+// bookkeeping objects, transactions, and page pool entries.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "berrydb/platform/size_class_alloc.h"
+
+namespace {
+
+constexpr size_t kWindowSize = 256;
+constexpr size_t kStepsPerThread = 4 * 1024 * 1024;
+constexpr size_t kBlockSizes[] = {
+  16, 24, 48, 64, 96, 128, 200, 320, 512, 4096 + 64, 16, 32, 64, 256, 1024, 48,
+};
+constexpr size_t kBlockSizeCount = sizeof(kBlockSizes) / sizeof(kBlockSizes[0]);
+
+struct MallocAllocator {
+  static inline void* Allocate(size_t size) { return std::malloc(size); }
+  static inline void Deallocate(void* block, size_t size) {
+    std::free(block);
+    (void)(size);
+  }
+};
+
+template<typename Allocator>
+void RunThread() {
+  void* blocks[kWindowSize];
+  size_t sizes[kWindowSize];
+  for (size_t i = 0; i < kWindowSize; ++i) {
+    sizes[i] = kBlockSizes[i % kBlockSizeCount];
+    blocks[i] = Allocator::Allocate(sizes[i]);
+  }
+
+  for (size_t step = 0; step < kStepsPerThread; ++step) {
+    size_t slot = step % kWindowSize;
+    Allocator::Deallocate(blocks[slot], sizes[slot]);
+    sizes[slot] = kBlockSizes[(step * 7) % kBlockSizeCount];
+    blocks[slot] = Allocator::Allocate(sizes[slot]);
+    // Touch the block, like the allocator's callers would.
+    *static_cast<uint8_t*>(blocks[slot]) = static_cast<uint8_t>(step);
+  }
+
+  for (size_t i = 0; i < kWindowSize; ++i)
+    Allocator::Deallocate(blocks[i], sizes[i]);
+}
+
+/** Returns the nanoseconds per allocation / deallocation pair. */
+template<typename Allocator>
+double Measure(size_t thread_count) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_count; ++i)
+    threads.emplace_back(RunThread<Allocator>);
+  for (std::thread& thread : threads)
+    thread.join();
+  auto end = std::chrono::steady_clock::now();
+
+  double nanoseconds = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count());
+  return nanoseconds / kStepsPerThread;
+}
+
+}  // namespace
+
+int main() {
+  size_t max_threads = std::thread::hardware_concurrency();
+  if (max_threads == 0)
+    max_threads = 1;
+
+  std::printf("threads  malloc ns/op  size-class ns/op\n");
+  for (size_t thread_count = 1; thread_count <= max_threads;
+       thread_count *= 2) {
+    double malloc_ns = Measure<MallocAllocator>(thread_count);
+    double size_class_ns = Measure<berrydb::SizeClassAllocator>(thread_count);
+    std::printf("%7zu  %12.2f  %16.2f\n", thread_count, malloc_ns,
+                size_class_ns);
+  }
+  return 0;
+}
@@ -0,0 +1,159 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures the page compression codec used by StoreOptions::compress_pages.
+//
+// Each page is filled with data of a different compressibility, then
+// compressed and decompressed repeatedly. Reading a compressed page costs one
+// decompression, so the decompression speed bounds the read throughput of a
+// store whose data file is cached.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../util/lz_codec.h"
+
+namespace {
+
+constexpr size_t kMinPageShift = 12;
+constexpr size_t kMaxPageShift = 16;
+constexpr size_t kBytesPerMeasurement = 256 * 1024 * 1024;
+
+enum class PageContents {
+  kRandom,
+  kHalfRandom,
+  kRecords,
+  kSparse,
+};
+
+constexpr PageContents kAllPageContents[] = {
+  PageContents::kRandom, PageContents::kHalfRandom, PageContents::kRecords,
+  PageContents::kSparse,
+};
+
+const char* PageContentsName(PageContents contents) {
+  switch (contents) {
+    case PageContents::kRandom:
+      return "random";
+    case PageContents::kHalfRandom:
+      return "half-random";
+    case PageContents::kRecords:
+      return "records";
+    case PageContents::kSparse:
+      return "sparse";
+  }
+  return "";
+}
+
+/** Fills a page buffer with data that compresses to a varying degree. */
+void FillPage(PageContents contents, std::vector<uint8_t>* page) {
+  std::mt19937 rnd(static_cast<uint32_t>(page->size()));
+  size_t page_size = page->size();
+  switch (contents) {
+    case PageContents::kRandom:
+      for (size_t i = 0; i < page_size; ++i)
+        (*page)[i] = static_cast<uint8_t>(rnd());
+      break;
+    case PageContents::kHalfRandom:
+      // Runs of random bytes alternate with runs of a repeated byte.
+      for (size_t i = 0; i < page_size; ++i)
+        (*page)[i] = ((i / 32) % 2 == 0) ? static_cast<uint8_t>(rnd()) : 0;
+      break;
+    case PageContents::kRecords:
+      // Fixed-size records with a shared key prefix, a counter, and a small
+      // random value, which is what a B+ tree leaf page roughly looks like.
+      for (size_t i = 0; i < page_size; i += 32) {
+        char record[64];
+        std::snprintf(record, sizeof(record), "user_key_%08zu:%013u", i / 32,
+                      static_cast<unsigned>(rnd() % 100000));
+        std::memcpy(page->data() + i, record, std::min<size_t>(
+            32, page_size - i));
+      }
+      break;
+    case PageContents::kSparse:
+      // A mostly empty page, like a freshly split node.
+      std::memset(page->data(), 0, page_size);
+      for (size_t i = 0; i < page_size / 16; ++i)
+        (*page)[i] = static_cast<uint8_t>(rnd());
+      break;
+  }
+}
+
+struct Measurement {
+  double ratio;
+  double compress_mbps;
+  double decompress_mbps;
+};
+
+Measurement Measure(size_t page_shift, PageContents contents) {
+  size_t page_size = static_cast<size_t>(1) << page_shift;
+  std::vector<uint8_t> page(page_size);
+  FillPage(contents, &page);
+  std::vector<uint8_t> compressed(page_size);
+  std::vector<uint8_t> decompressed(page_size);
+
+  size_t iterations = kBytesPerMeasurement / page_size;
+  size_t compressed_size = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    compressed_size = berrydb::LzCompress(
+        page.data(), page_size, compressed.data(), compressed.size());
+  }
+  auto end = std::chrono::steady_clock::now();
+  double compress_seconds = std::chrono::duration<double>(end - start).count();
+
+  // The store writes pages that do not compress uncompressed, so reading them
+  // is a plain copy.
+  bool stored_compressed = compressed_size != 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (stored_compressed) {
+      if (!berrydb::LzDecompress(compressed.data(), compressed_size,
+                                 decompressed.data(), page_size)) {
+        std::fprintf(stderr, "Decompression failed\n");
+        return Measurement{0, 0, 0};
+      }
+    } else {
+      std::memcpy(decompressed.data(), page.data(), page_size);
+    }
+  }
+  end = std::chrono::steady_clock::now();
+  double decompress_seconds =
+      std::chrono::duration<double>(end - start).count();
+  if (std::memcmp(decompressed.data(), page.data(), page_size) != 0) {
+    std::fprintf(stderr, "Decompressed page does not match\n");
+    return Measurement{0, 0, 0};
+  }
+
+  Measurement measurement;
+  measurement.ratio = stored_compressed ?
+      static_cast<double>(page_size) / static_cast<double>(compressed_size) :
+      1.0;
+  double megabytes = static_cast<double>(iterations * page_size) / 1e6;
+  measurement.compress_mbps = megabytes / compress_seconds;
+  measurement.decompress_mbps = megabytes / decompress_seconds;
+  return measurement;
+}
+
+}  // namespace
+
+int main() {
+  std::printf("page size  contents     ratio  compress MB/s  read MB/s\n");
+  for (size_t page_shift = kMinPageShift; page_shift <= kMaxPageShift;
+       page_shift += 2) {
+    for (PageContents contents : kAllPageContents) {
+      Measurement measurement = Measure(page_shift, contents);
+      std::printf("%9zu  %-11s  %5.2f  %13.0f  %9.0f\n",
+                  static_cast<size_t>(1) << page_shift,
+                  PageContentsName(contents), measurement.ratio,
+                  measurement.compress_mbps, measurement.decompress_mbps);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares a shared resource pool with a partitioned pool.
+//
+// Each thread runs short transactions against its own store. In the shared
+// pool, all the threads contend for the pool's lock. In the partitioned pool,
+// the stores are hashed across as many partitions as there are threads, so
+// the lock is striped. Stores that hash to the same partition still contend.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "berrydb/options.h"
+#include "berrydb/pool.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "berrydb/vfs.h"
+
+namespace {
+
+constexpr size_t kMaxThreads = 64;
+constexpr size_t kTransactionsPerThread = 200000;
+
+std::string StorePath(size_t index) {
+  return "pool_benchmark_" + std::to_string(index) + ".berry";
+}
+
+void RunThread(berrydb::Store* store) {
+  for (size_t i = 0; i < kTransactionsPerThread; ++i) {
+    berrydb::Transaction* transaction;
+    if (store->CreateTransaction(&transaction) != berrydb::Status::kSuccess)
+      continue;
+    transaction->Commit();
+    transaction->Release();
+  }
+}
+
+/** Returns the number of transactions per second, across all threads. */
+double Measure(size_t thread_count, size_t partition_count) {
+  berrydb::PoolOptions pool_options;
+  pool_options.page_shift = 12;
+  pool_options.page_pool_size = 64 * thread_count;
+  pool_options.partition_count = partition_count;
+  berrydb::Pool* pool = berrydb::Pool::Create(pool_options);
+
+  std::vector<berrydb::Store*> stores;
+  for (size_t i = 0; i < thread_count; ++i) {
+    berrydb::Store* store;
+    if (pool->OpenStore(StorePath(i), berrydb::StoreOptions(), &store) !=
+        berrydb::Status::kSuccess) {
+      std::fprintf(stderr, "Failed to open %s\n", StorePath(i).c_str());
+      return 0;
+    }
+    stores.push_back(store);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (berrydb::Store* store : stores)
+    threads.emplace_back(RunThread, store);
+  for (std::thread& thread : threads)
+    thread.join();
+  auto end = std::chrono::steady_clock::now();
+
+  for (berrydb::Store* store : stores)
+    store->Release();
+  pool->Release();
+
+  berrydb::Vfs* vfs = berrydb::DefaultVfs();
+  for (size_t i = 0; i < thread_count; ++i) {
+    vfs->DeleteFile(StorePath(i));
+    vfs->DeleteFile(berrydb::Store::LogFilePath(StorePath(i)));
+  }
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return static_cast<double>(thread_count * kTransactionsPerThread) / seconds;
+}
+
+}  // namespace
+
+int main() {
+  std::printf("threads  shared txn/s  partitioned txn/s\n");
+  for (size_t thread_count = 1; thread_count <= kMaxThreads;
+       thread_count *= 2) {
+    double shared = Measure(thread_count, 1);
+    double partitioned = Measure(thread_count, thread_count);
+    std::printf("%7zu  %12.0f  %17.0f\n", thread_count, shared, partitioned);
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./compressed_page_cache.h"
+
+#include <cstring>
+#include <new>
+
+#include "./util/lz_codec.h"
+
+namespace berrydb {
+
+CompressedPageCache::CompressedPageCache(size_t page_size, size_t capacity)
+    : page_size_(page_size), capacity_(capacity),
+      compression_buffer_((capacity == 0) ? nullptr :
+          reinterpret_cast<uint8_t*>(Allocate(page_size))) {
+}
+
+CompressedPageCache::~CompressedPageCache() {
+  // We cannot use C++11's range-based for loop because the iterator would get
+  // invalidated if we release the entry it's pointing to.
+  for (auto it = entry_list_.begin(); it != entry_list_.end(); ) {
+    Entry* entry = *it;
+    ++it;
+    ReleaseEntry(entry);
+  }
+  DCHECK_EQ(used_bytes_, 0U);
+
+  if (compression_buffer_ != nullptr)
+    Deallocate(compression_buffer_, page_size_);
+}
+
+void CompressedPageCache::Insert(
+    StoreImpl* store, size_t page_id, const uint8_t* data) {
+  DCHECK(store != nullptr);
+  DCHECK(data != nullptr);
+  DCHECK_EQ(0U, entry_map_.count(std::make_pair(store, page_id)));
+  if (!is_enabled())
+    return;
+
+  // Pages that shrink by less than a quarter are not worth the CPU time spent
+  // decompressing them, and would push out pages that compress better.
+  size_t max_compressed_size = page_size_ - (page_size_ >> 2);
+  size_t compressed_size = LzCompress(
+      data, page_size_, compression_buffer_, max_compressed_size);
+  if (compressed_size == 0)
+    return;
+  size_t allocation_size = sizeof(Entry) + compressed_size;
+  if (allocation_size > capacity_)
+    return;
+
+  while (used_bytes_ + allocation_size > capacity_) {
+    DCHECK(!entry_list_.empty());
+    ReleaseEntry(entry_list_.front());
+  }
+
+  Entry* entry = reinterpret_cast<Entry*>(Allocate(allocation_size));
+  new (entry) Entry();
+  entry->store = store;
+  entry->page_id = page_id;
+  entry->compressed_size = compressed_size;
+  std::memcpy(entry->data(), compression_buffer_, compressed_size);
+
+  entry_map_[std::make_pair(store, page_id)] = entry;
+  entry_list_.push_back(entry);
+  used_bytes_ += allocation_size;
+}
+
+bool CompressedPageCache::Fetch(
+    StoreImpl* store, size_t page_id, uint8_t* data) {
+  DCHECK(store != nullptr);
+  DCHECK(data != nullptr);
+
+  const auto& it = entry_map_.find(std::make_pair(store, page_id));
+  if (it == entry_map_.end())
+    return false;
+
+  Entry* entry = it->second;
+  bool decompressed = LzDecompress(
+      entry->data(), entry->compressed_size, data, page_size_);
+  // The compressed data never leaves memory, so it cannot be corrupted.
+  DCHECK(decompressed);
+  UNUSED(decompressed);
+
+  ReleaseEntry(entry);
+  return true;
+}
+
+void CompressedPageCache::Remove(StoreImpl* store, size_t page_id) {
+  DCHECK(store != nullptr);
+
+  const auto& it = entry_map_.find(std::make_pair(store, page_id));
+  if (it != entry_map_.end())
+    ReleaseEntry(it->second);
+}
+
+void CompressedPageCache::RemoveStorePages(StoreImpl* store) {
+  DCHECK(store != nullptr);
+
+  for (auto it = entry_list_.begin(); it != entry_list_.end(); ) {
+    Entry* entry = *it;
+    ++it;
+    if (entry->store == store)
+      ReleaseEntry(entry);
+  }
+}
+
+void CompressedPageCache::ReleaseEntry(Entry* entry) {
+  DCHECK(entry != nullptr);
+  DCHECK_EQ(1U,
+            entry_map_.count(std::make_pair(entry->store, entry->page_id)));
+
+  entry_map_.erase(std::make_pair(entry->store, entry->page_id));
+  entry_list_.erase(entry);
+
+  size_t allocation_size = entry->allocation_size();
+  DCHECK_LE(allocation_size, used_bytes_);
+  used_bytes_ -= allocation_size;
+
+  entry->~Entry();
+  Deallocate(entry, allocation_size);
+}
+
+}  // namespace berrydb
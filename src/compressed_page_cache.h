@@ -0,0 +1,131 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_COMPRESSED_PAGE_CACHE_H_
+#define BERRYDB_COMPRESSED_PAGE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "berrydb/platform.h"
+#include "./util/linked_list.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class StoreImpl;
+
+/** Second cache tier that holds compressed copies of evicted store pages.
+ *
+ * When the page pool evicts a store page from its LRU list, the page's data
+ * matches the store's data file, so the data can be discarded. If the pool has
+ * a compressed cache, the page data is compressed and kept in this cache
+ * instead. A page pool miss that hits the compressed cache is served by
+ * decompressing the page, which is much cheaper than a disk read. The pool's
+ * effective capacity grows roughly by the data's compression ratio.
+ *
+ * The cache is exclusive with the page pool: a page leaves the compressed
+ * cache when it is loaded into a page pool entry. So, the cache never holds
+ * stale data, because store pages are only modified in the page pool.
+ *
+ * The cache's memory usage is bounded by a byte capacity, which includes the
+ * bookkeeping overhead of each cached page. When the capacity is exceeded, the
+ * least recently inserted pages are discarded. Pages that do not compress well
+ * are not cached, because they would displace multiple compressible pages.
+ */
+class CompressedPageCache {
+ public:
+  /** Sets up a cache. A capacity of 0 disables the cache.
+   *
+   * @param page_size the size of the cached pages
+   * @param capacity  maximum number of bytes used by cached pages */
+  CompressedPageCache(size_t page_size, size_t capacity);
+
+  /** Discards all the cached pages. */
+  ~CompressedPageCache();
+
+  /** Caches a copy of a store page.
+   *
+   * The page must not already be cached. This may discard other pages, and
+   * may decide not to cache the page, if the page does not compress well.
+   *
+   * @param store   the store that the page belongs to
+   * @param page_id the page's ID in the store
+   * @param data    the page's data; must match the store's data file
+   */
+  void Insert(StoreImpl* store, size_t page_id, const uint8_t* data);
+
+  /** Removes a page from the cache, and decompresses its data.
+   *
+   * @param  store   the store that the page belongs to
+   * @param  page_id the page's ID in the store
+   * @param  data    receives the page's data if the page is cached
+   * @return         true if the page was cached, false otherwise
+   */
+  bool Fetch(StoreImpl* store, size_t page_id, uint8_t* data);
+
+  /** Removes a page from the cache, if it is cached. */
+  void Remove(StoreImpl* store, size_t page_id);
+
+  /** Removes all of a store's pages from the cache.
+   *
+   * This must be called when a store is closed, because another store may be
+   * allocated at the same address afterwards. */
+  void RemoveStorePages(StoreImpl* store);
+
+  /** True if the cache can hold pages. */
+  inline bool is_enabled() const noexcept { return capacity_ != 0; }
+
+  /** Maximum number of bytes used by the cached pages. */
+  inline size_t capacity() const noexcept { return capacity_; }
+
+  /** Number of bytes used by the cached pages, including bookkeeping. */
+  inline size_t used_bytes() const noexcept { return used_bytes_; }
+
+  /** Number of pages in the cache. */
+  inline size_t page_count() const noexcept { return entry_list_.size(); }
+
+ private:
+  /** A compressed page. The compressed data follows the entry in memory. */
+  class Entry {
+   public:
+    inline uint8_t* data() noexcept {
+      return reinterpret_cast<uint8_t*>(this + 1);
+    }
+    inline size_t allocation_size() const noexcept {
+      return sizeof(Entry) + compressed_size;
+    }
+
+    friend class LinkedListBridge<Entry>;
+    LinkedList<Entry>::Node linked_list_node_;
+
+    StoreImpl* store;
+    size_t page_id;
+    size_t compressed_size;
+  };
+
+  /** Unlinks an entry from the cache's data structures and frees it. */
+  void ReleaseEntry(Entry* entry);
+
+  using EntryMapKey = std::pair<StoreImpl*, size_t>;
+  std::unordered_map<EntryMapKey, Entry*, PointerSizeHasher<StoreImpl>,
+      std::equal_to<EntryMapKey>,
+      PlatformAllocator<std::pair<const EntryMapKey, Entry*>>> entry_map_;
+
+  /** Cached pages, ordered by insertion time. The oldest page is first. */
+  LinkedList<Entry> entry_list_;
+
+  const size_t page_size_;
+  const size_t capacity_;
+  size_t used_bytes_ = 0;
+
+  /** Receives compressed page data. Null if the cache is disabled. */
+  uint8_t* compression_buffer_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_COMPRESSED_PAGE_CACHE_H_
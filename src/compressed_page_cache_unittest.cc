@@ -0,0 +1,137 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./compressed_page_cache.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+class CompressedPageCacheTest : public ::testing::Test {
+ protected:
+  CompressedPageCacheTest()
+      : store1_(reinterpret_cast<StoreImpl*>(&store1_storage_)),
+        store2_(reinterpret_cast<StoreImpl*>(&store2_storage_)) { }
+
+  /** Page data that compresses well. Different seeds give different data. */
+  std::vector<uint8_t> CompressiblePage(uint8_t seed) {
+    std::vector<uint8_t> data(kPageSize);
+    for (size_t i = 0; i < kPageSize; ++i)
+      data[i] = static_cast<uint8_t>(seed + (i / 64));
+    return data;
+  }
+
+  std::vector<uint8_t> RandomPage() {
+    std::vector<uint8_t> data;
+    data.reserve(kPageSize);
+    for (size_t i = 0; i < kPageSize; ++i)
+      data.push_back(static_cast<uint8_t>(rnd_()));
+    return data;
+  }
+
+  constexpr static size_t kPageSize = 4096;
+
+  // The cache only uses store pointers as keys.
+  size_t store1_storage_, store2_storage_;
+  StoreImpl* const store1_;
+  StoreImpl* const store2_;
+  std::mt19937 rnd_;
+};
+
+constexpr size_t CompressedPageCacheTest::kPageSize;
+
+TEST_F(CompressedPageCacheTest, Disabled) {
+  CompressedPageCache cache(kPageSize, 0);
+  EXPECT_FALSE(cache.is_enabled());
+
+  std::vector<uint8_t> page = CompressiblePage(1);
+  cache.Insert(store1_, 1, page.data());
+  EXPECT_EQ(0U, cache.page_count());
+  EXPECT_EQ(0U, cache.used_bytes());
+
+  std::vector<uint8_t> output(kPageSize);
+  EXPECT_FALSE(cache.Fetch(store1_, 1, output.data()));
+}
+
+TEST_F(CompressedPageCacheTest, InsertFetch) {
+  CompressedPageCache cache(kPageSize, 64 * 1024);
+  EXPECT_TRUE(cache.is_enabled());
+  EXPECT_EQ(64U * 1024, cache.capacity());
+
+  std::vector<uint8_t> page1 = CompressiblePage(1);
+  std::vector<uint8_t> page2 = CompressiblePage(2);
+  cache.Insert(store1_, 1, page1.data());
+  cache.Insert(store2_, 1, page2.data());
+  EXPECT_EQ(2U, cache.page_count());
+  EXPECT_LT(0U, cache.used_bytes());
+  EXPECT_GT(kPageSize, cache.used_bytes());
+
+  std::vector<uint8_t> output(kPageSize);
+  EXPECT_FALSE(cache.Fetch(store1_, 2, output.data()));
+  ASSERT_TRUE(cache.Fetch(store2_, 1, output.data()));
+  EXPECT_EQ(page2, output);
+  ASSERT_TRUE(cache.Fetch(store1_, 1, output.data()));
+  EXPECT_EQ(page1, output);
+
+  // Fetching a page removes it from the cache.
+  EXPECT_EQ(0U, cache.page_count());
+  EXPECT_EQ(0U, cache.used_bytes());
+  EXPECT_FALSE(cache.Fetch(store1_, 1, output.data()));
+}
+
+TEST_F(CompressedPageCacheTest, SkipsIncompressiblePages) {
+  CompressedPageCache cache(kPageSize, 64 * 1024);
+  std::vector<uint8_t> page = RandomPage();
+  cache.Insert(store1_, 1, page.data());
+  EXPECT_EQ(0U, cache.page_count());
+  EXPECT_EQ(0U, cache.used_bytes());
+}
+
+TEST_F(CompressedPageCacheTest, EvictsOldestPages) {
+  std::vector<uint8_t> page = CompressiblePage(0);
+  CompressedPageCache probe(kPageSize, 64 * 1024);
+  probe.Insert(store1_, 0, page.data());
+  size_t entry_size = probe.used_bytes();
+
+  // Room for 3 pages.
+  CompressedPageCache cache(kPageSize, entry_size * 3 + entry_size / 2);
+  for (size_t i = 0; i < 5; ++i) {
+    page = CompressiblePage(static_cast<uint8_t>(i));
+    cache.Insert(store1_, i, page.data());
+    EXPECT_LE(cache.used_bytes(), cache.capacity());
+  }
+  EXPECT_EQ(3U, cache.page_count());
+
+  std::vector<uint8_t> output(kPageSize);
+  EXPECT_FALSE(cache.Fetch(store1_, 0, output.data()));
+  EXPECT_FALSE(cache.Fetch(store1_, 1, output.data()));
+  for (size_t i = 2; i < 5; ++i) {
+    ASSERT_TRUE(cache.Fetch(store1_, i, output.data()));
+    EXPECT_EQ(CompressiblePage(static_cast<uint8_t>(i)), output);
+  }
+}
+
+TEST_F(CompressedPageCacheTest, Remove) {
+  CompressedPageCache cache(kPageSize, 64 * 1024);
+  std::vector<uint8_t> page = CompressiblePage(1);
+  cache.Insert(store1_, 1, page.data());
+  cache.Insert(store1_, 2, page.data());
+  cache.Insert(store2_, 1, page.data());
+
+  cache.Remove(store1_, 1);
+  cache.Remove(store1_, 3);
+  EXPECT_EQ(2U, cache.page_count());
+
+  cache.RemoveStorePages(store1_);
+  EXPECT_EQ(1U, cache.page_count());
+  std::vector<uint8_t> output(kPageSize);
+  EXPECT_FALSE(cache.Fetch(store1_, 2, output.data()));
+  EXPECT_TRUE(cache.Fetch(store2_, 1, output.data()));
+}
+
+}  // namespace berrydb
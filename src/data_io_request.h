@@ -0,0 +1,37 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_DATA_IO_REQUEST_H_
+#define BERRYDB_DATA_IO_REQUEST_H_
+
+#include "berrydb/platform.h"
+#include "berrydb/vfs.h"
+#include "./util/thread_pool.h"
+
+namespace berrydb {
+
+/** An I/O operation issued by a store on its data file.
+ *
+ * The request's token points to this structure. Requests are either waited for
+ * by StoreImpl::WaitForDataIo(), or completed asynchronously, by queueing a
+ * task on the pool's asynchronous operation threads.
+ */
+struct DataIoRequest {
+  /** Passed to the data file's Submit*() methods. */
+  BlockIoRequest request;
+
+  /** Queued when the request completes, if the request is asynchronous.
+   *
+   * Null for requests waited for by StoreImpl::WaitForDataIo(). */
+  ThreadPool::Task* completion_task = nullptr;
+
+  /** Set when a request that is waited for completes.
+   *
+   * Guarded by the store's data file I/O mutex. */
+  bool completed = false;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_DATA_IO_REQUEST_H_
@@ -36,4 +36,38 @@ TEST(EndiannessTest, LoadMatchesStore) {
   EXPECT_EQ(0xCDCDCDCDCDCDCDCDU, LoadUint64(buffer + 24));
 }
 
+TEST(EndiannessTest, LoadMatchesStoreUint16) {
+  alignas(8) uint8_t buffer[8];
+  std::memset(buffer, 0xCD, sizeof(buffer));
+
+  StoreUint16(0x4272, buffer + 2);
+  EXPECT_EQ(0xCD, buffer[0]);
+  EXPECT_EQ(0xCD, buffer[1]);
+  for (size_t i = 4; i < 8; ++i)
+    EXPECT_EQ(0xCD, buffer[i]);
+  EXPECT_EQ(0x4272, LoadUint16(buffer + 2));
+
+  StoreUint16(0x7942, buffer + 4);
+  EXPECT_EQ(0x4272, LoadUint16(buffer + 2));
+  EXPECT_EQ(0x7942, LoadUint16(buffer + 4));
+  EXPECT_EQ(0xCDCD, LoadUint16(buffer + 6));
+}
+
+TEST(EndiannessTest, LoadMatchesStoreUint32) {
+  alignas(8) uint8_t buffer[16];
+  std::memset(buffer, 0xCD, sizeof(buffer));
+
+  StoreUint32(0x42657272, buffer + 4);
+  for (size_t i = 0; i < 4; ++i)
+    EXPECT_EQ(0xCD, buffer[i]);
+  for (size_t i = 8; i < 16; ++i)
+    EXPECT_EQ(0xCD, buffer[i]);
+  EXPECT_EQ(0x42657272U, LoadUint32(buffer + 4));
+
+  StoreUint32(0x79444220, buffer + 8);
+  EXPECT_EQ(0x42657272U, LoadUint32(buffer + 4));
+  EXPECT_EQ(0x79444220U, LoadUint32(buffer + 8));
+  EXPECT_EQ(0xCDCDCDCDU, LoadUint32(buffer + 12));
+}
+
 }  // namespace berrydb
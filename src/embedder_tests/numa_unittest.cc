@@ -0,0 +1,26 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/platform.h"
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+TEST(NumaTest, CurrentNodeIsValid) {
+  EXPECT_LE(1U, NumaNodeCount());
+  EXPECT_LT(CurrentNumaNode(), NumaNodeCount());
+}
+
+TEST(NumaTest, BindDoesNotCrash) {
+  constexpr size_t kBlockSize = 64 * 1024;
+  void* block = Allocate(kBlockSize);
+  BindToNumaNode(block, kBlockSize, CurrentNumaNode());
+  std::memset(block, 0, kBlockSize);
+  Deallocate(block, kBlockSize);
+}
+
+}  // namespace berrydb
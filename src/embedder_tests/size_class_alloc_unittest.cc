@@ -0,0 +1,93 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/platform/size_class_alloc.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+TEST(SizeClassAllocatorTest, SizeClasses) {
+  EXPECT_EQ(0U, SizeClassAllocator::SizeClass(1));
+  EXPECT_EQ(0U, SizeClassAllocator::SizeClass(16));
+  EXPECT_EQ(1U, SizeClassAllocator::SizeClass(17));
+  EXPECT_EQ(7U, SizeClassAllocator::SizeClass(128));
+  EXPECT_EQ(8U, SizeClassAllocator::SizeClass(129));
+  EXPECT_EQ(160U, SizeClassAllocator::ClassSize(8));
+  EXPECT_EQ(SizeClassAllocator::kClassCount - 1,
+            SizeClassAllocator::SizeClass(SizeClassAllocator::kMaxSize));
+  EXPECT_EQ(SizeClassAllocator::kMaxSize + 0,
+            SizeClassAllocator::ClassSize(SizeClassAllocator::kClassCount - 1));
+
+  size_t previous_class_size = 0;
+  for (size_t size_class = 0; size_class < SizeClassAllocator::kClassCount;
+       ++size_class) {
+    size_t class_size = SizeClassAllocator::ClassSize(size_class);
+    EXPECT_LT(previous_class_size, class_size);
+    EXPECT_EQ(size_class, SizeClassAllocator::SizeClass(class_size));
+    EXPECT_EQ(size_class, SizeClassAllocator::SizeClass(
+        previous_class_size + 1));
+    // At most 25% of a block is wasted.
+    EXPECT_LE(class_size, (previous_class_size + 1) * 5 / 4 + 15);
+    previous_class_size = class_size;
+  }
+}
+
+TEST(SizeClassAllocatorTest, ReusesFreedBlocks) {
+  void* block = SizeClassAllocator::Allocate(100);
+  std::memset(block, 0, 100);
+  SizeClassAllocator::Deallocate(block, 100);
+
+  // Sizes in the same class share blocks.
+  void* reused_block = SizeClassAllocator::Allocate(112);
+  EXPECT_EQ(block, reused_block);
+  SizeClassAllocator::Deallocate(reused_block, 112);
+}
+
+TEST(SizeClassAllocatorTest, LargeBlocks) {
+  size_t size = SizeClassAllocator::kMaxSize + 1;
+  void* block = SizeClassAllocator::Allocate(size);
+  std::memset(block, 0, size);
+  SizeClassAllocator::Deallocate(block, size);
+}
+
+TEST(SizeClassAllocatorTest, BlocksMoveAcrossThreads) {
+  constexpr size_t kBlockCount = 4096;
+  constexpr size_t kBlockSize = 64;
+
+  std::vector<void*> blocks;
+  for (size_t i = 0; i < kBlockCount; ++i) {
+    blocks.push_back(SizeClassAllocator::Allocate(kBlockSize));
+    std::memset(blocks.back(), static_cast<int>(i), kBlockSize);
+  }
+
+  // Blocks allocated on one thread are freed on another thread, which spills
+  // them to the central cache when it exits.
+  std::thread freer([&]() {
+    for (void* block : blocks)
+      SizeClassAllocator::Deallocate(block, kBlockSize);
+  });
+  freer.join();
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    threads.emplace_back([&]() {
+      std::vector<void*> thread_blocks;
+      for (size_t j = 0; j < kBlockCount; ++j) {
+        thread_blocks.push_back(SizeClassAllocator::Allocate(kBlockSize));
+        std::memset(thread_blocks.back(), static_cast<int>(j), kBlockSize);
+      }
+      for (void* block : thread_blocks)
+        SizeClassAllocator::Deallocate(block, kBlockSize);
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+}
+
+}  // namespace berrydb
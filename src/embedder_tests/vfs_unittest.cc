@@ -7,6 +7,7 @@
 #include <cstring>
 #include <random>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -170,6 +171,108 @@ TEST_F(VfsTest, BlockAccessFileReadWriteOffsets) {
   EXPECT_EQ(Status::kSuccess, vfs_->DeleteFile(kFileName));
 }
 
+TEST_F(VfsTest, BlockAccessFileAsyncIo) {
+  uint8_t buffer[4][1 << kBlockShift], read_buffer[4][1 << kBlockShift];
+  BlockAccessFile* file = nullptr;
+  size_t file_size;
+
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t j = 0; j < 1 << kBlockShift; ++j)
+      buffer[i][j] = static_cast<uint8_t>(rnd_());
+  }
+
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+  ASSERT_NE(nullptr, file);
+
+  BlockIoRequest requests[4];
+  BlockIoRequest* completed[4];
+  for (size_t i = 0; i < 4; ++i) {
+    requests[i].token = &buffer[i];
+    file->SubmitWrite(buffer[i], i << kBlockShift, 1 << kBlockShift,
+                      &requests[i]);
+  }
+  size_t completed_count = 0;
+  while (completed_count < 4) {
+    size_t count = file->PollCompletions(completed, 4, true);
+    ASSERT_LT(0U, count);
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ(Status::kSuccess, completed[i]->status);
+      EXPECT_EQ(BlockIoRequest::Type::kWrite, completed[i]->type);
+      EXPECT_EQ(&buffer[completed[i] - requests], completed[i]->token);
+    }
+    completed_count += count;
+  }
+  EXPECT_EQ(0U, file->PollCompletions(completed, 4, true));
+
+  file->SubmitSync(&requests[0]);
+  ASSERT_EQ(1U, file->PollCompletions(completed, 4, true));
+  EXPECT_EQ(&requests[0], completed[0]);
+  EXPECT_EQ(Status::kSuccess, completed[0]->status);
+
+  // Read the blocks back in reverse order.
+  for (size_t i = 0; i < 4; ++i) {
+    file->SubmitRead((3 - i) << kBlockShift, 1 << kBlockShift,
+                     read_buffer[3 - i], &requests[i]);
+  }
+  completed_count = 0;
+  while (completed_count < 4) {
+    size_t count = file->PollCompletions(completed, 4, true);
+    ASSERT_LT(0U, count);
+    for (size_t i = 0; i < count; ++i)
+      EXPECT_EQ(Status::kSuccess, completed[i]->status);
+    completed_count += count;
+  }
+  for (size_t i = 0; i < 4; ++i)
+    EXPECT_EQ(0, std::memcmp(buffer[i], read_buffer[i], 1 << kBlockShift));
+
+  EXPECT_EQ(Status::kSuccess, file->Close());
+  EXPECT_EQ(Status::kSuccess, vfs_->DeleteFile(kFileName));
+}
+
+TEST_F(VfsTest, BlockAccessFileAsyncIoQueueDepth) {
+  // More requests than an I/O queue is likely to hold at once.
+  constexpr size_t kBlockCount = 200;
+  std::vector<uint8_t> buffer(kBlockCount << kBlockShift);
+  for (uint8_t& byte : buffer)
+    byte = static_cast<uint8_t>(rnd_());
+  BlockAccessFile* file = nullptr;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+  ASSERT_NE(nullptr, file);
+
+  std::vector<BlockIoRequest> requests(kBlockCount);
+  for (size_t i = 0; i < kBlockCount; ++i) {
+    file->SubmitWrite(&buffer[i << kBlockShift], i << kBlockShift,
+                      1 << kBlockShift, &requests[i]);
+  }
+  BlockIoRequest* completed[16];
+  size_t completed_count = 0;
+  while (completed_count < kBlockCount) {
+    size_t count = file->PollCompletions(completed, 16, true);
+    ASSERT_LT(0U, count);
+    for (size_t i = 0; i < count; ++i)
+      EXPECT_EQ(Status::kSuccess, completed[i]->status);
+    completed_count += count;
+  }
+
+  std::vector<uint8_t> read_buffer(kBlockCount << kBlockShift);
+  ASSERT_EQ(Status::kSuccess, file->Read(
+      0, kBlockCount << kBlockShift, read_buffer.data()));
+  EXPECT_EQ(buffer, read_buffer);
+
+  // Reads past the end of the file fail.
+  file->SubmitRead(kBlockCount << kBlockShift, 1 << kBlockShift,
+                   read_buffer.data(), &requests[0]);
+  ASSERT_EQ(1U, file->PollCompletions(completed, 16, true));
+  EXPECT_EQ(&requests[0], completed[0]);
+  EXPECT_EQ(Status::kIoError, completed[0]->status);
+
+  EXPECT_EQ(Status::kSuccess, file->Close());
+  EXPECT_EQ(Status::kSuccess, vfs_->DeleteFile(kFileName));
+}
+
 TEST_F(VfsTest, OpenForRandomAccessOptions) {
   RandomAccessFile* file = nullptr;
   const size_t kInvalidSize = 0x0badc0de;
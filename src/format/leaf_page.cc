@@ -0,0 +1,460 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./leaf_page.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif  // defined(__SSE2__) || defined(__AVX2__)
+
+#include "berrydb/platform.h"
+
+namespace berrydb {
+
+// The leaf page format is as follows:
+//
+//  0: 2-byte page tag - "Lf"
+//  2: 2-byte number of key/value pairs (N) in the page
+//  4: 2-byte number of restart points (R), which is ceil(N / 16)
+//  6: 2-byte size of the key prefix (P) shared by all the keys in the page
+//  8: R 4-byte key heads - the first 4 bytes of the restart points' key
+//     suffixes padded with zeros, read as big-endian numbers; the numbers
+//     are stored like the other integers in the page
+//  8 + 4R: R 2-byte page offsets of the cells at restart points
+//  8 + 6R: P-byte key prefix, padded to a 2-byte boundary
+//  followed by N cells, in key order, each padded to a 2-byte boundary
+//
+// The cell format is as follows:
+//
+//  0: 2-byte number of key suffix bytes shared with the previous key (S); this
+//     is always 0 for cells at restart points
+//  2: 2-byte number of key suffix bytes stored in the cell (U)
+//  4: 2-byte value size (V)
+//  6: U bytes of key suffix, followed by V bytes of value
+//
+// The key suffix is the part of the key that follows the page-wide prefix. A
+// cell's full key is the page prefix, followed by the first S bytes of the
+// previous key's suffix, followed by the U bytes stored in the cell.
+//
+// The unused space between the last cell and the end of the page is not
+// initialized.
+
+namespace {
+
+/** Number of leading bytes shared by two strings. */
+inline size_t CommonPrefixSize(string_view a, string_view b) noexcept {
+  size_t max_size = std::min(a.size(), b.size());
+  size_t size = 0;
+  while (size < max_size && a[size] == b[size])
+    ++size;
+  return size;
+}
+
+/** Number of restart points needed to index a number of cells. */
+inline size_t RestartCount(size_t entry_count) noexcept {
+  return (entry_count + LeafPage::kRestartInterval - 1) /
+      LeafPage::kRestartInterval;
+}
+
+#if defined(__SSE2__) || defined(__AVX2__)
+/** Number of set bits in a SIMD comparison mask. */
+inline size_t MaskBitCount(unsigned mask) noexcept {
+  size_t count = 0;
+  for (; mask != 0; mask &= mask - 1)
+    ++count;
+  return count;
+}
+#endif  // defined(__SSE2__) || defined(__AVX2__)
+
+}  // anonymous namespace
+
+constexpr size_t LeafPage::kRestartInterval;
+constexpr size_t LeafPage::kMaxPageSize;
+constexpr uint16_t LeafPage::kPageTag;
+
+size_t LeafPage::LayoutSize(
+    const string_view* keys, const string_view* values, size_t count,
+    size_t prefix_size) noexcept {
+  size_t size = kHeaderSize + RestartCount(count) * 6 + AlignSize(prefix_size);
+  for (size_t i = 0; i < count; ++i) {
+    size_t suffix_size = (i % kRestartInterval == 0) ?
+        keys[i].size() - prefix_size :
+        keys[i].size() - CommonPrefixSize(keys[i - 1], keys[i]);
+    size += CellSize(suffix_size, values[i].size());
+  }
+  return size;
+}
+
+size_t LeafPage::BuiltSize(
+    const string_view* keys, const string_view* values, size_t count) {
+  if (count == 0)
+    return kHeaderSize;
+  size_t prefix_size = CommonPrefixSize(keys[0], keys[count - 1]);
+  return LayoutSize(keys, values, count, prefix_size);
+}
+
+size_t LeafPage::Build(
+    const string_view* keys, const string_view* values, size_t count,
+    size_t page_size, uint8_t* to) {
+  DCHECK_LE(page_size, kMaxPageSize);
+  DCHECK_LE(kHeaderSize, page_size);
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(to) & 7, 0U);
+#if DCHECK_IS_ON()
+  for (size_t i = 1; i < count; ++i)
+    DCHECK(keys[i - 1] < keys[i]);
+#endif  // DCHECK_IS_ON()
+
+  // The prefix shared by all the input keys is never longer than the prefix
+  // shared by the keys that end up in the page, so this pass gets an estimate
+  // that is very close to the final answer.
+  size_t fit_count = 0;
+  if (count != 0) {
+    size_t prefix_size = CommonPrefixSize(keys[0], keys[count - 1]);
+    size_t size = kHeaderSize + AlignSize(prefix_size);
+    for (; fit_count < count; ++fit_count) {
+      size_t suffix_size;
+      if (fit_count % kRestartInterval == 0) {
+        size += 6;  // Key head and slot array entry.
+        suffix_size = keys[fit_count].size() - prefix_size;
+      } else {
+        suffix_size = keys[fit_count].size() -
+            CommonPrefixSize(keys[fit_count - 1], keys[fit_count]);
+      }
+      size += CellSize(suffix_size, values[fit_count].size());
+      if (size > page_size)
+        break;
+    }
+  }
+
+  // Padding can make the estimate above off by a few bytes.
+  while (fit_count > 0 && BuiltSize(keys, values, fit_count) > page_size)
+    --fit_count;
+
+  size_t prefix_size = (fit_count == 0) ?
+      0 : CommonPrefixSize(keys[0], keys[fit_count - 1]);
+  size_t restart_count = RestartCount(fit_count);
+
+  StoreUint16(kPageTag, to + kTagOffset);
+  StoreUint16(static_cast<uint16_t>(fit_count), to + kEntryCountOffset);
+  StoreUint16(static_cast<uint16_t>(restart_count), to + kRestartCountOffset);
+  StoreUint16(static_cast<uint16_t>(prefix_size), to + kPrefixSizeOffset);
+
+  size_t offset = kHeaderSize + restart_count * 6;
+  if (prefix_size != 0)
+    std::memcpy(to + offset, keys[0].data(), prefix_size);
+  offset += AlignSize(prefix_size);
+
+  for (size_t i = 0; i < fit_count; ++i) {
+    size_t shared_size;
+    if (i % kRestartInterval == 0) {
+      size_t restart_index = i / kRestartInterval;
+      StoreUint32(KeyHead(reinterpret_cast<const uint8_t*>(keys[i].data()) +
+                              prefix_size,
+                          keys[i].size() - prefix_size),
+                  to + kHeaderSize + restart_index * 4);
+      StoreUint16(static_cast<uint16_t>(offset),
+                  to + kHeaderSize + restart_count * 4 + restart_index * 2);
+      shared_size = 0;
+    } else {
+      shared_size = CommonPrefixSize(keys[i - 1], keys[i]) - prefix_size;
+    }
+    size_t suffix_size = keys[i].size() - prefix_size - shared_size;
+    size_t value_size = values[i].size();
+
+    uint8_t* cell = to + offset;
+    StoreUint16(static_cast<uint16_t>(shared_size),
+                cell + kCellSharedSizeOffset);
+    StoreUint16(static_cast<uint16_t>(suffix_size),
+                cell + kCellSuffixSizeOffset);
+    StoreUint16(static_cast<uint16_t>(value_size), cell + kCellValueSizeOffset);
+    uint8_t* cell_data = cell + kCellHeaderSize;
+    std::memcpy(cell_data, keys[i].data() + prefix_size + shared_size,
+                suffix_size);
+    std::memcpy(cell_data + suffix_size, values[i].data(), value_size);
+
+    offset += CellSize(suffix_size, value_size);
+    DCHECK_LE(offset, page_size);
+  }
+
+  return fit_count;
+}
+
+bool LeafPage::IsValid() const noexcept {
+  if (page_size_ < kHeaderSize)
+    return false;
+  if (LoadUint16(data_ + kTagOffset) != kPageTag)
+    return false;
+
+  size_t count = entry_count();
+  size_t restarts = restart_count();
+  if (restarts != RestartCount(count))
+    return false;
+
+  size_t prefix_size = LoadUint16(data_ + kPrefixSizeOffset);
+  size_t offset = prefix_offset() + AlignSize(prefix_size);
+  if (offset > page_size_)
+    return false;
+
+  size_t previous_suffix_size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (offset + kCellHeaderSize > page_size_)
+      return false;
+
+    const uint8_t* cell = data_ + offset;
+    size_t shared_size = LoadUint16(cell + kCellSharedSizeOffset);
+    size_t suffix_size = LoadUint16(cell + kCellSuffixSizeOffset);
+    size_t value_size = LoadUint16(cell + kCellValueSizeOffset);
+    if (i % kRestartInterval == 0) {
+      if (restart_offset(i / kRestartInterval) != offset)
+        return false;
+      if (shared_size != 0)
+        return false;
+      if (offset + kCellHeaderSize + suffix_size > page_size_)
+        return false;
+      if (restart_head(i / kRestartInterval) !=
+          KeyHead(cell + kCellHeaderSize, suffix_size)) {
+        return false;
+      }
+    } else if (shared_size > previous_suffix_size) {
+      return false;
+    }
+
+    offset += CellSize(suffix_size, value_size);
+    if (offset > page_size_)
+      return false;
+    previous_suffix_size = shared_size + suffix_size;
+  }
+  return true;
+}
+
+bool LeafPage::Find(string_view key, string_view* value) const noexcept {
+  string_view prefix = key_prefix();
+  if (key.size() < prefix.size() ||
+      std::memcmp(key.data(), prefix.data(), prefix.size()) != 0) {
+    return false;
+  }
+  key.remove_prefix(prefix.size());
+
+  size_t restarts = restart_count();
+  if (restarts == 0)
+    return false;
+
+  // Find the last restart point whose key is less than or equal to the probe.
+  //
+  // The restart points in [0, head_begin) have smaller keys than the probe, and
+  // the restart points in [head_end, restarts) have greater keys. Only the
+  // restart points with tied key heads need full key comparisons. Restart point
+  // keys are not front-coded, so they can be compared in place.
+  const uint8_t* key_data = reinterpret_cast<const uint8_t*>(key.data());
+  size_t head_begin, head_end;
+  FindRestartHeadRange(
+      KeyHead(key_data, key.size()), &head_begin, &head_end);
+
+  size_t low = head_begin, high = head_end;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    const uint8_t* cell = data_ + restart_offset(middle);
+    string_view restart_key(
+        reinterpret_cast<const char*>(cell + kCellHeaderSize),
+        LoadUint16(cell + kCellSuffixSizeOffset));
+    if (restart_key.compare(key) <= 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  // low is now the index of the first restart point greater than the probe.
+  if (low == 0)
+    return false;
+  --low;
+
+  // Scan the keys after the restart point. The scan tracks the number of bytes
+  // that the probe shares with the previous key, which is known to be smaller
+  // than the probe. This avoids reconstructing the front-coded keys.
+  size_t matched_size = 0;
+  size_t offset = restart_offset(low);
+  size_t end_index = std::min(
+      (low + 1) * kRestartInterval, entry_count());
+  for (size_t index = low * kRestartInterval; index < end_index; ++index) {
+    const uint8_t* cell = data_ + offset;
+    size_t shared_size = LoadUint16(cell + kCellSharedSizeOffset);
+    size_t suffix_size = LoadUint16(cell + kCellSuffixSizeOffset);
+    size_t value_size = LoadUint16(cell + kCellValueSizeOffset);
+
+    // If the key shares fewer bytes with the previous key than the probe does,
+    // the key's first differing byte is greater than the probe's byte.
+    if (shared_size < matched_size)
+      return false;
+
+    // If the key shares more bytes with the previous key than the probe does,
+    // the key is smaller than the probe, and shares matched_size bytes with it.
+    if (shared_size == matched_size) {
+      const uint8_t* suffix = cell + kCellHeaderSize;
+      size_t probe_size = key.size() - matched_size;
+      size_t compare_size = std::min(suffix_size, probe_size);
+      size_t i = 0;
+      while (i < compare_size && suffix[i] == key_data[matched_size + i])
+        ++i;
+
+      if (i == compare_size) {
+        if (suffix_size == probe_size) {
+          *value = string_view(
+              reinterpret_cast<const char*>(suffix + suffix_size), value_size);
+          return true;
+        }
+        if (suffix_size > probe_size)
+          return false;
+      } else if (suffix[i] > key_data[matched_size + i]) {
+        return false;
+      }
+      matched_size += i;
+    }
+
+    offset += CellSize(suffix_size, value_size);
+  }
+  return false;
+}
+
+void LeafPage::FindRestartHeadRange(
+    uint32_t probe_head, size_t* begin, size_t* end) const noexcept {
+  const uint8_t* heads = data_ + kHeaderSize;
+  size_t count = restart_count();
+
+  // The key heads are sorted, so counting the heads that are smaller than the
+  // probe's head and the heads that are equal to it yields the range.
+  size_t less_count = 0, equal_count = 0;
+  size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  // The SIMD loads below read the heads in the CPU's byte order, which is how
+  // the default LoadUint32() reads integers.
+  //
+  // SIMD instructions only offer signed comparisons. Flipping the sign bit
+  // maps unsigned ordering onto signed ordering.
+  const int kSignBit = static_cast<int>(0x80000000U);
+#endif  // defined(__AVX2__) || defined(__SSE2__)
+
+#if defined(__AVX2__)
+  const __m256i sign_bits8 = _mm256_set1_epi32(kSignBit);
+  const __m256i probe8 = _mm256_xor_si256(
+      _mm256_set1_epi32(static_cast<int>(probe_head)), sign_bits8);
+  for (; i + 8 <= count; i += 8) {
+    __m256i heads8 = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(heads + i * 4)),
+        sign_bits8);
+    unsigned less_mask = static_cast<unsigned>(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(probe8, heads8))));
+    unsigned equal_mask = static_cast<unsigned>(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(probe8, heads8))));
+    less_count += MaskBitCount(less_mask);
+    equal_count += MaskBitCount(equal_mask);
+    if ((less_mask | equal_mask) != 0xFF) {
+      // Found a head greater than the probe's head.
+      *begin = less_count;
+      *end = less_count + equal_count;
+      return;
+    }
+  }
+#endif  // defined(__AVX2__)
+
+#if defined(__SSE2__)
+  const __m128i sign_bits4 = _mm_set1_epi32(kSignBit);
+  const __m128i probe4 = _mm_xor_si128(
+      _mm_set1_epi32(static_cast<int>(probe_head)), sign_bits4);
+  for (; i + 4 <= count; i += 4) {
+    __m128i heads4 = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(heads + i * 4)),
+        sign_bits4);
+    unsigned less_mask = static_cast<unsigned>(_mm_movemask_ps(
+        _mm_castsi128_ps(_mm_cmpgt_epi32(probe4, heads4))));
+    unsigned equal_mask = static_cast<unsigned>(_mm_movemask_ps(
+        _mm_castsi128_ps(_mm_cmpeq_epi32(probe4, heads4))));
+    less_count += MaskBitCount(less_mask);
+    equal_count += MaskBitCount(equal_mask);
+    if ((less_mask | equal_mask) != 0xF) {
+      *begin = less_count;
+      *end = less_count + equal_count;
+      return;
+    }
+  }
+#endif  // defined(__SSE2__)
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  // Scalar loop for the heads that do not fill up a SIMD register.
+  for (; i < count; ++i) {
+    uint32_t head = LoadUint32(heads + i * 4);
+    if (head > probe_head)
+      break;
+    if (head < probe_head)
+      ++less_count;
+    else
+      ++equal_count;
+  }
+  *begin = less_count;
+  *end = less_count + equal_count;
+#else  // defined(__AVX2__) || defined(__SSE2__)
+  // Portable fallback: two binary searches over the key heads.
+  UNUSED(i);
+  UNUSED(equal_count);
+  size_t low = 0, high = count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (LoadUint32(heads + middle * 4) < probe_head)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  less_count = low;
+  high = count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (LoadUint32(heads + middle * 4) <= probe_head)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  *begin = less_count;
+  *end = low;
+#endif  // defined(__AVX2__) || defined(__SSE2__)
+}
+
+LeafPage::Iterator::Iterator(const LeafPage& page, uint8_t* key_buffer) noexcept
+    : page_(page), key_buffer_(key_buffer), entry_count_(page.entry_count()) {
+  string_view prefix = page.key_prefix();
+  std::memcpy(key_buffer_, prefix.data(), prefix.size());
+  cell_offset_ = page.prefix_offset() + AlignSize(prefix.size());
+  if (Valid())
+    DecodeCell();
+}
+
+void LeafPage::Iterator::Next() noexcept {
+  DCHECK(Valid());
+  size_t value_size = value_.size();
+  size_t suffix_size = LoadUint16(
+      page_.data_ + cell_offset_ + kCellSuffixSizeOffset);
+  cell_offset_ += CellSize(suffix_size, value_size);
+  ++index_;
+  if (Valid())
+    DecodeCell();
+}
+
+void LeafPage::Iterator::DecodeCell() noexcept {
+  const uint8_t* cell = page_.data_ + cell_offset_;
+  size_t shared_size = LoadUint16(cell + kCellSharedSizeOffset);
+  size_t suffix_size = LoadUint16(cell + kCellSuffixSizeOffset);
+  size_t value_size = LoadUint16(cell + kCellValueSizeOffset);
+
+  // The previous key's suffix is still in the buffer, so only the bytes stored
+  // in the cell need to be copied.
+  size_t key_offset = LoadUint16(page_.data_ + kPrefixSizeOffset) + shared_size;
+  std::memcpy(key_buffer_ + key_offset, cell + kCellHeaderSize, suffix_size);
+  key_size_ = key_offset + suffix_size;
+  value_ = string_view(
+      reinterpret_cast<const char*>(cell + kCellHeaderSize + suffix_size),
+      value_size);
+}
+
+}  // namespace berrydb
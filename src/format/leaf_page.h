@@ -0,0 +1,237 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_FORMAT_LEAF_PAGE_H_
+#define BERRYDB_FORMAT_LEAF_PAGE_H_
+
+#include "berrydb/platform.h"
+
+namespace berrydb {
+
+/** Read-only view over the on-disk layout of a B-tree leaf page.
+ *
+ * Leaf pages use a slotted layout. Keys are stored in sorted order, and are
+ * compressed in two ways. First, the prefix shared by all the keys in the page
+ * is stored once, and truncated from every key. Second, the remaining key
+ * suffixes are front-coded: each key only stores the bytes that it does not
+ * share with the previous key.
+ *
+ * Front-coding requires decoding keys sequentially, so every
+ * kRestartInterval-th key (a restart point) is stored without front-coding.
+ * The page's slot array only points to the restart points, and lookups search
+ * the slot array before linearly scanning at most kRestartInterval keys.
+ *
+ * Next to the slot array, the page stores the first 4 bytes of each restart
+ * point's key suffix, as 32-bit integers whose most significant byte is the
+ * key's first byte (a.k.a. poor man's normalized keys). Comparing these
+ * integers gives the same ordering as comparing keys, except for ties. The
+ * integers are stored with StoreUint32(), like the page's other integers, so
+ * the SIMD comparisons can load them directly. Lookups compare the probe against many key heads at once
+ * using SIMD instructions, and only compare full keys when the heads tie.
+ *
+ * The on-disk layout is documented in leaf_page.cc. Pages are produced in one
+ * shot by Build(), which is consistent with the copy-on-write B-tree
+ * modification strategy.
+ */
+class LeafPage {
+ public:
+  /** Number of keys in a group that starts with a restart point. */
+  static constexpr size_t kRestartInterval = 16;
+
+  /** The largest page size supported by this layout.
+   *
+   * The in-page offsets are 16-bit integers. */
+  static constexpr size_t kMaxPageSize = 1 << 16;
+
+  /** Tag stored at the beginning of every leaf page. */
+  static constexpr uint16_t kPageTag = 0x664c;  // "Lf" on little-endian.
+
+  /** Lays out a sorted sequence of key/value pairs into a leaf page.
+   *
+   * The entries are consumed in order, and as many entries as possible are
+   * placed on the page. The entries that do not fit should be placed in other
+   * pages by the caller.
+   *
+   * @param  keys      the keys to be placed in the page; must be strictly
+   *                   increasing
+   * @param  values    the values associated with the keys
+   * @param  count     the number of entries in keys and values
+   * @param  page_size the size of the buffer receiving the page; must be at
+   *                   most kMaxPageSize
+   * @param  to        receives the page data; must be 8-byte-aligned
+   * @return           the number of entries stored in the page; can be zero if
+   *                   the first entry does not fit in an empty page
+   */
+  static size_t Build(
+      const string_view* keys, const string_view* values, size_t count,
+      size_t page_size, uint8_t* to);
+
+  /** Computes the page space needed to store key/value pairs.
+   *
+   * This is the size of the page built by Build(), minus any trailing unused
+   * bytes. The method is intended for sizing decisions, such as planning page
+   * splits, and for measuring the layout's density.
+   */
+  static size_t BuiltSize(
+      const string_view* keys, const string_view* values, size_t count);
+
+  /** Creates a view over a page's data.
+   *
+   * The page should have been checked using IsValid() if it comes from an
+   * untrusted source, such as a store's data file. */
+  inline LeafPage(const uint8_t* data, size_t page_size) noexcept
+      : data_(data), page_size_(page_size) {
+    DCHECK_EQ(reinterpret_cast<uintptr_t>(data) & 7, 0U);
+    DCHECK_LE(page_size, kMaxPageSize);
+  }
+
+  /** True if the page data is well-formed.
+   *
+   * This method checks all the offsets and sizes stored in the page, so the
+   * other methods can be safely used on valid pages. */
+  bool IsValid() const noexcept;
+
+  /** Number of key/value pairs stored in the page. */
+  inline size_t entry_count() const noexcept {
+    return LoadUint16(data_ + kEntryCountOffset);
+  }
+
+  /** The prefix shared by all the keys in the page. */
+  inline string_view key_prefix() const noexcept {
+    return string_view(
+        reinterpret_cast<const char*>(data_ + prefix_offset()),
+        LoadUint16(data_ + kPrefixSizeOffset));
+  }
+
+  /** Looks up a key in the page.
+   *
+   * @param  key   the key to be looked up
+   * @param  value if the key is found, receives a view into the page's buffer
+   *               storing the value associated with the key
+   * @return       true if the page contains the key
+   */
+  bool Find(string_view key, string_view* value) const noexcept;
+
+  /** Iterates over the entries in a page, in key order.
+   *
+   * The iterator reconstructs keys in a caller-supplied buffer, because
+   * front-coded keys are not stored contiguously in the page. */
+  class Iterator {
+   public:
+    /** Positions the iterator on the page's first entry.
+     *
+     * @param page       the page to iterate over; must outlive the iterator
+     * @param key_buffer receives the current key; must be at least as large
+     *                   as the page
+     */
+    Iterator(const LeafPage& page, uint8_t* key_buffer) noexcept;
+
+    /** False if the iterator moved past the last entry. */
+    inline bool Valid() const noexcept { return index_ < entry_count_; }
+
+    /** Moves to the next entry. */
+    void Next() noexcept;
+
+    /** The current entry's key. Points into the key buffer. */
+    inline string_view key() const noexcept {
+      DCHECK(Valid());
+      return string_view(reinterpret_cast<const char*>(key_buffer_), key_size_);
+    }
+
+    /** The current entry's value. Points into the page data. */
+    inline string_view value() const noexcept {
+      DCHECK(Valid());
+      return value_;
+    }
+
+   private:
+    /** Decodes the cell at cell_offset_ into key_buffer_ and value_. */
+    void DecodeCell() noexcept;
+
+    const LeafPage& page_;
+    uint8_t* const key_buffer_;
+    const size_t entry_count_;
+    size_t index_ = 0;
+    size_t cell_offset_;
+    size_t key_size_;
+    string_view value_;
+  };
+
+ private:
+  // Offsets of the fixed-size fields in the page header.
+  static constexpr size_t kTagOffset = 0;
+  static constexpr size_t kEntryCountOffset = 2;
+  static constexpr size_t kRestartCountOffset = 4;
+  static constexpr size_t kPrefixSizeOffset = 6;
+  static constexpr size_t kHeaderSize = 8;
+
+  // Offsets of the fixed-size fields in a cell header.
+  static constexpr size_t kCellSharedSizeOffset = 0;
+  static constexpr size_t kCellSuffixSizeOffset = 2;
+  static constexpr size_t kCellValueSizeOffset = 4;
+  static constexpr size_t kCellHeaderSize = 6;
+
+  /** The first 4 bytes of a key, read as a big-endian number.
+   *
+   * Keys shorter than 4 bytes are padded with zeros. If a < b, then
+   * KeyHead(a) <= KeyHead(b). */
+  static inline uint32_t KeyHead(const uint8_t* key, size_t size) noexcept {
+    uint32_t head = 0;
+    for (size_t i = 0; i < 4; ++i)
+      head = (head << 8) | ((i < size) ? key[i] : 0);
+    return head;
+  }
+
+  /** Rounds up a size so the next field is 2-byte-aligned. */
+  static inline size_t AlignSize(size_t size) noexcept {
+    return (size + 1) & ~static_cast<size_t>(1);
+  }
+
+  /** Page space used by a cell, including alignment padding. */
+  static inline size_t CellSize(
+      size_t suffix_size, size_t value_size) noexcept {
+    return AlignSize(kCellHeaderSize + suffix_size + value_size);
+  }
+
+  /** Narrows down the restart points that may precede a key.
+   *
+   * @param  probe_head the KeyHead() of the key's suffix
+   * @param  begin      receives the index of the first restart point whose
+   *                    key head is not smaller than probe_head
+   * @param  end        receives the index of the first restart point whose
+   *                    key head is greater than probe_head
+   */
+  void FindRestartHeadRange(
+      uint32_t probe_head, size_t* begin, size_t* end) const noexcept;
+
+  /** Page space needed to lay out entries with the given key prefix size. */
+  static size_t LayoutSize(
+      const string_view* keys, const string_view* values, size_t count,
+      size_t prefix_size) noexcept;
+
+  /** Number of restart points in the page's slot array. */
+  inline size_t restart_count() const noexcept {
+    return LoadUint16(data_ + kRestartCountOffset);
+  }
+  /** Page offset of the cell at a restart point. */
+  inline size_t restart_offset(size_t restart_index) const noexcept {
+    return LoadUint16(
+        data_ + kHeaderSize + restart_count() * 4 + restart_index * 2);
+  }
+  /** The first 4 bytes of a restart point's key suffix. See KeyHead(). */
+  inline uint32_t restart_head(size_t restart_index) const noexcept {
+    return LoadUint32(data_ + kHeaderSize + restart_index * 4);
+  }
+  /** Page offset of the shared key prefix. */
+  inline size_t prefix_offset() const noexcept {
+    return kHeaderSize + restart_count() * 6;
+  }
+
+  const uint8_t* const data_;
+  const size_t page_size_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_FORMAT_LEAF_PAGE_H_
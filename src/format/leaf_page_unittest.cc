@@ -0,0 +1,314 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./leaf_page.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+class LeafPageTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::memset(page_, 0xCD, sizeof(page_));
+  }
+
+  /** Views over the strings in keys_ and values_, used as Build() input. */
+  void UpdateViews() {
+    key_views_.clear();
+    value_views_.clear();
+    for (const std::string& key : keys_)
+      key_views_.push_back(string_view(key.data(), key.size()));
+    for (const std::string& value : values_)
+      value_views_.push_back(string_view(value.data(), value.size()));
+  }
+
+  /** Keys shaped like rows in a multi-tenant table. */
+  std::string RowKey(size_t tenant, const char* table, size_t row) {
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "tenant/%08zu/table/%s/row/%010zu",
+                  tenant, table, row);
+    return std::string(buffer);
+  }
+
+  static constexpr size_t kPageSize = 4096;
+
+  alignas(8) uint8_t page_[kPageSize];
+  alignas(8) uint8_t key_buffer_[kPageSize];
+  std::vector<std::string> keys_, values_;
+  std::vector<string_view> key_views_, value_views_;
+  std::mt19937 rnd_;
+};
+
+constexpr size_t LeafPageTest::kPageSize;
+
+TEST_F(LeafPageTest, Empty) {
+  EXPECT_EQ(0U, LeafPage::Build(nullptr, nullptr, 0, kPageSize, page_));
+
+  LeafPage page(page_, kPageSize);
+  EXPECT_TRUE(page.IsValid());
+  EXPECT_EQ(0U, page.entry_count());
+  EXPECT_EQ(0U, page.key_prefix().size());
+
+  string_view value;
+  EXPECT_FALSE(page.Find("", &value));
+  EXPECT_FALSE(page.Find("key", &value));
+
+  LeafPage::Iterator it(page, key_buffer_);
+  EXPECT_FALSE(it.Valid());
+}
+
+TEST_F(LeafPageTest, SingleEntry) {
+  string_view key("key"), value("value");
+  ASSERT_EQ(1U, LeafPage::Build(&key, &value, 1, kPageSize, page_));
+
+  LeafPage page(page_, kPageSize);
+  EXPECT_TRUE(page.IsValid());
+  EXPECT_EQ(1U, page.entry_count());
+  EXPECT_EQ(string_view("key"), page.key_prefix());
+
+  string_view found_value;
+  ASSERT_TRUE(page.Find("key", &found_value));
+  EXPECT_EQ(string_view("value"), found_value);
+  EXPECT_FALSE(page.Find("", &found_value));
+  EXPECT_FALSE(page.Find("ke", &found_value));
+  EXPECT_FALSE(page.Find("kex", &found_value));
+  EXPECT_FALSE(page.Find("key0", &found_value));
+  EXPECT_FALSE(page.Find("kez", &found_value));
+}
+
+TEST_F(LeafPageTest, EmptyKeysAndValues) {
+  keys_ = {"", "a", "ab", "abc", "b"};
+  values_ = {"empty", "", "ab-value", "", "b-value"};
+  UpdateViews();
+  ASSERT_EQ(5U, LeafPage::Build(
+      key_views_.data(), value_views_.data(), 5, kPageSize, page_));
+
+  LeafPage page(page_, kPageSize);
+  EXPECT_TRUE(page.IsValid());
+  EXPECT_EQ(0U, page.key_prefix().size());
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    string_view value;
+    ASSERT_TRUE(page.Find(key_views_[i], &value)) << keys_[i];
+    EXPECT_EQ(value_views_[i], value);
+  }
+  string_view value;
+  EXPECT_FALSE(page.Find("aa", &value));
+  EXPECT_FALSE(page.Find("abcd", &value));
+  EXPECT_FALSE(page.Find("c", &value));
+}
+
+TEST_F(LeafPageTest, FindAndIterate) {
+  std::set<std::string> key_set;
+  while (key_set.size() < 100) {
+    key_set.insert(RowKey(
+        rnd_() % 3, (rnd_() % 2) ? "orders" : "items", rnd_() % 1000));
+  }
+  for (const std::string& key : key_set) {
+    keys_.push_back(key);
+    values_.push_back(std::to_string(rnd_()));
+  }
+  UpdateViews();
+  ASSERT_EQ(keys_.size(), LeafPage::Build(
+      key_views_.data(), value_views_.data(), keys_.size(), kPageSize, page_));
+
+  LeafPage page(page_, kPageSize);
+  ASSERT_TRUE(page.IsValid());
+  EXPECT_EQ(keys_.size(), page.entry_count());
+  EXPECT_EQ(string_view("tenant/0000000"), page.key_prefix());
+
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    string_view value;
+    ASSERT_TRUE(page.Find(key_views_[i], &value)) << keys_[i];
+    EXPECT_EQ(value_views_[i], value);
+
+    // Keys right before and right after an existing key.
+    std::string missing_key = keys_[i];
+    missing_key.push_back('\0');
+    EXPECT_EQ(key_set.count(missing_key), page.Find(
+        string_view(missing_key.data(), missing_key.size()), &value));
+    missing_key.pop_back();
+    missing_key.pop_back();
+    EXPECT_EQ(key_set.count(missing_key), page.Find(
+        string_view(missing_key.data(), missing_key.size()), &value));
+  }
+  for (size_t i = 0; i < 1000; ++i) {
+    std::string key = RowKey(rnd_() % 4, "orders", rnd_() % 1000);
+    string_view value;
+    EXPECT_EQ(key_set.count(key),
+              page.Find(string_view(key.data(), key.size()), &value));
+  }
+
+  size_t index = 0;
+  for (LeafPage::Iterator it(page, key_buffer_); it.Valid(); it.Next()) {
+    ASSERT_LT(index, keys_.size());
+    EXPECT_EQ(key_views_[index], it.key());
+    EXPECT_EQ(value_views_[index], it.value());
+    ++index;
+  }
+  EXPECT_EQ(keys_.size(), index);
+}
+
+TEST_F(LeafPageTest, PartialBuild) {
+  for (size_t i = 0; i < 1000; ++i) {
+    keys_.push_back(RowKey(42, "orders", i * 7));
+    values_.push_back(std::string(32, static_cast<char>('a' + i % 26)));
+  }
+  UpdateViews();
+
+  size_t built = LeafPage::Build(
+      key_views_.data(), value_views_.data(), keys_.size(), kPageSize, page_);
+  ASSERT_LT(0U, built);
+  ASSERT_GT(keys_.size(), built);
+  EXPECT_LE(LeafPage::BuiltSize(key_views_.data(), value_views_.data(), built),
+            kPageSize);
+  EXPECT_GT(LeafPage::BuiltSize(
+                key_views_.data(), value_views_.data(), built + 1),
+            kPageSize);
+
+  LeafPage page(page_, kPageSize);
+  ASSERT_TRUE(page.IsValid());
+  EXPECT_EQ(built, page.entry_count());
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    string_view value;
+    EXPECT_EQ(i < built, page.Find(key_views_[i], &value)) << keys_[i];
+  }
+}
+
+TEST_F(LeafPageTest, EntryLargerThanPage) {
+  std::string big_value(kPageSize, 'x');
+  string_view key("key"), value(big_value.data(), big_value.size());
+  EXPECT_EQ(0U, LeafPage::Build(&key, &value, 1, kPageSize, page_));
+
+  LeafPage page(page_, kPageSize);
+  EXPECT_TRUE(page.IsValid());
+  EXPECT_EQ(0U, page.entry_count());
+}
+
+TEST_F(LeafPageTest, IsValidCatchesCorruption) {
+  for (size_t i = 0; i < 40; ++i) {
+    keys_.push_back(RowKey(1, "orders", i));
+    values_.push_back("value");
+  }
+  UpdateViews();
+  ASSERT_EQ(keys_.size(), LeafPage::Build(
+      key_views_.data(), value_views_.data(), keys_.size(), kPageSize, page_));
+  ASSERT_TRUE(LeafPage(page_, kPageSize).IsValid());
+
+  // A page that is too small to hold its cells.
+  EXPECT_FALSE(LeafPage(page_, 64).IsValid());
+
+  // The page header fields are in the first 8 bytes.
+  for (size_t i = 0; i < 8; ++i) {
+    for (size_t j = 0; j < 8; ++j) {
+      uint8_t mask = 1 << j;
+      page_[i] ^= mask;
+      EXPECT_FALSE(LeafPage(page_, kPageSize).IsValid()) << i << " " << j;
+      page_[i] ^= mask;
+      ASSERT_TRUE(LeafPage(page_, kPageSize).IsValid());
+    }
+  }
+
+  // The 40 entries use 3 restart points. The key heads follow the header, and
+  // the restart offsets follow the key heads.
+  for (size_t i = 8; i < 8 + 3 * 4; ++i) {
+    page_[i] ^= 0x01;
+    EXPECT_FALSE(LeafPage(page_, kPageSize).IsValid()) << i;
+    page_[i] ^= 0x01;
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    page_[8 + 3 * 4 + i * 2] ^= 0x02;
+    EXPECT_FALSE(LeafPage(page_, kPageSize).IsValid()) << i;
+    page_[8 + 3 * 4 + i * 2] ^= 0x02;
+  }
+  ASSERT_TRUE(LeafPage(page_, kPageSize).IsValid());
+}
+
+// Restart points whose keys start with the same 4 bytes have tied key heads,
+// so lookups must fall back to comparing full keys.
+TEST_F(LeafPageTest, TiedKeyHeads) {
+  const char* const kHeads[] = {"", "\x01", "aaaa", "aaab", "\xff\xff\xff\xff"};
+  std::set<std::string> key_set;
+  for (const char* head : kHeads) {
+    for (size_t i = 0; i < 50; ++i) {
+      std::string key(head);
+      for (size_t j = rnd_() % 6; j > 0; --j)
+        key.push_back(static_cast<char>(rnd_() % 4));
+      key_set.insert(key);
+    }
+  }
+  for (const std::string& key : key_set) {
+    keys_.push_back(key);
+    values_.push_back(std::to_string(keys_.size()));
+  }
+  UpdateViews();
+  ASSERT_EQ(keys_.size(), LeafPage::Build(
+      key_views_.data(), value_views_.data(), keys_.size(), kPageSize, page_));
+
+  LeafPage page(page_, kPageSize);
+  ASSERT_TRUE(page.IsValid());
+  ASSERT_EQ(0U, page.key_prefix().size());
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    string_view value;
+    ASSERT_TRUE(page.Find(key_views_[i], &value)) << i;
+    EXPECT_EQ(value_views_[i], value);
+  }
+
+  for (size_t i = 0; i < 2000; ++i) {
+    std::string key(kHeads[rnd_() % 5]);
+    for (size_t j = rnd_() % 7; j > 0; --j)
+      key.push_back(static_cast<char>(rnd_() % 5));
+    string_view value;
+    EXPECT_EQ(key_set.count(key),
+              page.Find(string_view(key.data(), key.size()), &value));
+  }
+}
+
+// Compares the layout's density with a slotted layout that stores each key in
+// full. The key set models a multi-tenant table, where all the keys share a
+// long prefix, and consecutive keys share most of their bytes.
+TEST_F(LeafPageTest, DensityOnTenantTableKeys) {
+  for (size_t i = 0; i < 20000; ++i) {
+    keys_.push_back(RowKey(1337, "customer_orders", i * 3 + rnd_() % 3));
+    values_.push_back(std::string(16, static_cast<char>(rnd_())));
+  }
+  UpdateViews();
+
+  size_t page_count = 0;
+  size_t next_entry = 0;
+  while (next_entry < keys_.size()) {
+    size_t built = LeafPage::Build(
+        key_views_.data() + next_entry, value_views_.data() + next_entry,
+        keys_.size() - next_entry, kPageSize, page_);
+    ASSERT_LT(0U, built);
+    next_entry += built;
+    ++page_count;
+  }
+
+  // An uncompressed slotted page uses a 2-byte slot and a 4-byte cell header
+  // for each entry, in addition to the full key and value.
+  size_t uncompressed_page_count = 0;
+  size_t page_used = kPageSize;
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    size_t entry_size = 2 + 4 + keys_[i].size() + values_[i].size();
+    if (page_used + entry_size > kPageSize) {
+      ++uncompressed_page_count;
+      page_used = 8;
+    }
+    page_used += entry_size;
+  }
+
+  EXPECT_LE(page_count * 2, uncompressed_page_count)
+      << "prefix-compressed pages: " << page_count
+      << " uncompressed pages: " << uncompressed_page_count;
+}
+
+}  // namespace berrydb
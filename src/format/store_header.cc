@@ -5,6 +5,7 @@
 #include "./store_header.h"
 
 #include "berrydb/platform.h"
+#include "../util/crc32c.h"
 
 namespace berrydb {
 
@@ -16,7 +17,13 @@ namespace berrydb {
 // 24: 8-byte number of pages in the store data file
 // 32: 8-byte page index of the head of the free page list
 // 40: 1-byte page shift (log2 of the page size)
-// 41: 7-byte padding - reserved for future expansion, must be set to zero
+// 41: 1-byte flags - bit 0 is the clean shutdown flag, bit 1 is set if pages
+//     are compressed, the others must be zero
+// 42: 6-byte padding - reserved for future expansion, must be set to zero
+// 48: 8-byte page index of the root catalog's root page
+// 56: 8-byte generation number
+// 64: 4-byte CRC32C of bytes 0-63
+// 68: 4-byte padding - reserved for future expansion, must be set to zero
 //
 // The format version number is a mechanism for future expansion. The number
 // will remain at 0 until the format is stabilized. At that point, the version
@@ -27,7 +34,11 @@ StoreHeader::StoreHeader(size_t page_shift, size_t page_count)
 #if DCHECK_IS_ON()
     , free_list_head_page(kInvalidFreeListHeadPage)
 #endif  // DCHECK_IS_ON()
+    , root_page(0)
     , page_shift(page_shift)
+    , generation(0)
+    , clean_shutdown(false)
+    , compress_pages(false)
     {
 }
 
@@ -42,9 +53,22 @@ void StoreHeader::Serialize(uint8_t* to) {
   StoreUint64(0, to + 40);
   DCHECK_LT(page_shift, 32U);
   to[40] = static_cast<uint8_t>(page_shift);
+  to[41] = (clean_shutdown ? 1 : 0) | (compress_pages ? 2 : 0);
+
+  StoreUint64(root_page, to + 48);
+  StoreUint64(generation, to + 56);
+
+  // This is guaranteed to set all the bytes 68..71 to 0.
+  StoreUint64(0, to + 64);
+  StoreUint32(Crc32c(to, 64), to + 64);
 }
 
 bool StoreHeader::Deserialize(const uint8_t *from) {
+  // The checksum catches torn writes and media errors. The field checks below
+  // catch headers written by buggy code.
+  if (LoadUint32(from + 64) != Crc32c(from, 64))
+    return false;
+
   uint64_t global_magic = LoadUint64(from);
   if (global_magic != kGlobalMagic)
     return false;
@@ -85,6 +109,21 @@ bool StoreHeader::Deserialize(const uint8_t *from) {
     return false;
   }
 
+  uint8_t flags = from[41];
+  if ((flags & ~3) != 0)
+    return false;
+  clean_shutdown = (flags & 1) != 0;
+  compress_pages = (flags & 2) != 0;
+
+  number = LoadUint64(from + 48);
+  root_page = static_cast<size_t>(number);
+  if (root_page != number || root_page == 0 || root_page >= page_count) {
+    // The header page cannot be the root page. This should only happen due to
+    // data corruption.
+    return false;
+  }
+
+  generation = LoadUint64(from + 56);
   return true;
 }
 
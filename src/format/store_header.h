@@ -14,6 +14,12 @@ namespace berrydb {
  * The in-memory header data layout is optimized for computation. The methods
  * Serialize() and Deserialize() translate between the in-memory layout and the
  * on-disk layout.
+ *
+ * The store's header page has two header slots, which are updated in turns.
+ * Each update bumps the header's generation number, and writes the header into
+ * the slot that did not hold the previous generation, so a torn write cannot
+ * damage the last valid header. Each slot is protected by a checksum. Stores
+ * are opened using the valid slot with the highest generation number.
  */
 struct StoreHeader {
   /** Used when reading header data from a file.
@@ -25,6 +31,21 @@ struct StoreHeader {
   /** Used by the StoreImpl constructor. */
   StoreHeader(size_t page_shift, size_t page_count);
 
+  /** Offset of the header slot used by a generation, in the header page.
+   *
+   * The slots are half a page apart, so they are in different disk sectors for
+   * all reasonable page sizes.
+   *
+   * @param  generation the header's generation number
+   * @param  page_shift base-2 log of the store's page size
+   * @return            the offset of the slot in the store's header page
+   */
+  static inline size_t SlotOffset(
+      uint64_t generation, size_t page_shift) noexcept {
+    DCHECK_LE(kSerializedSize * 2, static_cast<size_t>(1) << page_shift);
+    return static_cast<size_t>(generation & 1) << (page_shift - 1);
+  }
+
   /** Stores the header data into a buffer using the on-disk layout.
    *
    * @param  to the buffer that receives the on-disk layout header data
@@ -35,7 +56,8 @@ struct StoreHeader {
    *
    * The method replaces this instance's state. If the read succeeds, the
    * instance will reflect data in the header. If the read fails, the instance's
-   * state is undefined.
+   * state is undefined. Reads fail if the header's checksum does not match its
+   * data, which is the case for torn writes.
    *
    * @param  from the buffer that stores the on-disk layout header data; the
    *              data should come from a previous Serialize() call
@@ -53,16 +75,40 @@ struct StoreHeader {
   /** 0-based index of the page at the head of the free list. */
   size_t free_list_head_page;
 
+  /** 0-based index of the root catalog's root page.
+   *
+   * Transactions that commit using shadow paging never overwrite live pages.
+   * Instead, they write the modified pages to new locations, and switch the
+   * store to the new pages by updating this field. */
+  size_t root_page;
+
   /** Base-2 log of the store's page size.
    *
    * The store's page size can be computed as 1 << page_shift, or
    * 2 ** page_shift. */
   size_t page_shift;
 
+  /** Incremented every time the header is written to the store's data file.
+   *
+   * When opening a store, the header slot with the highest generation wins. */
+  uint64_t generation;
+
+  /** True if the store was closed cleanly.
+   *
+   * The flag is cleared on disk when a store is opened, and set when the store
+   * is closed, after all its pages were written. Stores that were closed
+   * cleanly do not need recovery. */
+  bool clean_shutdown;
+
+  /** True if the store's pages are compressed on disk.
+   *
+   * This is decided when the store is created, and cannot be changed. */
+  bool compress_pages;
+
   /** The size of a serialized store header, in bytes.
    *
    * This is a constant because the store header only has fixed-width fields. */
-  static constexpr size_t kSerializedSize = 48;
+  static constexpr size_t kSerializedSize = 72;
 
   /** Magic number used to tag all BerryDB files.
    *
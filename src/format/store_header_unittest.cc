@@ -8,6 +8,9 @@
 
 #include "gtest/gtest.h"
 
+#include "berrydb/platform.h"
+#include "../util/crc32c.h"
+
 namespace berrydb {
 
 TEST(StoreHeaderTest, SerializeDeserialize) {
@@ -18,6 +21,10 @@ TEST(StoreHeaderTest, SerializeDeserialize) {
   header.page_shift = 12;
   header.page_count = 0xc0decdef;
   header.free_list_head_page = 0x12345678;
+  header.root_page = 0x9abcdef0;
+  header.generation = 0x0123456789abcdef;
+  header.clean_shutdown = true;
+  header.compress_pages = true;
   header.Serialize(buffer);
 
   for (size_t i = StoreHeader::kSerializedSize; i < sizeof(buffer); ++i)
@@ -28,6 +35,17 @@ TEST(StoreHeaderTest, SerializeDeserialize) {
   EXPECT_EQ(header.page_shift, header2.page_shift);
   EXPECT_EQ(header.page_count, header2.page_count);
   EXPECT_EQ(header.free_list_head_page, header2.free_list_head_page);
+  EXPECT_EQ(header.root_page, header2.root_page);
+  EXPECT_EQ(header.generation, header2.generation);
+  EXPECT_EQ(header.clean_shutdown, header2.clean_shutdown);
+  EXPECT_EQ(header.compress_pages, header2.compress_pages);
+
+  header.clean_shutdown = false;
+  header.compress_pages = false;
+  header.Serialize(buffer);
+  EXPECT_EQ(true, header2.Deserialize(buffer));
+  EXPECT_EQ(false, header2.clean_shutdown);
+  EXPECT_EQ(false, header2.compress_pages);
 }
 
 TEST(StoreHeaderTest, HeaderErrors) {
@@ -36,22 +54,67 @@ TEST(StoreHeaderTest, HeaderErrors) {
   header.page_shift = 12;
   header.free_list_head_page = 0x12345678;
   header.page_count = 0xc0decdef;
+  header.root_page = 0x9abcdef0;
+  header.generation = 42;
+  header.clean_shutdown = false;
+  header.compress_pages = false;
   header.Serialize(buffer);
 
   StoreHeader header2;
   ASSERT_EQ(true, header2.Deserialize(buffer));
 
+  // The checksum covers all the header fields, so any bit flip there should
+  // result in a de-serialization error. This catches torn writes.
+  for (size_t i = 0; i < 68; ++i) {
+    for (size_t j = 0; j < 8; ++j) {
+      uint8_t mask = 1 << j;
+      buffer[i] ^= mask;
+      EXPECT_EQ(false, header2.Deserialize(buffer)) << i << " " << j;
+      buffer[i] ^= mask;
+    }
+  }
+  ASSERT_EQ(true, header2.Deserialize(buffer));
+
   // The first 24 bytes (including the version number) are effectively a fixed
-  // header. Any change there should result in a de-serialization error.
+  // header. Any change there should result in a de-serialization error, even
+  // if the checksum is updated to match.
   for (size_t i = 0; i < 24; ++i) {
     for (size_t j = 0; j < 8; ++j) {
       uint8_t mask = 1 << j;
       buffer[i] ^= mask;
+      StoreUint32(Crc32c(buffer, 64), buffer + 64);
       EXPECT_EQ(false, header2.Deserialize(buffer));
       buffer[i] ^= mask;
+      StoreUint32(Crc32c(buffer, 64), buffer + 64);
       ASSERT_EQ(true, header2.Deserialize(buffer));
     }
   }
+
+  // Unknown flags are rejected.
+  buffer[41] |= 4;
+  StoreUint32(Crc32c(buffer, 64), buffer + 64);
+  EXPECT_EQ(false, header2.Deserialize(buffer));
+  buffer[41] &= ~4;
+  StoreUint32(Crc32c(buffer, 64), buffer + 64);
+  ASSERT_EQ(true, header2.Deserialize(buffer));
+
+  // The root page must be a page in the store, other than the header page.
+  header.root_page = 0;
+  header.Serialize(buffer);
+  EXPECT_EQ(false, header2.Deserialize(buffer));
+  header.root_page = header.page_count;
+  header.Serialize(buffer);
+  EXPECT_EQ(false, header2.Deserialize(buffer));
+  header.root_page = header.page_count - 1;
+  header.Serialize(buffer);
+  EXPECT_EQ(true, header2.Deserialize(buffer));
+}
+
+TEST(StoreHeaderTest, SlotOffset) {
+  EXPECT_EQ(0U, StoreHeader::SlotOffset(0, 12));
+  EXPECT_EQ(2048U, StoreHeader::SlotOffset(1, 12));
+  EXPECT_EQ(0U, StoreHeader::SlotOffset(2, 12));
+  EXPECT_EQ(16384U, StoreHeader::SlotOffset(3, 15));
 }
 
 }  // namespace berrydb
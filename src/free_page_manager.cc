@@ -0,0 +1,263 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./free_page_manager.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "berrydb/status.h"
+#include "./page_pool.h"
+#include "./store_impl.h"
+
+namespace berrydb {
+
+// Free list pages have the following format:
+//
+//  0: 8-byte page ID of the next free list page, 0 for the last page
+//  8: 8-byte number of entries stored in this page
+// 16: 8-byte entries, each storing the page ID of a free page
+//
+// Page 0 holds the store header, so it can never be on the free list. A page
+// filled with zeros is an empty free list page, which is what
+// StoreImpl::Bootstrap() writes.
+
+namespace {
+
+constexpr size_t kNextPageOffset = 0;
+constexpr size_t kEntryCountOffset = 8;
+constexpr size_t kEntriesOffset = 16;
+
+}  // anonymous namespace
+
+FreePageManager::FreePageManager(StoreImpl* store) noexcept : store_(store) {
+  DCHECK(store != nullptr);
+}
+
+Status FreePageManager::AllocPage(size_t* page_id) {
+  DCHECK(page_id != nullptr);
+
+  PagePool* page_pool = store_->page_pool();
+  StoreHeader* header = store_->header();
+  Page* head_page;
+  Status status = page_pool->StorePage(
+      store_, header->free_list_head_page, PagePool::kFetchPageData,
+      &head_page);
+  if (status != Status::kSuccess)
+    return status;
+  // Every page allocation and release goes through the list's head page.
+  head_page->set_priority(PagePriority::kInner);
+
+  uint8_t* head_data = head_page->data();
+  size_t page_size = page_pool->page_size();
+  uint64_t entry_count = LoadUint64(head_data + kEntryCountOffset);
+  if (entry_count > (store_->usable_page_size() - kEntriesOffset) / 8) {
+    page_pool->UnpinStorePage(head_page);
+    return Status::kDataCorrupted;
+  }
+
+  if (entry_count != 0) {
+    --entry_count;
+    uint64_t free_page_id = LoadUint64(
+        head_data + kEntriesOffset + entry_count * 8);
+    if (!store_->IsDataPage(free_page_id)) {
+      page_pool->UnpinStorePage(head_page);
+      return Status::kDataCorrupted;
+    }
+
+    // Mapped pages are read-only until they are marked dirty, so the data
+    // pointer must be obtained again.
+    head_page->MarkDirty();
+    head_data = head_page->data();
+    PageModified(head_page->page_id());
+    StoreUint64(entry_count, head_data + kEntryCountOffset);
+    page_pool->UnpinStorePage(head_page);
+    *page_id = static_cast<size_t>(free_page_id);
+    return Status::kSuccess;
+  }
+
+  uint64_t next_page_id = LoadUint64(head_data + kNextPageOffset);
+  if (next_page_id != 0) {
+    if (!store_->IsDataPage(next_page_id)) {
+      page_pool->UnpinStorePage(head_page);
+      return Status::kDataCorrupted;
+    }
+
+    // The second page's entries move into the head page, and the second page
+    // is handed out.
+    Page* next_page;
+    status = page_pool->StorePage(
+        store_, static_cast<size_t>(next_page_id), PagePool::kFetchPageData,
+        &next_page);
+    if (status != Status::kSuccess) {
+      page_pool->UnpinStorePage(head_page);
+      return status;
+    }
+    head_page->MarkDirty();
+    head_data = head_page->data();
+    PageModified(head_page->page_id());
+    std::memcpy(head_data, next_page->data(), page_size);
+    page_pool->UnpinStorePage(next_page);
+    // The handed out page's entries live in the head page now.
+    dirty_pages_.erase(
+        std::remove(dirty_pages_.begin(), dirty_pages_.end(), next_page_id),
+        dirty_pages_.end());
+    page_pool->UnpinStorePage(head_page);
+    *page_id = static_cast<size_t>(next_page_id);
+    return Status::kSuccess;
+  }
+  page_pool->UnpinStorePage(head_page);
+
+  // The free list is empty, so the data file must grow.
+  ++header->page_count;
+  status = store_->UpdateHeaderPage();
+  if (status != Status::kSuccess) {
+    --header->page_count;
+    return status;
+  }
+  *page_id = header->page_count - 1;
+  return Status::kSuccess;
+}
+
+Status FreePageManager::FreePage(size_t page_id) {
+  DCHECK(store_->IsDataPage(page_id));
+
+  PagePool* page_pool = store_->page_pool();
+  Page* head_page;
+  Status status = page_pool->StorePage(
+      store_, store_->header()->free_list_head_page, PagePool::kFetchPageData,
+      &head_page);
+  if (status != Status::kSuccess)
+    return status;
+  // Every page allocation and release goes through the list's head page.
+  head_page->set_priority(PagePriority::kInner);
+
+  uint8_t* head_data = head_page->data();
+  size_t page_size = page_pool->page_size();
+  uint64_t entry_count = LoadUint64(head_data + kEntryCountOffset);
+  size_t page_capacity = (store_->usable_page_size() - kEntriesOffset) / 8;
+  if (entry_count > page_capacity) {
+    page_pool->UnpinStorePage(head_page);
+    return Status::kDataCorrupted;
+  }
+
+  if (entry_count < page_capacity) {
+    // Mapped pages are read-only until they are marked dirty, so the data
+    // pointer must be obtained again.
+    head_page->MarkDirty();
+    head_data = head_page->data();
+    PageModified(head_page->page_id());
+    StoreUint64(page_id, head_data + kEntriesOffset + entry_count * 8);
+    StoreUint64(entry_count + 1, head_data + kEntryCountOffset);
+    page_pool->UnpinStorePage(head_page);
+    return Status::kSuccess;
+  }
+
+  // The head page is full. The freed page receives the head page's entries,
+  // and becomes the second page in the list.
+  Page* freed_page;
+  status = page_pool->StorePage(
+      store_, page_id, PagePool::kIgnorePageData, &freed_page);
+  if (status != Status::kSuccess) {
+    page_pool->UnpinStorePage(head_page);
+    return status;
+  }
+  freed_page->MarkDirty();
+  PageModified(page_id);
+  std::memcpy(freed_page->data(), head_data, page_size);
+  page_pool->UnpinStorePage(freed_page);
+
+  head_page->MarkDirty();
+  head_data = head_page->data();
+  PageModified(head_page->page_id());
+  StoreUint64(page_id, head_data + kNextPageOffset);
+  StoreUint64(0, head_data + kEntryCountOffset);
+  page_pool->UnpinStorePage(head_page);
+  return Status::kSuccess;
+}
+
+Status FreePageManager::Recover() {
+  PagePool* page_pool = store_->page_pool();
+  size_t page_capacity = (store_->usable_page_size() - kEntriesOffset) / 8;
+
+  // The previous page in the list stays pinned, so it can be cut off from a
+  // damaged page. The walk is bounded by the page count to break cycles.
+  Page* previous_page = nullptr;
+  size_t page_id = store_->header()->free_list_head_page;
+  size_t max_page_count = store_->header()->page_count;
+  while (page_id != 0) {
+    Page* page;
+    Status status = page_pool->StorePage(
+        store_, page_id, PagePool::kFetchPageData, &page);
+    if (status != Status::kSuccess && status != Status::kDataCorrupted) {
+      if (previous_page != nullptr)
+        page_pool->UnpinStorePage(previous_page);
+      return status;
+    }
+
+    bool is_damaged = (status == Status::kDataCorrupted) ||
+        max_page_count == 0;
+    uint64_t next_page_id = 0;
+    if (!is_damaged) {
+      --max_page_count;
+      const uint8_t* data = page->data();
+      uint64_t entry_count = LoadUint64(data + kEntryCountOffset);
+      next_page_id = LoadUint64(data + kNextPageOffset);
+      is_damaged = entry_count > page_capacity ||
+          (next_page_id != 0 && !store_->IsDataPage(next_page_id));
+      for (size_t i = 0; !is_damaged && i < entry_count; ++i) {
+        is_damaged = !store_->IsDataPage(
+            LoadUint64(data + kEntriesOffset + i * 8));
+      }
+      if (is_damaged)
+        page_pool->UnpinStorePage(page);
+    }
+
+    if (is_damaged) {
+      // A damaged head page is rewritten as an empty free list page.
+      bool reset_head_page = (previous_page == nullptr);
+      if (reset_head_page) {
+        status = page_pool->StorePage(
+            store_, page_id, PagePool::kIgnorePageData, &previous_page);
+        if (status != Status::kSuccess)
+          return status;
+      }
+      previous_page->MarkDirty();
+      PageModified(previous_page->page_id());
+      if (reset_head_page)
+        std::memset(previous_page->data(), 0, page_pool->page_size());
+      StoreUint64(0, previous_page->data() + kNextPageOffset);
+      page_pool->UnpinStorePage(previous_page);
+      return Status::kSuccess;
+    }
+
+    if (previous_page != nullptr)
+      page_pool->UnpinStorePage(previous_page);
+    previous_page = page;
+    page_id = static_cast<size_t>(next_page_id);
+  }
+
+  if (previous_page != nullptr)
+    page_pool->UnpinStorePage(previous_page);
+  return Status::kSuccess;
+}
+
+Status FreePageManager::WriteDirtyPages() {
+  Status status = store_->page_pool()->WriteBackStorePages(
+      store_, dirty_pages_.data(), dirty_pages_.size());
+  if (status != Status::kSuccess)
+    return status;
+  dirty_pages_.clear();
+  return Status::kSuccess;
+}
+
+void FreePageManager::PageModified(size_t page_id) {
+  // The list is short, as most modifications hit the head page.
+  if (std::find(dirty_pages_.begin(), dirty_pages_.end(), page_id) ==
+      dirty_pages_.end()) {
+    dirty_pages_.push_back(page_id);
+  }
+}
+
+}  // namespace berrydb
@@ -2,8 +2,18 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-#ifndef BERRYDB_FREE_PAGE_MANAGER_H
-#define BERRYDB_FREE_PAGE_MANAGER_H
+#ifndef BERRYDB_FREE_PAGE_MANAGER_H_
+#define BERRYDB_FREE_PAGE_MANAGER_H_
+
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class StoreImpl;
+enum class Status : int;
 
 /** Tracks the free pages in a store's data file.
  *
@@ -13,9 +23,73 @@
  * of pages. Instead, the page IDs for free pages are stored in a list, so they
  * can be reused. The free page list entries are stored in pages that are
  * exclusively allocated for this purpose.
+ *
+ * The free list's head page is always the page referenced by the store header,
+ * so the header only changes when the data file grows. When the head page
+ * fills up, its entries are moved into the page being freed, which becomes the
+ * second page in the list. Conversely, when the head page is empty, the second
+ * page's entries are moved back into the head page, and the second page is
+ * handed out.
  */
 class FreePageManager {
+ public:
+  /** Sets up the free page manager for a store.
+   *
+   * The manager does not do any I/O until it is used. */
+  explicit FreePageManager(StoreImpl* store) noexcept;
+
+  /** Obtains an unused page from the store's data file.
+   *
+   * Pages are taken off the free list if possible. If the free list is empty,
+   * the data file is grown. The content of the allocated page is undefined, so
+   * callers should fetch it from the page pool using kIgnorePageData.
+   *
+   * @param  page_id if the call succeeds, receives the allocated page's ID
+   * @return         most likely kSuccess, kPoolFull or kIoError;
+   *                 kDataCorrupted if the free list pages are inconsistent
+   */
+  Status AllocPage(size_t* page_id);
 
+  /** Returns a page to the store's free list.
+   *
+   * The page's content may be overwritten, so the caller must not use the page
+   * after this call.
+   *
+   * @param  page_id the page to be freed; must have been obtained via
+   *                 AllocPage(), and must not have been freed since
+   * @return         most likely kSuccess, kPoolFull or kIoError;
+   *                 kDataCorrupted if the free list pages are inconsistent
+   */
+  Status FreePage(size_t page_id);
+
+  /** Repairs the free list after the store was not closed cleanly.
+   *
+   * Free list pages are updated in place, so a crash can leave a torn or
+   * inconsistent free list page behind. This walks the free list, and cuts it
+   * off before the first damaged page. The pages listed in the discarded part
+   * of the list are leaked, which is safe.
+   *
+   * @return most likely kSuccess, kPoolFull or kIoError */
+  Status Recover();
+
+  /** Writes back the free list pages modified since the last call.
+   *
+   * Shadow paging commits call this, so the pages handed out to the committing
+   * transaction are not listed as free on disk once the commit is durable.
+   *
+   * @return most likely kSuccess or kIoError */
+  Status WriteDirtyPages();
+
+ private:
+  /** Records that a free list page was modified. */
+  void PageModified(size_t page_id);
+
+  StoreImpl* const store_;
+
+  /** The free list pages modified since the last WriteDirtyPages() call. */
+  std::vector<size_t, PlatformAllocator<size_t>> dirty_pages_;
 };
 
-#endif  // BERRYDB_FREE_PAGE_MANAGER_H
+}  // namespace berrydb
+
+#endif  // BERRYDB_FREE_PAGE_MANAGER_H_
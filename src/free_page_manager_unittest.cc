@@ -0,0 +1,265 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./free_page_manager.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/status.h"
+#include "berrydb/vfs.h"
+#include "./pool_impl.h"
+#include "./store_impl.h"
+#include "./test/file_deleter.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+class FreePageManagerTest : public ::testing::Test {
+ protected:
+  FreePageManagerTest()
+      : data_file_deleter_(kStoreFileName),
+        log_file_deleter_(StoreImpl::LogFilePath(kStoreFileName)) { }
+
+  void SetUp() override {
+    PoolOptions options;
+    options.page_shift = kStorePageShift;
+    options.page_pool_size = 16;
+    pool_.reset(PoolImpl::Create(options));
+  }
+
+  void OpenStore(bool map_data_file = false) {
+    StoreOptions options;
+    options.map_data_file = map_data_file;
+    StoreImpl* raw_store;
+    ASSERT_EQ(Status::kSuccess, pool_->OpenStore(
+        kStoreFileName, options, &raw_store));
+    store_.reset(raw_store);
+  }
+
+  /** Flips a bit in a page of the closed store's data file. */
+  void DamagePage(size_t page_id) {
+    BlockAccessFile* data_file;
+    size_t file_size;
+    ASSERT_EQ(Status::kSuccess, DefaultVfs()->OpenForBlockAccess(
+        kStoreFileName, kStorePageShift, false, false, &data_file,
+        &file_size));
+    uint8_t buffer[1 << kStorePageShift];
+    size_t offset = page_id << kStorePageShift;
+    ASSERT_EQ(Status::kSuccess, data_file->Read(offset, sizeof(buffer),
+                                                buffer));
+    buffer[100] ^= 1;
+    ASSERT_EQ(Status::kSuccess, data_file->Write(buffer, offset,
+                                                 sizeof(buffer)));
+    ASSERT_EQ(Status::kSuccess, data_file->Close());
+  }
+
+  const std::string kStoreFileName = "test_free_page_manager.berry";
+  // 4 kb pages hold 510 free list entries.
+  constexpr static size_t kStorePageShift = 12;
+
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+
+  UniquePtr<PoolImpl> pool_;
+  UniquePtr<StoreImpl> store_;
+};
+
+TEST_F(FreePageManagerTest, AllocGrowsDataFile) {
+  OpenStore();
+  FreePageManager* manager = store_->free_page_manager();
+  EXPECT_EQ(StoreImpl::kReservedPageCount, store_->header()->page_count);
+
+  for (size_t i = 0; i < 5; ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+    EXPECT_EQ(StoreImpl::kReservedPageCount + i, page_id);
+  }
+  EXPECT_EQ(StoreImpl::kReservedPageCount + 5, store_->header()->page_count);
+}
+
+TEST_F(FreePageManagerTest, FreedPagesAreReused) {
+  OpenStore();
+  FreePageManager* manager = store_->free_page_manager();
+
+  size_t page_ids[3];
+  for (size_t i = 0; i < 3; ++i)
+    ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_ids[i]));
+  ASSERT_EQ(Status::kSuccess, manager->FreePage(page_ids[1]));
+
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+  EXPECT_EQ(page_ids[1], page_id);
+  ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+  EXPECT_EQ(page_ids[2] + 1, page_id);
+}
+
+TEST_F(FreePageManagerTest, FreeListSpansPages) {
+  OpenStore();
+  FreePageManager* manager = store_->free_page_manager();
+
+  // Enough pages to fill up the head page three times over.
+  constexpr size_t kPageCount = 1600;
+  std::set<size_t> allocated;
+  for (size_t i = 0; i < kPageCount; ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+    allocated.insert(page_id);
+  }
+  ASSERT_EQ(kPageCount, allocated.size());
+  for (size_t page_id : allocated)
+    ASSERT_EQ(Status::kSuccess, manager->FreePage(page_id));
+  size_t page_count = store_->header()->page_count;
+
+  std::set<size_t> reallocated;
+  for (size_t i = 0; i < kPageCount; ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+    reallocated.insert(page_id);
+  }
+  EXPECT_EQ(allocated, reallocated);
+  EXPECT_EQ(page_count, store_->header()->page_count);
+}
+
+TEST_F(FreePageManagerTest, FreeListPersists) {
+  OpenStore();
+  std::set<size_t> freed;
+  for (size_t i = 0; i < 1000; ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(
+        &page_id));
+    if (i % 3 == 0)
+      freed.insert(page_id);
+  }
+  for (size_t page_id : freed)
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->FreePage(page_id));
+  size_t page_count = store_->header()->page_count;
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  OpenStore();
+  EXPECT_EQ(page_count, store_->header()->page_count);
+  std::set<size_t> reallocated;
+  for (size_t i = 0; i < freed.size(); ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(
+        &page_id));
+    reallocated.insert(page_id);
+  }
+  EXPECT_EQ(freed, reallocated);
+
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(
+      &page_id));
+  EXPECT_EQ(page_count, page_id);
+}
+
+TEST_F(FreePageManagerTest, MappedDataFile) {
+  OpenStore();
+  std::set<size_t> freed;
+  for (size_t i = 0; i < 1600; ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(
+        &page_id));
+    if (i % 2 == 0)
+      freed.insert(page_id);
+  }
+  for (size_t page_id : freed)
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->FreePage(page_id));
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  // The free list pages are read from the mapping, and must be copied out of
+  // it before they are modified.
+  OpenStore(true);
+  std::set<size_t> reallocated;
+  for (size_t i = 0; i < freed.size(); ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(
+        &page_id));
+    reallocated.insert(page_id);
+  }
+  EXPECT_EQ(freed, reallocated);
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  OpenStore(true);
+  for (size_t page_id : freed)
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->FreePage(page_id));
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  OpenStore(true);
+  reallocated.clear();
+  for (size_t i = 0; i < freed.size(); ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(
+        &page_id));
+    reallocated.insert(page_id);
+  }
+  EXPECT_EQ(freed, reallocated);
+}
+
+TEST_F(FreePageManagerTest, RecoverResetsDamagedHeadPage) {
+  OpenStore();
+  FreePageManager* manager = store_->free_page_manager();
+  for (size_t i = 0; i < 5; ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+    ASSERT_EQ(Status::kSuccess, manager->FreePage(page_id));
+  }
+  size_t page_count = store_->header()->page_count;
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  DamagePage(1);
+  OpenStore();
+  manager = store_->free_page_manager();
+  ASSERT_EQ(Status::kSuccess, manager->Recover());
+
+  // The free pages are leaked, so the data file grows.
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+  EXPECT_EQ(page_count, page_id);
+}
+
+TEST_F(FreePageManagerTest, RecoverCutsOffDamagedPages) {
+  OpenStore();
+  FreePageManager* manager = store_->free_page_manager();
+
+  // The 510th freed page receives the full head page's 509 entries, and the
+  // head page holds the entries freed afterwards.
+  constexpr size_t kPageCount = 520;
+  std::vector<size_t> freed;
+  for (size_t i = 0; i < kPageCount; ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+    freed.push_back(page_id);
+  }
+  for (size_t page_id : freed)
+    ASSERT_EQ(Status::kSuccess, manager->FreePage(page_id));
+  size_t second_page_id = freed[509];
+  std::set<size_t> head_page_entries(freed.begin() + 510, freed.end());
+  size_t page_count = store_->header()->page_count;
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  DamagePage(second_page_id);
+  OpenStore();
+  manager = store_->free_page_manager();
+  ASSERT_EQ(Status::kSuccess, manager->Recover());
+
+  // The head page's entries survive, and the rest of the list is leaked.
+  std::set<size_t> reallocated;
+  for (size_t i = 0; i < head_page_entries.size(); ++i) {
+    size_t page_id;
+    ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+    reallocated.insert(page_id);
+  }
+  EXPECT_EQ(head_page_entries, reallocated);
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, manager->AllocPage(&page_id));
+  EXPECT_EQ(page_count, page_id);
+}
+
+}  // namespace berrydb
@@ -0,0 +1,203 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./overflow_chain.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "berrydb/status.h"
+#include "./free_page_manager.h"
+#include "./page_pool.h"
+#include "./store_impl.h"
+
+namespace berrydb {
+
+// Overflow pages have the following format:
+//
+// 0: 8-byte page ID of the next page in the chain, 0 for the last page
+// 8: value bytes, up to the page's checksum trailer
+//
+// The chain does not store the value's size, as the size must be stored in the
+// B-tree cell pointing to the chain anyway. Every page in the chain except for
+// the last one is completely filled with value bytes.
+
+namespace {
+
+constexpr size_t kNextPageOffset = 0;
+constexpr size_t kDataOffset = 8;
+
+}  // anonymous namespace
+
+OverflowChainWriter::OverflowChainWriter(StoreImpl* store) noexcept
+    : store_(store) {
+  DCHECK(store != nullptr);
+}
+
+OverflowChainWriter::~OverflowChainWriter() {
+  if (page_ != nullptr)
+    store_->page_pool()->UnpinAndEvictStorePage(page_);
+}
+
+Status OverflowChainWriter::StartPage() {
+  DCHECK(page_ == nullptr || page_offset_ == store_->usable_page_size());
+
+  size_t page_id;
+  Status status = store_->free_page_manager()->AllocPage(&page_id);
+  if (status != Status::kSuccess)
+    return status;
+
+  PagePool* page_pool = store_->page_pool();
+  if (page_ == nullptr) {
+    first_page_id_ = page_id;
+  } else {
+    // The full page is released before the new page is fetched, so the writer
+    // never needs more than one page pool entry.
+    StoreUint64(page_id, page_->data() + kNextPageOffset);
+    page_pool->UnpinAndEvictStorePage(page_);
+    page_ = nullptr;
+    if (store_->IsClosed())
+      return Status::kIoError;
+  }
+
+  status = page_pool->StorePage(
+      store_, page_id, PagePool::kIgnorePageData, &page_);
+  if (status != Status::kSuccess) {
+    page_ = nullptr;
+    return status;
+  }
+  page_->MarkDirty();
+  page_->set_priority(PagePriority::kOverflow);
+  page_offset_ = kDataOffset;
+  return Status::kSuccess;
+}
+
+Status OverflowChainWriter::Write(string_view data) {
+  size_t page_size = store_->usable_page_size();
+
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  size_t bytes_left = data.size();
+  while (bytes_left != 0) {
+    // A page is only completed when more data arrives, so the chain never ends
+    // with an empty page.
+    if (page_ == nullptr || page_offset_ == page_size) {
+      Status status = StartPage();
+      if (status != Status::kSuccess)
+        return status;
+    }
+
+    size_t chunk_size = std::min(bytes_left, page_size - page_offset_);
+    std::memcpy(page_->data() + page_offset_, bytes, chunk_size);
+    page_offset_ += chunk_size;
+    size_ += chunk_size;
+    bytes += chunk_size;
+    bytes_left -= chunk_size;
+  }
+  return Status::kSuccess;
+}
+
+Status OverflowChainWriter::Finish(size_t* first_page_id) {
+  DCHECK(first_page_id != nullptr);
+
+  if (page_ == nullptr) {
+    // Empty values still get a chain, so readers don't need a special case.
+    DCHECK_EQ(size_, 0U);
+    Status status = StartPage();
+    if (status != Status::kSuccess)
+      return status;
+  }
+
+  StoreUint64(0, page_->data() + kNextPageOffset);
+  store_->page_pool()->UnpinAndEvictStorePage(page_);
+  page_ = nullptr;
+  if (store_->IsClosed())
+    return Status::kIoError;
+
+  *first_page_id = first_page_id_;
+  return Status::kSuccess;
+}
+
+OverflowChainReader::OverflowChainReader(
+    StoreImpl* store, size_t first_page_id, size_t size) noexcept
+    : store_(store), next_page_id_(first_page_id), remaining_(size) {
+  DCHECK(store != nullptr);
+}
+
+OverflowChainReader::~OverflowChainReader() {
+  if (page_ != nullptr)
+    store_->page_pool()->UnpinAndEvictStorePage(page_);
+}
+
+Status OverflowChainReader::Read(size_t size, uint8_t* buffer) {
+  DCHECK_LE(size, remaining_);
+
+  PagePool* page_pool = store_->page_pool();
+  size_t page_size = store_->usable_page_size();
+  while (size != 0) {
+    if (page_ == nullptr || page_offset_ == page_size) {
+      if (page_ != nullptr) {
+        page_pool->UnpinAndEvictStorePage(page_);
+        page_ = nullptr;
+      }
+      if (!store_->IsDataPage(next_page_id_)) {
+        return Status::kDataCorrupted;
+      }
+
+      Status status = page_pool->StorePage(
+          store_, next_page_id_, PagePool::kFetchPageData, &page_);
+      if (status != Status::kSuccess) {
+        page_ = nullptr;
+        return status;
+      }
+      page_->set_priority(PagePriority::kOverflow);
+      uint64_t next_page_id = LoadUint64(page_->data() + kNextPageOffset);
+      next_page_id_ = static_cast<size_t>(next_page_id);
+      if (next_page_id_ != next_page_id)
+        return Status::kDataCorrupted;
+      page_offset_ = kDataOffset;
+    }
+
+    size_t chunk_size = std::min(size, page_size - page_offset_);
+    std::memcpy(buffer, page_->data() + page_offset_, chunk_size);
+    page_offset_ += chunk_size;
+    remaining_ -= chunk_size;
+    buffer += chunk_size;
+    size -= chunk_size;
+  }
+  return Status::kSuccess;
+}
+
+Status FreeOverflowChain(StoreImpl* store, size_t first_page_id, size_t size) {
+  DCHECK(store != nullptr);
+
+  PagePool* page_pool = store->page_pool();
+  size_t page_data_size = store->usable_page_size() - kDataOffset;
+  size_t chain_length =
+      (size == 0) ? 1 : (size + page_data_size - 1) / page_data_size;
+
+  size_t page_id = first_page_id;
+  for (size_t i = 0; i < chain_length; ++i) {
+    if (!store->IsDataPage(page_id)) {
+      return Status::kDataCorrupted;
+    }
+
+    Page* page;
+    Status status = page_pool->StorePage(
+        store, page_id, PagePool::kFetchPageData, &page);
+    if (status != Status::kSuccess)
+      return status;
+    uint64_t next_page_id = LoadUint64(page->data() + kNextPageOffset);
+    page_pool->UnpinAndEvictStorePage(page);
+
+    status = store->free_page_manager()->FreePage(page_id);
+    if (status != Status::kSuccess)
+      return status;
+    page_id = static_cast<size_t>(next_page_id);
+    if (page_id != next_page_id)
+      return Status::kDataCorrupted;
+  }
+  return (page_id == 0) ? Status::kSuccess : Status::kDataCorrupted;
+}
+
+}  // namespace berrydb
@@ -0,0 +1,134 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_OVERFLOW_CHAIN_H_
+#define BERRYDB_OVERFLOW_CHAIN_H_
+
+#include "berrydb/platform.h"
+
+namespace berrydb {
+
+class Page;
+class StoreImpl;
+enum class Status : int;
+
+/** Streams a large value into a chain of overflow pages.
+ *
+ * Values that do not fit in a B-tree page are stored in a singly linked list
+ * (chain) of pages allocated by the store's free page manager. The B-tree cell
+ * only stores the ID of the chain's first page and the value's size.
+ *
+ * The writer accepts the value in chunks of arbitrary sizes, so callers never
+ * need to materialize the whole value in memory. At most one overflow page is
+ * pinned at a time, and finished pages are released via
+ * PagePool::UnpinAndEvictStorePage(), so writing a large value does not evict
+ * the pages in the page pool's LRU list.
+ */
+class OverflowChainWriter {
+ public:
+  /** Sets up a writer for a new value. No pages are allocated until needed. */
+  explicit OverflowChainWriter(StoreImpl* store) noexcept;
+
+  /** Releases the overflow page that is currently being filled, if any.
+   *
+   * Destroying a writer before Finish() succeeds leaks the pages that were
+   * allocated for the value. */
+  ~OverflowChainWriter();
+
+  /** Appends a chunk of data to the value.
+   *
+   * @param  data the bytes to be appended to the value
+   * @return      most likely kSuccess, kPoolFull or kIoError
+   */
+  Status Write(string_view data);
+
+  /** Completes the chain after the whole value was written.
+   *
+   * The writer must not be used after this method is called.
+   *
+   * @param  first_page_id if the call succeeds, receives the ID of the chain's
+   *                       first page, which is needed to read the value back
+   * @return               most likely kSuccess, kPoolFull or kIoError
+   */
+  Status Finish(size_t* first_page_id);
+
+  /** Number of value bytes written so far. */
+  inline size_t size() const noexcept { return size_; }
+
+ private:
+  /** Allocates a page for the chain, and pins it as the current page.
+   *
+   * If there is a current page, it must be full. The new page is linked to it,
+   * and the full page is released. */
+  Status StartPage();
+
+  StoreImpl* const store_;
+
+  /** The pinned overflow page that receives written data. */
+  Page* page_ = nullptr;
+  /** Offset in the current page where the next data byte will be written. */
+  size_t page_offset_ = 0;
+  /** The ID of the chain's first page, valid once a page is allocated. */
+  size_t first_page_id_ = 0;
+  size_t size_ = 0;
+};
+
+/** Streams a large value out of a chain of overflow pages.
+ *
+ * The reader hands out the value in chunks of arbitrary sizes. Like the writer,
+ * the reader pins at most one overflow page at a time, and releases the pages
+ * it is done with without placing them in the page pool's LRU list.
+ */
+class OverflowChainReader {
+ public:
+  /** Sets up a reader for a value written by OverflowChainWriter.
+   *
+   * @param store         the store holding the value
+   * @param first_page_id the chain's first page, from Finish()
+   * @param size          the value's size, from OverflowChainWriter::size()
+   */
+  OverflowChainReader(
+      StoreImpl* store, size_t first_page_id, size_t size) noexcept;
+
+  /** Releases the overflow page that is currently being read, if any. */
+  ~OverflowChainReader();
+
+  /** Reads the next chunk of the value.
+   *
+   * @param  size   the number of bytes to be read; must not exceed remaining()
+   * @param  buffer receives the value bytes
+   * @return        most likely kSuccess, kPoolFull or kIoError; kDataCorrupted
+   *                if the chain is shorter than the value
+   */
+  Status Read(size_t size, uint8_t* buffer);
+
+  /** Number of value bytes that have not been read yet. */
+  inline size_t remaining() const noexcept { return remaining_; }
+
+ private:
+  StoreImpl* const store_;
+
+  /** The pinned overflow page that data is read from. */
+  Page* page_ = nullptr;
+  /** Offset in the current page of the next data byte to be read. */
+  size_t page_offset_;
+  /** The page to be read after the current page is exhausted. */
+  size_t next_page_id_;
+  size_t remaining_;
+};
+
+/** Returns the pages in a value's overflow chain to the free page manager.
+ *
+ * @param  store         the store holding the value
+ * @param  first_page_id the chain's first page, from Finish()
+ * @param  size          the value's size, from OverflowChainWriter::size()
+ * @return               most likely kSuccess, kPoolFull or kIoError;
+ *                       kDataCorrupted if the chain's length does not match
+ *                       the value's size
+ */
+Status FreeOverflowChain(StoreImpl* store, size_t first_page_id, size_t size);
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_OVERFLOW_CHAIN_H_
@@ -0,0 +1,168 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./overflow_chain.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/status.h"
+#include "./page_pool.h"
+#include "./pool_impl.h"
+#include "./store_impl.h"
+#include "./test/file_deleter.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+class OverflowChainTest : public ::testing::Test {
+ protected:
+  OverflowChainTest()
+      : data_file_deleter_(kStoreFileName),
+        log_file_deleter_(StoreImpl::LogFilePath(kStoreFileName)) { }
+
+  void CreatePool(size_t page_capacity) {
+    PoolOptions options;
+    options.page_shift = kStorePageShift;
+    options.page_pool_size = page_capacity;
+    pool_.reset(PoolImpl::Create(options));
+  }
+
+  void OpenStore() {
+    StoreImpl* raw_store;
+    ASSERT_EQ(Status::kSuccess, pool_->OpenStore(
+        kStoreFileName, StoreOptions(), &raw_store));
+    store_.reset(raw_store);
+  }
+
+  void GenerateValue(size_t size) {
+    value_.resize(size);
+    for (size_t i = 0; i < size; ++i)
+      value_[i] = static_cast<uint8_t>(rnd_());
+  }
+
+  /** Writes value_ in randomly sized chunks. */
+  void WriteValue(size_t* first_page_id) {
+    OverflowChainWriter writer(store_.get());
+    size_t offset = 0;
+    while (offset < value_.size()) {
+      size_t chunk_size = std::min(
+          value_.size() - offset, static_cast<size_t>(rnd_() % 10000));
+      ASSERT_EQ(Status::kSuccess, writer.Write(string_view(
+          reinterpret_cast<const char*>(value_.data() + offset), chunk_size)));
+      offset += chunk_size;
+    }
+    EXPECT_EQ(value_.size(), writer.size());
+    ASSERT_EQ(Status::kSuccess, writer.Finish(first_page_id));
+  }
+
+  /** Reads a value in randomly sized chunks and compares it to value_. */
+  void CheckValue(size_t first_page_id) {
+    OverflowChainReader reader(store_.get(), first_page_id, value_.size());
+    std::vector<uint8_t> buffer(value_.size());
+    size_t offset = 0;
+    while (offset < value_.size()) {
+      EXPECT_EQ(value_.size() - offset, reader.remaining());
+      size_t chunk_size = std::min(
+          value_.size() - offset, static_cast<size_t>(rnd_() % 10000));
+      ASSERT_EQ(Status::kSuccess, reader.Read(
+          chunk_size, buffer.data() + offset));
+      offset += chunk_size;
+    }
+    EXPECT_EQ(0U, reader.remaining());
+    EXPECT_TRUE(buffer == value_);
+  }
+
+  const std::string kStoreFileName = "test_overflow_chain.berry";
+  constexpr static size_t kStorePageShift = 12;
+
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+
+  UniquePtr<PoolImpl> pool_;
+  UniquePtr<StoreImpl> store_;
+  std::vector<uint8_t> value_;
+  std::mt19937 rnd_;
+};
+
+TEST_F(OverflowChainTest, WriteRead) {
+  CreatePool(16);
+  OpenStore();
+
+  for (size_t size : {0, 1, 4088, 4089, 8176, 300000}) {
+    GenerateValue(size);
+    size_t first_page_id;
+    WriteValue(&first_page_id);
+    CheckValue(first_page_id);
+  }
+}
+
+TEST_F(OverflowChainTest, ValuePersists) {
+  CreatePool(16);
+  OpenStore();
+  GenerateValue(100000);
+  size_t first_page_id;
+  WriteValue(&first_page_id);
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  OpenStore();
+  CheckValue(first_page_id);
+}
+
+TEST_F(OverflowChainTest, BypassesLru) {
+  // The store's 3 reserved pages fill up the pool, except for one entry.
+  CreatePool(4);
+  OpenStore();
+  PagePool* page_pool = pool_->page_pool();
+
+  Page* root_page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store_.get(), 2, PagePool::kFetchPageData, &root_page));
+  page_pool->UnpinStorePage(root_page);
+
+  // The value spans about 250 pages.
+  GenerateValue(1 << 20);
+  size_t first_page_id;
+  WriteValue(&first_page_id);
+  CheckValue(first_page_id);
+  EXPECT_EQ(4U, page_pool->allocated_pages());
+  EXPECT_EQ(0U, page_pool->pinned_pages());
+
+  // The root page would have been evicted if the overflow pages went through
+  // the LRU list.
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store_.get(), 2, PagePool::kFetchPageData, &page));
+  EXPECT_EQ(root_page, page);
+  page_pool->UnpinStorePage(page);
+}
+
+TEST_F(OverflowChainTest, FreedPagesAreReused) {
+  CreatePool(16);
+  OpenStore();
+
+  GenerateValue(50000);
+  size_t first_page_id;
+  WriteValue(&first_page_id);
+  size_t page_count = store_->header()->page_count;
+
+  ASSERT_EQ(Status::kSuccess, FreeOverflowChain(
+      store_.get(), first_page_id, value_.size()));
+  GenerateValue(50000);
+  WriteValue(&first_page_id);
+  CheckValue(first_page_id);
+  EXPECT_EQ(page_count, store_->header()->page_count);
+
+  // A size that disagrees with the chain's length is caught.
+  EXPECT_EQ(Status::kDataCorrupted, FreeOverflowChain(
+      store_.get(), first_page_id, value_.size() - 10000));
+}
+
+}  // namespace berrydb
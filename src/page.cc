@@ -4,24 +4,25 @@
 
 #include "./page.h"
 
+#include <cstring>
 #include <type_traits>
 
 #include "berrydb/platform.h"
 #include "./page_pool.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
 
 namespace berrydb {
 
-Page* Page::Create(PagePool* page_pool) {
+Page* Page::Create(PagePool* page_pool, size_t numa_node) {
   DCHECK(page_pool != nullptr);
+  DCHECK_LT(numa_node, page_pool->numa_node_count());
 
-  size_t block_size = sizeof(Page) + page_pool->page_size();
-  void* page_block = Allocate(block_size);
-  Page* page = new (page_block) Page(page_pool);
-  DCHECK_EQ(reinterpret_cast<void*>(page), page_block);
-
-  // Make sure that page data is 8-byte aligned.
-  DCHECK_EQ(reinterpret_cast<uintptr_t>(page->data()) & 0x07, 0U);
+  void* heap_block = Allocate(sizeof(Page));
+  Page* page = new (heap_block) Page(page_pool, numa_node);
+  DCHECK_EQ(reinterpret_cast<void*>(page), heap_block);
 
+  page->AllocBuffer(page_pool);
   return page;
 }
 
@@ -30,13 +31,71 @@ void Page::Release(PagePool *page_pool) {
   DCHECK_EQ(page_pool_, page_pool);
 #endif  // DCHECK_IS_ON()
 
-  size_t block_size = sizeof(Page) + page_pool->page_size();
-  void* heap_block = reinterpret_cast<void*>(this);
-  Deallocate(heap_block, block_size);
+  if (buffer_ != nullptr) {
+    data_ = nullptr;  // ReleaseBuffer() expects data_ to point elsewhere.
+    ReleaseBuffer(page_pool);
+  }
+  Deallocate(static_cast<void*>(this), sizeof(Page));
+}
+
+void Page::AllocBuffer(PagePool* page_pool) {
+  DCHECK(buffer_ == nullptr);
+#if DCHECK_IS_ON()
+  DCHECK_EQ(page_pool_, page_pool);
+#endif  // DCHECK_IS_ON()
+
+  size_t padding = BufferPadding(page_pool);
+  void* heap_block = Allocate(page_pool->page_size() + padding);
+  uintptr_t block = reinterpret_cast<uintptr_t>(heap_block);
+  uintptr_t buffer = block;
+  if (padding != 0) {
+    // The padding is one below a power of two, so it doubles as a mask.
+    buffer = (block + padding) & ~static_cast<uintptr_t>(padding);
+  }
+  buffer_offset_ = static_cast<uint32_t>(buffer - block);
+
+  bool was_mapped = is_mapped();
+  buffer_ = reinterpret_cast<uint8_t*>(buffer);
+  if (!was_mapped)
+    data_ = buffer_;
+
+  // Make sure that page data is 8-byte aligned.
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(buffer_) & 0x07, 0U);
+
+  // The heap may hand out memory that was first touched on another node.
+  if (page_pool->numa_node_count() > 1)
+    BindToNumaNode(buffer_, page_pool->page_size(), numa_node_);
+
+  page_pool->PageBufferAllocated();
+}
+
+void Page::ReleaseBuffer(PagePool* page_pool) noexcept {
+  DCHECK(buffer_ != nullptr);
+  DCHECK(data_ != buffer_);
+#if DCHECK_IS_ON()
+  DCHECK_EQ(page_pool_, page_pool);
+#endif  // DCHECK_IS_ON()
+
+  void* heap_block = static_cast<void*>(buffer_ - buffer_offset_);
+  Deallocate(heap_block, page_pool->page_size() + BufferPadding(page_pool));
+  buffer_ = nullptr;
+  buffer_offset_ = 0;
+  page_pool->PageBufferReleased();
+}
+
+size_t Page::BufferPadding(PagePool* page_pool) noexcept {
+  if (page_pool->numa_node_count() <= 1)
+    return 0;
+  // Buffers smaller than a virtual memory page cannot be bound on their own.
+  size_t alignment = NumaBindAlignment();
+  if (page_pool->page_size() < alignment)
+    return 0;
+  return alignment - 1;
 }
 
-Page::Page(PagePool* page_pool)
-    : pin_count_(1)
+Page::Page(PagePool* page_pool, size_t numa_node)
+    : pin_count_(1), data_(nullptr),
+      numa_node_(static_cast<uint8_t>(numa_node))
 #if DCHECK_IS_ON()
     , page_pool_(page_pool)
 #endif  // DCHECK_IS_ON()
@@ -52,4 +111,15 @@ Page::~Page() {
   DCHECK(transaction_ == nullptr);
 }
 
+void Page::UnmapData() {
+  DCHECK(is_mapped());
+  DCHECK(transaction_ != nullptr);
+
+  PagePool* page_pool = transaction_->store()->page_pool();
+  if (buffer_ == nullptr)
+    AllocBuffer(page_pool);
+  std::memcpy(buffer_, data_, page_pool->page_size());
+  data_ = buffer_;
+}
+
 }  // namespace berrydb
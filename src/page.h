@@ -10,13 +10,40 @@
 
 #include "berrydb/platform.h"
 #include "./util/linked_list.h"
+#include "./util/version_lock.h"
 
 namespace berrydb {
 
 class PagePool;
+class PageVersion;
 class StoreImpl;
 class TransactionImpl;
 
+/** Eviction priority classes for page pool entries.
+ *
+ * When a page pool is full, the least recently used page of the lowest class is
+ * evicted first. Classes are listed from lowest to highest priority.
+ *
+ * The store tags its header page as kRoot, its free list's head page as
+ * kInner, and overflow chain pages as kOverflow. The B-tree classes are not
+ * assigned yet, because the store does not have a B-tree, so all the other
+ * pages are kLeaf. */
+enum class PagePriority : uint8_t {
+  /** Overflow chain pages, which are streamed through and rarely reused. */
+  kOverflow = 0,
+  /** Log pages, which are only needed until they are written. */
+  kLog = 1,
+  /** B-tree leaves, and other pages without a more specific class. */
+  kLeaf = 2,
+  /** B-tree inner nodes, and other pages used by many lookups. */
+  kInner = 3,
+  /** Tree roots, and store metadata used by most operations. */
+  kRoot = 4,
+};
+
+/** Number of values in PagePriority. */
+constexpr size_t kPagePriorityCount = 5;
+
 /** Control block for a page pool entry, which caches a store page.
  *
  * Although this class represents a page pool entry, it is simply named Page,
@@ -24,8 +51,7 @@ class TransactionImpl;
  * entry's buffer.
  *
  * Each entry in a page pool has a control block (the members of this class),
- * which is laid out in memory right before the buffer that holds the content of
- * of the cached store page.
+ * and usually a buffer that holds the content of the cached store page.
  *
  * An entry belongs to the same PagePool for its entire lifetime. The entry's
  * control block does not hold a reference to the pool (in release mode) to save
@@ -42,6 +68,18 @@ class TransactionImpl;
  *
  * Each linked list has a sentinel. For simplicity, the sentinel is simply a
  * page control block without a page data buffer.
+ *
+ * Each entry also has a version lock, which coordinates concurrent access to
+ * the entry's buffer. B-tree traversals read node pages optimistically and
+ * validate the version afterwards, while writers latch the pages they modify.
+ * The version is bumped when the entry stops caching a store page, so readers
+ * that raced with an eviction discard what they read.
+ *
+ * Entries caching clean pages of stores whose data files are memory-mapped
+ * point into the mapping instead of holding a copy of the page. These entries
+ * release their buffers, so they only use the memory of their control blocks.
+ * The mapping is read-only, so a buffer is allocated again, and the page data
+ * is copied into it, when the entry is marked dirty.
  */
 class Page {
   enum class Status;
@@ -49,8 +87,13 @@ class Page {
  public:
   /** Allocates an entry that will belong to the given page pool.
    *
-   * The returned page has one pin on it, which is owned by the caller. */
-  static Page* Create(PagePool* page_pool);
+   * The returned page has one pin on it, which is owned by the caller.
+   *
+   * @param page_pool the page pool that will own the entry
+   * @param numa_node the NUMA node whose memory should back the entry's buffer;
+   *                  only used by page pools partitioned by NUMA node
+   */
+  static Page* Create(PagePool* page_pool, size_t numa_node = 0);
 
   /** Releases the memory resources used up by this page pool entry.
    *
@@ -92,16 +135,80 @@ class Page {
     return is_dirty_;
   }
 
-  /** The page data held by this page. */
-  inline uint8_t* data() noexcept {
-    return reinterpret_cast<uint8_t*>(this + 1);
+  /** True while the page's data is read without the pool's lock.
+   *
+   * The thread performing the I/O keeps the page pinned. Other threads must
+   * not use the page until the I/O completes. */
+  inline bool has_pending_io() const noexcept { return has_pending_io_; }
+
+  /** Sets the value returned by has_pending_io(). The page must be pinned. */
+  inline void set_pending_io(bool has_pending_io) noexcept {
+    DCHECK(pin_count_ != 0);
+    has_pending_io_ = has_pending_io;
+  }
+
+  /** The page data held by this page.
+   *
+   * The data must not be modified before the page is marked dirty, because it
+   * may be backed by a read-only memory mapping. MarkDirty() moves such data
+   * into the page's buffer, so writers must call this after MarkDirty().
+   *
+   * This is null if the page does not have a buffer and is not mapped. */
+  inline uint8_t* data() noexcept { return data_; }
+
+  /** True if the page data is backed by a memory-mapped data file. */
+  inline bool is_mapped() const noexcept { return data_ != buffer_; }
+
+  /** True if the page has its own buffer. See AllocBuffer(). */
+  inline bool has_buffer() const noexcept { return buffer_ != nullptr; }
+
+  /** Points the page's data into a memory-mapped data file.
+   *
+   * The page must be assigned to a store, and must not be dirty. The page's
+   * buffer, if it has one, is kept until ReleaseBuffer() is called. */
+  inline void MapData(const uint8_t* mapped_data) noexcept {
+    DCHECK(transaction_ != nullptr);
+    DCHECK(!is_dirty_);
+    DCHECK(mapped_data != nullptr);
+    // The mapping is never written, as the data is copied by MarkDirty().
+    data_ = const_cast<uint8_t*>(mapped_data);
   }
 
+  /** Allocates the page's buffer.
+   *
+   * The page must not have a buffer. Unless the page is mapped, its data is
+   * stored in the new buffer.
+   *
+   * @param page_pool the page pool that owns this entry */
+  void AllocBuffer(PagePool* page_pool);
+
+  /** Frees the buffer of a page whose data is memory-mapped.
+   *
+   * This saves the buffer's memory while the page points into the mapping.
+   *
+   * @param page_pool the page pool that owns this entry */
+  void ReleaseBuffer(PagePool* page_pool) noexcept;
+
 #if DCHECK_IS_ON()
   /** The pool that this page belongs to. Solely intended for use in DCHECKs. */
   inline const PagePool* page_pool() const noexcept { return page_pool_; }
 #endif  // DCHECK_IS_ON
 
+  /** The newest before-image of this page, used for snapshot reads.
+   *
+   * This is null if no transaction needs an older version of the page. Pages
+   * that have before-images are pinned by their version chain. */
+  inline PageVersion* newest_version() const noexcept {
+    return newest_version_;
+  }
+  /** Replaces the head of this page's version chain. */
+  inline void set_newest_version(PageVersion* version) noexcept {
+    newest_version_ = version;
+  }
+
+  /** Coordinates concurrent access to the page data. */
+  inline VersionLock* version_lock() noexcept { return &version_lock_; }
+
   /** True if the pool page's contents can be replaced. */
   inline bool IsUnpinned() const noexcept { return pin_count_ == 0; }
 
@@ -135,12 +242,14 @@ class Page {
     DCHECK(transaction_ == nullptr);
     DCHECK(transaction_list_node_.list_sentinel() == nullptr);
     DCHECK(linked_list_node_.list_sentinel() == nullptr);
+    DCHECK(store_lru_list_node_.list_sentinel() == nullptr);
 #endif  // DCHECK_IS_ON()
     DCHECK(pin_count_ != 0);
     DCHECK(!is_dirty_);
 
     transaction_ = transaction;
     page_id_ = page_id;
+    priority_ = PagePriority::kLeaf;
   }
 
   /** Track the fact that the pool page no longer caches a store page.
@@ -157,24 +266,71 @@ class Page {
 #if DCHECK_IS_ON()
     DCHECK(transaction_list_node_.list_sentinel() != nullptr);
     DCHECK(linked_list_node_.list_sentinel() == nullptr);
+    DCHECK(store_lru_list_node_.list_sentinel() == nullptr);
 #endif  // DCHECK_IS_ON()
 
 #if DCHECK_IS_ON()
     transaction_ = nullptr;
 #endif  // DCHECK_IS_ON()
+    data_ = buffer_;
+    version_lock_.Invalidate();
+  }
+
+  /** The NUMA node whose memory backs the page's buffer.
+   *
+   * Page pools partitioned by NUMA node keep the page in this node's lists
+   * whenever the page is unpinned. */
+  inline size_t numa_node() const noexcept { return numa_node_; }
+
+  /** The page's eviction priority class. See PagePriority. */
+  inline PagePriority priority() const noexcept { return priority_; }
+
+  /** Orders the page pool's unpinned pages by the time they were unpinned.
+   *
+   * The page pool sets this value when it adds the page to its LRU lists. A
+   * page with a lower value was used less recently. */
+  inline size_t lru_stamp() const noexcept { return lru_stamp_; }
+
+  /** Sets the value returned by lru_stamp(). */
+  inline void set_lru_stamp(size_t lru_stamp) noexcept {
+    lru_stamp_ = lru_stamp;
+  }
+
+  /** Changes the page's eviction priority class.
+   *
+   * The page must be pinned, because the page pool keeps a separate LRU list
+   * for each priority class. Pages start out in the kLeaf class whenever they
+   * are assigned to cache a store page. */
+  inline void set_priority(PagePriority priority) noexcept {
+    DCHECK(pin_count_ != 0);
+    priority_ = priority;
   }
 
   /** Changes the page's dirtiness status.
    *
    * The page must be assigned to store while its dirtiness is changed. */
-  inline void MarkDirty(bool will_be_dirty = true) noexcept {
+  inline void MarkDirty(bool will_be_dirty = true) {
     DCHECK(transaction_ != nullptr);
+    if (will_be_dirty && is_mapped())
+      UnmapData();
+    DCHECK(data_ != nullptr);
     is_dirty_ = will_be_dirty;
   }
 
  private:
+  /** Copies memory-mapped page data into the page's buffer.
+   *
+   * A buffer is allocated if the page does not have one. */
+  void UnmapData();
+
+  /** Extra bytes allocated with a buffer, so the buffer can be aligned.
+   *
+   * Entries in page pools partitioned by NUMA node have their buffers aligned
+   * to virtual memory pages, so BindToNumaNode() covers the whole buffer. */
+  static size_t BufferPadding(PagePool* page_pool) noexcept;
+
    /** Use Page::Create() to construct Page instances. */
-   Page(PagePool* page);
+   Page(PagePool* page, size_t numa_node);
    ~Page();
 
 #if DCHECK_IS_ON()
@@ -192,6 +348,9 @@ class Page {
   friend class TransactionLinkedListBridge;
   LinkedList<Page>::Node transaction_list_node_;
 
+  friend class StoreLruListBridge;
+  LinkedList<Page>::Node store_lru_list_node_;
+
   TransactionImpl* transaction_;
 
   /** The cached page ID, for pool entries that are caching a store's pages.
@@ -204,7 +363,28 @@ class Page {
 
   /** Number of times the page was pinned. Very similar to a reference count. */
   size_t pin_count_;
+
+  /** See lru_stamp(). */
+  size_t lru_stamp_ = 0;
+
+  VersionLock version_lock_;
+
+  /** See data(). Equals buffer_, unless the page data is memory-mapped. */
+  uint8_t* data_;
+
+  /** The page's own buffer. Null if the page does not have a buffer. */
+  uint8_t* buffer_ = nullptr;
+
+  /** Head of the page's version chain. See newest_version(). */
+  PageVersion* newest_version_ = nullptr;
   bool is_dirty_ = false;
+  /** See has_pending_io(). */
+  bool has_pending_io_ = false;
+  PagePriority priority_ = PagePriority::kLeaf;
+  /** See numa_node(). */
+  const uint8_t numa_node_;
+  /** Bytes between the start of the buffer's heap block and the buffer. */
+  uint32_t buffer_offset_ = 0;
 
 #if DCHECK_IS_ON()
   PagePool* const page_pool_;
@@ -230,6 +410,26 @@ class Page {
       return host;
     }
   };
+
+  /** Bridge for the LRU lists that StoreImpl keeps for the page pool.
+   *
+   * This is public for StoreImpl's and PagePool's use. */
+  class StoreLruListBridge {
+   public:
+    using Embedder = Page;
+    using Node = LinkedListNode<Page>;
+
+    static inline Node* NodeForHost(Embedder* host) noexcept {
+      return &host->store_lru_list_node_;
+    }
+    static inline Embedder* HostForNode(Node* node) noexcept {
+      Embedder* host = reinterpret_cast<Embedder*>(
+          reinterpret_cast<char*>(node) - offsetof(
+              Embedder, store_lru_list_node_));
+      DCHECK_EQ(node, &host->store_lru_list_node_);
+      return host;
+    }
+  };
 };
 
 }  // namespace berrydb
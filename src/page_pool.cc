@@ -4,19 +4,28 @@
 
 #include "./page_pool.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 
 #include "berrydb/platform.h"
+#include "./pool_impl.h"
 #include "./store_impl.h"
 
 namespace berrydb {
 
-PagePool::PagePool(PoolImpl* pool, size_t page_shift, size_t page_capacity)
+constexpr size_t PagePool::kMaxNumaNodes;
+
+PagePool::PagePool(PoolImpl* pool, size_t page_shift, size_t page_capacity,
+                   size_t compressed_cache_size, size_t numa_node_count)
     : page_shift_(page_shift), page_size_(1 << page_shift),
-      page_capacity_(page_capacity), pool_(pool), free_list_(), lru_list_(),
-      log_list_() {
+      page_capacity_(page_capacity), pool_(pool),
+      numa_node_count_(numa_node_count), log_list_(),
+      compressed_cache_(page_size_, compressed_cache_size) {
   // The page size should be a power of two.
   DCHECK_EQ(page_size_ & (page_size_ - 1), 0U);
+  DCHECK_NE(numa_node_count, 0U);
+  DCHECK_LE(numa_node_count, kMaxNumaNodes);
 }
 
 PagePool::~PagePool() {
@@ -25,18 +34,24 @@ PagePool::~PagePool() {
   // We cannot use C++11's range-based for loop because the iterator would get
   // invalidated if we release the page it's pointing to.
 
-  for (auto it = free_list_.begin(); it != free_list_.end(); ) {
-    Page* page = *it;
-    ++it;
-    page->Release(this);
-  }
-
-  // The LRU list should be empty, unless we crash-close.
-
-  for (auto it = lru_list_.begin(); it != lru_list_.end(); ) {
-    Page* page = *it;
-    ++it;
-    page->Release(this);
+  for (size_t i = 0; i < numa_node_count_; ++i) {
+    NumaPartition& partition = partitions_[i];
+    for (auto it = partition.free_list.begin();
+         it != partition.free_list.end(); ) {
+      Page* page = *it;
+      ++it;
+      page->Release(this);
+    }
+
+    // The LRU list should be empty, unless we crash-close.
+
+    for (LinkedList<Page>& lru_list : partition.lru_lists) {
+      for (auto it = lru_list.begin(); it != lru_list.end(); ) {
+        Page* page = *it;
+        ++it;
+        page->Release(this);
+      }
+    }
   }
 }
 
@@ -49,8 +64,10 @@ void PagePool::UnpinStorePage(Page* page) {
 #endif  // DCHECK_IS_ON()
 
   page->RemovePin();
-  if (page->IsUnpinned())
-    lru_list_.push_back(page);
+  if (page->IsUnpinned()) {
+    PushLruPage(page);
+    pool_->PagesReleased();
+  }
 }
 
 void PagePool::UnpinAndWriteStorePage(Page* page) {
@@ -76,14 +93,36 @@ void PagePool::UnpinAndWriteStorePage(Page* page) {
   page->MarkDirty(false);
   if (write_status != Status::kSuccess) {
     // TODO(pwnall): Figure out the correct strategy for unassigning here.
+    store->PoolPageUnassigned();
     page->UnassignFromStore();
     transaction->PageUnassigned(page);
-    free_list_.push_back(page);
+    free_list(page)->push_back(page);
+    pool_->PagesReleased();
     store->Close();
     return;
   }
 
-  lru_list_.push_back(page);
+  PushLruPage(page);
+  pool_->PagesReleased();
+}
+
+void PagePool::UnpinAndEvictStorePage(Page* page) {
+  DCHECK(page != nullptr);
+  DCHECK(page->transaction() != nullptr);
+  DCHECK(page->transaction()->store() != nullptr);
+#if DCHECK_IS_ON()
+  DCHECK_EQ(page->page_pool(), this);
+#endif  // DCHECK_IS_ON()
+
+  page->RemovePin();
+  if (!page->IsUnpinned())
+    return;
+
+  // UnassignPageFromStore() requires a pinned page. The pin also keeps the page
+  // out of the LRU list, which is the point of this method.
+  page->AddPin();
+  UnassignPageFromStore(page);
+  UnpinUnassignedPage(page);
 }
 
 void PagePool::UnpinUnassignedPage(Page* page) {
@@ -94,8 +133,10 @@ void PagePool::UnpinUnassignedPage(Page* page) {
   DCHECK(page->transaction() == nullptr);
 
   page->RemovePin();
-  if (page->IsUnpinned())
-    free_list_.push_back(page);
+  if (page->IsUnpinned()) {
+    free_list(page)->push_back(page);
+    pool_->PagesReleased();
+  }
 }
 
 void PagePool::UnassignPageFromStore(Page* page) {
@@ -110,6 +151,7 @@ void PagePool::UnassignPageFromStore(Page* page) {
   StoreImpl* store = transaction->store();
   DCHECK_EQ(1U, page_map_.count(std::make_pair(store, page->page_id())));
   page_map_.erase(std::make_pair(store, page->page_id()));
+  store->PoolPageUnassigned();
   if (page->is_dirty()) {
     Status write_status = store->WritePage(page);
     page->MarkDirty(false);
@@ -124,35 +166,258 @@ void PagePool::UnassignPageFromStore(Page* page) {
   }
 }
 
-Page* PagePool::AllocPage() {
-  if (!free_list_.empty()) {
-    // The free list is used as a stack (LIFO), because the last used free page
-    // has the highest chance of being in the CPU's caches.
-    Page* page = free_list_.front();
-    free_list_.pop_front();
-    page->AddPin();
-    DCHECK(page->transaction() == nullptr);
-    DCHECK(!page->is_dirty());
-    return page;
+Page* PagePool::AllocPage(StoreImpl* requester, size_t numa_node) {
+  Page* page = AllocPageEntry(requester, numa_node);
+  if (page != nullptr && !page->has_buffer())
+    page->AllocBuffer(this);
+  return page;
+}
+
+Page* PagePool::AllocPageEntry(StoreImpl* requester, size_t numa_node) {
+  DCHECK_LT(numa_node, numa_node_count_);
+
+  // A store at its maximum replaces its own pages, leaving the rest of the pool
+  // to the other stores.
+  if (requester != nullptr && requester->pool_max_pages() != 0 &&
+      requester->pool_page_count() >= requester->pool_max_pages()) {
+    Page* page = StoreLruPage(requester, numa_node);
+    if (page != nullptr)
+      return EvictPage(page);
   }
 
-  if (page_count_ < page_capacity_) {
-    ++page_count_;
-    Page* page = Page::Create(this);
+  Page* page = PopUnusedPage(numa_node);
+  if (page != nullptr)
     return page;
+
+  // The resource pool may move capacity here from pools with less demand.
+  if (page_count_ < page_capacity_ || pool_->GrowPagePool(this)) {
+    ++page_count_;
+    return Page::Create(this, numa_node);
   }
 
-  if (!lru_list_.empty()) {
-    Page* page = lru_list_.front();
-    page->AddPin();
-    lru_list_.pop_front();
-    UnassignPageFromStore(page);
-    return page;
+  // Remote partitions are only used when the local partition cannot give up a
+  // page, so each node's entries mostly serve the node's threads.
+  for (size_t i = 0; i < numa_node_count_; ++i) {
+    size_t partition_node = (numa_node + i) % numa_node_count_;
+    if (i != 0) {
+      page = PopUnusedPage(partition_node);
+      if (page != nullptr)
+        return page;
+    }
+    page = ChooseEvictionVictim(requester, partition_node);
+    if (page != nullptr)
+      return EvictPage(page);
   }
+  return nullptr;
+}
+
+Page* PagePool::PopUnusedPage(size_t numa_node) {
+  LinkedList<Page>& free_list = partitions_[numa_node].free_list;
+  if (free_list.empty())
+    return nullptr;
 
+  // The free list is used as a stack (LIFO), because the last used free page
+  // has the highest chance of being in the CPU's caches.
+  Page* page = free_list.front();
+  free_list.pop_front();
+  page->AddPin();
+  DCHECK(page->transaction() == nullptr);
+  DCHECK(!page->is_dirty());
+  return page;
+}
+
+Page* PagePool::ChooseEvictionVictim(StoreImpl* requester, size_t numa_node) {
+  LinkedList<Page>* lru_lists = partitions_[numa_node].lru_lists;
+
+  // Inner pages lose their protection when they crowd out the leaves.
+  if (HotSetOverflows()) {
+    Page* page = ChooseEvictionVictim(
+        requester, numa_node, PagePriority::kInner);
+    if (page != nullptr)
+      return page;
+  }
+
+  for (size_t priority = 0; priority < kPagePriorityCount; ++priority) {
+    if (lru_lists[priority].empty())
+      continue;
+    Page* page = ChooseEvictionVictim(
+        requester, numa_node, static_cast<PagePriority>(priority));
+    if (page != nullptr)
+      return page;
+  }
   return nullptr;
 }
 
+Page* PagePool::ChooseEvictionVictim(
+    StoreImpl* requester, size_t numa_node, PagePriority priority) {
+  // Stores over their share give up pages first. A requester at its share
+  // would go over it, so it replaces its own pages. Next come the stores over
+  // their reservation, and the requester, whose reservation only protects its
+  // pages from other stores. Within each group, the least recently used page
+  // is evicted. That page is at the front of its store's LRU list.
+  Page* over_share_page = nullptr;
+  Page* unreserved_page = nullptr;
+  for (StoreImpl* store : stores_) {
+    LinkedList<Page, Page::StoreLruListBridge>* store_lru_list =
+        store->pool_lru_list(numa_node, priority);
+    if (store_lru_list->empty())
+      continue;
+    size_t store_page_count = store->pool_page_count();
+    if (store == requester)
+      ++store_page_count;
+    else if (store_page_count <= store->pool_min_pages())
+      continue;
+
+    Page* page = store_lru_list->front();
+    if (store_page_count > StoreShare(store) && (over_share_page == nullptr ||
+        page->lru_stamp() < over_share_page->lru_stamp())) {
+      over_share_page = page;
+    }
+    if (unreserved_page == nullptr ||
+        page->lru_stamp() < unreserved_page->lru_stamp()) {
+      unreserved_page = page;
+    }
+  }
+  return (over_share_page != nullptr) ? over_share_page : unreserved_page;
+}
+
+Page* PagePool::StoreLruPage(StoreImpl* store, size_t numa_node) {
+  for (size_t i = 0; i < numa_node_count_; ++i) {
+    size_t partition_node = (numa_node + i) % numa_node_count_;
+    for (size_t priority = 0; priority < kPagePriorityCount; ++priority) {
+      LinkedList<Page, Page::StoreLruListBridge>* store_lru_list =
+          store->pool_lru_list(partition_node,
+                               static_cast<PagePriority>(priority));
+      if (!store_lru_list->empty())
+        return store_lru_list->front();
+    }
+  }
+  return nullptr;
+}
+
+LinkedList<Page, Page::StoreLruListBridge>* PagePool::store_lru_list(
+    Page* page) {
+  DCHECK(page->transaction() != nullptr);
+  return page->transaction()->store()->pool_lru_list(
+      page->numa_node(), page->priority());
+}
+
+void PagePool::PushLruPage(Page* page) {
+  DCHECK(page->IsUnpinned());
+  page->set_lru_stamp(++lru_clock_);
+  lru_list(page)->push_back(page);
+  store_lru_list(page)->push_back(page);
+}
+
+void PagePool::EraseLruPage(Page* page) {
+  DCHECK(page->IsUnpinned());
+  lru_list(page)->erase(page);
+  store_lru_list(page)->erase(page);
+}
+
+Page* PagePool::EvictPage(Page* page) {
+  DCHECK(page->IsUnpinned());
+  EraseLruPage(page);
+  page->AddPin();
+
+  StoreImpl* store = page->transaction()->store();
+  size_t page_id = page->page_id();
+  // Pages backed by a memory-mapped data file can be reloaded cheaply.
+  bool should_compress = compressed_cache_.is_enabled() && !page->is_mapped();
+  UnassignPageFromStore(page);
+
+  // The store is closed if writing the page failed. Otherwise, the page data
+  // matches the data file, so it is safe to cache.
+  if (should_compress && !store->IsClosed())
+    compressed_cache_.Insert(store, page_id, page->data());
+  return page;
+}
+
+Page* PagePool::WaitAndAllocPage(StoreImpl* requester) {
+  std::chrono::steady_clock::time_point deadline =
+      pool_->PinnedPageWaitDeadline();
+  while (pool_->WaitForPageRelease(deadline)) {
+    Page* page = AllocPageEntry(requester, LocalNumaNode());
+    if (page != nullptr)
+      return page;
+  }
+  // A page may have been released right before the deadline.
+  return AllocPageEntry(requester, LocalNumaNode());
+}
+
+size_t PagePool::ShrinkCapacity(size_t page_count) {
+  size_t dropped_pages = 0;
+  while (dropped_pages < page_count && page_capacity_ != 0) {
+    if (page_count_ < page_capacity_) {
+      --page_capacity_;
+      ++dropped_pages;
+      continue;
+    }
+
+    Page* page = nullptr;
+    for (size_t i = 0; i < numa_node_count_; ++i) {
+      LinkedList<Page>& free_list = partitions_[i].free_list;
+      if (!free_list.empty()) {
+        page = free_list.front();
+        free_list.pop_front();
+        break;
+      }
+    }
+    if (page == nullptr) {
+      if (lru_page_count() == 0)
+        break;
+
+      for (size_t i = 0; i < numa_node_count_ && page == nullptr; ++i)
+        page = ChooseEvictionVictim(nullptr, i);
+      if (page == nullptr) {
+        // Store reservations must yield to a smaller memory budget.
+        for (size_t i = 0; i < numa_node_count_ && page == nullptr; ++i) {
+          for (LinkedList<Page>& lru_list : partitions_[i].lru_lists) {
+            if (!lru_list.empty()) {
+              page = lru_list.front();
+              break;
+            }
+          }
+        }
+      }
+      EraseLruPage(page);
+      // UnassignPageFromStore() requires a pinned page.
+      page->AddPin();
+      UnassignPageFromStore(page);
+      page->RemovePin();
+    }
+
+    DCHECK(page->transaction() == nullptr);
+    page->Release(this);
+    --page_count_;
+    --page_capacity_;
+    ++dropped_pages;
+  }
+  return dropped_pages;
+}
+
+Status PagePool::ReadStorePage(Page* page) {
+  DCHECK(page != nullptr);
+  DCHECK(!page->IsUnpinned());
+  DCHECK(!page->has_pending_io());
+
+  StoreImpl* store = page->transaction()->store();
+  if (!store->IsOpen())
+    return store->ReadPage(page);
+
+  page->set_pending_io(true);
+  store->PageIoStarted();
+  Status status;
+  {
+    PoolImpl::Unlock unlock(pool_);
+    status = store->ReadPage(page);
+  }
+  page->set_pending_io(false);
+  store->PageIoCompleted();
+  pool_->PageIoCompleted();
+  return status;
+}
+
 Status PagePool::FetchStorePage(Page *page, PageFetchMode fetch_mode) {
   DCHECK(page != nullptr);
   DCHECK(page->transaction() != nullptr);
@@ -161,8 +426,29 @@ Status PagePool::FetchStorePage(Page *page, PageFetchMode fetch_mode) {
   DCHECK_EQ(page->page_pool(), this);
 #endif  // DCHECK_IS_ON()
 
-  if (fetch_mode == PagePool::kFetchPageData)
-    return page->transaction()->store()->ReadPage(page);
+  StoreImpl* store = page->transaction()->store();
+  if (fetch_mode == PagePool::kFetchPageData &&
+      store->IsPageMapped(page->page_id())) {
+    // Mapped pages are never compressed, so the compressed cache is skipped.
+    // ReadStorePage() points the entry into the mapping, so a buffer left
+    // over from the entry's previous use is released.
+    Status status = ReadStorePage(page);
+    if (status == Status::kSuccess && page->is_mapped() && page->has_buffer())
+      page->ReleaseBuffer(this);
+    return status;
+  }
+
+  if (!page->has_buffer())
+    page->AllocBuffer(this);
+  if (fetch_mode == PagePool::kFetchPageData) {
+    if (compressed_cache_.Fetch(store, page->page_id(), page->data()))
+      return Status::kSuccess;
+    return ReadStorePage(page);
+  }
+
+  // The compressed cache must not hold a copy of a page in the pool, because
+  // the copy would become stale when the page is modified.
+  compressed_cache_.Remove(store, page->page_id());
 
   // Technically, the page should be marked dirty here, to reflect the fact that
   // the in-memory data does not match the on-disk page content. However,
@@ -187,15 +473,19 @@ Status PagePool::AssignPageToStore(
   DCHECK_EQ(page->page_pool(), this);
 #endif  // DCHECK_IS_ON()
 
+  // The page is cached before it is read, so other threads looking for it wait
+  // for the read, instead of reading it again.
   TransactionImpl* transaction = store->init_transaction();
   page->Assign(transaction, page_id);
   transaction->PageAssigned(page);
+  page_map_[std::make_pair(store, page_id)] = page;
+  store->PoolPageAssigned();
   Status fetch_status = FetchStorePage(page, fetch_mode);
-  if (fetch_status == Status::kSuccess) {
-    page_map_[std::make_pair(store, page_id)] = page;
+  if (fetch_status == Status::kSuccess)
     return Status::kSuccess;
-  }
 
+  page_map_.erase(std::make_pair(store, page_id));
+  store->PoolPageUnassigned();
   page->UnassignFromStore();
   transaction->PageUnassigned(page);
   return fetch_status;
@@ -211,10 +501,33 @@ void PagePool::PinStorePage(Page* page) {
   // If the page is already pinned, it is not contained in any list. If the page
   // has no pins, it must be in the LRU list.
   if (page->IsUnpinned())
-    lru_list_.erase(page);
+    EraseLruPage(page);
   page->AddPin();
 }
 
+void PagePool::StoreCreated(StoreImpl* store) {
+  DCHECK(store != nullptr);
+  store_weight_sum_ += store->pool_weight();
+  stores_.push_back(store);
+}
+
+size_t PagePool::StoreShare(const StoreImpl* store) const noexcept {
+  if (store_weight_sum_ == 0)
+    return page_capacity_;
+  return page_capacity_ * store->pool_weight() / store_weight_sum_;
+}
+
+void PagePool::StoreClosed(StoreImpl* store) {
+  DCHECK(store != nullptr);
+  DCHECK(!store->IsOpen());
+  DCHECK_EQ(store->pool_page_count(), 0U);
+  DCHECK_LE(store->pool_weight(), store_weight_sum_);
+
+  store_weight_sum_ -= store->pool_weight();
+  stores_.erase(std::find(stores_.begin(), stores_.end(), store));
+  compressed_cache_.RemoveStorePages(store);
+}
+
 void PagePool::PinTransactionPages(
     LinkedList<Page, Page::TransactionLinkedListBridge> *page_list) {
   DCHECK(page_list != nullptr);
@@ -228,30 +541,168 @@ void PagePool::PinTransactionPages(
   }
 }
 
-Status PagePool::StorePage(
-    StoreImpl* store, size_t page_id, PageFetchMode fetch_mode, Page** result) {
+Status PagePool::WriteBackStorePage(StoreImpl* store, size_t page_id) {
   DCHECK(store != nullptr);
 
   const auto& it = page_map_.find(std::make_pair(store, page_id));
-  if (it != page_map_.end()) {
-    Page* page = it->second;
-    DCHECK_EQ(store, page->transaction()->store());
-    DCHECK_EQ(page_id, page->page_id());
+  if (it == page_map_.end())
+    return Status::kSuccess;
+  Page* page = it->second;
+  if (!page->is_dirty())
+    return Status::kSuccess;
+
+  Status status = store->WritePage(page);
+  if (status == Status::kSuccess)
+    page->MarkDirty(false);
+  return status;
+}
+
+Status PagePool::WriteBackStorePages(
+    StoreImpl* store, const size_t* page_ids, size_t page_count) {
+  DCHECK(store != nullptr);
+
+  std::vector<Page*, PlatformAllocator<Page*>> dirty_pages;
+  for (size_t i = 0; i < page_count; ++i) {
+    const auto& it = page_map_.find(std::make_pair(store, page_ids[i]));
+    if (it != page_map_.end() && it->second->is_dirty())
+      dirty_pages.push_back(it->second);
+  }
+  if (dirty_pages.empty())
+    return Status::kSuccess;
+
+  Status status = store->WritePages(dirty_pages.data(), dirty_pages.size());
+  if (status == Status::kSuccess) {
+    for (Page* page : dirty_pages)
+      page->MarkDirty(false);
+  }
+  return status;
+}
+
+bool PagePool::StartStorePageFetch(
+    StoreImpl* store, size_t page_id, AsyncPageFetch* fetch) {
+  DCHECK(store != nullptr);
+  DCHECK(fetch != nullptr);
+  DCHECK(fetch->io.completion_task != nullptr);
+
+  if (!store->IsOpen() || !store->CanSubmitPageRead(page_id) ||
+      page_map_.count(std::make_pair(store, page_id)) != 0) {
+    return false;
+  }
+
+  Page* page = AllocPageEntry(store, LocalNumaNode());
+  if (page == nullptr)
+    return false;
+  // See StorePage() for the ways in which allocating can change the pool.
+  if (store->IsClosed() ||
+      page_map_.count(std::make_pair(store, page_id)) != 0) {
+    UnpinUnassignedPage(page);
+    return false;
+  }
+  ++recent_misses_;
+
+  TransactionImpl* transaction = store->init_transaction();
+  page->Assign(transaction, page_id);
+  transaction->PageAssigned(page);
+  page_map_[std::make_pair(store, page_id)] = page;
+  store->PoolPageAssigned();
+  if (!page->has_buffer())
+    page->AllocBuffer(this);
+  if (compressed_cache_.Fetch(store, page_id, page->data())) {
+    UnpinStorePage(page);
+    return false;
+  }
+
+  // Other threads looking for the page wait for the read, as in
+  // ReadStorePage(). The store's Close() waits for the read as well.
+  page->set_pending_io(true);
+  store->PageIoStarted();
+  fetch->page = page;
+  store->SubmitPageRead(page, &fetch->io);
+  return true;
+}
+
+Status PagePool::FinishStorePageFetch(AsyncPageFetch* fetch) {
+  DCHECK(fetch != nullptr);
+  Page* page = fetch->page;
+  DCHECK(page != nullptr);
+  DCHECK(page->has_pending_io());
 #if DCHECK_IS_ON()
-    DCHECK_EQ(page->page_pool(), this);
+  DCHECK_EQ(page->page_pool(), this);
 #endif  // DCHECK_IS_ON()
 
-    // The page can either be pinned (by another transaction/cursor) or unpinned
-    // and waiting in the LRU list. The check in PinStorePage() is needed for
-    // correctness.
-    PinStorePage(page);
-    *result = page;
+  TransactionImpl* transaction = page->transaction();
+  StoreImpl* store = transaction->store();
+  Status status = store->FinishPageRead(page, fetch->io);
+  page->set_pending_io(false);
+  store->PageIoCompleted();
+  pool_->PageIoCompleted();
+  fetch->page = nullptr;
+
+  if (status == Status::kSuccess) {
+    UnpinStorePage(page);
     return Status::kSuccess;
   }
 
-  Page* page = AllocPage();
-  if (page == nullptr)
-    return Status::kPoolFull;
+  page_map_.erase(std::make_pair(store, page->page_id()));
+  store->PoolPageUnassigned();
+  page->UnassignFromStore();
+  transaction->PageUnassigned(page);
+  UnpinUnassignedPage(page);
+  return status;
+}
+
+Status PagePool::StorePage(
+    StoreImpl* store, size_t page_id, PageFetchMode fetch_mode, Page** result) {
+  DCHECK(store != nullptr);
+
+  Page* page;
+  while (true) {
+    const auto& it = page_map_.find(std::make_pair(store, page_id));
+    if (it != page_map_.end()) {
+      page = it->second;
+      DCHECK_EQ(store, page->transaction()->store());
+      DCHECK_EQ(page_id, page->page_id());
+#if DCHECK_IS_ON()
+      DCHECK_EQ(page->page_pool(), this);
+#endif  // DCHECK_IS_ON()
+
+      // Another thread is reading the page. The read may fail, which removes
+      // the page from the map, so the lookup must be repeated.
+      if (page->has_pending_io()) {
+        pool_->WaitForPageIo();
+        continue;
+      }
+
+      // The page can either be pinned (by another transaction/cursor) or
+      // unpinned and waiting in the LRU list. The check in PinStorePage() is
+      // needed for correctness.
+      PinStorePage(page);
+      *result = page;
+      return Status::kSuccess;
+    }
+
+    ++recent_misses_;
+    page = AllocPageEntry(store, LocalNumaNode());
+    if (page == nullptr) {
+      if (!pool_->waits_for_pinned_pages())
+        return Status::kPoolFull;
+      page = WaitAndAllocPage(store);
+      if (page == nullptr)
+        return Status::kPoolFull;
+    }
+
+    // Allocating may release the pool's lock, while waiting for pinned pages,
+    // or while closing a store whose evicted page could not be written back.
+    // Another thread may have started caching the page in the meantime, and
+    // the requesting store itself may have been closed.
+    if (store->IsClosed()) {
+      UnpinUnassignedPage(page);
+      return Status::kAlreadyClosed;
+    }
+    if (page_map_.count(std::make_pair(store, page_id)) == 0)
+      break;
+    UnpinUnassignedPage(page);
+  }
 #if DCHECK_IS_ON()
   DCHECK_EQ(page->page_pool(), this);
 #endif  // DCHECK_IS_ON()
@@ -9,9 +9,12 @@
 #include <cstdint>
 #include <functional>
 #include <unordered_map>
+#include <vector>
 
 #include "berrydb/platform.h"
 #include "berrydb/status.h"
+#include "./compressed_page_cache.h"
+#include "./data_io_request.h"
 #include "./page.h"
 #include "./util/linked_list.h"
 #include "./util/platform_allocator.h"
@@ -22,6 +25,22 @@ class PoolImpl;
 class Store;
 class StoreImpl;
 
+/** A store page read that does not block the thread that starts it.
+ *
+ * Started by PagePool::StartStorePageFetch(). The caller sets the request's
+ * completion task, which is queued on the pool's asynchronous operation
+ * threads when the read completes, and must call
+ * PagePool::FinishStorePageFetch() while holding the pool's lock.
+ */
+struct AsyncPageFetch {
+  /** The data file read. */
+  DataIoRequest io;
+
+  /** The pool entry that receives the page. Pinned while the read is pending.
+   */
+  Page* page = nullptr;
+};
+
 /**
  * Manages buffers used as scratch pad and cache for a store's data pages.
  *
@@ -44,9 +63,10 @@ class StoreImpl;
  * Taking the above into consideration, a page pool is a specialized cache
  * memory whose entries are buffers that cache on-disk pages. A page pool can
  * cache pages from any number of different stores, as long as the stores have
- * the same page size. In fact, an application aiming for maximum efficiency
- * given a fixed memory budget will use a single page pool for all its open
- * stores.
+ * the same page size. A resource pool has one page pool for each page size
+ * used by its stores, and the page pools share the resource pool's memory
+ * budget. The resource pool moves capacity between its page pools, towards the
+ * page sizes that see the most misses.
  *
  * To speed up initialization, a page pool does not allocate memory for its
  * entire capacity when it is created. Instead, the entries are allocated as
@@ -80,7 +100,37 @@ class StoreImpl;
  *
  * Bootstrapping code may call UnpinAndWriteStorePage() instead of the usual
  * UnpinStorePage(), which hints the page pool that the entry should be evicted
- * immediately.
+ * immediately. Code that streams through pages that are unlikely to be reused,
+ * such as overflow pages, calls UnpinAndEvictStorePage() so the pages do not
+ * push the cached entries out of the LRU list.
+ *
+ * Pages belong to priority classes, such as B-tree leaves and inner nodes, and
+ * each class has its own LRU list. The pages in lower classes are evicted
+ * first, so a burst of leaf accesses does not evict the inner nodes used by
+ * every lookup, and point lookups that miss the pool only need to read the
+ * leaf. Root and inner pages make up a hot set, which stays resident without
+ * being pinned. If the hot set grows past half of the pool, its inner pages
+ * are evicted first, so leaves can still be cached.
+ *
+ * Stores sharing a page pool can be given quotas. Each store gets a share of
+ * the pool proportional to its weight, and may also have a number of reserved
+ * entries, and a maximum number of entries. When the pool is full, the LRU
+ * page of a store over its share is evicted first, followed by the LRU page of
+ * a store over its reservation. A store at its maximum evicts its own pages.
+ * Each store also keeps its unpinned pages in LRU lists of its own, so these
+ * pages are found without walking past the other stores' pages.
+ *
+ * A page pool may have a second cache tier, which holds compressed copies of
+ * the store pages evicted from the LRU list. Store page requests that miss the
+ * pool check the compressed cache before reading from the store's data file.
+ *
+ * On NUMA machines, a page pool may be partitioned by NUMA node. Each entry's
+ * buffer is backed by one node's memory, and the entry stays in that node's
+ * unused entry list and LRU lists. Page requests that miss the pool are served
+ * by entries on the requesting thread's node, and only fall back to other
+ * nodes' entries when the local partition has no entry to spare. The map from
+ * store pages to entries is not partitioned, because a cached page on a remote
+ * node is still much cheaper than a read from the store's data file.
  */
 class PagePool {
  public:
@@ -99,8 +149,21 @@ class PagePool {
     kIgnorePageData = false,
   };
 
-  /** Sets up a page pool. Page memory may be allocated on-demand. */
-  PagePool(PoolImpl* pool, size_t page_shift, size_t page_capacity);
+  /** Sets up a page pool. Page memory may be allocated on-demand.
+   *
+   * @param pool                  the resource pool that owns this page pool
+   * @param page_shift            base-2 log of the pool's page size
+   * @param page_capacity         maximum number of pages in the pool
+   * @param compressed_cache_size maximum number of bytes used by the
+   *                              compressed cache tier; 0 disables the tier
+   * @param numa_node_count       number of NUMA nodes that the entries are
+   *                              partitioned across; at most kMaxNumaNodes
+   */
+  PagePool(PoolImpl* pool, size_t page_shift, size_t page_capacity,
+           size_t compressed_cache_size = 0, size_t numa_node_count = 1);
+
+  /** Upper bound for the number of partitions in a page pool. */
+  static constexpr size_t kMaxNumaNodes = 8;
 
   /** Deallocates the memory used by the pool's pages. */
   ~PagePool();
@@ -121,11 +184,42 @@ class PagePool {
    *                    pool entry holding the page
    * @return            may return kPoolFull if the page pool is (almost) full
    *                    and cannot find a free page, or kIoError if reading the
-   *                    store page failed */
+   *                    store page failed; if the resource pool waits for
+   *                    pinned pages, kPoolFull is only returned after the
+   *                    wait times out; kAlreadyClosed if the store was closed
+   *                    while a page was being allocated, for example because
+   *                    writing back an evicted page failed */
   Status StorePage(
       StoreImpl* store, size_t page_id, PageFetchMode fetch_mode,
       Page** result);
 
+  /** Starts caching a store page, without waiting for the page's data.
+   *
+   * This lets asynchronous operations avoid occupying a thread while the page
+   * is read. No read is started if the page is already cached, if the pool has
+   * no unused or evictable page, or if StoreImpl::CanSubmitPageRead() is false
+   * for the page. Pages found in the compressed page cache are cached right
+   * away.
+   *
+   * @param  store   the store to fetch a page from
+   * @param  page_id the page that will be cached
+   * @param  fetch   receives the read's state; the request's completion task
+   *                 must be set, and the pool must have asynchronous operation
+   *                 threads
+   * @return         true if a read was started, so the fetch's completion task
+   *                 will be queued; false if the page needs no read, or must be
+   *                 fetched using StorePage() */
+  bool StartStorePageFetch(
+      StoreImpl* store, size_t page_id, AsyncPageFetch* fetch);
+
+  /** Finishes caching a page whose read was started by StartStorePageFetch().
+   *
+   * The page is unpinned, and stays cached if the read succeeded.
+   *
+   * @param  fetch the structure passed to StartStorePageFetch()
+   * @return       the same result as the read done by StorePage() */
+  Status FinishStorePageFetch(AsyncPageFetch* fetch);
+
   /** Releases a Page previously obtained by StorePage().
    *
    * The method removes the caller's pin from this pool page entry. The page
@@ -159,6 +253,46 @@ class PagePool {
    */
   void UnpinAndWriteStorePage(Page* page);
 
+  /** Releases a Page previously obtained by StorePage(), bypassing the LRU.
+   *
+   * This is similar to UnpinStorePage(), but the caller is supplying an extra
+   * hint that the page will not be used again soon. If the caller held the last
+   * pin, the page is written back if dirty, and the page pool entry is moved to
+   * the unused entry list instead of the LRU list. The next StorePage() call
+   * will reuse the entry, so streaming through many pages, such as the pages
+   * holding a large value, does not evict the pages in the LRU list.
+   *
+   * As with other write-backs, an I/O error closes the page's store.
+   *
+   * @param  page a page that was previously obtained from this pool using
+   *             StorePage()
+   */
+  void UnpinAndEvictStorePage(Page* page);
+
+  /** Writes back a store page, if it is cached and dirty.
+   *
+   * Pages that are not cached need no write, as dirty pages are written back
+   * when they are evicted. The page stays cached, and is clean afterwards.
+   *
+   * @param  store   the store that owns the page
+   * @param  page_id the page to be written back
+   * @return         most likely kSuccess or kIoError
+   */
+  Status WriteBackStorePage(StoreImpl* store, size_t page_id);
+
+  /** Writes back several store pages, keeping the writes in flight together.
+   *
+   * Behaves like calling WriteBackStorePage() for each page, except that the
+   * dirty pages are written using a single StoreImpl::WritePages() call.
+   *
+   * @param  store      the store that owns the pages
+   * @param  page_ids   the pages to be written back
+   * @param  page_count the number of entries in page_ids
+   * @return            most likely kSuccess or kIoError
+   */
+  Status WriteBackStorePages(
+      StoreImpl* store, const size_t* page_ids, size_t page_count);
+
   /** The base-2 log of the pool's page size. */
   inline size_t page_shift() const noexcept { return page_shift_; }
 
@@ -171,26 +305,137 @@ class PagePool {
   /** Total number of pages allocated for this pool. */
   inline size_t allocated_pages() const noexcept { return page_count_; }
 
+  /** Number of pool pages that currently own a data buffer.
+   *
+   * Pages that point into a store's data file mapping release their buffers,
+   * so this can be smaller than allocated_pages() when mapping is used.
+   */
+  inline size_t allocated_page_buffers() const noexcept {
+    return buffer_count_;
+  }
+
+  /** Heap memory held by the pool's page entries and their buffers.
+   *
+   * This only counts page entries and their data buffers, which make up the
+   * bulk of a pool's memory. Bookkeeping such as the page map is not counted.
+   */
+  inline size_t resident_bytes() const noexcept {
+    return page_count_ * sizeof(Page) + buffer_count_ * page_size_;
+  }
+
+  /** Called by Page when it allocates its data buffer. */
+  inline void PageBufferAllocated() noexcept { ++buffer_count_; }
+
+  /** Called by Page when it releases its data buffer. */
+  inline void PageBufferReleased() noexcept {
+    DCHECK_GT(buffer_count_, 0U);
+    --buffer_count_;
+  }
+
   /** Number of pages that were allocated and are now unused.
    *
    * Pool pages can become unused when a store is closed or experiences I/O
    * errors. These pages are added to a free list, so future demand can be met
    * without invoking the platform allocator.
    */
-  inline size_t unused_pages() const noexcept { return free_list_.size(); }
+  inline size_t unused_pages() const noexcept {
+    size_t unused_pages = 0;
+    for (size_t i = 0; i < numa_node_count_; ++i)
+      unused_pages += partitions_[i].free_list.size();
+    return unused_pages;
+  }
+
+  /** Number of unused pages backed by a NUMA node's memory. */
+  inline size_t unused_pages(size_t numa_node) const noexcept {
+    DCHECK_LT(numa_node, numa_node_count_);
+    return partitions_[numa_node].free_list.size();
+  }
 
   /** Number of pages that are pinned by running transactions.
    *
    * Only unpinned pages can be evicted and reused to meed demands for new
    * pages. If all pages in the pool become pinned, transactions that need more
-   * page pool entries will be aborted. */
+   * page pool entries wait for other transactions to unpin pages, and fail if
+   * the wait times out. */
   inline size_t pinned_pages() const noexcept {
-    return page_count_ - free_list_.size() - lru_list_.size();
+    return page_count_ - unused_pages() - lru_page_count();
+  }
+
+  /** Number of unpinned pages that cache store pages. */
+  inline size_t lru_page_count() const noexcept {
+    size_t lru_page_count = 0;
+    for (size_t i = 0; i < numa_node_count_; ++i) {
+      for (const LinkedList<Page>& lru_list : partitions_[i].lru_lists)
+        lru_page_count += lru_list.size();
+    }
+    return lru_page_count;
   }
 
+  /** Number of unpinned pages in a priority class. */
+  inline size_t lru_page_count(PagePriority priority) const noexcept {
+    size_t lru_page_count = 0;
+    for (size_t i = 0; i < numa_node_count_; ++i)
+      lru_page_count += partitions_[i].lru_lists[
+          static_cast<size_t>(priority)].size();
+    return lru_page_count;
+  }
+
+  /** Number of NUMA nodes that the pool's entries are partitioned across.
+   *
+   * This is 1 for pools that are not partitioned. */
+  inline size_t numa_node_count() const noexcept { return numa_node_count_; }
+
+  /** Number of recent StorePage() calls that missed the pool.
+   *
+   * The resource pool uses this count to decide which of its page pools gets
+   * more of the memory budget. */
+  inline size_t recent_misses() const noexcept { return recent_misses_; }
+
+  /** Halves recent_misses(), so the count favors recent demand. */
+  inline void DecayMisses() noexcept { recent_misses_ >>= 1; }
+
+  /** Raises the pool's capacity by one page.
+   *
+   * As with the initial capacity, the page's memory is allocated on demand. */
+  inline void GrowCapacity() noexcept { ++page_capacity_; }
+
+  /** Lowers the pool's capacity, and releases the memory of dropped pages.
+   *
+   * Capacity that is not backed by allocated pages is dropped first, followed
+   * by unused pages. Afterwards, pages are evicted from the LRU list, and dirty
+   * pages are written back. Pinned pages cannot be dropped.
+   *
+   * @param  page_count the desired capacity reduction, in pages
+   * @return            the capacity reduction achieved, in pages; may be less
+   *                    than page_count if too many pages are pinned
+   */
+  size_t ShrinkCapacity(size_t page_count);
+
   /** The resource pool that this page pool belongs to. */
   inline PoolImpl* pool() const noexcept { return pool_; }
 
+  /** The second cache tier, which holds compressed evicted pages. */
+  inline CompressedPageCache* compressed_cache() noexcept {
+    return &compressed_cache_;
+  }
+
+  /** Called when a store whose pages may be cached by this pool is created.
+   *
+   * Registers the store's weight, which is used to compute the pool share of
+   * each store. */
+  void StoreCreated(StoreImpl* store);
+
+  /** The share of this pool's entries that a store should use under contention.
+   *
+   * @param  store a store that uses this pool
+   * @return       the number of entries proportional to the store's weight */
+  size_t StoreShare(const StoreImpl* store) const noexcept;
+
+  /** Called when a store whose pages may be cached by this pool is closed.
+   *
+   * All the store's pages must have been removed from the pool's entries. */
+  void StoreClosed(StoreImpl* store);
+
   /**
    * Allocates a page and pins it.
    *
@@ -200,9 +445,25 @@ class PagePool {
    *
    * The caller is responsible for reducing the page's pin count.
    *
-   * @return a pinned page, or nullptr if the pool is at capacity
+   * @param  requester the store whose page will be cached by the allocated
+   *                   entry, if any; used to enforce the store quotas
+   * @return           a pinned page, or nullptr if the pool is at capacity
+   */
+  inline Page* AllocPage(StoreImpl* requester = nullptr) {
+    return AllocPage(requester, LocalNumaNode());
+  }
+
+  /** Allocates a page and pins it, preferring a NUMA node's partition.
+   *
+   * This method is intended for internal and testing use.
+   *
+   * @param  requester see AllocPage()
+   * @param  numa_node the partition that the page should come from; pages in
+   *                   other partitions are used if this partition's unused and
+   *                   evictable pages are all protected or pinned
+   * @return           a pinned page, or nullptr if the pool is at capacity
    */
-  Page* AllocPage();
+  Page* AllocPage(StoreImpl* requester, size_t numa_node);
 
   /** Releases a Page previously obtained by Alloc().
    *
@@ -267,6 +528,110 @@ class PagePool {
       LinkedList<Page, Page::TransactionLinkedListBridge>* page_list);
 
  private:
+  /** Waits for other threads to release pages, then allocates a page.
+   *
+   * Called when AllocPage() fails and the resource pool waits for pinned pages.
+   *
+   * @param  requester see AllocPage()
+   * @return           a pinned page without a data buffer, or nullptr if the
+   *                   wait timed out */
+  Page* WaitAndAllocPage(StoreImpl* requester);
+
+  /** AllocPage() without the guarantee that the page has a data buffer.
+   *
+   * Entries that last cached a memory-mapped store page have no buffer. Store
+   * pages are allocated with this method, and FetchStorePage() only allocates
+   * a buffer if the page will not be mapped.
+   *
+   * @param  requester see AllocPage()
+   * @param  numa_node see AllocPage()
+   * @return           a pinned page, or nullptr if the pool is at capacity */
+  Page* AllocPageEntry(StoreImpl* requester, size_t numa_node);
+
+  /** Reads a pool entry's page data from its store, without the pool's lock.
+   *
+   * While the read is in progress, the page is marked as having pending I/O,
+   * and other threads looking for the page wait for the read. The pool's lock
+   * is held throughout the read if the store is not open, because Close() only
+   * waits for the I/O started before it.
+   *
+   * @param  page a pinned page pool entry that is associated with a store
+   * @return      the result of StoreImpl::ReadPage() */
+  Status ReadStorePage(Page* page);
+
+  /** The partition serving the page requests of the current thread. */
+  inline size_t LocalNumaNode() const {
+    if (numa_node_count_ == 1)
+      return 0;
+    return CurrentNumaNode() % numa_node_count_;
+  }
+
+  /** Removes an entry from a partition's unused entry list, and pins it.
+   *
+   * @return a pinned unused page, or nullptr if the partition has none */
+  Page* PopUnusedPage(size_t numa_node);
+
+  /** Picks the LRU list page to be evicted so a store can cache a page.
+   *
+   * @param  requester see AllocPage()
+   * @param  numa_node the partition whose LRU lists are searched
+   * @return           a page in an LRU list, or nullptr if all the pages in the
+   *                   lists are protected by their stores' reservations */
+  Page* ChooseEvictionVictim(StoreImpl* requester, size_t numa_node);
+
+  /** Picks the page to be evicted from one priority class's LRU list.
+   *
+   * Only the stores' own LRU lists are consulted, so the choice takes time
+   * proportional to the number of stores using the pool.
+   *
+   * @param  requester see AllocPage()
+   * @param  numa_node the partition whose LRU list is searched
+   * @param  priority  the priority class whose LRU list is searched
+   * @return           a page in the list, or nullptr if all the pages in the
+   *                   list are protected by their stores' reservations */
+  Page* ChooseEvictionVictim(
+      StoreImpl* requester, size_t numa_node, PagePriority priority);
+
+  /** The LRU list holding a page, while the page is unpinned. */
+  inline LinkedList<Page>* lru_list(Page* page) noexcept {
+    DCHECK_LT(page->numa_node(), numa_node_count_);
+    return &partitions_[page->numa_node()].lru_lists[
+        static_cast<size_t>(page->priority())];
+  }
+
+  /** The list that holds a page's store's pages in the page's LRU list. */
+  LinkedList<Page, Page::StoreLruListBridge>* store_lru_list(Page* page);
+
+  /** Adds an unpinned page at the end of its LRU lists. */
+  void PushLruPage(Page* page);
+
+  /** Removes a page from its LRU lists, before the page is pinned. */
+  void EraseLruPage(Page* page);
+
+  /** The unused entry list that receives a page when it is freed. */
+  inline LinkedList<Page>* free_list(Page* page) noexcept {
+    DCHECK_LT(page->numa_node(), numa_node_count_);
+    return &partitions_[page->numa_node()].free_list;
+  }
+
+  /** True if the hot set's inner pages should be evicted before other pages. */
+  inline bool HotSetOverflows() const noexcept {
+    return lru_page_count(PagePriority::kRoot) +
+        lru_page_count(PagePriority::kInner) > (page_capacity_ >> 1);
+  }
+
+  /** The least recently used page in the LRU lists that caches a store's page.
+   *
+   * @param  numa_node the partition that is searched first
+   * @return           a page in an LRU list, or nullptr if no unpinned page
+   *                   caches one of the store's pages */
+  Page* StoreLruPage(StoreImpl* store, size_t numa_node);
+
+  /** Removes a page from the LRU list, and unassigns it from its store.
+   *
+   * @return the evicted page, which is pinned and unassigned */
+  Page* EvictPage(Page* page);
+
   /** Entries that belong to this page pool that are assigned to stores. */
   using PageMapKey = std::pair<StoreImpl*, size_t>;
   std::unordered_map<PageMapKey, Page*, PointerSizeHasher<StoreImpl>,
@@ -281,24 +646,52 @@ class PagePool {
   /** Number of pages currently held by the pool. */
   size_t page_count_ = 0;
 
-  /** The list of pages that haven't been returned to the OS.
-   *
-   * This is only populated when a Store is closed and its pages are flushed
-   * from the pool.
-   */
-  LinkedList<Page> free_list_;
+  /** See allocated_page_buffers(). */
+  size_t buffer_count_ = 0;
 
-  /** Pages that can be evicted, ordered by the relative time of last use.
-   *
-   * The first page in the list is the least recently used (LRU) page. The LRU
-   * cache replacement policy should be implemented by removing the first page
-   * in this list (pop_front), and pages should be added at the end of the list
-   * (push_back).
-   */
-  LinkedList<Page> lru_list_;
+  /** See recent_misses(). */
+  size_t recent_misses_ = 0;
+
+  /** Sum of the weights of the stores using this pool. */
+  size_t store_weight_sum_ = 0;
+
+  /** The stores using this pool. */
+  std::vector<StoreImpl*, PlatformAllocator<StoreImpl*>> stores_;
+
+  /** The lru_stamp() of the page most recently added to an LRU list. */
+  size_t lru_clock_ = 0;
+
+  /** The entries backed by one NUMA node's memory that are not pinned. */
+  struct NumaPartition {
+    /** The list of pages that haven't been returned to the OS.
+     *
+     * This is only populated when a Store is closed and its pages are flushed
+     * from the pool.
+     */
+    LinkedList<Page> free_list;
+
+    /** Pages that can be evicted, ordered by the relative time of last use.
+     *
+     * There is one list for each priority class, indexed by PagePriority. The
+     * first page in each list is the least recently used (LRU) page. The LRU
+     * cache replacement policy should be implemented by removing the first
+     * page in a list (pop_front), and pages should be added at the end of the
+     * list (push_back).
+     */
+    LinkedList<Page> lru_lists[kPagePriorityCount];
+  };
+
+  /** See numa_node_count(). */
+  const size_t numa_node_count_;
+
+  /** The pool's partitions. Only the first numa_node_count_ ones are used. */
+  NumaPartition partitions_[kMaxNumaNodes];
 
   /** Log pages waiting to be written to disk. */
   LinkedList<Page> log_list_;
+
+  /** Compressed copies of store pages evicted from the LRU list. */
+  CompressedPageCache compressed_cache_;
 };
 
 }  // namespace berrydb
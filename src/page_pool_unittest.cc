@@ -4,9 +4,13 @@
 
 #include "./page_pool.h"
 
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
 #include <random>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -18,6 +22,7 @@
 #include "./store_impl.h"
 #include "./test/block_access_file_wrapper.h"
 #include "./test/file_deleter.h"
+#include "./util/thread_pool.h"
 #include "./util/unique_ptr.h"
 
 namespace berrydb {
@@ -41,10 +46,12 @@ class PagePoolTest : public ::testing::Test {
     log_file1_.reset(raw_log_file1);
   }
 
-  void CreatePool(int page_shift, int page_capacity) {
+  void CreatePool(int page_shift, int page_capacity,
+                  size_t compressed_page_cache_size = 0) {
     PoolOptions options;
     options.page_shift = page_shift;
     options.page_pool_size = page_capacity;
+    options.compressed_page_cache_size = compressed_page_cache_size;
     pool_.reset(PoolImpl::Create(options));
   }
 
@@ -66,6 +73,9 @@ class PagePoolTest : public ::testing::Test {
 
   const std::string kStoreFileName1 = "test_page_pool_1.berry";
   constexpr static size_t kStorePageShift = 12;
+  // Store writes overwrite the rest of each page with a checksum trailer.
+  constexpr static size_t kUsablePageSize =
+      (1 << kStorePageShift) - StoreImpl::kPageTrailerSize;
 
   Vfs* vfs_;
   // Must precede UniquePtr members, because on Windows all file handles must be
@@ -190,6 +200,149 @@ TEST_F(PagePoolTest, AllocUsesLruList) {
   page_pool->UnpinUnassignedPage(page2);
 }
 
+TEST_F(PagePoolTest, AllocPrefersLocalNumaPartition) {
+  CreatePool(12, 2);
+  PagePool page_pool(pool_.get(), 12, 2, 0, 2);
+  EXPECT_EQ(2U, page_pool.numa_node_count());
+
+  Page* page1 = page_pool.AllocPage(nullptr, 1);
+  ASSERT_NE(nullptr, page1);
+  EXPECT_EQ(1U, page1->numa_node());
+  Page* page0 = page_pool.AllocPage(nullptr, 0);
+  ASSERT_NE(nullptr, page0);
+  EXPECT_EQ(0U, page0->numa_node());
+
+  page_pool.UnpinUnassignedPage(page0);
+  page_pool.UnpinUnassignedPage(page1);
+  EXPECT_EQ(1U, page_pool.unused_pages(0));
+  EXPECT_EQ(1U, page_pool.unused_pages(1));
+  EXPECT_EQ(2U, page_pool.unused_pages());
+
+  EXPECT_EQ(page1, page_pool.AllocPage(nullptr, 1));
+  // The local partition has no unused pages left, so the pool falls back to
+  // the other partition.
+  EXPECT_EQ(page0, page_pool.AllocPage(nullptr, 1));
+  EXPECT_EQ(nullptr, page_pool.AllocPage(nullptr, 1));
+  EXPECT_EQ(2U, page_pool.pinned_pages());
+
+  page_pool.UnpinUnassignedPage(page0);
+  page_pool.UnpinUnassignedPage(page1);
+  EXPECT_EQ(1U, page_pool.unused_pages(0));
+  EXPECT_EQ(1U, page_pool.unused_pages(1));
+}
+
+TEST_F(PagePoolTest, EvictionPrefersLocalNumaPartition) {
+  CreatePool(kStorePageShift, 2);
+  PagePool page_pool(pool_.get(), kStorePageShift, 2, 0, 2);
+
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file1_.release(), data_file1_size_, log_file1_.release(),
+      log_file1_size_, &page_pool, StoreOptions()));
+
+  Page* pages[2];
+  for (size_t numa_node = 0; numa_node < 2; ++numa_node) {
+    Page* page = page_pool.AllocPage(nullptr, numa_node);
+    ASSERT_NE(nullptr, page);
+    ASSERT_EQ(Status::kSuccess, page_pool.AssignPageToStore(
+        page, store.get(), numa_node, PagePool::kIgnorePageData));
+    // Unset the page's dirty bit to avoid having the page written to the
+    // store when it is evicted from the LRU list.
+    page->MarkDirty(false);
+    pages[numa_node] = page;
+  }
+  page_pool.UnpinStorePage(pages[0]);
+  page_pool.UnpinStorePage(pages[1]);
+
+  // The page on node 1 is evicted, even though node 0's page is older.
+  Page* page = page_pool.AllocPage(nullptr, 1);
+  EXPECT_EQ(pages[1], page);
+  EXPECT_EQ(1U, page_pool.lru_page_count());
+
+  page_pool.UnpinUnassignedPage(page);
+  store->Close();
+}
+
+TEST_F(PagePoolTest, EvictionPrefersLowPriorityPages) {
+  CreatePool(kStorePageShift, 3);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file1_.release(), data_file1_size_, log_file1_.release(),
+      log_file1_size_, page_pool, StoreOptions()));
+
+  Page* pages[3];
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), i, PagePool::kIgnorePageData, &pages[i]));
+    EXPECT_EQ(PagePriority::kLeaf, pages[i]->priority());
+  }
+  pages[0]->set_priority(PagePriority::kInner);
+  for (size_t i = 0; i < 3; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+  EXPECT_EQ(1U, page_pool->lru_page_count(PagePriority::kInner));
+  EXPECT_EQ(2U, page_pool->lru_page_count(PagePriority::kLeaf));
+
+  // The inner page is the least recently used page, but leaves go first.
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 3, PagePool::kIgnorePageData, &page));
+  EXPECT_EQ(pages[1], page);
+  EXPECT_EQ(PagePriority::kLeaf, page->priority());
+
+  // Overflow pages go before leaves.
+  page->set_priority(PagePriority::kOverflow);
+  page_pool->UnpinStorePage(page);
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 4, PagePool::kIgnorePageData, &page));
+  EXPECT_EQ(pages[1], page);
+  EXPECT_EQ(PagePriority::kLeaf, page->priority());
+  page_pool->UnpinStorePage(page);
+
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 5, PagePool::kIgnorePageData, &page));
+  EXPECT_EQ(pages[2], page);
+  page_pool->UnpinStorePage(page);
+
+  // The inner page survived all the leaf accesses.
+  size_t misses = page_pool->recent_misses();
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 0, PagePool::kFetchPageData, &page));
+  EXPECT_EQ(pages[0], page);
+  EXPECT_EQ(misses, page_pool->recent_misses());
+  page_pool->UnpinStorePage(page);
+}
+
+TEST_F(PagePoolTest, EvictionTrimsOverflowingHotSet) {
+  CreatePool(kStorePageShift, 4);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file1_.release(), data_file1_size_, log_file1_.release(),
+      log_file1_size_, page_pool, StoreOptions()));
+
+  Page* pages[4];
+  for (size_t i = 0; i < 4; ++i) {
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), i, PagePool::kIgnorePageData, &pages[i]));
+  }
+  pages[0]->set_priority(PagePriority::kRoot);
+  pages[1]->set_priority(PagePriority::kInner);
+  pages[2]->set_priority(PagePriority::kInner);
+  for (size_t i = 0; i < 4; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+
+  // 3 hot pages exceed half of the pool, so the LRU inner page goes first.
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 4, PagePool::kIgnorePageData, &page));
+  EXPECT_EQ(pages[1], page);
+  page_pool->UnpinStorePage(page);
+
+  // Once the hot set fits, leaves are evicted before inner pages.
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 5, PagePool::kIgnorePageData, &page));
+  EXPECT_EQ(pages[3], page);
+  page_pool->UnpinStorePage(page);
+}
+
 TEST_F(PagePoolTest, AllocPrefersFreeListToLruList) {
   CreatePool(kStorePageShift, 2);
   PagePool* page_pool = pool_->page_pool();
@@ -318,7 +471,7 @@ TEST_F(PagePoolTest, AssignPageToStoreSuccess) {
     EXPECT_EQ(store->init_transaction(), page->transaction());
     EXPECT_EQ(i, page->page_id());
     EXPECT_EQ(0, std::memcmp(
-        page->data(), buffer + (i << kStorePageShift), 1 << kStorePageShift));
+        page->data(), buffer + (i << kStorePageShift), kUsablePageSize));
     page_pool->UnpinStorePage(page);
   }
 }
@@ -468,7 +621,7 @@ TEST_F(PagePoolTest, StorePage) {
   EXPECT_EQ(store->init_transaction(), page->transaction());
   EXPECT_EQ(2U, page->page_id());
   EXPECT_EQ(0, std::memcmp(
-      page->data(), buffer + (2 << kStorePageShift), 1 << kStorePageShift));
+      page->data(), buffer + (2 << kStorePageShift), kUsablePageSize));
 
   Page* page2;
   ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
@@ -479,7 +632,7 @@ TEST_F(PagePoolTest, StorePage) {
   EXPECT_EQ(store->init_transaction(), page->transaction());
   EXPECT_EQ(2U, page2->page_id());
   EXPECT_EQ(0, std::memcmp(
-      page2->data(), buffer + (2 << kStorePageShift), 1 << kStorePageShift));
+      page2->data(), buffer + (2 << kStorePageShift), kUsablePageSize));
   EXPECT_EQ(1U, page_pool->allocated_pages());
   EXPECT_EQ(0U, page_pool->unused_pages());
   EXPECT_EQ(1U, page_pool->pinned_pages());
@@ -514,4 +667,317 @@ TEST_F(PagePoolTest, StorePage) {
   EXPECT_EQ(0U, page_pool->pinned_pages());
 }
 
+TEST_F(PagePoolTest, CompressedCacheServesEvictedPages) {
+  // Page data that compresses well.
+  uint8_t buffer[3 << kStorePageShift];
+  for(size_t i = 0; i < sizeof(buffer); ++i)
+    buffer[i] = static_cast<uint8_t>(i / 100);
+
+  CreatePool(kStorePageShift, 1, 64 * 1024);
+  PagePool* page_pool = pool_->page_pool();
+  CompressedPageCache* compressed_cache = page_pool->compressed_cache();
+  BlockAccessFileWrapper data_file_wrapper(data_file1_.release());
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      &data_file_wrapper, data_file1_size_, log_file1_.release(),
+      log_file1_size_, page_pool, StoreOptions()));
+
+  for (size_t i = 0; i < 3; ++i)
+    WriteStorePage(store.get(), i, buffer + (i << kStorePageShift));
+  EXPECT_EQ(0U, compressed_cache->page_count());
+
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 1, PagePool::kFetchPageData, &page));
+  page_pool->UnpinStorePage(page);
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 2, PagePool::kFetchPageData, &page));
+  page_pool->UnpinStorePage(page);
+  EXPECT_EQ(1U, compressed_cache->page_count());
+
+  // Page 1 was evicted from the LRU list, and is served without disk I/O.
+  data_file_wrapper.SetAccessError(Status::kIoError);
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 1, PagePool::kFetchPageData, &page));
+  EXPECT_EQ(1U, page->page_id());
+  EXPECT_EQ(0, std::memcmp(
+      page->data(), buffer + (1 << kStorePageShift), kUsablePageSize));
+  page_pool->UnpinStorePage(page);
+
+  // Page 2 was evicted to make room for page 1.
+  EXPECT_EQ(1U, compressed_cache->page_count());
+
+  // Pages that will be overwritten leave the compressed cache, so it does not
+  // end up holding stale data.
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 2, PagePool::kIgnorePageData, &page));
+  page->MarkDirty(false);
+  page_pool->UnpinStorePage(page);
+  EXPECT_EQ(1U, compressed_cache->page_count());
+  std::vector<uint8_t> data(1 << kStorePageShift);
+  EXPECT_FALSE(compressed_cache->Fetch(store.get(), 2, data.data()));
+
+  // Closing the store discards its compressed pages.
+  store->Close();
+  EXPECT_EQ(0U, compressed_cache->page_count());
+}
+
+/** Blocks reads until AllowReads() is called.
+ *
+ * Used to keep a store page read in flight while other threads use the pool.
+ */
+class BlockingReadFileWrapper : public BlockAccessFileWrapper {
+ public:
+  BlockingReadFileWrapper(BlockAccessFile* file)
+      : BlockAccessFileWrapper(file) { }
+
+  /** Waits until a Read() call is blocked. */
+  void WaitForRead() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!read_started_)
+      condition_.wait(lock);
+  }
+
+  /** Unblocks the pending and future Read() calls. */
+  void AllowReads() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    reads_allowed_ = true;
+    condition_.notify_all();
+  }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) override {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      read_started_ = true;
+      condition_.notify_all();
+      while (!reads_allowed_)
+        condition_.wait(lock);
+    }
+    return BlockAccessFileWrapper::Read(offset, byte_count, buffer);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool read_started_ = false;
+  bool reads_allowed_ = false;
+};
+
+TEST_F(PagePoolTest, StorePageAfterEvictionClosesStoreDuringRead) {
+  CreatePool(kStorePageShift, 3);
+  PagePool* page_pool = pool_->page_pool();
+  BlockingReadFileWrapper data_file_wrapper(data_file1_.release());
+  UniquePtr<StoreImpl> store1(StoreImpl::Create(
+      &data_file_wrapper, data_file1_size_, log_file1_.release(),
+      log_file1_size_, page_pool, StoreOptions()));
+
+  const std::string kStoreFileName2 = "test_page_pool_2.berry";
+  FileDeleter data_file2_deleter(kStoreFileName2);
+  FileDeleter log_file2_deleter(StoreImpl::LogFilePath(kStoreFileName2));
+  BlockAccessFile* data_file2;
+  size_t data_file2_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      data_file2_deleter.path(), kStorePageShift, true, false, &data_file2,
+      &data_file2_size));
+  RandomAccessFile* log_file2;
+  size_t log_file2_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForRandomAccess(
+      log_file2_deleter.path(), true, false, &log_file2, &log_file2_size));
+  UniquePtr<StoreImpl> store2(StoreImpl::Create(
+      data_file2, data_file2_size, log_file2, log_file2_size, page_pool,
+      StoreOptions()));
+
+  // A dirty store1 page waits in the LRU list, and a store2 page is pinned.
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store1.get(), 1, PagePool::kIgnorePageData, &page));
+  page->MarkDirty();
+  page_pool->UnpinStorePage(page);
+  Page* store2_page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store2.get(), 5, PagePool::kIgnorePageData, &store2_page));
+  store2_page->MarkDirty(false);
+  data_file_wrapper.SetAccessError(Status::kIoError);
+
+  // The read of a store1 page takes the pool's last page, and stays in flight.
+  Status read_status = Status::kSuccess;
+  std::thread read_thread([&]() {
+    PoolImpl::Lock lock(pool_.get());
+    Page* read_page = nullptr;
+    read_status = page_pool->StorePage(
+        store1.get(), 2, PagePool::kFetchPageData, &read_page);
+  });
+  data_file_wrapper.WaitForRead();
+
+  // Evicting the dirty store1 page fails, so store1 gets closed. Closing waits
+  // for the in-flight read, and releases the pool's lock.
+  Page* evicting_page = nullptr;
+  Status evicting_status = Status::kIoError;
+  std::thread evicting_thread([&]() {
+    PoolImpl::Lock lock(pool_.get());
+    evicting_status = page_pool->StorePage(
+        store2.get(), 7, PagePool::kIgnorePageData, &evicting_page);
+  });
+
+  // Cache the page requested by the evicting thread while its lock is released.
+  Page* cached_page = nullptr;
+  while (true) {
+    PoolImpl::Lock lock(pool_.get());
+    if (!store1->IsOpen()) {
+      page_pool->UnpinStorePage(store2_page);
+      ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+          store2.get(), 7, PagePool::kIgnorePageData, &cached_page));
+      cached_page->MarkDirty(false);
+      break;
+    }
+  }
+
+  data_file_wrapper.AllowReads();
+  read_thread.join();
+  evicting_thread.join();
+
+  EXPECT_EQ(Status::kIoError, read_status);
+  EXPECT_TRUE(store1->IsClosed());
+  ASSERT_EQ(Status::kSuccess, evicting_status);
+  EXPECT_EQ(cached_page, evicting_page);
+  EXPECT_EQ(7U, evicting_page->page_id());
+  EXPECT_EQ(1U, page_pool->pinned_pages());
+
+  page_pool->UnpinStorePage(evicting_page);
+  page_pool->UnpinStorePage(cached_page);
+  store2->Close();
+}
+
+/** Counts the asynchronous reads and writes submitted to a file. */
+class SubmitCountingFileWrapper : public BlockAccessFileWrapper {
+ public:
+  SubmitCountingFileWrapper(BlockAccessFile* file)
+      : BlockAccessFileWrapper(file) { }
+
+  void SubmitRead(size_t offset, size_t byte_count, uint8_t* buffer,
+                  BlockIoRequest* request) override {
+    ++submitted_reads_;
+    BlockAccessFileWrapper::SubmitRead(offset, byte_count, buffer, request);
+  }
+
+  void SubmitWrite(uint8_t* buffer, size_t offset, size_t byte_count,
+                   BlockIoRequest* request) override {
+    ++submitted_writes_;
+    BlockAccessFileWrapper::SubmitWrite(buffer, offset, byte_count, request);
+  }
+
+  inline size_t submitted_reads() const noexcept { return submitted_reads_; }
+  inline size_t submitted_writes() const noexcept { return submitted_writes_; }
+
+ private:
+  size_t submitted_reads_ = 0;
+  size_t submitted_writes_ = 0;
+};
+
+TEST_F(PagePoolTest, StorePageIoUsesAsyncRequests) {
+  CreatePool(kStorePageShift, 2);
+  PagePool* page_pool = pool_->page_pool();
+  SubmitCountingFileWrapper data_file_wrapper(data_file1_.release());
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      &data_file_wrapper, data_file1_size_, log_file1_.release(),
+      log_file1_size_, page_pool, StoreOptions()));
+
+  uint8_t buffer[1 << kStorePageShift];
+  for(size_t i = 0; i < sizeof(buffer); ++i)
+    buffer[i] = static_cast<uint8_t>(rnd_());
+  WriteStorePage(store.get(), 3, buffer);
+  EXPECT_EQ(1U, data_file_wrapper.submitted_writes());
+
+  // Page misses are read using asynchronous requests.
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 3, PagePool::kFetchPageData, &page));
+  EXPECT_EQ(1U, data_file_wrapper.submitted_reads());
+  EXPECT_EQ(0, std::memcmp(page->data(), buffer, kUsablePageSize));
+
+  // Evicting a dirty page writes it back using an asynchronous request.
+  page->MarkDirty();
+  page->data()[0] ^= 1;
+  page_pool->UnpinAndEvictStorePage(page);
+  EXPECT_EQ(2U, data_file_wrapper.submitted_writes());
+
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 3, PagePool::kFetchPageData, &page));
+  EXPECT_EQ(2U, data_file_wrapper.submitted_reads());
+  EXPECT_EQ(buffer[0] ^ 1, page->data()[0]);
+  page_pool->UnpinStorePage(page);
+}
+
+/** An asynchronous page fetch that signals its completion. */
+struct SignalingPageFetch {
+  ThreadPool::Task task;  // Must be the first member.
+  AsyncPageFetch fetch;
+  PagePool* page_pool;
+
+  std::mutex mutex;
+  std::condition_variable completed_signal;
+  bool completed = false;
+  Status status = Status::kIoError;
+
+  static void Run(ThreadPool::Task* task) {
+    SignalingPageFetch* fetch = reinterpret_cast<SignalingPageFetch*>(task);
+    Status status;
+    {
+      PoolImpl::Lock lock(fetch->page_pool->pool());
+      status = fetch->page_pool->FinishStorePageFetch(&fetch->fetch);
+    }
+    std::lock_guard<std::mutex> lock(fetch->mutex);
+    fetch->status = status;
+    fetch->completed = true;
+    fetch->completed_signal.notify_all();
+  }
+
+  /** Blocks until the fetch completes, and returns its status. */
+  Status Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!completed)
+      completed_signal.wait(lock);
+    return status;
+  }
+};
+
+TEST_F(PagePoolTest, StartStorePageFetch) {
+  PoolOptions options;
+  options.page_shift = kStorePageShift;
+  options.page_pool_size = 4;
+  options.async_thread_count = 1;
+  pool_.reset(PoolImpl::Create(options));
+  PagePool* page_pool = pool_->page_pool();
+  SubmitCountingFileWrapper data_file_wrapper(data_file1_.release());
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      &data_file_wrapper, data_file1_size_, log_file1_.release(),
+      log_file1_size_, page_pool, StoreOptions()));
+
+  uint8_t buffer[1 << kStorePageShift];
+  for(size_t i = 0; i < sizeof(buffer); ++i)
+    buffer[i] = static_cast<uint8_t>(rnd_());
+  WriteStorePage(store.get(), 3, buffer);
+
+  SignalingPageFetch fetch;
+  fetch.task.run = &SignalingPageFetch::Run;
+  fetch.fetch.io.completion_task = &fetch.task;
+  fetch.page_pool = page_pool;
+  {
+    PoolImpl::Lock lock(pool_.get());
+    ASSERT_TRUE(page_pool->StartStorePageFetch(store.get(), 3, &fetch.fetch));
+  }
+  EXPECT_EQ(Status::kSuccess, fetch.Wait());
+  EXPECT_EQ(1U, data_file_wrapper.submitted_reads());
+
+  // The fetched page is cached, so it is not read again.
+  PoolImpl::Lock lock(pool_.get());
+  EXPECT_FALSE(page_pool->StartStorePageFetch(store.get(), 3, &fetch.fetch));
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 3, PagePool::kFetchPageData, &page));
+  EXPECT_EQ(1U, data_file_wrapper.submitted_reads());
+  EXPECT_EQ(0, std::memcmp(page->data(), buffer, kUsablePageSize));
+  page_pool->UnpinStorePage(page);
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
 }  // namespace berrydb
@@ -74,6 +74,26 @@ TEST_F(PageTest, CreateRelease) {
   page->Release(&page_pool);
 }
 
+TEST_F(PageTest, NumaPartitionedBuffersAreBindable) {
+  CreatePool(12, 42);
+  PagePool page_pool(pool_.get(), 12, 42, 0, 2);
+
+  Page* pages[2];
+  for (size_t numa_node = 0; numa_node < 2; ++numa_node) {
+    pages[numa_node] = Page::Create(&page_pool, numa_node);
+    EXPECT_EQ(numa_node, pages[numa_node]->numa_node());
+
+    // BindToNumaNode() can cover the entire buffer.
+    uintptr_t data = reinterpret_cast<uintptr_t>(pages[numa_node]->data());
+    EXPECT_EQ(0U, data % NumaBindAlignment());
+  }
+
+  for (Page* page : pages) {
+    page->RemovePin();
+    page->Release(&page_pool);
+  }
+}
+
 TEST_F(PageTest, Pinning) {
   CreatePool(12, 42);
   PagePool page_pool(pool_.get(), 12, 42);
@@ -117,11 +137,15 @@ TEST_F(PageTest, AssignToStoreUnassignFromStore) {
   EXPECT_EQ(transaction, page->transaction());
   EXPECT_EQ(1337U, page->page_id());
 
+  uint64_t version;
+  ASSERT_TRUE(page->version_lock()->ReadLock(&version));
   page->UnassignFromStore();
   transaction->PageUnassigned(page);
 #if DCHECK_IS_ON()
   EXPECT_EQ(nullptr, page->transaction());
 #endif  // DCHECK_IS_ON()
+  // Optimistic readers must not trust data read before the page was unassigned.
+  EXPECT_FALSE(page->version_lock()->Validate(version));
 
   page->Release(page_pool);
 }
@@ -0,0 +1,50 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./page_version.h"
+
+#include <cstring>
+#include <type_traits>
+
+#include "berrydb/platform.h"
+#include "./page.h"
+
+namespace berrydb {
+
+static_assert(std::is_standard_layout<PageVersion>::value,
+    "PageVersion must be a standard layout type to be embedded in lists");
+
+constexpr uint64_t PageVersion::kUncommitted;
+
+PageVersion* PageVersion::Create(
+    Page* page, TransactionImpl* transaction, size_t page_size) {
+  DCHECK(page != nullptr);
+  DCHECK(transaction != nullptr);
+
+  size_t block_size = sizeof(PageVersion) + page_size;
+  void* heap_block = Allocate(block_size);
+  PageVersion* version = new (heap_block) PageVersion(page, transaction);
+  DCHECK_EQ(reinterpret_cast<void*>(version), heap_block);
+
+  // Make sure that the version data has the same alignment as page data.
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(version->data()) & 0x07, 0U);
+
+  std::memcpy(version->data(), page->data(), page_size);
+  return version;
+}
+
+void PageVersion::Release(size_t page_size) {
+  DCHECK(older_ == nullptr);
+  DCHECK(newer_ == nullptr);
+
+  this->~PageVersion();
+  size_t block_size = sizeof(PageVersion) + page_size;
+  void* heap_block = reinterpret_cast<void*>(this);
+  Deallocate(heap_block, block_size);
+}
+
+PageVersion::PageVersion(Page* page, TransactionImpl* transaction) noexcept
+    : page_(page), transaction_(transaction) { }
+
+}  // namespace berrydb
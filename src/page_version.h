@@ -0,0 +1,123 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_PAGE_VERSION_H_
+#define BERRYDB_PAGE_VERSION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "berrydb/platform.h"
+#include "./util/linked_list.h"
+
+namespace berrydb {
+
+class Page;
+class TransactionImpl;
+
+/** A before-image of a store page, used to serve snapshot reads.
+ *
+ * Before a transaction modifies a page pool entry for the first time, it saves
+ * a copy of the entry's data in a PageVersion. Transactions whose snapshot
+ * predates the modification read the before-image, so readers never wait for
+ * writers, and writers never wait for readers.
+ *
+ * The versions of a page form a chain, ordered from newest to oldest, whose
+ * head is stored in the page pool entry. Each version records the commit
+ * timestamp of the transaction that replaced its content. The version's data
+ * is the page content that was visible to snapshots taken before that
+ * timestamp, and after the next older version's timestamp.
+ *
+ * Like Page, the control block is laid out in memory right before the buffer
+ * that holds the page data.
+ */
+class PageVersion {
+ public:
+  /** Timestamp used by the versions of uncommitted transactions. */
+  static constexpr uint64_t kUncommitted = ~static_cast<uint64_t>(0);
+
+  /** Saves a page's data as a version owned by an uncommitted transaction.
+   *
+   * The new version is not linked into the page's version chain. */
+  static PageVersion* Create(
+      Page* page, TransactionImpl* transaction, size_t page_size);
+
+  /** Releases the memory used by the version.
+   *
+   * The version must have been removed from its page's chain. */
+  void Release(size_t page_size);
+
+  /** The page pool entry whose data was saved in this version. */
+  inline Page* page() const noexcept { return page_; }
+
+  /** The transaction that created this version, until it commits. */
+  inline TransactionImpl* transaction() const noexcept { return transaction_; }
+
+  /** Commit timestamp of the transaction that replaced this version's data.
+   *
+   * This is kUncommitted while the transaction is in progress. */
+  inline uint64_t superseded_at() const noexcept { return superseded_at_; }
+
+  /** The next older version in the page's chain. */
+  inline PageVersion* older() const noexcept { return older_; }
+  /** The next newer version in the page's chain. */
+  inline PageVersion* newer() const noexcept { return newer_; }
+
+  /** The page data captured by this version. */
+  inline uint8_t* data() noexcept {
+    return reinterpret_cast<uint8_t*>(this + 1);
+  }
+
+  /** Records that the transaction that created this version committed. */
+  inline void MarkCommitted(uint64_t commit_timestamp) noexcept {
+    DCHECK(transaction_ != nullptr);
+    DCHECK_EQ(superseded_at_, kUncommitted);
+    transaction_ = nullptr;
+    superseded_at_ = commit_timestamp;
+  }
+
+  /** Links this version at the head of a chain, in front of another version.
+   *
+   * @param newest the chain's current head; can be null */
+  inline void LinkBefore(PageVersion* newest) noexcept {
+    DCHECK(older_ == nullptr);
+    DCHECK(newer_ == nullptr);
+    older_ = newest;
+    if (newest != nullptr) {
+      DCHECK(newest->newer_ == nullptr);
+      newest->newer_ = this;
+    }
+  }
+
+  /** Removes this version from its chain. */
+  inline void Unlink() noexcept {
+    if (older_ != nullptr)
+      older_->newer_ = newer_;
+    if (newer_ != nullptr)
+      newer_->older_ = older_;
+    older_ = nullptr;
+    newer_ = nullptr;
+  }
+
+ private:
+  /** Use PageVersion::Create() to construct PageVersion instances. */
+  PageVersion(Page* page, TransactionImpl* transaction) noexcept;
+
+  friend class LinkedListBridge<PageVersion>;
+  /** Node in the list of versions created or retained by a transaction/store.
+   *
+   * Uncommitted versions are listed by the transaction that created them.
+   * Committed versions are listed by their store, in commit order. */
+  LinkedList<PageVersion>::Node linked_list_node_;
+
+  Page* const page_;
+  TransactionImpl* transaction_;
+  uint64_t superseded_at_ = kUncommitted;
+  PageVersion* older_ = nullptr;
+  PageVersion* newer_ = nullptr;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_PAGE_VERSION_H_
@@ -4,10 +4,14 @@
 
 #include "./pool_impl.h"
 
+#include <algorithm>
+
 #include "berrydb/options.h"
 #include "berrydb/platform.h"
 #include "berrydb/vfs.h"
 #include "./store_impl.h"
+#include "./util/crc32c.h"
+#include "./util/thread_pool.h"
 
 namespace berrydb {
 
@@ -21,17 +25,99 @@ PoolImpl* PoolImpl::Create(const PoolOptions& options) {
   void* heap_block = Allocate(sizeof(PoolImpl));
   PoolImpl* pool = new (heap_block) PoolImpl(options);
   DCHECK_EQ(heap_block, static_cast<void*>(pool));
+  if (options.partition_count > 1)
+    pool->CreatePartitions(options);
+  if (options.async_thread_count != 0) {
+    pool->async_thread_pool_ = ThreadPool::Create(options.async_thread_count);
+    for (size_t i = 0; i < pool->partition_count_; ++i)
+      pool->partition(i)->async_thread_pool_ = pool->async_thread_pool_;
+  }
   return pool;
 }
 
+void PoolImpl::CreatePartitions(const PoolOptions& options) {
+  DCHECK(partitions_ == nullptr);
+
+  void* heap_block = Allocate(sizeof(PoolImpl*) * partition_count_);
+  partitions_ = static_cast<PoolImpl**>(heap_block);
+
+  PoolOptions partition_options = options;
+  partition_options.partition_count = 1;
+  partition_options.async_thread_count = 0;
+  for (size_t i = 0; i < partition_count_; ++i) {
+    partition_options.page_pool_size =
+        PartitionPagePoolSize(i, options.page_pool_size);
+    partitions_[i] = PoolImpl::Create(partition_options);
+  }
+}
+
+size_t PoolImpl::PartitionPagePoolSize(
+    size_t index, size_t page_pool_size) const {
+  DCHECK_LT(index, partition_count_);
+  size_t page_pool_size_share = page_pool_size / partition_count_;
+  if (index < page_pool_size % partition_count_)
+    ++page_pool_size_share;
+  return page_pool_size_share;
+}
+
+PoolImpl* PoolImpl::StorePartition(const std::string& path) noexcept {
+  if (partitions_ == nullptr)
+    return this;
+
+  uint32_t path_hash = Crc32c(
+      reinterpret_cast<const uint8_t*>(path.data()), path.size());
+  return partitions_[path_hash % partition_count_];
+}
+
+constexpr size_t PoolImpl::kPagePoolCount;
+constexpr size_t PoolImpl::kTransactionPinReserve;
+
+namespace {
+
+/** The number of partitions in the page pools of a resource pool. */
+size_t PagePoolNumaNodeCount(const PoolOptions& options) {
+  if (!options.numa_aware_page_pool)
+    return 1;
+  return std::min(NumaNodeCount(), PagePool::kMaxNumaNodes);
+}
+
+}  // namespace
+
 PoolImpl::PoolImpl(const PoolOptions& options)
-    : api_(), page_pool_(this, options.page_shift, options.page_pool_size),
-      vfs_((options.vfs == nullptr) ? DefaultVfs() : options.vfs) {
+    : api_(),
+      page_pool_(this, options.page_shift, options.page_pool_size,
+                 options.compressed_page_cache_size,
+                 PagePoolNumaNodeCount(options)),
+      page_pool_size_(options.page_pool_size),
+      decay_countdown_(options.page_pool_size + 1),
+      decay_interval_(options.page_pool_size + 1),
+      pinned_page_wait_(options.pinned_page_wait_ms),
+      vfs_((options.vfs == nullptr) ? DefaultVfs() : options.vfs),
+      partition_count_(
+          (options.partition_count == 0) ? 1 : options.partition_count) {
+  DCHECK_LT(options.page_shift, kPagePoolCount);
+  for (size_t i = 0; i < kPagePoolCount; ++i)
+    page_pools_[i] = nullptr;
+  page_pools_[options.page_shift] = &page_pool_;
 }
 
-PoolImpl::~PoolImpl() { }
+PoolImpl::~PoolImpl() {
+  for (PagePool* page_pool : page_pools_) {
+    if (page_pool == nullptr || page_pool == &page_pool_)
+      continue;
+    page_pool->~PagePool();
+    Deallocate(page_pool, sizeof(PagePool));
+  }
+}
 
 void PoolImpl::Release() {
+  // Finish the queued asynchronous operations while the stores are still open.
+  if (async_thread_pool_ != nullptr) {
+    async_thread_pool_->Release();
+    for (size_t i = 0; i < partition_count_; ++i)
+      partition(i)->async_thread_pool_ = nullptr;
+  }
+
   // Replace the entire store list so StoreClosed() doesn't invalidate our
   // iterator.
   StoreSet close_queue;
@@ -39,14 +125,30 @@ void PoolImpl::Release() {
   for (StoreImpl* store : close_queue)
     store->Close();
 
-  // The existence of pinned pages implies that some transactions are still
-  // running. This should not be the case, as all the stores should have been
-  // closed.
-  DCHECK_EQ(page_pool_.pinned_pages(), 0U);
+  if (partitions_ != nullptr) {
+    for (size_t i = 0; i < partition_count_; ++i)
+      partitions_[i]->Release();
+    Deallocate(static_cast<void*>(partitions_),
+               sizeof(PoolImpl*) * partition_count_);
+    partitions_ = nullptr;
+  }
+
+#if DCHECK_IS_ON()
+  for (PagePool* page_pool : page_pools_) {
+    if (page_pool == nullptr)
+      continue;
 
-  // The difference between allocated pages and unused pages is pages in the LRU
-  // queue. All the stores should have been closed, so the LRU should be empty.
-  DCHECK_EQ(page_pool_.allocated_pages(), page_pool_.unused_pages());
+    // The existence of pinned pages implies that some transactions are still
+    // running. This should not be the case, as all the stores should have been
+    // closed.
+    DCHECK_EQ(page_pool->pinned_pages(), 0U);
+
+    // The difference between allocated pages and unused pages is pages in the
+    // LRU queue. All the stores should have been closed, so the LRU should be
+    // empty.
+    DCHECK_EQ(page_pool->allocated_pages(), page_pool->unused_pages());
+  }
+#endif  // DCHECK_IS_ON()
 
   this->~PoolImpl();
   void* heap_block = static_cast<void*>(this);
@@ -61,11 +163,12 @@ void PoolImpl::StoreCreated(StoreImpl* store) {
 #endif  // DCHECK_IS_ON()
 
   // stores_.insert(store);
+  store->page_pool()->StoreCreated(store);
 }
 
 void PoolImpl::StoreClosed(StoreImpl* store) {
   DCHECK(store != nullptr);
-  DCHECK(store->IsClosed());
+  DCHECK(!store->IsOpen());
 #if DCHECK_IS_ON()
   DCHECK_EQ(this, store->page_pool()->pool());
 #endif  // DCHECK_IS_ON()
@@ -74,15 +177,249 @@ void PoolImpl::StoreClosed(StoreImpl* store) {
   //               StoreImpl::TransactionClosed().
 
   stores_.erase(store);
+  store->page_pool()->StoreClosed(store);
+}
+
+PagePool* PoolImpl::page_pool(size_t page_shift) {
+  DCHECK_LT(page_shift, kPagePoolCount);
+
+  PagePool* page_pool = page_pools_[page_shift];
+  if (page_pool != nullptr)
+    return page_pool;
+
+  // The compressed cache tier only serves the default page size.
+  void* heap_block = Allocate(sizeof(PagePool));
+  page_pool = new (heap_block) PagePool(this, page_shift, 0, 0,
+                                        page_pool_.numa_node_count());
+  DCHECK_EQ(heap_block, static_cast<void*>(page_pool));
+  page_pools_[page_shift] = page_pool;
+  return page_pool;
+}
+
+bool PoolImpl::GrowPagePool(PagePool* page_pool) {
+  DCHECK(page_pool != nullptr);
+
+  // Page pools created outside the resource pool, which happens in tests, do
+  // not share the budget.
+  size_t page_shift = page_pool->page_shift();
+  if (page_shift >= kPagePoolCount || page_pools_[page_shift] != page_pool)
+    return false;
+
+  // Capacity owed to a lowered budget must be paid back before growing.
+  if (budget_deficit_ != 0) {
+    PayBudgetDeficit();
+    if (budget_deficit_ != 0)
+      return false;
+  }
+
+  --decay_countdown_;
+  if (decay_countdown_ == 0) {
+    decay_countdown_ = decay_interval_;
+    for (PagePool* decayed_pool : page_pools_) {
+      if (decayed_pool != nullptr)
+        decayed_pool->DecayMisses();
+    }
+  }
+
+  size_t page_size = page_pool->page_size();
+  if (free_budget_ < page_size)
+    ReclaimBudget(page_pool, page_size - free_budget_);
+  if (free_budget_ < page_size)
+    return false;
+
+  free_budget_ -= page_size;
+  page_pool->GrowCapacity();
+  return true;
+}
+
+void PoolImpl::ReclaimBudget(PagePool* requester, size_t byte_count) {
+  // Demand is measured in recent misses per byte of capacity. Pools with no
+  // capacity count as having one page, so the comparisons are meaningful.
+  // a / b < c / d is computed as a * d < c * b, to avoid divisions.
+  size_t requester_bytes = requester->page_size() *
+      std::max(requester->page_capacity(), static_cast<size_t>(1));
+  uint64_t requester_misses = requester->recent_misses();
+
+  // A page pool without any evictable pages must take capacity from others,
+  // or its stores cannot make progress.
+  bool must_reclaim = requester->page_capacity() == requester->pinned_pages();
+
+  PagePool* victim = nullptr;
+  uint64_t victim_misses = 0;
+  size_t victim_bytes = 1;
+  for (PagePool* page_pool : page_pools_) {
+    if (page_pool == nullptr || page_pool == requester)
+      continue;
+    if (page_pool->page_capacity() == page_pool->pinned_pages())
+      continue;  // Nothing can be reclaimed.
+
+    uint64_t misses = page_pool->recent_misses();
+    size_t bytes = page_pool->page_size() * page_pool->page_capacity();
+    if (!must_reclaim && misses * requester_bytes >= requester_misses * bytes)
+      continue;  // The page pool's pages are in higher demand.
+    if (victim == nullptr || misses * victim_bytes < victim_misses * bytes) {
+      victim = page_pool;
+      victim_misses = misses;
+      victim_bytes = bytes;
+    }
+  }
+  if (victim == nullptr)
+    return;
+
+  size_t victim_page_size = victim->page_size();
+  size_t page_count = (byte_count + victim_page_size - 1) / victim_page_size;
+  free_budget_ += victim->ShrinkCapacity(page_count) * victim_page_size;
+}
+
+void PoolImpl::SetPagePoolSize(size_t page_pool_size) {
+  if (partitions_ != nullptr) {
+    page_pool_size_ = page_pool_size;
+    for (size_t i = 0; i < partition_count_; ++i) {
+      PoolImpl* partition = partitions_[i];
+      Lock lock(partition);
+      partition->SetPagePoolSize(PartitionPagePoolSize(i, page_pool_size));
+    }
+    return;
+  }
+
+  size_t page_shift = page_pool_.page_shift();
+  size_t old_budget = page_pool_size_ << page_shift;
+  size_t new_budget = page_pool_size << page_shift;
+  page_pool_size_ = page_pool_size;
+
+  if (new_budget >= old_budget) {
+    // Page pools pick up the new budget in GrowPagePool(), when they need it.
+    size_t growth = new_budget - old_budget;
+    size_t repaid = std::min(growth, budget_deficit_);
+    budget_deficit_ -= repaid;
+    free_budget_ += growth - repaid;
+    PagesReleased();
+    return;
+  }
+
+  budget_deficit_ += old_budget - new_budget;
+  PayBudgetDeficit();
+}
+
+void PoolImpl::PayBudgetDeficit() {
+  size_t repaid = std::min(free_budget_, budget_deficit_);
+  free_budget_ -= repaid;
+  budget_deficit_ -= repaid;
+
+  for (PagePool* page_pool : page_pools_) {
+    if (budget_deficit_ == 0)
+      return;
+    if (page_pool == nullptr)
+      continue;
+
+    size_t page_size = page_pool->page_size();
+    size_t page_count = (budget_deficit_ + page_size - 1) / page_size;
+    size_t freed_bytes = page_pool->ShrinkCapacity(page_count) * page_size;
+    if (freed_bytes >= budget_deficit_) {
+      // Page pools shrink in whole pages, so the last one may overshoot.
+      free_budget_ += freed_bytes - budget_deficit_;
+      budget_deficit_ = 0;
+    } else {
+      budget_deficit_ -= freed_bytes;
+    }
+  }
+}
+
+PoolImpl::Lock::Lock(PoolImpl* pool) : pool_(pool) {
+  if (pool == nullptr)
+    return;
+  lock_ = std::unique_lock<std::mutex>(pool->mutex_);
+  DCHECK(pool->held_lock_ == nullptr);
+  pool->held_lock_ = &lock_;
+}
+
+PoolImpl::Lock::~Lock() {
+  if (pool_ == nullptr)
+    return;
+  DCHECK_EQ(&lock_, pool_->held_lock_);
+  pool_->held_lock_ = nullptr;
+}
+
+PoolImpl::Unlock::Unlock(PoolImpl* pool)
+    : pool_(pool), lock_(pool->held_lock_) {
+  if (lock_ == nullptr)
+    return;
+  pool->held_lock_ = nullptr;
+  lock_->unlock();
+}
+
+PoolImpl::Unlock::~Unlock() {
+  if (lock_ == nullptr)
+    return;
+  lock_->lock();
+  DCHECK(pool_->held_lock_ == nullptr);
+  pool_->held_lock_ = lock_;
+}
+
+void PoolImpl::WaitForPageIo() {
+  std::unique_lock<std::mutex>* lock = held_lock_;
+  DCHECK(lock != nullptr);
+  held_lock_ = nullptr;
+  page_io_completed_.wait(*lock);
+  DCHECK(held_lock_ == nullptr);
+  held_lock_ = lock;
+}
+
+bool PoolImpl::WaitForPageRelease(
+    std::chrono::steady_clock::time_point deadline) {
+  // Other threads register their own locks while this thread waits.
+  std::unique_lock<std::mutex>* lock = held_lock_;
+  DCHECK(lock != nullptr);
+  held_lock_ = nullptr;
+  ++page_waiter_count_;
+  std::cv_status status = page_released_.wait_until(*lock, deadline);
+  --page_waiter_count_;
+  DCHECK(held_lock_ == nullptr);
+  held_lock_ = lock;
+  return status == std::cv_status::no_timeout;
+}
+
+Status PoolImpl::AdmitTransaction(PagePool* page_pool) {
+  DCHECK(page_pool != nullptr);
+  if (!waits_for_pinned_pages())
+    return Status::kSuccess;
+
+  std::chrono::steady_clock::time_point deadline = PinnedPageWaitDeadline();
+  while (!HasRoomForTransaction(page_pool)) {
+    if (!WaitForPageRelease(deadline))
+      return Status::kPoolFull;
+  }
+  return Status::kSuccess;
+}
+
+bool PoolImpl::HasRoomForTransaction(PagePool* page_pool) const {
+  size_t pinned_bytes = kTransactionPinReserve * page_pool->page_size();
+  for (PagePool* pinning_pool : page_pools_) {
+    if (pinning_pool != nullptr)
+      pinned_bytes += pinning_pool->pinned_pages() * pinning_pool->page_size();
+  }
+  return pinned_bytes <= (page_pool_size_ << page_pool_.page_shift());
 }
 
 Status PoolImpl::OpenStore(
     const std::string& path, const StoreOptions& options,
     StoreImpl** result) {
+  if (partitions_ != nullptr)
+    return StorePartition(path)->OpenStore(path, options, result);
+
+  if (options.page_shift != 0 &&
+      (options.page_shift >= kPagePoolCount ||
+       !StoreImpl::PageShiftFitsHeader(options.page_shift))) {
+    return Status::kInvalidArgument;
+  }
+  PagePool* page_pool = (options.page_shift == 0) ?
+      &page_pool_ : this->page_pool(options.page_shift);
+
   BlockAccessFile* data_file;
   size_t data_file_size;
   Status status = vfs_->OpenForBlockAccess(
-      path, page_pool_.page_shift(), options.create_if_missing,
+      path, StoreImpl::DataFileBlockShift(page_pool->page_shift()),
+      options.create_if_missing,
       options.error_if_exists, &data_file, &data_file_size);
   if (status != Status::kSuccess)
     return status;
@@ -105,12 +442,15 @@ Status PoolImpl::OpenStore(
   }
 
   StoreImpl* store = StoreImpl::Create(
-      data_file, data_file_size, log_file, log_file_size, &page_pool_, options);
+      data_file, data_file_size, log_file, log_file_size, page_pool, options);
   stores_.insert(store);
 
   status = store->Initialize(options);
   if (status != Status::kSuccess) {
+    // Closing the store also removes it from stores_. The caller never sees
+    // the store, so it must be released here.
     store->Close();
+    store->Release();
     return status;
   }
 
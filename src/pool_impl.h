@@ -5,7 +5,10 @@
 #ifndef BERRYDB_POOL_IMPL_H_
 #define BERRYDB_POOL_IMPL_H_
 
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <unordered_set>
 
 #include "berrydb/pool.h"
@@ -15,6 +18,7 @@
 namespace berrydb {
 
 class StoreImpl;
+class ThreadPool;
 class Vfs;
 
 /** Internal representation for the Pool class in the public API. */
@@ -39,23 +43,192 @@ class PoolImpl {
   /** Computes the public API Pool* for this resource pool. */
   inline Pool* ToApi() noexcept { return &api_; }
 
-  /** This resource pool's page pool. */
+  /** This resource pool's page pool for the default page size. */
   inline PagePool* page_pool() noexcept { return &page_pool_; }
 
+  /** This resource pool's page pool for a page size.
+   *
+   * The page pool is created when it is first requested, and starts out with
+   * no capacity. It obtains capacity from the pool's memory budget as it is
+   * used.
+   *
+   * @param  page_shift base-2 log of the page size; must be below
+   *                    kPagePoolCount
+   * @return            the page pool caching pages of the given size
+   */
+  PagePool* page_pool(size_t page_shift);
+
+  /** Attempts to raise a page pool's capacity by one page.
+   *
+   * The capacity comes out of the memory budget that is not assigned to any
+   * page pool. If that is not sufficient, the capacity is taken from another
+   * page pool that had fewer recent misses per byte of capacity than the
+   * requesting page pool. Page pools that cannot evict any of their pages are
+   * served from any page pool, so they can make progress.
+   *
+   * This is called by page pools that are at capacity and need a new page.
+   *
+   * @param  page_pool one of this resource pool's page pools
+   * @return           true if the page pool's capacity was raised
+   */
+  bool GrowPagePool(PagePool* page_pool);
+
+  /** Serializes the operations on this pool's stores and transactions.
+   *
+   * The public API acquires this lock, via PoolImpl::Lock, in all the calls that
+   * may use the pool's pages. The stores of a partitioned pool use their
+   * partition's lock. */
+  inline std::mutex& mutex() const noexcept { return mutex_; }
+
+  /** Holds a pool's mutex() on behalf of a thread that uses the pool.
+   *
+   * While held, the lock is registered with the pool, so operations that block
+   * can release it and let other threads use the pool in the meantime. */
+  class Lock {
+   public:
+    /** Acquires a pool's lock. A null pool is not locked. */
+    explicit Lock(PoolImpl* pool);
+    /** Releases the pool's lock, if it was acquired. */
+    ~Lock();
+
+    Lock(const Lock&) = delete;
+    Lock& operator=(const Lock&) = delete;
+
+   private:
+    PoolImpl* const pool_;
+    std::unique_lock<std::mutex> lock_;
+  };
+
+  /** Releases a pool's Lock while the calling thread performs blocking I/O.
+   *
+   * The lock is re-acquired when this goes out of scope. The pool's state may
+   * change in the meantime, so callers must not rely on what they learned
+   * before the lock was released. Nothing is released if the calling thread
+   * does not hold the pool's Lock, which is the case in single-threaded tests.
+   */
+  class Unlock {
+   public:
+    explicit Unlock(PoolImpl* pool);
+    ~Unlock();
+
+    Unlock(const Unlock&) = delete;
+    Unlock& operator=(const Unlock&) = delete;
+
+   private:
+    PoolImpl* const pool_;
+    std::unique_lock<std::mutex>* const lock_;
+  };
+
+  /** True if operations wait for pinned pages instead of failing right away. */
+  inline bool waits_for_pinned_pages() const noexcept {
+    return pinned_page_wait_.count() != 0;
+  }
+
+  /** The time until which an operation starting now may wait for pages. */
+  inline std::chrono::steady_clock::time_point PinnedPageWaitDeadline() const {
+    return std::chrono::steady_clock::now() + pinned_page_wait_;
+  }
+
+  /** Blocks until another thread releases pages, or the deadline passes.
+   *
+   * The caller must hold the pool's Lock, which is released while waiting.
+   * Callers must re-check their condition after this returns, as wake-ups may
+   * be spurious.
+   *
+   * @param  deadline obtained from PinnedPageWaitDeadline()
+   * @return          false if the deadline passed
+   */
+  bool WaitForPageRelease(std::chrono::steady_clock::time_point deadline);
+
+  /** Called when pages become unpinned or the memory budget grows.
+   *
+   * Wakes up the operations waiting for pages. */
+  inline void PagesReleased() {
+    if (page_waiter_count_ != 0)
+      page_released_.notify_all();
+  }
+
+  /** Blocks until another thread completes the I/O on one of its pages.
+   *
+   * The caller must hold the pool's Lock, which is released while waiting.
+   * Callers must re-check their condition after this returns, as the completed
+   * I/O may concern a different page. */
+  void WaitForPageIo();
+
+  /** Called when I/O performed while the pool's lock was released completes.
+   *
+   * Wakes up the operations waiting for the I/O's page. */
+  inline void PageIoCompleted() { page_io_completed_.notify_all(); }
+
+  /** Waits until the resource pool has room for a new transaction's pages.
+   *
+   * A transaction is admitted while the pages pinned across the pool's page
+   * pools, plus a reserve for the new transaction, fit in the memory budget.
+   * Pools that do not wait for pinned pages admit all transactions, and leave
+   * it to their page requests to fail with kPoolFull.
+   *
+   * The caller must hold the pool's Lock.
+   *
+   * @param  page_pool the page pool used by the transaction's store
+   * @return           kSuccess if the transaction was admitted, kPoolFull if
+   *                   the wait timed out
+   */
+  Status AdmitTransaction(PagePool* page_pool);
+
+  /** Pages reserved for a new transaction by AdmitTransaction(). */
+  static constexpr size_t kTransactionPinReserve = 4;
+
   // See the public API documention for details.
   void Release();
   Status OpenStore(
       const std::string& path, const StoreOptions& options,
       StoreImpl** result);
   inline size_t page_size() const noexcept { return page_pool_.page_size(); }
-  inline size_t page_pool_size() const noexcept {
-    return page_pool_.page_capacity();
+  inline size_t page_pool_size() const noexcept { return page_pool_size_; }
+  void SetPagePoolSize(size_t page_pool_size);
+
+  /** Upper bound for the page shifts of the stores using a pool. */
+  static constexpr size_t kPagePoolCount = 32;
+
+  /** Number of partitions in this pool. See PoolOptions::partition_count. */
+  inline size_t partition_count() const noexcept { return partition_count_; }
+
+  /** One of this pool's partitions.
+   *
+   * Each partition is a resource pool in its own right, with its own page
+   * pools, memory budget and lock. A pool that is not partitioned is its own
+   * only partition.
+   *
+   * @param  index must be below partition_count()
+   * @return       the resource pool serving the partition's stores
+   */
+  inline PoolImpl* partition(size_t index) noexcept {
+    DCHECK_LT(index, partition_count_);
+    return (partitions_ == nullptr) ? this : partitions_[index];
   }
 
+  /** The partition that opens and serves the store at a path.
+   *
+   * The store's operations must be performed while holding the partition's
+   * mutex(), so the partitions stripe the pool's lock. The partition is chosen
+   * by hashing the path, so the same path always ends up in the same
+   * partition. Distinct paths may share a partition, and then contend for its
+   * lock. */
+  PoolImpl* StorePartition(const std::string& path) noexcept;
+
+  /** The threads running the asynchronous operations on this pool's stores.
+   *
+   * The partitions of a partitioned pool share the pool's threads. Null if
+   * PoolOptions::async_thread_count is 0. */
+  inline ThreadPool* async_thread_pool() noexcept { return async_thread_pool_; }
+
   /** Called upon the creation of a Store instance that uses this pool. */
   void StoreCreated(StoreImpl* store);
 
-  /** Called when a Store that uses this pool is closed. */
+  /** Called when a Store that uses this pool is closed.
+   *
+   * This is the store's last use of the pool. The store enters the closed state
+   * right after this returns. */
   void StoreClosed(StoreImpl* store);
 
  private:
@@ -67,9 +240,76 @@ class PoolImpl {
   /* The public API version of this class. */
   Pool api_;  // Must be the first class member.
 
-  /** The page pool part of this resource pool. */
+  /** Frees up memory budget for a page pool, by shrinking another page pool.
+   *
+   * @param requester   the page pool that will receive the memory budget
+   * @param byte_count  the desired amount of memory budget
+   */
+  void ReclaimBudget(PagePool* requester, size_t byte_count);
+
+  /** Shrinks page pools until their capacity fits in the memory budget.
+   *
+   * Pinned pages cannot be dropped, so some of the deficit may remain. */
+  void PayBudgetDeficit();
+
+  /** True if the pinned pages leave room for a new transaction's pages. */
+  bool HasRoomForTransaction(PagePool* page_pool) const;
+
+  /** Creates the partitions of a partitioned pool. Called by Create(). */
+  void CreatePartitions(const PoolOptions& options);
+
+  /** The memory budget of a partition, in pages of the default size.
+   *
+   * The budget is split evenly, and the first partitions get the remainder. */
+  size_t PartitionPagePoolSize(size_t index, size_t page_pool_size) const;
+
+  /** The page pool part of this resource pool, for the default page size. */
   PagePool page_pool_;
 
+  /** The page pools of this resource pool, indexed by page shift.
+   *
+   * Includes the page pool for the default page size. Entries for page sizes
+   * that were never used are null. */
+  PagePool* page_pools_[kPagePoolCount];
+
+  /** The memory budget, in pages of the default size. */
+  size_t page_pool_size_;
+
+  /** Bytes of the memory budget not assigned to any page pool's capacity. */
+  size_t free_budget_ = 0;
+
+  /** Bytes of page pool capacity in excess of the memory budget.
+   *
+   * This is non-zero when the budget was lowered while too many pages were
+   * pinned. The page pools shrink as their pages get unpinned. */
+  size_t budget_deficit_ = 0;
+
+  /** Number of GrowPagePool() calls until the page pool miss counts decay. */
+  size_t decay_countdown_;
+
+  /** GrowPagePool() calls between decays of the page pool miss counts. */
+  const size_t decay_interval_;
+
+  /** See mutex(). */
+  mutable std::mutex mutex_;
+
+  /** The Lock that holds mutex_. Null if mutex_ is not held via a Lock.
+   *
+   * Only read and written while holding mutex_. */
+  std::unique_lock<std::mutex>* held_lock_ = nullptr;
+
+  /** Signaled by PagesReleased(). Waited on with mutex_ held. */
+  std::condition_variable page_released_;
+
+  /** Number of threads blocked in WaitForPageRelease(). */
+  size_t page_waiter_count_ = 0;
+
+  /** Signaled by PageIoCompleted(). Waited on with mutex_ held. */
+  std::condition_variable page_io_completed_;
+
+  /** See PoolOptions::pinned_page_wait_ms. */
+  const std::chrono::milliseconds pinned_page_wait_;
+
   /** The opened stores that use this resource pool. */
   using StoreSet = std::unordered_set<
       StoreImpl*, PointerHasher<StoreImpl>, std::equal_to<StoreImpl*>,
@@ -78,6 +318,18 @@ class PoolImpl {
 
   /** The platform services implementation used by this pool's stores. */
   Vfs* const vfs_;
+
+  /** See partition_count(). */
+  const size_t partition_count_;
+
+  /** The partitions of a partitioned pool. Null if the pool is not partitioned.
+   *
+   * A partitioned pool does not cache any pages itself. The array's memory
+   * comes from Allocate(). */
+  PoolImpl** partitions_ = nullptr;
+
+  /** See async_thread_pool(). Owned by the pool that is not a partition. */
+  ThreadPool* async_thread_pool_ = nullptr;
 };
 
 }  // namespace berrydb
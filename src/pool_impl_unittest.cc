@@ -0,0 +1,585 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./pool_impl.h"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/status.h"
+#include "./page_pool.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/unique_ptr.h"
+#include "./vfs/memory_vfs.h"
+
+namespace berrydb {
+
+class PoolImplTest : public ::testing::Test {
+ protected:
+  PoolImplTest() : vfs_(MemoryVfs::Create()) { }
+
+  void CreatePool(size_t page_pool_size, size_t pinned_page_wait_ms = 0) {
+    PoolOptions options;
+    options.page_shift = kSmallPageShift;
+    options.page_pool_size = page_pool_size;
+    options.pinned_page_wait_ms = pinned_page_wait_ms;
+    options.vfs = vfs_.get();
+    pool_.reset(PoolImpl::Create(options));
+  }
+
+  StoreImpl* OpenStore(const std::string& path, size_t page_shift) {
+    StoreOptions options;
+    options.page_shift = page_shift;
+    return OpenStore(path, options);
+  }
+
+  StoreImpl* OpenStore(const std::string& path, const StoreOptions& options) {
+    StoreImpl* store = nullptr;
+    EXPECT_EQ(Status::kSuccess, pool_->OpenStore(path, options, &store));
+    return store;
+  }
+
+  /** Brings a store page into the pool, and leaves it in the LRU list. */
+  Status TouchPage(StoreImpl* store, size_t page_id) {
+    PagePool* page_pool = store->page_pool();
+    Page* page;
+    Status status = page_pool->StorePage(
+        store, page_id, PagePool::kIgnorePageData, &page);
+    if (status != Status::kSuccess)
+      return status;
+    page->MarkDirty();
+    page_pool->UnpinStorePage(page);
+    return Status::kSuccess;
+  }
+
+  /** Pins store pages until the page pool cannot hold any more pages. */
+  void PinAllPages(StoreImpl* store, Page** pages, size_t page_count) {
+    PagePool* page_pool = store->page_pool();
+    for (size_t i = 0; i < page_count; ++i) {
+      ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+          store, 3 + i, PagePool::kIgnorePageData, &pages[i]));
+      pages[i]->MarkDirty();
+    }
+    ASSERT_EQ(page_count, page_pool->pinned_pages());
+  }
+
+  /** Bytes of the pool's memory budget assigned to page pools. */
+  size_t AssignedBudget() {
+    return pool_->page_pool(kSmallPageShift)->page_capacity() *
+        (1 << kSmallPageShift) +
+        pool_->page_pool(kLargePageShift)->page_capacity() *
+        (1 << kLargePageShift);
+  }
+
+  constexpr static size_t kSmallPageShift = 12;
+  constexpr static size_t kLargePageShift = 16;
+
+  UniquePtr<MemoryVfs> vfs_;  // Must outlive pool_.
+  UniquePtr<PoolImpl> pool_;
+};
+
+constexpr size_t PoolImplTest::kSmallPageShift;
+constexpr size_t PoolImplTest::kLargePageShift;
+
+TEST_F(PoolImplTest, PagePoolPerPageSize) {
+  CreatePool(64);
+  EXPECT_EQ(pool_->page_pool(), pool_->page_pool(kSmallPageShift));
+
+  PagePool* large_page_pool = pool_->page_pool(kLargePageShift);
+  EXPECT_EQ(large_page_pool, pool_->page_pool(kLargePageShift));
+  EXPECT_EQ(1U << kLargePageShift, large_page_pool->page_size());
+  EXPECT_EQ(0U, large_page_pool->page_capacity());
+
+  UniquePtr<StoreImpl> small_store(OpenStore("small.berry", 0));
+  UniquePtr<StoreImpl> large_store(OpenStore("large.berry", kLargePageShift));
+  EXPECT_EQ(pool_->page_pool(), small_store->page_pool());
+  EXPECT_EQ(large_page_pool, large_store->page_pool());
+  EXPECT_EQ(kLargePageShift, large_store->header()->page_shift);
+
+  // The large store's bootstrap took budget from the default page size.
+  EXPECT_LT(0U, large_page_pool->page_capacity());
+  EXPECT_GT(64U, pool_->page_pool()->page_capacity());
+  EXPECT_GE(64U << kSmallPageShift, AssignedBudget());
+
+  ASSERT_EQ(Status::kSuccess, large_store->Close());
+  ASSERT_EQ(Status::kSuccess, small_store->Close());
+
+  // Stores must be reopened with the page size they were created with.
+  StoreImpl* store;
+  EXPECT_NE(Status::kSuccess, pool_->OpenStore(
+      "large.berry", StoreOptions(), &store));
+  large_store.reset(OpenStore("large.berry", kLargePageShift));
+  EXPECT_EQ(Status::kSuccess, large_store->Close());
+}
+
+TEST_F(PoolImplTest, OpenStoreRejectsUnsupportedPageSizes) {
+  CreatePool(64);
+  EXPECT_FALSE(StoreImpl::PageShiftFitsHeader(7));
+  EXPECT_TRUE(StoreImpl::PageShiftFitsHeader(8));
+
+  const size_t page_shifts[] = {1, 7, PoolImpl::kPagePoolCount, 64};
+  for (size_t page_shift : page_shifts) {
+    StoreOptions options;
+    options.page_shift = page_shift;
+    StoreImpl* store;
+    EXPECT_EQ(Status::kInvalidArgument, pool_->OpenStore(
+        "unsupported.berry", options, &store)) << page_shift;
+  }
+
+  UniquePtr<StoreImpl> store(OpenStore("supported.berry", kSmallPageShift));
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, NumaAwarePagePoolsShareNodeCount) {
+  PoolOptions options;
+  options.page_shift = kSmallPageShift;
+  options.page_pool_size = 16;
+  options.numa_aware_page_pool = true;
+  options.vfs = vfs_.get();
+  pool_.reset(PoolImpl::Create(options));
+
+  // Machines without NUMA get a single partition.
+  size_t numa_node_count = pool_->page_pool()->numa_node_count();
+  EXPECT_LE(1U, numa_node_count);
+  EXPECT_LE(numa_node_count, NumaNodeCount());
+  EXPECT_EQ(numa_node_count,
+            pool_->page_pool(kLargePageShift)->numa_node_count());
+
+  UniquePtr<StoreImpl> store(OpenStore("numa.berry", 0));
+  ASSERT_NE(nullptr, store.get());
+  for (size_t page_id = 2; page_id < 40; ++page_id)
+    ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), page_id));
+  EXPECT_EQ(16U, pool_->page_pool()->allocated_pages());
+  EXPECT_EQ(0U, pool_->page_pool()->pinned_pages());
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, PartitionsSplitStoresAndBudget) {
+  PoolOptions options;
+  options.page_shift = kSmallPageShift;
+  options.page_pool_size = 66;
+  options.partition_count = 4;
+  options.vfs = vfs_.get();
+  pool_.reset(PoolImpl::Create(options));
+
+  ASSERT_EQ(4U, pool_->partition_count());
+  EXPECT_EQ(17U, pool_->partition(0)->page_pool_size());
+  EXPECT_EQ(17U, pool_->partition(1)->page_pool_size());
+  EXPECT_EQ(16U, pool_->partition(2)->page_pool_size());
+  EXPECT_EQ(16U, pool_->partition(3)->page_pool_size());
+
+  // Each store is served by its partition, which has its own lock.
+  constexpr size_t kStoreCount = 8;
+  UniquePtr<StoreImpl> stores[kStoreCount];
+  bool partition_used[4] = {false, false, false, false};
+  for (size_t i = 0; i < kStoreCount; ++i) {
+    std::string path = "partition" + std::to_string(i) + ".berry";
+    stores[i].reset(OpenStore(path, 0));
+    ASSERT_NE(nullptr, stores[i].get());
+
+    PoolImpl* partition = stores[i]->page_pool()->pool();
+    EXPECT_EQ(pool_->StorePartition(path), partition);
+    EXPECT_NE(pool_.get(), partition);
+    EXPECT_NE(&pool_->mutex(), &partition->mutex());
+    for (size_t j = 0; j < 4; ++j) {
+      if (pool_->partition(j) == partition)
+        partition_used[j] = true;
+    }
+  }
+  size_t used_partition_count = 0;
+  for (bool used : partition_used)
+    used_partition_count += used ? 1 : 0;
+  EXPECT_LT(1U, used_partition_count);
+
+  // A store cannot use the memory budget of other partitions.
+  PagePool* page_pool = stores[0]->page_pool();
+  for (size_t page_id = 2; page_id < 40; ++page_id)
+    ASSERT_EQ(Status::kSuccess, TouchPage(stores[0].get(), page_id));
+  EXPECT_GE(page_pool->pool()->page_pool_size(),
+            page_pool->allocated_pages());
+
+  pool_->SetPagePoolSize(8);
+  EXPECT_EQ(8U, pool_->page_pool_size());
+  for (size_t i = 0; i < 4; ++i)
+    EXPECT_EQ(2U, pool_->partition(i)->page_pool_size());
+  EXPECT_GE(2U, page_pool->allocated_pages());
+
+  for (UniquePtr<StoreImpl>& store : stores)
+    ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, BudgetFollowsMisses) {
+  CreatePool(64);
+  UniquePtr<StoreImpl> small_store(OpenStore("small.berry", 0));
+  UniquePtr<StoreImpl> large_store(OpenStore("large.berry", kLargePageShift));
+  PagePool* small_page_pool = pool_->page_pool(kSmallPageShift);
+  PagePool* large_page_pool = pool_->page_pool(kLargePageShift);
+
+  // The small store fills up its page pool.
+  for (size_t i = 0; i < 64; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(small_store.get(), 3 + i));
+  size_t small_capacity = small_page_pool->page_capacity();
+  size_t large_capacity = large_page_pool->page_capacity();
+
+  // The large store cycles through a working set that does not fit in its
+  // page pool. Its misses pull budget away from the small store's pages, which
+  // are not used anymore.
+  constexpr size_t kWorkingSet = 3;
+  for (size_t round = 0; round < 50; ++round) {
+    for (size_t i = 0; i < kWorkingSet; ++i)
+      ASSERT_EQ(Status::kSuccess, TouchPage(large_store.get(), 3 + i));
+    EXPECT_GE(64U << kSmallPageShift, AssignedBudget());
+  }
+  EXPECT_LE(large_capacity + kWorkingSet - 1, large_page_pool->page_capacity());
+  EXPECT_GT(small_capacity, small_page_pool->page_capacity());
+
+  // Once the working set fits, the large store stops missing.
+  size_t misses = large_page_pool->recent_misses();
+  for (size_t i = 0; i < kWorkingSet; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(large_store.get(), 3 + i));
+  EXPECT_EQ(misses, large_page_pool->recent_misses());
+
+  // The small store can still use its remaining capacity.
+  for (size_t i = 0; i < 64; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(small_store.get(), 3 + i));
+
+  ASSERT_EQ(Status::kSuccess, large_store->Close());
+  ASSERT_EQ(Status::kSuccess, small_store->Close());
+}
+
+TEST_F(PoolImplTest, SetPagePoolSizeGrowsLazily) {
+  CreatePool(8);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  pool_->SetPagePoolSize(32);
+  EXPECT_EQ(32U, pool_->page_pool_size());
+  EXPECT_EQ(8U, page_pool->page_capacity());
+
+  for (size_t i = 0; i < 32; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 3 + i));
+  EXPECT_EQ(32U, page_pool->page_capacity());
+  EXPECT_EQ(32U, page_pool->allocated_pages());
+
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, SetPagePoolSizeShrinksAndWritesBack) {
+  CreatePool(32);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  for (size_t i = 0; i < 32; ++i) {
+    Page* page;
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), 3 + i, PagePool::kIgnorePageData, &page));
+    page->MarkDirty();
+    std::memset(page->data(), static_cast<int>(i), page_pool->page_size());
+    page_pool->UnpinStorePage(page);
+  }
+  EXPECT_EQ(32U, page_pool->allocated_pages());
+
+  pool_->SetPagePoolSize(4);
+  EXPECT_EQ(4U, pool_->page_pool_size());
+  EXPECT_EQ(4U, page_pool->page_capacity());
+  EXPECT_EQ(4U, page_pool->allocated_pages());
+  EXPECT_EQ(0U, page_pool->unused_pages());
+
+  // The evicted pages were written back.
+  for (size_t i = 0; i < 32; ++i) {
+    Page* page;
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), 3 + i, PagePool::kFetchPageData, &page));
+    EXPECT_EQ(static_cast<uint8_t>(i), page->data()[0]);
+    EXPECT_EQ(static_cast<uint8_t>(i), page->data()[1000]);
+    page_pool->UnpinStorePage(page);
+  }
+  EXPECT_EQ(4U, page_pool->allocated_pages());
+
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, SetPagePoolSizeWaitsForPinnedPages) {
+  CreatePool(8);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  Page* pinned_pages[6];
+  for (size_t i = 0; i < 6; ++i) {
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), 3 + i, PagePool::kIgnorePageData, &pinned_pages[i]));
+    pinned_pages[i]->MarkDirty();
+  }
+
+  // Only the capacity that is not pinned can be dropped right away.
+  pool_->SetPagePoolSize(2);
+  EXPECT_EQ(6U, page_pool->page_capacity());
+  EXPECT_EQ(6U, page_pool->allocated_pages());
+
+  // Growing the budget back pays down the deficit first.
+  pool_->SetPagePoolSize(3);
+  EXPECT_EQ(6U, page_pool->page_capacity());
+
+  for (size_t i = 0; i < 6; ++i)
+    page_pool->UnpinStorePage(pinned_pages[i]);
+
+  // The next miss drops the unpinned pages that exceed the budget.
+  ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 9));
+  EXPECT_EQ(3U, page_pool->page_capacity());
+  EXPECT_EQ(3U, page_pool->allocated_pages());
+
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, ScanDoesNotEvictOtherStoresPages) {
+  CreatePool(24);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  UniquePtr<StoreImpl> scanner(OpenStore("scan.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+  EXPECT_EQ(12U, page_pool->StoreShare(store.get()));
+
+  for (size_t i = 0; i < 10; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 3 + i));
+  for (size_t i = 0; i < 100; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(scanner.get(), 3 + i));
+
+  // The scanner went over its share, so it replaced its own pages.
+  EXPECT_EQ(12U, scanner->pool_page_count());
+  size_t misses = page_pool->recent_misses();
+  for (size_t i = 0; i < 10; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 3 + i));
+  EXPECT_EQ(misses, page_pool->recent_misses());
+
+  ASSERT_EQ(Status::kSuccess, scanner->Close());
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, StoreLruListsFollowPoolLruList) {
+  CreatePool(24);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  UniquePtr<StoreImpl> other(OpenStore("other.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+  LinkedList<Page, Page::StoreLruListBridge>* store_lru_list =
+      store->pool_lru_list(0, PagePriority::kLeaf);
+  LinkedList<Page, Page::StoreLruListBridge>* other_lru_list =
+      other->pool_lru_list(0, PagePriority::kLeaf);
+
+  ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 3));
+  ASSERT_EQ(Status::kSuccess, TouchPage(other.get(), 3));
+  ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 4));
+  EXPECT_EQ(4U, store_lru_list->back()->page_id());
+  EXPECT_EQ(3U, other_lru_list->back()->page_id());
+  EXPECT_LT(other_lru_list->back()->lru_stamp(),
+            store_lru_list->back()->lru_stamp());
+
+  // Pinned pages leave the store's list along with the pool's list.
+  size_t store_lru_page_count = store_lru_list->size();
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), 3, PagePool::kFetchPageData, &page));
+  EXPECT_EQ(store_lru_page_count - 1, store_lru_list->size());
+  page_pool->UnpinStorePage(page);
+  EXPECT_EQ(store_lru_page_count, store_lru_list->size());
+  EXPECT_EQ(page, store_lru_list->back());
+  EXPECT_LT(other_lru_list->back()->lru_stamp(), page->lru_stamp());
+
+  ASSERT_EQ(Status::kSuccess, other->Close());
+  EXPECT_TRUE(other_lru_list->empty());
+  ASSERT_EQ(Status::kSuccess, store->Close());
+  EXPECT_TRUE(store_lru_list->empty());
+}
+
+TEST_F(PoolImplTest, StoreWeightsAndReservations) {
+  CreatePool(24);
+  StoreOptions options;
+  options.page_pool_weight = 1;
+  options.page_pool_min_pages = 8;
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", options));
+  options.page_pool_weight = 5;
+  options.page_pool_min_pages = 0;
+  UniquePtr<StoreImpl> heavy(OpenStore("heavy.berry", options));
+  PagePool* page_pool = pool_->page_pool();
+  EXPECT_EQ(4U, page_pool->StoreShare(store.get()));
+  EXPECT_EQ(20U, page_pool->StoreShare(heavy.get()));
+
+  for (size_t i = 0; i < 12; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 3 + i));
+  for (size_t i = 0; i < 100; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(heavy.get(), 3 + i));
+
+  // The heavy store took everything beyond the light store's reservation.
+  EXPECT_EQ(8U, store->pool_page_count());
+  EXPECT_EQ(16U, heavy->pool_page_count());
+
+  // The reservation does not protect the store's pages from the store itself.
+  for (size_t i = 0; i < 12; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 100 + i));
+  EXPECT_LE(8U, store->pool_page_count());
+
+  ASSERT_EQ(Status::kSuccess, heavy->Close());
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, StoreMaxPages) {
+  CreatePool(24);
+  StoreOptions options;
+  options.page_pool_max_pages = 6;
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", options));
+  PagePool* page_pool = pool_->page_pool();
+
+  for (size_t i = 0; i < 20; ++i)
+    ASSERT_EQ(Status::kSuccess, TouchPage(store.get(), 3 + i));
+  EXPECT_EQ(6U, store->pool_page_count());
+  EXPECT_EQ(6U, page_pool->allocated_pages());
+
+  // Pinned pages may exceed the limit.
+  Page* pages[8];
+  PinAllPages(store.get(), pages, 8);
+  EXPECT_EQ(8U, store->pool_page_count());
+  for (size_t i = 0; i < 8; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, StorePageWaitsForPinnedPages) {
+  CreatePool(4, 10000);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  Page* pages[4];
+  Page* page;
+  std::thread unpinner;
+  {
+    PoolImpl::Lock lock(pool_.get());
+    PinAllPages(store.get(), pages, 4);
+
+    // The other thread can only take the lock while this thread waits.
+    unpinner = std::thread([&]() {
+      PoolImpl::Lock unpinner_lock(pool_.get());
+      page_pool->UnpinStorePage(pages[0]);
+    });
+
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), 42, PagePool::kIgnorePageData, &page));
+    page->MarkDirty();
+    EXPECT_EQ(4U, page_pool->pinned_pages());
+  }
+  unpinner.join();
+
+  page_pool->UnpinStorePage(page);
+  for (size_t i = 1; i < 4; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, StorePageWaitTimesOut) {
+  CreatePool(4, 20);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  PoolImpl::Lock lock(pool_.get());
+  Page* pages[4];
+  PinAllPages(store.get(), pages, 4);
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  Page* page;
+  EXPECT_EQ(Status::kPoolFull, page_pool->StorePage(
+      store.get(), 42, PagePool::kIgnorePageData, &page));
+  EXPECT_LE(std::chrono::milliseconds(20),
+            std::chrono::steady_clock::now() - start);
+
+  for (size_t i = 0; i < 4; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, StorePageFailsRightAwayWithoutWait) {
+  CreatePool(4);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  Page* pages[4];
+  PinAllPages(store.get(), pages, 4);
+  Page* page;
+  EXPECT_EQ(Status::kPoolFull, page_pool->StorePage(
+      store.get(), 42, PagePool::kIgnorePageData, &page));
+
+  for (size_t i = 0; i < 4; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, TransactionAdmissionWaitsForPinnedPages) {
+  CreatePool(8, 10000);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  Page* pages[6];
+  UniquePtr<TransactionImpl> transaction;
+  std::thread unpinner;
+  {
+    PoolImpl::Lock lock(pool_.get());
+    PinAllPages(store.get(), pages, 6);
+
+    // 6 pinned pages leave no room for a transaction's reserve of 4 pages,
+    // until the other thread unpins 2 pages.
+    unpinner = std::thread([&]() {
+      for (size_t i = 0; i < 2; ++i) {
+        PoolImpl::Lock unpinner_lock(pool_.get());
+        page_pool->UnpinStorePage(pages[i]);
+      }
+    });
+
+    TransactionImpl* raw_transaction;
+    ASSERT_EQ(Status::kSuccess, store->CreateTransaction(&raw_transaction));
+    transaction.reset(raw_transaction);
+    EXPECT_GE(8U - PoolImpl::kTransactionPinReserve,
+              page_pool->pinned_pages());
+  }
+  unpinner.join();
+
+  for (size_t i = 2; i < 6; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+  ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(PoolImplTest, TransactionAdmissionTimesOut) {
+  CreatePool(8, 20);
+  UniquePtr<StoreImpl> store(OpenStore("small.berry", 0));
+  PagePool* page_pool = pool_->page_pool();
+
+  PoolImpl::Lock lock(pool_.get());
+  Page* pages[6];
+  PinAllPages(store.get(), pages, 6);
+
+  // The transaction is turned away after the wait times out.
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  TransactionImpl* transaction = nullptr;
+  EXPECT_EQ(Status::kPoolFull, store->CreateTransaction(&transaction));
+  EXPECT_LE(std::chrono::milliseconds(20),
+            std::chrono::steady_clock::now() - start);
+  EXPECT_EQ(nullptr, transaction);
+
+  // The transaction is admitted once the pool has room for it.
+  for (size_t i = 0; i < 6; ++i)
+    page_pool->UnpinStorePage(pages[i]);
+  ASSERT_EQ(Status::kSuccess, store->CreateTransaction(&transaction));
+  EXPECT_FALSE(transaction->IsClosed());
+  ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  transaction->Release();
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+}  // namespace berrydb
@@ -4,12 +4,16 @@
 
 #include "./store_impl.h"
 
+#include <algorithm>
 #include <cstring>
+#include <mutex>
 
 #include "berrydb/options.h"
 #include "berrydb/vfs.h"
 #include "./pool_impl.h"
 #include "./transaction_impl.h"
+#include "./util/crc32c.h"
+#include "./util/lz_codec.h"
 
 namespace berrydb {
 
@@ -17,6 +21,70 @@ static_assert(std::is_standard_layout<StoreImpl>::value,
     "StoreImpl must be a standard layout type so its public API can be "
     "exposed cheaply");
 
+constexpr size_t StoreImpl::kReservedPageCount;
+constexpr size_t StoreImpl::kPageTrailerSize;
+constexpr size_t StoreImpl::kMaxDataFileBlockShift;
+
+// Each page ends with an 8-byte trailer, in the following format:
+//
+// 0: 4-byte CRC32C of the page's usable bytes, followed by the 8-byte page ID
+// 4: 4-byte padding - reserved for future expansion, must be set to zero
+//
+// The checksum catches torn writes and media errors. Covering the page ID also
+// catches writes that landed at the wrong offset in the data file.
+//
+// The header page does not have a trailer. Each header slot has its own
+// checksum, so a torn header write only invalidates one slot, instead of the
+// entire page.
+//
+// Stores that compress their pages write each page (except for the header page)
+// as an image in the following format:
+//
+// 0: 4-byte CRC32C of the payload, followed by the 8-byte page ID
+// 4: 4-byte payload size
+// 8: payload - the page's usable bytes, compressed using LzCompress()
+//
+// Pages that do not compress are stored as they are, and their payload size is
+// the usable page size. Images are padded to the data file's block size, which
+// can be smaller than the page size. The rest of the page's space in the data
+// file is not read or written. Pages keep their page-sized slots, so page IDs
+// still map directly to data file offsets, and compression reduces the I/O
+// volume, but not the data file's size.
+
+namespace {
+
+/** Size of the header at the beginning of a compressed page image. */
+constexpr size_t kCompressedImageHeaderSize = 8;
+
+/** Maximum number of completed data file requests collected by one poll. */
+constexpr size_t kDataIoPollBatchSize = 16;
+
+/** Computes the checksum stored in a page's trailer. */
+inline uint32_t PageChecksum(
+    const uint8_t* page_data, size_t usable_page_size, size_t page_id) noexcept {
+  uint8_t page_id_bytes[8];
+  StoreUint64(page_id, page_id_bytes);
+  return Crc32cExtend(Crc32c(page_data, usable_page_size), page_id_bytes, 8);
+}
+
+/** Scratch space for a compressed page image.
+ *
+ * Page I/O can run on many threads at once, without the pool's lock, so each
+ * thread has its own buffer. The buffer grows to the largest page size used on
+ * the thread, and is kept for the thread's lifetime.
+ *
+ * @param  page_size the size of the page whose image will be held
+ * @return           a buffer of at least page_size bytes
+ */
+uint8_t* CompressionBuffer(size_t page_size) {
+  thread_local std::vector<uint8_t, PlatformAllocator<uint8_t>> buffer;
+  if (buffer.size() < page_size)
+    buffer.resize(page_size);
+  return buffer.data();
+}
+
+}  // anonymous namespace
+
 StoreImpl* StoreImpl::Create(
     BlockAccessFile* data_file, size_t data_file_size,
     RandomAccessFile* log_file, size_t log_file_size, PagePool* page_pool,
@@ -41,14 +109,21 @@ StoreImpl::StoreImpl(
     RandomAccessFile* log_file, size_t log_file_size, PagePool* page_pool,
     const StoreOptions& options)
     : data_file_(data_file), log_file_(log_file), page_pool_(page_pool),
-      init_transaction_(this, true), header_(
-          page_pool->page_shift(), data_file_size >> page_pool->page_shift()) {
+      pool_min_pages_(options.page_pool_min_pages),
+      pool_max_pages_(options.page_pool_max_pages),
+      pool_weight_(options.page_pool_weight),
+      init_transaction_(this, true),
+      // Compressed pages may not fill their space at the end of the data file.
+      header_(page_pool->page_shift(),
+              (data_file_size + page_pool->page_size() - 1) >>
+              page_pool->page_shift()),
+      free_page_manager_(this) {
   DCHECK(data_file != nullptr);
   DCHECK(log_file != nullptr);
   DCHECK(page_pool != nullptr);
 
-  // This will be used when we implement creating/loading the metadata page.
-  UNUSED(options);
+  data_io_pump_.task.run = &StoreImpl::RunDataIoPump;
+  data_io_pump_.store = this;
 
   // This will be used when we implement log recovery.
   UNUSED(log_file_size);
@@ -62,17 +137,53 @@ StoreImpl::~StoreImpl() {
 }
 
 Status StoreImpl::Initialize(const StoreOptions &options) {
-  // TODO(pwnall): Check the log and attempt recovery.
-
-  if (options.create_if_missing && header_.page_count < 3) {
-    Status status = Bootstrap();
-    if (status != Status::kSuccess)
-      return status;
+  if (options.create_if_missing && header_.page_count < kReservedPageCount) {
+    header_.compress_pages = options.compress_pages;
+
+    Status bootstrap_status = Bootstrap();
+    if (bootstrap_status != Status::kSuccess)
+      return bootstrap_status;
+  } else {
+    Status load_status = LoadHeader();
+    if (load_status != Status::kSuccess)
+      return load_status;
+
+    // Stores that were closed cleanly are opened without looking at anything
+    // other than the header page, regardless of the store's size.
+    was_closed_cleanly_ = header_.clean_shutdown;
+    if (!was_closed_cleanly_) {
+      // TODO(pwnall): Check the log and attempt recovery.
+      Status recover_status = free_page_manager_.Recover();
+      if (recover_status != Status::kSuccess)
+        return recover_status;
+    }
   }
 
+  // The flag stays cleared on disk while the store is in use, so a crash is
+  // detected the next time the store is opened.
+  Status status = WriteCleanShutdownFlag(false);
+  if (status != Status::kSuccess)
+    return status;
+  is_initialized_ = true;
+
+  // Compressed pages must be decompressed into page pool buffers anyway.
+  if (options.map_data_file && !header_.compress_pages)
+    MapDataFile();
   return Status::kSuccess;
 }
 
+void StoreImpl::MapDataFile() {
+  DCHECK(mapped_data_ == nullptr);
+
+  // The header page was written by WriteCleanShutdownFlag(), so the data file
+  // holds at least the store's reserved pages.
+  size_t page_count = static_cast<size_t>(header_.page_count);
+  DCHECK_LE(kReservedPageCount, page_count);
+  mapped_data_ = data_file_->MapForReading(page_count << header_.page_shift);
+  if (mapped_data_ != nullptr)
+    mapped_page_count_ = page_count;
+}
+
 Status StoreImpl::Bootstrap() {
   Page* header_page;
   Status fetch_status = page_pool_->StorePage(
@@ -84,9 +195,13 @@ Status StoreImpl::Bootstrap() {
   uint8_t* header_data = header_page->data();
   std::memset(header_data, 0, 1 << header_.page_shift);
   header_.free_list_head_page = 1;
-  header_.page_count = 3;
+  header_.root_page = 2;
+  header_.page_count = kReservedPageCount;
+  header_.generation = 0;
+  header_.clean_shutdown = false;
   // header.page_shift is already set correctly by the constructor.
-  header_.Serialize(header_data);
+  header_.Serialize(
+      header_data + StoreHeader::SlotOffset(0, header_.page_shift));
   page_pool_->UnpinAndWriteStorePage(header_page);
 
   Page* free_list_head_page;
@@ -114,10 +229,102 @@ Status StoreImpl::Bootstrap() {
   return Status::kSuccess;
 }
 
-TransactionImpl* StoreImpl::CreateTransaction() {
+Status StoreImpl::LoadHeader() {
+  if (header_.page_count < kReservedPageCount)
+    return Status::kDataCorrupted;
+
+  Page* header_page;
+  Status fetch_status = page_pool_->StorePage(
+      this, 0, PagePool::kFetchPageData, &header_page);
+  if (fetch_status != Status::kSuccess)
+    return fetch_status;
+  header_page->set_priority(PagePriority::kRoot);
+
+  // The slots are read into a temporary, because a failed Deserialize() leaves
+  // its instance in an undefined state.
+  StoreHeader header;
+  bool found_header = false;
+  for (uint64_t slot = 0; slot < 2; ++slot) {
+    size_t slot_offset = StoreHeader::SlotOffset(slot, header_.page_shift);
+    StoreHeader slot_header;
+    if (!slot_header.Deserialize(header_page->data() + slot_offset))
+      continue;
+    if (slot_header.page_shift != header_.page_shift ||
+        slot_header.page_count < kReservedPageCount ||
+        StoreHeader::SlotOffset(slot_header.generation, header_.page_shift) !=
+        slot_offset) {
+      continue;
+    }
+    if (!found_header || slot_header.generation > header.generation) {
+      header = slot_header;
+      found_header = true;
+    }
+  }
+  page_pool_->UnpinStorePage(header_page);
+  if (!found_header)
+    return Status::kDataCorrupted;
+  header_ = header;
+  return Status::kSuccess;
+}
+
+Status StoreImpl::UpdateHeaderPage() {
+  Page* header_page;
+  Status fetch_status = page_pool_->StorePage(
+      this, 0, PagePool::kFetchPageData, &header_page);
+  if (fetch_status != Status::kSuccess)
+    return fetch_status;
+  header_page->set_priority(PagePriority::kRoot);
+
+  header_page->MarkDirty();
+  ++header_.generation;
+  header_.Serialize(header_page->data() +
+      StoreHeader::SlotOffset(header_.generation, header_.page_shift));
+  page_pool_->UnpinStorePage(header_page);
+  return Status::kSuccess;
+}
+
+Status StoreImpl::RevertHeaderPage(uint64_t failed_generation) {
+  DCHECK_EQ(header_.generation + 1, failed_generation);
+
+  Page* header_page;
+  Status status = page_pool_->StorePage(
+      this, 0, PagePool::kFetchPageData, &header_page);
+  if (status != Status::kSuccess)
+    return status;
+
+  StoreHeader slot_header = header_;
+  slot_header.generation = failed_generation;
+  header_page->MarkDirty();
+  slot_header.Serialize(header_page->data() +
+      StoreHeader::SlotOffset(failed_generation, header_.page_shift));
+  page_pool_->UnpinStorePage(header_page);
+
+  status = page_pool_->WriteBackStorePage(this, 0);
+  if (status != Status::kSuccess)
+    return status;
+  return data_file_->Sync();
+}
+
+Status StoreImpl::WriteCleanShutdownFlag(bool clean_shutdown) {
+  header_.clean_shutdown = clean_shutdown;
+  Status status = UpdateHeaderPage();
+  if (status != Status::kSuccess)
+    return status;
+  status = init_transaction_.WriteDirtyPages();
+  if (status != Status::kSuccess)
+    return status;
+  return data_file_->Sync();
+}
+
+Status StoreImpl::CreateTransaction(TransactionImpl** result) {
+  Status status = page_pool_->pool()->AdmitTransaction(page_pool_);
+  if (status != Status::kSuccess)
+    return status;
+
   TransactionImpl* transaction = TransactionImpl::Create(this);
   transactions_.push_back(transaction);
-  return transaction;
+  *result = transaction;
+  return Status::kSuccess;
 }
 
 Status StoreImpl::Close() {
@@ -132,12 +339,27 @@ Status StoreImpl::Close() {
   // abort the live transactions cleanly, assuming no I/O errors.
   state_ = State::kClosing;
 
+  // The page pool only releases its lock for the I/O of open stores, so the
+  // I/O started before this point is the only I/O to wait for.
+  while (pending_page_io_count_ != 0)
+    page_pool_->pool()->WaitForPageIo();
+  {
+    // The pump task exits soon after the last asynchronous read is collected.
+    std::unique_lock<std::mutex> lock(data_io_mutex_);
+    while (data_io_pump_running_)
+      data_io_polled_.wait(lock);
+  }
+
   // Replace the entire transaction list so TransactionClosed() doesn't
   // invalidate our iterator.
   LinkedList<TransactionImpl> rollback_queue(std::move(transactions_));
 
   Status result = Status::kSuccess;
-  for (TransactionImpl* transaction : rollback_queue) {
+  while (!rollback_queue.empty()) {
+    // The transactions are unlinked, so they can be cached after they are
+    // released.
+    TransactionImpl* transaction = rollback_queue.front();
+    rollback_queue.pop_front();
     Status rollback_status = transaction->Rollback();
 
     // Report the first non-success status encountered while rolling back the
@@ -148,6 +370,24 @@ Status StoreImpl::Close() {
       result = rollback_status;
   }
 
+  // No transaction is open, so no snapshot needs the saved before-images or
+  // the retired pages.
+  PruneVersions();
+  DCHECK(committed_versions_.empty());
+  DCHECK(retired_pages_.empty());
+
+  if (is_initialized_) {
+    // The store's pages must be durable before the header claims that the
+    // store was closed cleanly.
+    Status status = init_transaction_.WriteDirtyPages();
+    if (status == Status::kSuccess)
+      status = data_file_->Sync();
+    if (status == Status::kSuccess)
+      status = WriteCleanShutdownFlag(true);
+    if (status != Status::kSuccess && result == Status::kSuccess)
+      result = status;
+  }
+
   // Rollback the init transaction to get the store's pages released.
   Status rollback_status = init_transaction_.Rollback();
   if (rollback_status != Status::kSuccess && result == Status::kSuccess)
@@ -156,8 +396,8 @@ Status StoreImpl::Close() {
   data_file_->Close();
   log_file_->Close();
 
-  state_ = State::kClosed;
   page_pool_->pool()->StoreClosed(this);
+  state_ = State::kClosed;
 
   return result;
 }
@@ -169,9 +409,82 @@ Status StoreImpl::ReadPage(Page* page) {
   DCHECK(!page->is_dirty());
   DCHECK(!page->IsUnpinned());
 
+  if (header_.compress_pages && page->page_id() != 0)
+    return ReadCompressedPage(page);
+
+  size_t file_offset = page->page_id() << header_.page_shift;
+  const uint8_t* page_data;
+  if (IsPageMapped(page->page_id())) {
+    page_data = mapped_data_ + file_offset;
+  } else {
+    size_t page_size = 1 << header_.page_shift;
+    Status status = ReadDataFile(file_offset, page_size, page->data());
+    if (status != Status::kSuccess)
+      return status;
+    page_data = page->data();
+  }
+
+  Status status = CheckPageTrailer(page_data, page->page_id());
+  if (status != Status::kSuccess)
+    return status;
+
+  if (page_data != page->data())
+    page->MapData(page_data);
+  return Status::kSuccess;
+}
+
+void StoreImpl::SubmitPageRead(Page* page, DataIoRequest* request) {
+  DCHECK(page != nullptr);
+  DCHECK(page->transaction() != nullptr);
+  DCHECK_EQ(this, page->transaction()->store());
+  DCHECK(!page->is_dirty());
+  DCHECK(page->has_buffer());
+  DCHECK(CanSubmitPageRead(page->page_id()));
+  DCHECK(request->completion_task != nullptr);
+  ThreadPool* thread_pool = page_pool_->pool()->async_thread_pool();
+  DCHECK(thread_pool != nullptr);
+
+  {
+    // Counted before submitting, so the count never drops below zero.
+    std::lock_guard<std::mutex> lock(data_io_mutex_);
+    ++async_data_io_count_;
+  }
+
   size_t file_offset = page->page_id() << header_.page_shift;
   size_t page_size = 1 << header_.page_shift;
-  return data_file_->Read(file_offset, page_size, page->data());
+  request->request.token = request;
+  data_file_->SubmitRead(
+      file_offset, page_size, page->data(), &request->request);
+
+  std::lock_guard<std::mutex> lock(data_io_mutex_);
+  if (async_data_io_count_ != 0 && !data_io_pump_running_) {
+    data_io_pump_running_ = true;
+    thread_pool->Submit(&data_io_pump_.task);
+  }
+}
+
+Status StoreImpl::FinishPageRead(Page* page, const DataIoRequest& request) {
+  DCHECK(page != nullptr);
+  DCHECK(!page->is_mapped());
+
+  if (request.request.status != Status::kSuccess)
+    return request.request.status;
+  return CheckPageTrailer(page->data(), page->page_id());
+}
+
+Status StoreImpl::CheckPageTrailer(
+    const uint8_t* page_data, size_t page_id) const noexcept {
+  // The header page does not have a checksum trailer.
+  if (page_id == 0)
+    return Status::kSuccess;
+
+  const uint8_t* trailer = page_data + usable_page_size();
+  if (LoadUint32(trailer) !=
+      PageChecksum(page_data, usable_page_size(), page_id) ||
+      LoadUint32(trailer + 4) != 0) {
+    return Status::kDataCorrupted;
+  }
+  return Status::kSuccess;
 }
 
 Status StoreImpl::WritePage(Page* page) {
@@ -181,9 +494,198 @@ Status StoreImpl::WritePage(Page* page) {
   DCHECK(page->is_dirty());
   //DCHECK(!page->IsUnpinned());
 
+  if (header_.compress_pages && page->page_id() != 0)
+    return WriteCompressedPage(page);
+
+  DataIoRequest request;
+  SubmitPageWrite(page, &request);
+  return WaitForDataIo(&request);
+}
+
+Status StoreImpl::WritePages(Page* const* pages, size_t page_count) {
+  // Compressed images are built in a per-thread buffer, one page at a time.
+  if (header_.compress_pages) {
+    for (size_t i = 0; i < page_count; ++i) {
+      Status status = WritePage(pages[i]);
+      if (status != Status::kSuccess)
+        return status;
+    }
+    return Status::kSuccess;
+  }
+
+  std::vector<DataIoRequest, PlatformAllocator<DataIoRequest>> requests(
+      page_count);
+  for (size_t i = 0; i < page_count; ++i)
+    SubmitPageWrite(pages[i], &requests[i]);
+
+  // Every request must be collected before the requests are freed.
+  Status result = Status::kSuccess;
+  for (DataIoRequest& request : requests) {
+    Status status = WaitForDataIo(&request);
+    if (status != Status::kSuccess && result == Status::kSuccess)
+      result = status;
+  }
+  return result;
+}
+
+void StoreImpl::SubmitPageWrite(Page* page, DataIoRequest* request) {
+  DCHECK(page != nullptr);
+  DCHECK(page->transaction() != nullptr);
+  DCHECK_EQ(this, page->transaction()->store());
+  DCHECK(page->is_dirty());
+  DCHECK(!header_.compress_pages || page->page_id() == 0);
+
+  if (page->page_id() != 0) {
+    uint8_t* trailer = page->data() + usable_page_size();
+    StoreUint32(PageChecksum(page->data(), usable_page_size(), page->page_id()),
+                trailer);
+    StoreUint32(0, trailer + 4);
+  }
+
   size_t file_offset = page->page_id() << header_.page_shift;
   size_t page_size = 1 << header_.page_shift;
-  return data_file_->Write(page->data(), file_offset, page_size);
+  request->request.token = request;
+  data_file_->SubmitWrite(
+      page->data(), file_offset, page_size, &request->request);
+}
+
+Status StoreImpl::ReadDataFile(
+    size_t offset, size_t byte_count, uint8_t* buffer) {
+  DataIoRequest request;
+  request.request.token = &request;
+  data_file_->SubmitRead(offset, byte_count, buffer, &request.request);
+  return WaitForDataIo(&request);
+}
+
+Status StoreImpl::WriteDataFile(
+    uint8_t* buffer, size_t offset, size_t byte_count) {
+  DataIoRequest request;
+  request.request.token = &request;
+  data_file_->SubmitWrite(buffer, offset, byte_count, &request.request);
+  return WaitForDataIo(&request);
+}
+
+Status StoreImpl::WaitForDataIo(DataIoRequest* request) {
+  DCHECK(request != nullptr);
+  DCHECK(request->completion_task == nullptr);
+
+  std::unique_lock<std::mutex> lock(data_io_mutex_);
+  while (!request->completed) {
+    if (data_io_polling_)
+      data_io_polled_.wait(lock);
+    else
+      PollDataIo(&lock);
+  }
+  return request->request.status;
+}
+
+void StoreImpl::PollDataIo(std::unique_lock<std::mutex>* lock) {
+  DCHECK(!data_io_polling_);
+
+  // Other threads check their requests, and submit new requests, while this
+  // thread blocks in PollCompletions().
+  data_io_polling_ = true;
+  lock->unlock();
+  BlockIoRequest* completed[kDataIoPollBatchSize];
+  size_t count = data_file_->PollCompletions(
+      completed, kDataIoPollBatchSize, true);
+  lock->lock();
+
+  for (size_t i = 0; i < count; ++i) {
+    DataIoRequest* request = static_cast<DataIoRequest*>(completed[i]->token);
+    if (request->completion_task == nullptr) {
+      request->completed = true;
+      continue;
+    }
+
+    // The task may free the request, so the request is not used afterwards.
+    DCHECK_NE(async_data_io_count_, 0U);
+    --async_data_io_count_;
+    page_pool_->pool()->async_thread_pool()->Submit(request->completion_task);
+  }
+  data_io_polling_ = false;
+  data_io_polled_.notify_all();
+}
+
+void StoreImpl::RunDataIoPump(ThreadPool::Task* task) {
+  DataIoPump* pump = reinterpret_cast<DataIoPump*>(task);
+  DCHECK_EQ(task, &pump->task);
+  StoreImpl* store = pump->store;
+
+  std::unique_lock<std::mutex> lock(store->data_io_mutex_);
+  while (store->async_data_io_count_ != 0) {
+    if (store->data_io_polling_)
+      store->data_io_polled_.wait(lock);
+    else
+      store->PollDataIo(&lock);
+  }
+  store->data_io_pump_running_ = false;
+  store->data_io_polled_.notify_all();
+}
+
+Status StoreImpl::ReadCompressedPage(Page* page) {
+  DCHECK(header_.compress_pages);
+
+  // The first block holds the image header, which has the payload size. Pages
+  // that compress well do not need more blocks.
+  size_t block_size = static_cast<size_t>(1)
+      << DataFileBlockShift(header_.page_shift);
+  size_t file_offset = page->page_id() << header_.page_shift;
+  uint8_t* image = CompressionBuffer(page_pool_->page_size());
+  Status status = ReadDataFile(file_offset, block_size, image);
+  if (status != Status::kSuccess)
+    return status;
+
+  size_t usable_size = usable_page_size();
+  size_t payload_size = LoadUint32(image + 4);
+  if (payload_size > usable_size)
+    return Status::kDataCorrupted;
+  size_t image_size = kCompressedImageHeaderSize + payload_size;
+  if (image_size > block_size) {
+    size_t read_size = (image_size - 1) & ~(block_size - 1);
+    status = ReadDataFile(
+        file_offset + block_size, read_size, image + block_size);
+    if (status != Status::kSuccess)
+      return status;
+  }
+
+  const uint8_t* payload = image + kCompressedImageHeaderSize;
+  if (LoadUint32(image) != PageChecksum(payload, payload_size, page->page_id()))
+    return Status::kDataCorrupted;
+  if (payload_size == usable_size) {
+    std::memcpy(page->data(), payload, usable_size);
+  } else if (!LzDecompress(payload, payload_size, page->data(), usable_size)) {
+    return Status::kDataCorrupted;
+  }
+  return Status::kSuccess;
+}
+
+Status StoreImpl::WriteCompressedPage(Page* page) {
+  DCHECK(header_.compress_pages);
+
+  size_t usable_size = usable_page_size();
+  uint8_t* image = CompressionBuffer(page_pool_->page_size());
+  uint8_t* payload = image + kCompressedImageHeaderSize;
+
+  // The payload must be smaller than the usable page size, which indicates an
+  // uncompressed page.
+  size_t payload_size = LzCompress(
+      page->data(), usable_size, payload, usable_size - 1);
+  if (payload_size == 0) {
+    std::memcpy(payload, page->data(), usable_size);
+    payload_size = usable_size;
+  }
+  StoreUint32(PageChecksum(payload, payload_size, page->page_id()), image);
+  StoreUint32(static_cast<uint32_t>(payload_size), image + 4);
+
+  size_t block_size = static_cast<size_t>(1)
+      << DataFileBlockShift(header_.page_shift);
+  size_t image_size = kCompressedImageHeaderSize + payload_size;
+  size_t write_size = (image_size + block_size - 1) & ~(block_size - 1);
+  std::memset(image + image_size, 0, write_size - image_size);
+
+  size_t file_offset = page->page_id() << header_.page_shift;
+  return WriteDataFile(image, file_offset, write_size);
 }
 
 void StoreImpl::TransactionClosed(TransactionImpl* transaction) {
@@ -198,6 +700,116 @@ void StoreImpl::TransactionClosed(TransactionImpl* transaction) {
     return;
 
   transactions_.erase(transaction);
+  PruneVersions();
+}
+
+void StoreImpl::VersionCommitted(PageVersion* version) {
+  DCHECK(version != nullptr);
+  DCHECK(version->transaction() == nullptr);
+  DCHECK(committed_versions_.empty() ||
+         committed_versions_.back()->superseded_at() <=
+         version->superseded_at());
+
+  committed_versions_.push_back(version);
+}
+
+Status StoreImpl::CommitRootPage(
+    size_t root_page,
+    std::vector<size_t, PlatformAllocator<size_t>>* shadow_pages,
+    bool* store_failed) {
+  DCHECK(IsDataPage(root_page));
+  DCHECK(shadow_pages != nullptr);
+  DCHECK(store_failed != nullptr);
+  *store_failed = false;
+
+  // The shadow pages must be durable before the header points to them. They
+  // are written in page ID order, so the data file sees sequential writes
+  // whenever possible.
+  std::vector<size_t, PlatformAllocator<size_t>> page_ids(*shadow_pages);
+  std::sort(page_ids.begin(), page_ids.end());
+  Status status = page_pool_->WriteBackStorePages(
+      this, page_ids.data(), page_ids.size());
+  if (status != Status::kSuccess)
+    return status;
+  // The free list must not list the shadow pages once the header points to
+  // them.
+  status = free_page_manager_.WriteDirtyPages();
+  if (status != Status::kSuccess)
+    return status;
+  status = data_file_->Sync();
+  if (status != Status::kSuccess)
+    return status;
+
+  StoreHeader committed_header = header_;
+  header_.root_page = root_page;
+  status = UpdateHeaderPage();
+  if (status != Status::kSuccess) {
+    // The header page was not modified.
+    header_ = committed_header;
+    return status;
+  }
+  status = page_pool_->WriteBackStorePage(this, 0);
+  if (status == Status::kSuccess)
+    status = data_file_->Sync();
+  if (status == Status::kSuccess)
+    return Status::kSuccess;
+
+  // The new header may be in the data file, so the shadow pages are leaked
+  // instead of freed. Until the committed header supersedes the new header on
+  // disk, reusing any page reachable from the new root page could corrupt the
+  // store after a crash, so the store must be closed if that cannot be done.
+  shadow_pages->clear();
+  uint64_t failed_generation = header_.generation;
+  header_ = committed_header;
+  if (RevertHeaderPage(failed_generation) != Status::kSuccess)
+    *store_failed = true;
+  return status;
+}
+
+void StoreImpl::PageRetired(size_t page_id, uint64_t commit_timestamp) {
+  DCHECK(IsDataPage(page_id));
+  DCHECK(retired_pages_.empty() ||
+         retired_pages_.back().first <= commit_timestamp);
+
+  retired_pages_.emplace_back(commit_timestamp, page_id);
+}
+
+void StoreImpl::PruneVersions() {
+  uint64_t oldest_read_timestamp = last_commit_timestamp_;
+  for (TransactionImpl* transaction : transactions_) {
+    if (transaction->read_timestamp() < oldest_read_timestamp)
+      oldest_read_timestamp = transaction->read_timestamp();
+  }
+
+  size_t page_size = page_pool_->page_size();
+  while (!committed_versions_.empty()) {
+    PageVersion* version = committed_versions_.front();
+    if (version->superseded_at() > oldest_read_timestamp)
+      break;
+    committed_versions_.pop_front();
+
+    // Versions are pruned in commit order, so each pruned version is the
+    // oldest version in its page's chain.
+    DCHECK(version->older() == nullptr);
+    Page* page = version->page();
+    if (page->newest_version() == version)
+      page->set_newest_version(nullptr);
+    version->Unlink();
+    version->Release(page_size);
+    if (page->newest_version() == nullptr)
+      page_pool_->UnpinStorePage(page);
+  }
+
+  size_t retired_count = 0;
+  while (retired_count < retired_pages_.size() &&
+         retired_pages_[retired_count].first <= oldest_read_timestamp) {
+    // A failure to free the page leaks it, which is preferable to keeping the
+    // page ID around.
+    free_page_manager_.FreePage(retired_pages_[retired_count].second);
+    ++retired_count;
+  }
+  retired_pages_.erase(
+      retired_pages_.begin(), retired_pages_.begin() + retired_count);
 }
 
 std::string StoreImpl::LogFilePath(const std::string& store_path) {
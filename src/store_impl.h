@@ -5,17 +5,27 @@
 #ifndef BERRYDB_STORE_IMPL_H_
 #define BERRYDB_STORE_IMPL_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "berrydb/platform.h"
 #include "berrydb/pool.h"
 #include "berrydb/store.h"
 #include "berrydb/vfs.h"
+#include "./data_io_request.h"
 #include "./format/store_header.h"
+#include "./free_page_manager.h"
 #include "./page.h"
+#include "./page_pool.h"
 #include "./transaction_impl.h"
 #include "./util/linked_list.h"
+#include "./util/platform_allocator.h"
+#include "./util/thread_pool.h"
 
 namespace berrydb {
 
@@ -27,6 +37,51 @@ class PoolImpl;
 /** Internal representation for the Store class in the public API. */
 class StoreImpl {
  public:
+  /** Number of pages at the beginning of the data file with fixed roles.
+   *
+   * Page 0 holds the store header, and page 1 is the head of the free page
+   * list. Page 2 is the root catalog's initial root page. The root page moves
+   * when it is updated using shadow paging, so page 2 can be freed and reused
+   * afterwards. */
+  static constexpr size_t kReservedPageCount = 3;
+
+  /** Bytes at the end of each page reserved for the page's checksum trailer.
+   *
+   * The trailer is 8 bytes, so the usable part of a page has the same
+   * alignment as the page. */
+  static constexpr size_t kPageTrailerSize = 8;
+
+  /** Base-2 log of the largest block size used to access data files.
+   *
+   * Compressed pages are written in blocks of this size, so a page that
+   * compresses well needs less I/O than an uncompressed page. */
+  static constexpr size_t kMaxDataFileBlockShift = 12;
+
+  /** Base-2 log of the block size used to access a store's data file.
+   *
+   * @param  page_shift base-2 log of the store's page size
+   * @return            the block_shift argument for Vfs::OpenForBlockAccess() */
+  static inline size_t DataFileBlockShift(size_t page_shift) noexcept {
+    return (page_shift < kMaxDataFileBlockShift) ?
+        page_shift : kMaxDataFileBlockShift;
+  }
+
+  /** True if a store's pages can be the given size.
+   *
+   * The header page holds two header slots, one at the start of each half,
+   * and the second slot must end before the page's trailer.
+   *
+   * @param  page_shift base-2 log of the store's page size
+   * @return            false if the page size is too small for the header page
+   */
+  static inline bool PageShiftFitsHeader(size_t page_shift) noexcept {
+    if (page_shift == 0 || page_shift >= 32)
+      return false;
+    size_t page_size = static_cast<size_t>(1) << page_shift;
+    return (page_size >> 1) + StoreHeader::kSerializedSize + kPageTrailerSize
+        <= page_size;
+  }
+
   /** Create a StoreImpl instance.
    *
    * This returns a minimally set up instance that can be registered with the
@@ -66,12 +121,91 @@ class StoreImpl {
   /** The page pool used by this store. */
   inline PagePool* page_pool() const noexcept { return page_pool_; }
 
+  /** Number of page pool entries caching this store's pages. */
+  inline size_t pool_page_count() const noexcept { return pool_page_count_; }
+
+  /** See StoreOptions::page_pool_min_pages. */
+  inline size_t pool_min_pages() const noexcept { return pool_min_pages_; }
+
+  /** See StoreOptions::page_pool_max_pages. 0 means no limit. */
+  inline size_t pool_max_pages() const noexcept { return pool_max_pages_; }
+
+  /** See StoreOptions::page_pool_weight. */
+  inline size_t pool_weight() const noexcept { return pool_weight_; }
+
+  /** Called by the page pool when an entry is assigned to a store page. */
+  inline void PoolPageAssigned() noexcept { ++pool_page_count_; }
+
+  /** Called by the page pool when an entry stops caching a store page. */
+  inline void PoolPageUnassigned() noexcept {
+    DCHECK_NE(pool_page_count_, 0U);
+    --pool_page_count_;
+  }
+
+  /** Called by the page pool before it performs I/O on one of the store's pages
+   * without the pool's lock. */
+  inline void PageIoStarted() noexcept { ++pending_page_io_count_; }
+
+  /** Called by the page pool when I/O started after PageIoStarted() completes.
+   */
+  inline void PageIoCompleted() noexcept {
+    DCHECK_NE(pending_page_io_count_, 0U);
+    --pending_page_io_count_;
+  }
+
+  /** The store's pages in one of the page pool's LRU lists.
+   *
+   * The page pool keeps each unpinned page in this list as well as in the
+   * shared LRU list, in the same order, so it can find a store's least
+   * recently used page without walking past other stores' pages.
+   *
+   * @param  numa_node the page pool partition holding the pages
+   * @param  priority  the priority class of the pages
+   * @return           the store's pages in the partition's LRU list for the
+   *                   priority class */
+  inline LinkedList<Page, Page::StoreLruListBridge>* pool_lru_list(
+      size_t numa_node, PagePriority priority) noexcept {
+    DCHECK_LT(numa_node, PagePool::kMaxNumaNodes);
+    return &pool_lru_lists_[numa_node][static_cast<size_t>(priority)];
+  }
+
+  /** The number of bytes at the start of each page available to page formats.
+   *
+   * The rest of each page is the checksum trailer, which is written by
+   * WritePage() and verified by ReadPage(). */
+  inline size_t usable_page_size() const noexcept {
+    return (static_cast<size_t>(1) << header_.page_shift) - kPageTrailerSize;
+  }
+
+  /** The manager for the free pages in this store's data file. */
+  inline FreePageManager* free_page_manager() noexcept {
+    return &free_page_manager_;
+  }
+
+  /** The in-memory copy of the store's header.
+   *
+   * Changes to the header must be followed by an UpdateHeaderPage() call. */
+  inline StoreHeader* header() noexcept { return &header_; }
+
+  /** True if a page ID can refer to a page that holds store data.
+   *
+   * Data pages are allocated from, and returned to, the free page list. This
+   * excludes the header page, the free list's head page, and page IDs past the
+   * end of the data file.
+   */
+  inline bool IsDataPage(uint64_t page_id) const noexcept {
+    return page_id != 0 && page_id != header_.free_list_head_page &&
+        page_id < header_.page_count;
+  }
+
   // See the public API documention for details.
   static std::string LogFilePath(const std::string& store_path);
-  TransactionImpl* CreateTransaction();
+  Status CreateTransaction(TransactionImpl** result);
   inline CatalogImpl* RootCatalog() noexcept { return nullptr; }
   Status Close();
   inline bool IsClosed() const noexcept { return state_ == State::kClosed; }
+  /** False once Close() starts. IsClosed() is true once Close() is done. */
+  inline bool IsOpen() const noexcept { return state_ == State::kOpen; }
   void Release();
 
   /** Initializes a store obtained by Store::Create.
@@ -90,24 +224,196 @@ class StoreImpl {
   /** Builds a new store on the currently opened files. */
   Status Bootstrap();
 
+  /** Reads the header of an existing store into memory.
+   *
+   * The newest header slot that passes validation is used, so a torn header
+   * write rolls the store back to the previous header.
+   *
+   * @return most likely kSuccess or kIoError; kDataCorrupted if the data file
+   *         does not start with a valid header for the pool's page size */
+  Status LoadHeader();
+
+  /** Copies the in-memory header into the store's header page.
+   *
+   * The header's generation is bumped, and the header is written into the slot
+   * that does not hold the previous generation. The header page is marked
+   * dirty, and will be written to the data file together with the other dirty
+   * pages.
+   *
+   * @return most likely kSuccess, kPoolFull or kIoError */
+  Status UpdateHeaderPage();
+
+  /** Undoes a failed header update in the header page and the data file.
+   *
+   * The in-memory header must have been restored to the last committed
+   * header. That header is written into the failed generation's slot, under
+   * the failed generation's number, so it supersedes whatever part of the
+   * failed update reached the data file. The header page is written and synced
+   * right away.
+   *
+   * @param  failed_generation the generation of the failed header update
+   * @return                   most likely kSuccess or kIoError */
+  Status RevertHeaderPage(uint64_t failed_generation);
+
+  /** Records the store's clean shutdown flag in the data file.
+   *
+   * The header is written and synced to the data file right away. When setting
+   * the flag, all the store's other pages must have been written and synced.
+   *
+   * @return most likely kSuccess or kIoError */
+  Status WriteCleanShutdownFlag(bool clean_shutdown);
+
+  /** True if the store was closed cleanly the last time it was used.
+   *
+   * Stores that were closed cleanly are consistent on disk, so opening them
+   * does not require recovery. */
+  inline bool was_closed_cleanly() const noexcept {
+    return was_closed_cleanly_;
+  }
+
   /** Reads a page from the store into the page pool.
    *
    * The page pool entry must have already been assigned to store, and must not
    * be holding onto a dirty page.
    *
+   * The page's checksum trailer is verified. Pages stay verified while they are
+   * cached in the page pool, so the checksum is only computed on cache misses.
+   *
+   * If the data file is memory-mapped, the page pool entry is pointed to the
+   * page's data in the mapping, instead of receiving a copy of the data. The
+   * entry must have a data buffer unless IsPageMapped() is true for the page.
+   *
+   * This may be called without holding the pool's lock, concurrently with
+   * other ReadPage() and WritePage() calls for different pages.
+   *
    * @param  page the page pool entry that will hold the store's page;
-   * @return      most likely kSuccess or kIoError */
+   * @return      most likely kSuccess or kIoError; kDataCorrupted if the
+   *              page's checksum does not match its content */
   Status ReadPage(Page* page);
 
+  /** True if ReadPage() points the page's pool entry into the data mapping. */
+  inline bool IsPageMapped(size_t page_id) const noexcept {
+    return page_id < mapped_page_count_;
+  }
+
+  /** True if SubmitPageRead() can be used to read a page.
+   *
+   * Mapped pages need no I/O, and compressed pages are read in several steps,
+   * so both are read by ReadPage(). */
+  inline bool CanSubmitPageRead(size_t page_id) const noexcept {
+    return !IsPageMapped(page_id) &&
+           (!header_.compress_pages || page_id == 0);
+  }
+
+  /** Starts reading a page from the store into the page pool.
+   *
+   * The page pool entry must meet ReadPage()'s requirements, and must have a
+   * data buffer. When the read completes, the request's completion task is
+   * queued on the pool's asynchronous operation threads, which must exist. The
+   * task must call FinishPageRead().
+   *
+   * The data file's completions are collected by a task running on the pool's
+   * asynchronous operation threads while asynchronous requests are in flight,
+   * so a single thread waits for all the store's reads.
+   *
+   * @param page    the page pool entry that will hold the store's page
+   * @param request must have a completion task */
+  void SubmitPageRead(Page* page, DataIoRequest* request);
+
+  /** Verifies a page read started by SubmitPageRead().
+   *
+   * @param  page    the page pool entry passed to SubmitPageRead()
+   * @param  request the request passed to SubmitPageRead()
+   * @return         the same result as ReadPage() */
+  Status FinishPageRead(Page* page, const DataIoRequest& request);
+
   /** Writes a page to the store.
    *
    * The page pool entry must be flagged as dirty. The caller is responsible for
    * clearing the page entry's dirty flag if this method succeeds.
    *
+   * The page's checksum trailer is computed and stored in the page pool entry
+   * before the page is written.
+   *
    * @param  page the page pool entry caching the store page to be written
    * @return      most likely kSuccess or kIoError */
   Status WritePage(Page* page);
 
+  /** Writes several pages to the store, keeping the writes in flight together.
+   *
+   * Each page must meet WritePage()'s requirements. All the writes are waited
+   * for, even if some of them fail. The caller is responsible for clearing the
+   * page entries' dirty flags if this method succeeds.
+   *
+   * @param  pages      the page pool entries caching the store pages
+   * @param  page_count the number of entries in pages
+   * @return            the first error reported by a write, or kSuccess */
+  Status WritePages(Page* const* pages, size_t page_count);
+
+  /** The commit timestamp of the most recently committed transaction.
+   *
+   * New transactions use this as their snapshot's read timestamp. */
+  inline uint64_t last_commit_timestamp() const noexcept {
+    return last_commit_timestamp_;
+  }
+
+  /** Allocates a commit timestamp for a committing transaction. */
+  inline uint64_t AssignCommitTimestamp() noexcept {
+    return ++last_commit_timestamp_;
+  }
+
+  /** Takes ownership of a page version whose transaction committed.
+   *
+   * The version is kept until no open transaction's snapshot needs it. */
+  void VersionCommitted(PageVersion* version);
+
+  /** Makes a shadow paging transaction's changes durable.
+   *
+   * The transaction's shadow pages and the modified free list pages are written
+   * and synced to the data file. Afterwards, the new root page is recorded in
+   * the header page, which is written and synced as well. Writing the header is
+   * the commit point. A crash before it leaves the store pointing to the old
+   * root page, and shadow paging never overwrites the pages reachable from it.
+   * Other dirty pages, such as pages modified by transactions that have not
+   * committed, are not written.
+   *
+   * If writing or syncing the header fails, the data file may still name the
+   * new root page. The committed header is written back into the new header's
+   * slot, and the shadow pages are leaked, so they are never reused while a
+   * header on disk may point to them. If the committed header cannot be made
+   * durable either, the store must be closed. This is left to the caller,
+   * because closing the store rolls back its transactions, including the one
+   * being committed.
+   *
+   * @param  root_page    the transaction's root page
+   * @param  shadow_pages the pages allocated by the transaction's
+   *                      CopyOnWrite() calls; cleared if the commit fails
+   *                      after the new header reached the data file, or may
+   *                      have reached it
+   * @param  store_failed set to true if the commit failed, and the caller must
+   *                      close the store after the committing transaction is
+   *                      rolled back; set to false otherwise
+   * @return              most likely kSuccess or kIoError */
+  Status CommitRootPage(
+      size_t root_page,
+      std::vector<size_t, PlatformAllocator<size_t>>* shadow_pages,
+      bool* store_failed);
+
+  /** Queues a page that was replaced by a shadow page for reuse.
+   *
+   * The page is returned to the free page list once no open transaction's
+   * snapshot can read it. The queue is only kept in memory, so the pages that
+   * are still queued when the store crashes are leaked, which is safe.
+   *
+   * @param page_id          the page that was replaced
+   * @param commit_timestamp the commit timestamp of the transaction that
+   *                         replaced the page */
+  void PageRetired(size_t page_id, uint64_t commit_timestamp);
+
+  /** Releases the page versions and retired pages that no open transaction can
+   * read. */
+  void PruneVersions();
+
   /** Updates the store to reflect a transaction's commit / abort.
    *
    * @param transaction must be associated with this store, and closed */
@@ -121,6 +427,54 @@ class StoreImpl {
 #endif  // DCHECK_IS_ON()
 
  private:
+  /** ReadPage() implementation for stores that compress their pages. */
+  Status ReadCompressedPage(Page* page);
+
+  /** WritePage() implementation for stores that compress their pages. */
+  Status WriteCompressedPage(Page* page);
+
+  /** Computes a page's checksum trailer, and starts writing the page.
+   *
+   * Must not be used for compressed pages. The write is waited for using
+   * WaitForDataIo(). */
+  void SubmitPageWrite(Page* page, DataIoRequest* request);
+
+  /** Verifies the checksum trailer of a page's data. */
+  Status CheckPageTrailer(
+      const uint8_t* page_data, size_t page_id) const noexcept;
+
+  /** Reads from the data file using its asynchronous I/O methods. */
+  Status ReadDataFile(size_t offset, size_t byte_count, uint8_t* buffer);
+
+  /** Writes to the data file using its asynchronous I/O methods. */
+  Status WriteDataFile(uint8_t* buffer, size_t offset, size_t byte_count);
+
+  /** Waits for a data file request submitted by this store to complete.
+   *
+   * One thread at a time collects the data file's completed requests, including
+   * the requests of the other waiting threads.
+   *
+   * @param  request the request to wait for; must not have a completion task
+   * @return         the request's result */
+  Status WaitForDataIo(DataIoRequest* request);
+
+  /** Collects the data file's completed requests.
+   *
+   * The caller must hold data_io_mutex_ via the given lock, and no other thread
+   * may be collecting completions. The lock is released while waiting for the
+   * data file. */
+  void PollDataIo(std::unique_lock<std::mutex>* lock);
+
+  /** Collects completions until no asynchronous request is in flight.
+   *
+   * Runs on the pool's asynchronous operation threads. */
+  static void RunDataIoPump(ThreadPool::Task* task);
+
+  /** Maps the pages currently in the data file into memory, if possible.
+   *
+   * Pages added to the data file afterwards are read using regular I/O. */
+  void MapDataFile();
+
   /** Use StoreImpl::Create() to obtain StoreImpl instances. */
   StoreImpl(
       BlockAccessFile* data_file, size_t data_file_size,
@@ -147,6 +501,52 @@ class StoreImpl {
   /** The page pool used by this store to interact with its data file. */
   PagePool* const page_pool_;
 
+  /** See pool_page_count(). */
+  size_t pool_page_count_ = 0;
+
+  /** Page I/O performed without the pool's lock. Close() waits for it. */
+  size_t pending_page_io_count_ = 0;
+
+  /** Guards the data file I/O state below, and DataIoRequest::completed.
+   *
+   * Data file requests may be submitted with or without the pool's lock, so
+   * their completions cannot be collected under the pool's lock. */
+  std::mutex data_io_mutex_;
+
+  /** Signaled when a thread is done collecting data file completions. */
+  std::condition_variable data_io_polled_;
+
+  /** True while a thread collects the data file's completed requests. */
+  bool data_io_polling_ = false;
+
+  /** Asynchronous data file requests that were not collected yet. */
+  size_t async_data_io_count_ = 0;
+
+  /** True while the data I/O pump task is queued or running.
+   *
+   * Close() waits for the task to exit, because the task uses the store. */
+  bool data_io_pump_running_ = false;
+
+  /** The task that collects completions for asynchronous requests. */
+  struct DataIoPump {
+    ThreadPool::Task task;  // Must be the first member.
+    StoreImpl* store;
+  };
+  DataIoPump data_io_pump_;
+
+  /** See pool_min_pages(). */
+  const size_t pool_min_pages_;
+
+  /** See pool_max_pages(). */
+  const size_t pool_max_pages_;
+
+  /** See pool_weight(). */
+  const size_t pool_weight_;
+
+  /** See pool_lru_list(). */
+  LinkedList<Page, Page::StoreLruListBridge>
+      pool_lru_lists_[PagePool::kMaxNumaNodes][kPagePriorityCount];
+
   /** The transactions opened on this store. */
   LinkedList<TransactionImpl> transactions_;
 
@@ -162,7 +562,38 @@ class StoreImpl {
   /** Metadata in the data file's header. */
   StoreHeader header_;
 
-  State state_ = State::kOpen;
+  /** Tracks the free pages in the data file. */
+  FreePageManager free_page_manager_;
+
+  /** Before-images that may be read by snapshots, in commit order. */
+  LinkedList<PageVersion> committed_versions_;
+
+  /** Pages replaced by shadow pages, with the commit timestamps that retired
+   * them, in commit order. */
+  std::vector<std::pair<uint64_t, size_t>,
+              PlatformAllocator<std::pair<uint64_t, size_t>>> retired_pages_;
+
+  /** See last_commit_timestamp(). */
+  uint64_t last_commit_timestamp_ = 0;
+
+  /** Atomic because the public API reads it without holding the pool's lock.
+   *
+   * The closed state is entered after Close() is done with the pool, so a thread
+   * that sees it can use the store without the pool's lock, even if the pool is
+   * released right afterwards. */
+  std::atomic<State> state_{State::kOpen};
+
+  /** True after Initialize() cleared the clean shutdown flag on disk. */
+  bool is_initialized_ = false;
+
+  /** See was_closed_cleanly(). */
+  bool was_closed_cleanly_ = false;
+
+  /** The data file's memory mapping, or nullptr if the file is not mapped. */
+  const uint8_t* mapped_data_ = nullptr;
+
+  /** Number of pages covered by the data file's memory mapping. */
+  size_t mapped_page_count_ = 0;
 };
 
 }  // namespace berrydb
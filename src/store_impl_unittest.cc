@@ -7,11 +7,14 @@
 #include <cstring>
 #include <random>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "berrydb/options.h"
 #include "berrydb/vfs.h"
+#include "./format/store_header.h"
+#include "./free_page_manager.h"
 #include "./page_pool.h"
 #include "./pool_impl.h"
 #include "./test/block_access_file_wrapper.h"
@@ -27,6 +30,11 @@ class StoreImplTest : public ::testing::Test {
         log_file_deleter_(StoreImpl::LogFilePath(kStoreFileName)) { }
 
   void SetUp() override {
+    OpenFiles();
+  }
+
+  /** (Re)opens the store's data and log files. */
+  void OpenFiles() {
     BlockAccessFile* raw_data_file;
     ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
         data_file_deleter_.path(), kStorePageShift, true, false, &raw_data_file,
@@ -40,6 +48,9 @@ class StoreImplTest : public ::testing::Test {
 
   const std::string kStoreFileName = "test_store_impl.berry";
   constexpr static size_t kStorePageShift = 12;
+  // WritePage() overwrites the rest of the page with the checksum trailer.
+  constexpr static size_t kUsablePageSize =
+      (1 << kStorePageShift) - StoreImpl::kPageTrailerSize;
 
   void CreatePool(int page_shift, int page_capacity) {
     PoolOptions options;
@@ -106,7 +117,7 @@ TEST_F(StoreImplTest, WriteReadPage) {
     page->MarkDirty(false);  // Bypass DCHECKs in ReadPage.
     ASSERT_EQ(Status::kSuccess, store->ReadPage(page));
     ASSERT_EQ(0, std::memcmp(
-        page->data(), buffer + (i << kStorePageShift), 1 << kStorePageShift));
+        page->data(), buffer + (i << kStorePageShift), kUsablePageSize));
 
     page_pool->UnassignPageFromStore(page);
     ASSERT_TRUE(!page->IsUnpinned());
@@ -122,7 +133,7 @@ TEST_F(StoreImplTest, WriteReadPage) {
     page->MarkDirty(false);  // Bypass DCHECKs in ReadPage.
     ASSERT_EQ(Status::kSuccess, store->ReadPage(page));
     ASSERT_EQ(0, std::memcmp(
-        page->data(), buffer + (i << kStorePageShift), 1 << kStorePageShift));
+        page->data(), buffer + (i << kStorePageShift), kUsablePageSize));
 
     page_pool->UnassignPageFromStore(page);
     ASSERT_TRUE(!page->IsUnpinned());
@@ -135,6 +146,272 @@ TEST_F(StoreImplTest, WriteReadPage) {
   EXPECT_TRUE(page->IsUnpinned());
 }
 
+TEST_F(StoreImplTest, ReadPageVerifiesChecksum) {
+  CreatePool(kStorePageShift, 2);
+  PagePool* page_pool = pool_->page_pool();
+  BlockAccessFile* data_file = data_file_.get();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+
+  Page* page = page_pool->AllocPage();
+  ASSERT_TRUE(page != nullptr);
+  // Page 0 holds the store header, which does not have a checksum trailer.
+  for (size_t i = 1; i < 3; ++i) {
+    ASSERT_EQ(Status::kSuccess, page_pool->AssignPageToStore(
+        page, store.get(), i, PagePool::kIgnorePageData));
+    page->MarkDirty();
+    std::memset(page->data(), 0x5a, 1 << kStorePageShift);
+    ASSERT_EQ(Status::kSuccess, store->WritePage(page));
+    page->MarkDirty(false);
+    page_pool->UnassignPageFromStore(page);
+  }
+
+  uint8_t buffer[1 << kStorePageShift];
+  ASSERT_EQ(Status::kSuccess, data_file->Read(
+      1 << kStorePageShift, sizeof(buffer), buffer));
+  for (size_t offset : {size_t(0), kUsablePageSize - 1, kUsablePageSize,
+                        sizeof(buffer) - 1}) {
+    buffer[offset] ^= 0x10;
+    ASSERT_EQ(Status::kSuccess, data_file->Write(
+        buffer, 1 << kStorePageShift, sizeof(buffer)));
+    ASSERT_EQ(Status::kSuccess, page_pool->AssignPageToStore(
+        page, store.get(), 1, PagePool::kIgnorePageData));
+    EXPECT_EQ(Status::kDataCorrupted, store->ReadPage(page)) << offset;
+    page_pool->UnassignPageFromStore(page);
+
+    buffer[offset] ^= 0x10;
+    ASSERT_EQ(Status::kSuccess, data_file->Write(
+        buffer, 1 << kStorePageShift, sizeof(buffer)));
+    ASSERT_EQ(Status::kSuccess, page_pool->AssignPageToStore(
+        page, store.get(), 1, PagePool::kIgnorePageData));
+    EXPECT_EQ(Status::kSuccess, store->ReadPage(page)) << offset;
+    page_pool->UnassignPageFromStore(page);
+  }
+
+  // The checksum covers the page ID, so a page written at the wrong offset is
+  // detected, even though its content is intact.
+  ASSERT_EQ(Status::kSuccess, data_file->Write(
+      buffer, 2 << kStorePageShift, sizeof(buffer)));
+  ASSERT_EQ(Status::kSuccess, page_pool->AssignPageToStore(
+      page, store.get(), 2, PagePool::kIgnorePageData));
+  EXPECT_EQ(Status::kDataCorrupted, store->ReadPage(page));
+  page_pool->UnassignPageFromStore(page);
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+  page_pool->UnpinUnassignedPage(page);
+}
+
+TEST_F(StoreImplTest, CompressedPages) {
+  // The fixture opens the data file with 4 KB blocks, so compressed pages can
+  // take up less than their full 32 KB.
+  constexpr size_t kPageShift = 15;
+  ASSERT_EQ(static_cast<size_t>(kStorePageShift),
+            StoreImpl::DataFileBlockShift(kPageShift));
+  CreatePool(kPageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  StoreOptions options;
+  options.compress_pages = true;
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, options));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+  EXPECT_TRUE(store->header()->compress_pages);
+
+  size_t usable_page_size = store->usable_page_size();
+  std::vector<uint8_t> random_data(usable_page_size);
+  for (size_t i = 0; i < usable_page_size; ++i)
+    random_data[i] = static_cast<uint8_t>(rnd_());
+  std::vector<uint8_t> compressible_data(usable_page_size);
+  for (size_t i = 0; i < usable_page_size; ++i)
+    compressible_data[i] = static_cast<uint8_t>(i / 64);
+
+  // The page at the end of the data file compresses well.
+  size_t page_ids[2];
+  const std::vector<uint8_t>* page_data[2] = {
+      &random_data, &compressible_data };
+  for (size_t i = 0; i < 2; ++i) {
+    ASSERT_EQ(Status::kSuccess,
+              store->free_page_manager()->AllocPage(&page_ids[i]));
+    Page* page;
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), page_ids[i], PagePool::kIgnorePageData, &page));
+    page->MarkDirty();
+    std::memcpy(page->data(), page_data[i]->data(), usable_page_size);
+    page_pool->UnpinAndWriteStorePage(page);
+  }
+  ASSERT_EQ(Status::kSuccess, store->Close());
+
+  OpenFiles();
+  EXPECT_LT(data_file_size_, (page_ids[1] + 1) << kPageShift);
+
+  // The option is ignored when opening an existing store.
+  store.reset(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+  EXPECT_TRUE(store->header()->compress_pages);
+  EXPECT_EQ(page_ids[1] + 1, store->header()->page_count);
+  for (size_t i = 0; i < 2; ++i) {
+    Page* page;
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), page_ids[i], PagePool::kFetchPageData, &page));
+    EXPECT_EQ(0, std::memcmp(
+        page->data(), page_data[i]->data(), usable_page_size)) << i;
+    page_pool->UnpinStorePage(page);
+  }
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, MappedDataFile) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+  size_t usable_page_size = store->usable_page_size();
+  std::vector<uint8_t> data(usable_page_size);
+  for (size_t i = 0; i < usable_page_size; ++i)
+    data[i] = static_cast<uint8_t>(rnd_());
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, store->free_page_manager()->AllocPage(&page_id));
+  Page* page;
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), page_id, PagePool::kIgnorePageData, &page));
+  page->MarkDirty();
+  std::memcpy(page->data(), data.data(), usable_page_size);
+  page_pool->UnpinAndWriteStorePage(page);
+  ASSERT_EQ(Status::kSuccess, store->Close());
+
+  OpenFiles();
+  StoreOptions options;
+  options.map_data_file = true;
+  store.reset(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, options));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), page_id, PagePool::kFetchPageData, &page));
+#if defined(__unix__) || defined(__APPLE__)
+  EXPECT_TRUE(page->is_mapped());
+#endif  // defined(__unix__) || defined(__APPLE__)
+  EXPECT_EQ(0, std::memcmp(page->data(), data.data(), usable_page_size));
+
+  // Modifying the page copies its data out of the read-only mapping.
+  page->MarkDirty();
+  EXPECT_FALSE(page->is_mapped());
+  EXPECT_EQ(0, std::memcmp(page->data(), data.data(), usable_page_size));
+  page->data()[0] ^= 1;
+  data[0] ^= 1;
+  page_pool->UnpinAndWriteStorePage(page);
+
+  // Pages added after the store was opened are read using regular I/O.
+  size_t new_page_id;
+  ASSERT_EQ(Status::kSuccess,
+            store->free_page_manager()->AllocPage(&new_page_id));
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), new_page_id, PagePool::kIgnorePageData, &page));
+  page->MarkDirty();
+  std::memset(page->data(), 0, usable_page_size);
+  page_pool->UnpinAndWriteStorePage(page);
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), new_page_id, PagePool::kFetchPageData, &page));
+  EXPECT_FALSE(page->is_mapped());
+  page_pool->UnpinStorePage(page);
+
+  // Writes are visible through the mapping.
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), page_id, PagePool::kFetchPageData, &page));
+  page_pool->UnpinAndEvictStorePage(page);
+  ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+      store.get(), page_id, PagePool::kFetchPageData, &page));
+#if defined(__unix__) || defined(__APPLE__)
+  EXPECT_TRUE(page->is_mapped());
+#endif  // defined(__unix__) || defined(__APPLE__)
+  EXPECT_EQ(0, std::memcmp(page->data(), data.data(), usable_page_size));
+  page_pool->UnpinStorePage(page);
+  ASSERT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, MappedPagesReleaseBuffers) {
+  constexpr size_t kPageCount = 8;
+  CreatePool(kStorePageShift, 32);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+  size_t page_ids[kPageCount];
+  for (size_t i = 0; i < kPageCount; ++i) {
+    ASSERT_EQ(Status::kSuccess,
+              store->free_page_manager()->AllocPage(&page_ids[i]));
+    Page* page;
+    ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+        store.get(), page_ids[i], PagePool::kIgnorePageData, &page));
+    page->MarkDirty();
+    std::memset(page->data(), static_cast<int>(i), store->usable_page_size());
+    page_pool->UnpinAndWriteStorePage(page);
+  }
+  ASSERT_EQ(Status::kSuccess, store->Close());
+  store.reset();
+
+  size_t resident_bytes_delta[2];
+  for (bool map_data_file : {false, true}) {
+    OpenFiles();
+    CreatePool(kStorePageShift, 32);
+    page_pool = pool_->page_pool();
+    StoreOptions options;
+    options.map_data_file = map_data_file;
+    store.reset(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, options));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+
+    size_t initial_resident_bytes = page_pool->resident_bytes();
+    size_t initial_buffers = page_pool->allocated_page_buffers();
+    Page* pages[kPageCount];
+    for (size_t i = 0; i < kPageCount; ++i) {
+      ASSERT_EQ(Status::kSuccess, page_pool->StorePage(
+          store.get(), page_ids[i], PagePool::kFetchPageData, &pages[i]));
+      EXPECT_EQ(static_cast<uint8_t>(i), pages[i]->data()[0]);
+    }
+    resident_bytes_delta[map_data_file ? 1 : 0] =
+        page_pool->resident_bytes() - initial_resident_bytes;
+
+#if defined(__unix__) || defined(__APPLE__)
+    if (map_data_file) {
+      EXPECT_EQ(initial_buffers, page_pool->allocated_page_buffers());
+
+      // Modifying a mapped page gives its entry a buffer again.
+      pages[0]->MarkDirty();
+      EXPECT_TRUE(pages[0]->has_buffer());
+      EXPECT_EQ(initial_buffers + 1, page_pool->allocated_page_buffers());
+      EXPECT_EQ(0U, pages[0]->data()[0]);
+      page_pool->UnpinAndWriteStorePage(pages[0]);
+      pages[0] = nullptr;
+    }
+#endif  // defined(__unix__) || defined(__APPLE__)
+    UNUSED(initial_buffers);
+
+    for (size_t i = 0; i < kPageCount; ++i) {
+      if (pages[i] != nullptr)
+        page_pool->UnpinStorePage(pages[i]);
+    }
+    ASSERT_EQ(Status::kSuccess, store->Close());
+    store.reset();
+  }
+
+  EXPECT_EQ(kPageCount * (sizeof(Page) + (1 << kStorePageShift)),
+            resident_bytes_delta[0]);
+#if defined(__unix__) || defined(__APPLE__)
+  EXPECT_EQ(kPageCount * sizeof(Page), resident_bytes_delta[1]);
+#endif  // defined(__unix__) || defined(__APPLE__)
+}
+
 TEST_F(StoreImplTest, CloseUnassignsPages) {
   CreatePool(kStorePageShift, 16);
   PagePool* page_pool = pool_->page_pool();
@@ -167,4 +444,67 @@ TEST_F(StoreImplTest, CloseUnassignsPages) {
   EXPECT_EQ(0U, page_pool->pinned_pages());
 }
 
+TEST_F(StoreImplTest, CleanShutdown) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+  EXPECT_FALSE(store->was_closed_cleanly());
+  EXPECT_FALSE(store->header()->clean_shutdown);
+  uint64_t generation = store->header()->generation;
+  ASSERT_EQ(Status::kSuccess, store->Close());
+  EXPECT_TRUE(store->header()->clean_shutdown);
+
+  OpenFiles();
+  store.reset(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+  EXPECT_TRUE(store->was_closed_cleanly());
+  EXPECT_FALSE(store->header()->clean_shutdown);
+  EXPECT_LT(generation, store->header()->generation);
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, TornHeaderWrite) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Close());
+  uint64_t generation = store->header()->generation;
+
+  // Damage the newest header slot, which records the clean shutdown.
+  OpenFiles();
+  uint8_t buffer[1 << kStorePageShift];
+  ASSERT_EQ(Status::kSuccess, data_file_->Read(0, sizeof(buffer), buffer));
+  buffer[StoreHeader::SlotOffset(generation, kStorePageShift) + 30] ^= 1;
+  ASSERT_EQ(Status::kSuccess, data_file_->Write(buffer, 0, sizeof(buffer)));
+
+  // The store falls back to the previous header, which was written while the
+  // store was open.
+  store.reset(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+  EXPECT_FALSE(store->was_closed_cleanly());
+  EXPECT_EQ(generation, store->header()->generation);
+  ASSERT_EQ(Status::kSuccess, store->Close());
+
+  // Damaging both slots makes the store unusable.
+  OpenFiles();
+  ASSERT_EQ(Status::kSuccess, data_file_->Read(0, sizeof(buffer), buffer));
+  buffer[StoreHeader::SlotOffset(0, kStorePageShift) + 30] ^= 1;
+  buffer[StoreHeader::SlotOffset(1, kStorePageShift) + 30] ^= 1;
+  ASSERT_EQ(Status::kSuccess, data_file_->Write(buffer, 0, sizeof(buffer)));
+  store.reset(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  EXPECT_EQ(Status::kDataCorrupted, store->Initialize(StoreOptions()));
+}
+
 }  // namespace berrydb
@@ -46,6 +46,12 @@ Status BlockAccessFileWrapper::Lock() {
   return file_->Lock();
 }
 
+const uint8_t* BlockAccessFileWrapper::MapForReading(size_t byte_count) {
+  DCHECK(!is_closed_);
+  if (access_error_ != Status::kSuccess)
+    return nullptr;
+  return file_->MapForReading(byte_count);
+}
 
 Status BlockAccessFileWrapper::Close() {
   DCHECK(!is_closed_);
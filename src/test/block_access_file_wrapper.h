@@ -41,6 +41,7 @@ class BlockAccessFileWrapper : public BlockAccessFile {
   Status Write(uint8_t* buffer, size_t offset, size_t byte_count) override;
   Status Sync() override;
   Status Lock() override;
+  const uint8_t* MapForReading(size_t byte_count) override;
   Status Close() override;
 
  private:
@@ -0,0 +1,366 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./crash_vfs.h"
+
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+
+namespace berrydb {
+
+constexpr size_t CrashVfs::kSectorSize;
+constexpr size_t CrashVfs::kNoCrashPoint;
+constexpr size_t CrashVfs::kNoFailurePoint;
+
+/** The data of a file stored by CrashVfs.
+ *
+ * A file outlives its entry in the VFS, if it is deleted while it is open.
+ */
+class CrashFile {
+ public:
+  static CrashFile* Create(CrashVfs* vfs) {
+    void* heap_block = Allocate(sizeof(CrashFile));
+    CrashFile* file = new (heap_block) CrashFile(vfs);
+    DCHECK_EQ(heap_block, static_cast<void*>(file));
+    return file;
+  }
+
+  void Release() {
+    DCHECK_EQ(open_count_, 0U);
+    this->~CrashFile();
+    Deallocate(this, sizeof(CrashFile));
+  }
+
+  inline CrashVfs* vfs() const noexcept { return vfs_; }
+  inline size_t size() const noexcept { return data_.size(); }
+  inline size_t open_count() const noexcept { return open_count_; }
+  inline bool is_deleted() const noexcept { return is_deleted_; }
+  inline bool is_locked() const noexcept { return is_locked_; }
+
+  inline void AddHandle() noexcept { ++open_count_; }
+  inline void RemoveHandle() noexcept {
+    DCHECK(open_count_ != 0);
+    --open_count_;
+  }
+  inline void MarkDeleted() noexcept { is_deleted_ = true; }
+  inline void SetLocked(bool is_locked) noexcept { is_locked_ = is_locked; }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) {
+    if (offset + byte_count > data_.size() || offset + byte_count < offset)
+      return Status::kIoError;
+    std::memcpy(buffer, data_.data() + offset, byte_count);
+    return Status::kSuccess;
+  }
+
+  void Write(const uint8_t* buffer, size_t offset, size_t byte_count) {
+    WriteAt(&data_, buffer, offset, byte_count);
+    pending_writes_.emplace_back();
+    PendingWrite& write = pending_writes_.back();
+    write.offset = offset;
+    write.data.assign(buffer, buffer + byte_count);
+  }
+
+  void Sync() {
+    durable_data_ = data_;
+    pending_writes_.clear();
+  }
+
+  /** Decides which of the writes since the last sync survive a power failure.
+   *
+   * The pending writes are replayed in order on top of the durable data, one
+   * sector at a time. Each sector is dropped with probability 1/2. */
+  void Recover(std::mt19937* rnd) {
+    for (const PendingWrite& write : pending_writes_) {
+      size_t offset = write.offset;
+      const uint8_t* buffer = write.data.data();
+      size_t byte_count = write.data.size();
+      while (byte_count != 0) {
+        // Sectors are aligned to the start of the file, not to the write.
+        size_t chunk_size =
+            CrashVfs::kSectorSize - (offset & (CrashVfs::kSectorSize - 1));
+        if (chunk_size > byte_count)
+          chunk_size = byte_count;
+
+        if (((*rnd)() & 1) != 0)
+          WriteAt(&durable_data_, buffer, offset, chunk_size);
+
+        offset += chunk_size;
+        buffer += chunk_size;
+        byte_count -= chunk_size;
+      }
+    }
+    pending_writes_.clear();
+    data_ = durable_data_;
+  }
+
+ private:
+  /** A write that was not followed by a sync. */
+  struct PendingWrite {
+    size_t offset;
+    std::vector<uint8_t> data;
+  };
+
+  CrashFile(CrashVfs* vfs) : vfs_(vfs) { }
+  ~CrashFile() = default;
+
+  /** Writes to a file's content, zero-filling any gap past its end. */
+  static void WriteAt(std::vector<uint8_t>* data, const uint8_t* buffer,
+                      size_t offset, size_t byte_count) {
+    if (data->size() < offset + byte_count)
+      data->resize(offset + byte_count, 0);
+    std::memcpy(data->data() + offset, buffer, byte_count);
+  }
+
+  CrashVfs* const vfs_;
+  /** The file's content, as observed by reads. */
+  std::vector<uint8_t> data_;
+  /** The file's content when it was last synced. */
+  std::vector<uint8_t> durable_data_;
+  /** The writes issued after the last sync, in order. */
+  std::vector<PendingWrite> pending_writes_;
+  size_t open_count_ = 0;
+  bool is_deleted_ = false;
+  bool is_locked_ = false;
+};
+
+namespace {
+
+/** State shared by the two file handle implementations. */
+class CrashFileHandle {
+ public:
+  CrashFileHandle(CrashFile* file)
+      : file_(file), crash_count_(file->vfs()->crash_count()) { }
+
+  /** False if the power failed after the file was opened. */
+  inline bool IsUsable() const noexcept {
+    return crash_count_ == file_->vfs()->crash_count();
+  }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) {
+    if (!IsUsable())
+      return Status::kIoError;
+    return file_->Read(offset, byte_count, buffer);
+  }
+
+  Status Write(const uint8_t* buffer, size_t offset, size_t byte_count) {
+    if (!IsUsable() || !file_->vfs()->StartOperation())
+      return Status::kIoError;
+    file_->Write(buffer, offset, byte_count);
+    return Status::kSuccess;
+  }
+
+  Status Sync() {
+    if (!IsUsable() || !file_->vfs()->StartOperation())
+      return Status::kIoError;
+    file_->Sync();
+    return Status::kSuccess;
+  }
+
+  Status Lock() {
+    if (!IsUsable())
+      return Status::kIoError;
+    if (holds_lock_)
+      return Status::kSuccess;
+    if (file_->is_locked())
+      return Status::kAlreadyLocked;
+    file_->SetLocked(true);
+    holds_lock_ = true;
+    return Status::kSuccess;
+  }
+
+  void Close() {
+    if (holds_lock_)
+      file_->SetLocked(false);
+    file_->vfs()->FileClosed(file_);
+  }
+
+ private:
+  CrashFile* const file_;
+  const size_t crash_count_;
+  bool holds_lock_ = false;
+};
+
+class CrashBlockAccessFile : public BlockAccessFile {
+ public:
+  CrashBlockAccessFile(CrashFile* file) : handle_(file) { }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) override {
+    return handle_.Read(offset, byte_count, buffer);
+  }
+
+  Status Write(uint8_t* buffer, size_t offset, size_t byte_count) override {
+    return handle_.Write(buffer, offset, byte_count);
+  }
+
+  Status Sync() override { return handle_.Sync(); }
+  Status Lock() override { return handle_.Lock(); }
+
+  Status Close() override {
+    handle_.Close();
+    void* heap_block = reinterpret_cast<void*>(this);
+    this->~CrashBlockAccessFile();
+    Deallocate(heap_block, sizeof(CrashBlockAccessFile));
+    return Status::kSuccess;
+  }
+
+ protected:
+  ~CrashBlockAccessFile() = default;
+
+ private:
+  CrashFileHandle handle_;
+};
+
+class CrashRandomAccessFile : public RandomAccessFile {
+ public:
+  CrashRandomAccessFile(CrashFile* file) : handle_(file) { }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) override {
+    return handle_.Read(offset, byte_count, buffer);
+  }
+
+  Status Write(
+      const uint8_t* buffer, size_t offset, size_t byte_count) override {
+    return handle_.Write(buffer, offset, byte_count);
+  }
+
+  Status Flush() override {
+    // Writes are not buffered.
+    return handle_.IsUsable() ? Status::kSuccess : Status::kIoError;
+  }
+
+  Status Sync() override { return handle_.Sync(); }
+
+  Status Close() override {
+    handle_.Close();
+    void* heap_block = reinterpret_cast<void*>(this);
+    this->~CrashRandomAccessFile();
+    Deallocate(heap_block, sizeof(CrashRandomAccessFile));
+    return Status::kSuccess;
+  }
+
+ protected:
+  ~CrashRandomAccessFile() = default;
+
+ private:
+  CrashFileHandle handle_;
+};
+
+}  // anonymous namespace
+
+CrashVfs::CrashVfs() = default;
+
+CrashVfs::~CrashVfs() {
+  for (const auto& it : files_) {
+    CrashFile* file = it.second;
+    DCHECK_EQ(file->open_count(), 0U);
+    file->Release();
+  }
+}
+
+Status CrashVfs::OpenForRandomAccess(
+    const std::string& file_path, bool create_if_missing, bool error_if_exists,
+    RandomAccessFile** result, size_t* file_size) {
+  CrashFile* file = OpenFile(file_path, create_if_missing, error_if_exists);
+  if (file == nullptr)
+    return Status::kIoError;
+
+  void* heap_block = Allocate(sizeof(CrashRandomAccessFile));
+  CrashRandomAccessFile* random_file =
+      new (heap_block) CrashRandomAccessFile(file);
+  DCHECK_EQ(heap_block, static_cast<void*>(random_file));
+  *result = random_file;
+  *file_size = file->size();
+  return Status::kSuccess;
+}
+
+Status CrashVfs::OpenForBlockAccess(
+    const std::string& file_path, size_t block_shift, bool create_if_missing,
+    bool error_if_exists, BlockAccessFile** result, size_t* file_size) {
+  UNUSED(block_shift);
+  CrashFile* file = OpenFile(file_path, create_if_missing, error_if_exists);
+  if (file == nullptr)
+    return Status::kIoError;
+
+  void* heap_block = Allocate(sizeof(CrashBlockAccessFile));
+  CrashBlockAccessFile* block_file =
+      new (heap_block) CrashBlockAccessFile(file);
+  DCHECK_EQ(heap_block, static_cast<void*>(block_file));
+  *result = block_file;
+  *file_size = file->size();
+  return Status::kSuccess;
+}
+
+Status CrashVfs::DeleteFile(const std::string& file_path) {
+  const auto& it = files_.find(file_path);
+  if (it == files_.end())
+    return Status::kNotFound;
+
+  CrashFile* file = it->second;
+  files_.erase(it);
+  if (file->open_count() == 0)
+    file->Release();
+  else
+    file->MarkDeleted();
+  return Status::kSuccess;
+}
+
+void CrashVfs::SetCrashPoint(size_t operation_count) {
+  DCHECK(!has_crashed_);
+  crash_point_ = operation_count;
+}
+
+void CrashVfs::Recover(std::mt19937* rnd) {
+  DCHECK(has_crashed_);
+  for (const auto& it : files_)
+    it.second->Recover(rnd);
+  has_crashed_ = false;
+  crash_point_ = kNoCrashPoint;
+}
+
+bool CrashVfs::StartOperation() {
+  if (has_crashed_)
+    return false;
+  if (operation_count_ == crash_point_) {
+    has_crashed_ = true;
+    ++crash_count_;
+    return false;
+  }
+  size_t operation = operation_count_++;
+  return operation != failure_point_;
+}
+
+void CrashVfs::FileClosed(CrashFile* file) {
+  file->RemoveHandle();
+  if (file->is_deleted() && file->open_count() == 0)
+    file->Release();
+}
+
+CrashFile* CrashVfs::OpenFile(
+    const std::string& file_path, bool create_if_missing,
+    bool error_if_exists) {
+  // No I/O is possible while the power is out.
+  if (has_crashed_)
+    return nullptr;
+
+  CrashFile* file;
+  const auto& it = files_.find(file_path);
+  if (it == files_.end()) {
+    if (!create_if_missing)
+      return nullptr;
+    file = CrashFile::Create(this);
+    files_[file_path] = file;
+  } else {
+    if (error_if_exists)
+      return nullptr;
+    file = it->second;
+  }
+  file->AddHandle();
+  return file;
+}
+
+}  // namespace berrydb
@@ -0,0 +1,135 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_TEST_CRASH_VFS_H_
+#define BERRYDB_TEST_CRASH_VFS_H_
+
+#include <cstddef>
+#include <map>
+#include <random>
+#include <string>
+
+#include "berrydb/vfs.h"
+
+namespace berrydb {
+
+class CrashFile;
+
+/** In-memory Vfs that simulates power failures, for durability tests.
+ *
+ * The VFS records every write and sync. Writes that were not followed by a
+ * sync of their file are kept in a list of pending writes, on top of the data
+ * that is known to be durable.
+ *
+ * A power failure happens when the number of writes and syncs issued to the
+ * VFS reaches the crash point set by SetCrashPoint(). The operation that would
+ * have exceeded the crash point, and all the following I/O calls on open files,
+ * fail with kIoError. Afterwards, Recover() decides which pending writes made
+ * it to the storage medium. Each sector of each pending write is kept or
+ * dropped at random. This models lost writes, pages torn at sector boundaries,
+ * and unsynced writes that reached the medium out of order.
+ *
+ * A single write or sync can also fail without a power failure, as set by
+ * SetFailurePoint(). The failed operation has no effect, and the following
+ * operations succeed. This models transient I/O errors.
+ *
+ * The VFS is intended for tests, and favors simplicity over efficiency.
+ */
+class CrashVfs : public Vfs {
+ public:
+  /** The granularity at which writes can be torn. */
+  static constexpr size_t kSectorSize = 512;
+
+  /** Value of crash_point() when no crash is scheduled. */
+  static constexpr size_t kNoCrashPoint = ~static_cast<size_t>(0);
+
+  /** Value of failure_point() when no failure is scheduled. */
+  static constexpr size_t kNoFailurePoint = ~static_cast<size_t>(0);
+
+  CrashVfs();
+  ~CrashVfs();
+
+  // Vfs API.
+  Status OpenForRandomAccess(
+      const std::string& file_path, bool create_if_missing,
+      bool error_if_exists, RandomAccessFile** result,
+      size_t* file_size) override;
+  Status OpenForBlockAccess(
+      const std::string& file_path, size_t block_shift,
+      bool create_if_missing, bool error_if_exists,
+      BlockAccessFile** result, size_t* file_size) override;
+  Status DeleteFile(const std::string& file_path) override;
+
+  /** Number of writes and syncs issued so far. */
+  inline size_t operation_count() const noexcept { return operation_count_; }
+
+  /** The operation count at which the simulated power failure happens. */
+  inline size_t crash_point() const noexcept { return crash_point_; }
+
+  /** True if the simulated power failure happened. */
+  inline bool has_crashed() const noexcept { return has_crashed_; }
+
+  /** Schedules a power failure.
+   *
+   * @param operation_count the power fails right before the write or sync that
+   *                        would bring operation_count() past this value;
+   *                        kNoCrashPoint disables the power failure */
+  void SetCrashPoint(size_t operation_count);
+
+  /** The operation count of the write or sync that fails on its own. */
+  inline size_t failure_point() const noexcept { return failure_point_; }
+
+  /** Schedules a transient I/O error.
+   *
+   * @param operation_count the write or sync issued when operation_count()
+   *                        equals this value fails with kIoError;
+   *                        kNoFailurePoint disables the error */
+  inline void SetFailurePoint(size_t operation_count) noexcept {
+    failure_point_ = operation_count;
+  }
+
+  /** Brings the VFS back after a power failure.
+   *
+   * Every sector of every pending write is independently kept or dropped. The
+   * files that were open during the power failure remain unusable, but they can
+   * be closed. Files opened after this call observe the surviving data.
+   *
+   * @param rnd the source of randomness for picking the surviving sectors
+   */
+  void Recover(std::mt19937* rnd);
+
+  /** Number of simulated power failures so far.
+   *
+   * This is intended for use by the VFS's files. */
+  inline size_t crash_count() const noexcept { return crash_count_; }
+
+  /** Accounts for a write or a sync, and crashes if the crash point is reached.
+   *
+   * This is intended for use by the VFS's files.
+   *
+   * @return false if the operation must fail, because the power failed before
+   *         it could start, or because it was chosen by SetFailurePoint() */
+  bool StartOperation();
+
+  /** Called when a file opened via this VFS is closed. */
+  void FileClosed(CrashFile* file);
+
+ private:
+  /** Finds, or creates, the file at the given path.
+   *
+   * @return a file with an open handle reserved for the caller, or nullptr */
+  CrashFile* OpenFile(const std::string& file_path, bool create_if_missing,
+                      bool error_if_exists);
+
+  std::map<std::string, CrashFile*> files_;
+  size_t operation_count_ = 0;
+  size_t crash_point_ = kNoCrashPoint;
+  size_t failure_point_ = kNoFailurePoint;
+  size_t crash_count_ = 0;
+  bool has_crashed_ = false;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_TEST_CRASH_VFS_H_
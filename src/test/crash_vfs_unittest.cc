@@ -0,0 +1,390 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./crash_vfs.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/status.h"
+#include "../page_pool.h"
+#include "../pool_impl.h"
+#include "../store_impl.h"
+#include "../transaction_impl.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+class CrashVfsTest : public ::testing::Test {
+ protected:
+  std::vector<uint8_t> RandomData(size_t byte_count) {
+    std::vector<uint8_t> data;
+    data.reserve(byte_count);
+    for (size_t i = 0; i < byte_count; ++i)
+      data.push_back(static_cast<uint8_t>(rnd_()));
+    return data;
+  }
+
+  /** Runs a store through shadow-paging commits until the power fails.
+   *
+   * Commit i fills the usable part of a copy of the root page with i + 1, and
+   * makes the copy the new root page.
+   *
+   * @param last_committed receives the number of the last commit that reported
+   *                       success, or 0 if none did
+   * @param last_attempted receives the number of the last commit started */
+  void RunCommits(size_t commit_count, size_t* last_committed,
+                  size_t* last_attempted) {
+    UniquePtr<PoolImpl> pool(PoolImpl::Create(PoolOptionsForVfs()));
+    *last_committed = 0;
+    *last_attempted = 0;
+
+    StoreImpl* raw_store;
+    if (pool->OpenStore(kFileName, StoreOptions(), &raw_store) !=
+        Status::kSuccess) {
+      return;
+    }
+    UniquePtr<StoreImpl> store(raw_store);
+    for (size_t i = 1; i <= commit_count; ++i) {
+      *last_attempted = i;
+      if (Commit(store.get(), static_cast<uint8_t>(i)) != Status::kSuccess)
+        break;
+      *last_committed = i;
+    }
+    store->Close();
+  }
+
+  /** Replaces the store's root page with a page filled with a value. */
+  Status Commit(StoreImpl* store, uint8_t value) {
+    PagePool* page_pool = store->page_pool();
+    TransactionImpl* raw_transaction;
+    Status status = store->CreateTransaction(&raw_transaction);
+    if (status != Status::kSuccess)
+      return status;
+    UniquePtr<TransactionImpl> transaction(raw_transaction);
+    Page* root_page;
+    status = page_pool->StorePage(
+        store, transaction->root_page(), PagePool::kFetchPageData, &root_page);
+    if (status != Status::kSuccess)
+      return status;
+
+    Page* shadow_page;
+    status = transaction->CopyOnWrite(root_page, &shadow_page);
+    page_pool->UnpinStorePage(root_page);
+    if (status != Status::kSuccess) {
+      transaction->Rollback();
+      return status;
+    }
+    std::memset(shadow_page->data(), value, store->usable_page_size());
+    transaction->SetRootPage(shadow_page->page_id());
+    page_pool->UnpinStorePage(shadow_page);
+    return transaction->Commit();
+  }
+
+  /** Checks that a recovered store's root page was written by a commit.
+   *
+   * @param min_value the value written by the last acknowledged commit
+   * @param max_value the value written by the last attempted commit */
+  void CheckRecoveredStore(uint8_t min_value, uint8_t max_value) {
+    UniquePtr<PoolImpl> pool(PoolImpl::Create(PoolOptionsForVfs()));
+    StoreImpl* raw_store;
+    ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+        kFileName, StoreOptions(), &raw_store));
+    UniquePtr<StoreImpl> store(raw_store);
+
+    Page* root_page;
+    ASSERT_EQ(Status::kSuccess, pool->page_pool()->StorePage(
+        store.get(), store->header()->root_page, PagePool::kFetchPageData,
+        &root_page));
+    uint8_t value = root_page->data()[0];
+    bool is_uniform = true;
+    for (size_t i = 0; i < store->usable_page_size(); ++i)
+      is_uniform &= (root_page->data()[i] == value);
+    pool->page_pool()->UnpinStorePage(root_page);
+    EXPECT_TRUE(is_uniform);
+    EXPECT_LE(min_value, value);
+    EXPECT_LE(value, max_value);
+
+    // The recovered store remains usable.
+    EXPECT_EQ(Status::kSuccess, Commit(store.get(), 0xFF));
+    EXPECT_EQ(Status::kSuccess, store->Close());
+  }
+
+  /** Fails one I/O operation at the end of a shadow-paging commit.
+   *
+   * The commit's last two operations write and sync the header page. The store
+   * is checked after the failure, and again after it is reopened.
+   *
+   * @param operations_from_end 0 fails the commit's last operation, 1 fails
+   *                            the operation before it
+   * @param crash_after_failure if true, the power fails right after the failed
+   *                            operation, before the store handles the error */
+  void CheckFailedCommit(size_t operations_from_end, bool crash_after_failure) {
+    // Measure a successful commit. The failing run performs the same I/O.
+    size_t commit_operations, shadow_page_id, old_root_page_id;
+    {
+      UniquePtr<PoolImpl> pool(PoolImpl::Create(PoolOptionsForVfs()));
+      StoreImpl* raw_store;
+      ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+          kFileName, StoreOptions(), &raw_store));
+      UniquePtr<StoreImpl> store(raw_store);
+      old_root_page_id = store->header()->root_page;
+      size_t start_operation = vfs_.operation_count();
+      ASSERT_EQ(Status::kSuccess, Commit(store.get(), 1));
+      commit_operations = vfs_.operation_count() - start_operation;
+      shadow_page_id = store->header()->root_page;
+      ASSERT_EQ(Status::kSuccess, store->Close());
+    }
+    ASSERT_EQ(Status::kSuccess, vfs_.DeleteFile(kFileName));
+    vfs_.DeleteFile(StoreImpl::LogFilePath(kFileName));
+
+    {
+      UniquePtr<PoolImpl> pool(PoolImpl::Create(PoolOptionsForVfs()));
+      StoreImpl* raw_store;
+      ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+          kFileName, StoreOptions(), &raw_store));
+      UniquePtr<StoreImpl> store(raw_store);
+      size_t failure_point =
+          vfs_.operation_count() + commit_operations - 1 - operations_from_end;
+      vfs_.SetFailurePoint(failure_point);
+      if (crash_after_failure)
+        vfs_.SetCrashPoint(failure_point + 1);
+      EXPECT_EQ(Status::kIoError, Commit(store.get(), 1));
+      vfs_.SetFailurePoint(CrashVfs::kNoFailurePoint);
+
+      if (crash_after_failure) {
+        EXPECT_TRUE(store->IsClosed());
+        store->Close();
+        store.reset();
+        vfs_.Recover(&rnd_);
+
+        // Either header may have survived. Both point to intact root pages.
+        CheckRecoveredStore(0, 1);
+        return;
+      }
+
+      // The store reverted to the old root page, and did not reuse the shadow
+      // page that the failed header pointed to.
+      ASSERT_FALSE(store->IsClosed());
+      EXPECT_EQ(old_root_page_id, store->header()->root_page);
+      ASSERT_EQ(Status::kSuccess, Commit(store.get(), 2));
+      EXPECT_NE(shadow_page_id, store->header()->root_page);
+      ASSERT_EQ(Status::kSuccess, store->Close());
+    }
+
+    // The reopened store uses the root page of the successful commit.
+    CheckRecoveredStore(2, 2);
+  }
+
+  PoolOptions PoolOptionsForVfs() {
+    PoolOptions options;
+    options.page_shift = 12;
+    options.page_pool_size = 16;
+    options.vfs = &vfs_;
+    return options;
+  }
+
+  const std::string kFileName = "test_crash_vfs.berry";
+  constexpr static size_t kSectorSize = CrashVfs::kSectorSize;
+
+  CrashVfs vfs_;
+  std::mt19937 rnd_;
+};
+
+constexpr size_t CrashVfsTest::kSectorSize;
+
+TEST_F(CrashVfsTest, SyncedWritesSurvive) {
+  BlockAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_.OpenForBlockAccess(
+      kFileName, 12, true, false, &file, &file_size));
+  std::vector<uint8_t> data = RandomData(4 * kSectorSize);
+  ASSERT_EQ(Status::kSuccess, file->Write(data.data(), 0, data.size()));
+  ASSERT_EQ(Status::kSuccess, file->Sync());
+  EXPECT_EQ(2U, vfs_.operation_count());
+
+  vfs_.SetCrashPoint(vfs_.operation_count());
+  std::vector<uint8_t> buffer(data.size());
+  ASSERT_EQ(Status::kSuccess, file->Read(0, buffer.size(), buffer.data()));
+  EXPECT_EQ(Status::kIoError, file->Write(buffer.data(), 0, buffer.size()));
+  EXPECT_TRUE(vfs_.has_crashed());
+  EXPECT_EQ(2U, vfs_.operation_count());
+
+  // Files that were open during the power failure cannot be used.
+  EXPECT_EQ(Status::kIoError, file->Read(0, buffer.size(), buffer.data()));
+  EXPECT_EQ(Status::kIoError, file->Sync());
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  // No files can be opened until the VFS recovers.
+  EXPECT_NE(Status::kSuccess, vfs_.OpenForBlockAccess(
+      kFileName, 12, false, false, &file, &file_size));
+
+  vfs_.Recover(&rnd_);
+  EXPECT_FALSE(vfs_.has_crashed());
+  ASSERT_EQ(Status::kSuccess, vfs_.OpenForBlockAccess(
+      kFileName, 12, false, false, &file, &file_size));
+  EXPECT_EQ(data.size(), file_size);
+  ASSERT_EQ(Status::kSuccess, file->Read(0, buffer.size(), buffer.data()));
+  EXPECT_EQ(data, buffer);
+  EXPECT_EQ(Status::kSuccess, file->Close());
+}
+
+TEST_F(CrashVfsTest, UnsyncedWritesTearAtSectors) {
+  RandomAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_.OpenForRandomAccess(
+      kFileName, true, false, &file, &file_size));
+  std::vector<uint8_t> old_data = RandomData(64 * kSectorSize);
+  ASSERT_EQ(Status::kSuccess, file->Write(old_data.data(), 0, old_data.size()));
+  ASSERT_EQ(Status::kSuccess, file->Sync());
+
+  // The unsynced write is not sector-aligned.
+  constexpr size_t kOffset = kSectorSize / 2;
+  std::vector<uint8_t> new_data = RandomData(62 * kSectorSize);
+  ASSERT_EQ(Status::kSuccess, file->Write(new_data.data(), kOffset,
+                                          new_data.size()));
+  vfs_.SetCrashPoint(vfs_.operation_count());
+  EXPECT_EQ(Status::kIoError, file->Sync());
+  EXPECT_EQ(Status::kSuccess, file->Close());
+  vfs_.Recover(&rnd_);
+
+  ASSERT_EQ(Status::kSuccess, vfs_.OpenForRandomAccess(
+      kFileName, false, false, &file, &file_size));
+  ASSERT_EQ(old_data.size(), file_size);
+  std::vector<uint8_t> buffer(file_size);
+  ASSERT_EQ(Status::kSuccess, file->Read(0, buffer.size(), buffer.data()));
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  // Each sector holds either the old data or the new data, and both outcomes
+  // occur with 62 sectors in play.
+  size_t new_sector_count = 0, old_sector_count = 0;
+  for (size_t sector = 0; sector < 64; ++sector) {
+    size_t start = sector * kSectorSize, end = start + kSectorSize;
+    if (start < kOffset)
+      start = kOffset;
+    if (end > kOffset + new_data.size())
+      end = kOffset + new_data.size();
+    if (start >= end)
+      continue;
+
+    size_t size = end - start;
+    if (std::memcmp(buffer.data() + start,
+                    new_data.data() + start - kOffset, size) == 0) {
+      ++new_sector_count;
+    } else {
+      EXPECT_EQ(0, std::memcmp(buffer.data() + start, old_data.data() + start,
+                               size)) << sector;
+      ++old_sector_count;
+    }
+  }
+  EXPECT_EQ(63U, new_sector_count + old_sector_count);
+  EXPECT_LT(0U, new_sector_count);
+  EXPECT_LT(0U, old_sector_count);
+}
+
+TEST_F(CrashVfsTest, UnsyncedAppendsMayLeaveHoles) {
+  RandomAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_.OpenForRandomAccess(
+      kFileName, true, false, &file, &file_size));
+  std::vector<uint8_t> data = RandomData(32 * kSectorSize);
+  ASSERT_EQ(Status::kSuccess, file->Write(data.data(), 0, data.size()));
+  vfs_.SetCrashPoint(vfs_.operation_count());
+  EXPECT_EQ(Status::kIoError, file->Sync());
+  EXPECT_EQ(Status::kSuccess, file->Close());
+  vfs_.Recover(&rnd_);
+
+  ASSERT_EQ(Status::kSuccess, vfs_.OpenForRandomAccess(
+      kFileName, false, false, &file, &file_size));
+  EXPECT_GE(data.size(), file_size);
+  std::vector<uint8_t> buffer(file_size);
+  ASSERT_EQ(Status::kSuccess, file->Read(0, buffer.size(), buffer.data()));
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  // Sectors that did not make it read as zeros.
+  const std::vector<uint8_t> zeros(kSectorSize, 0);
+  for (size_t offset = 0; offset < file_size; offset += kSectorSize) {
+    EXPECT_TRUE(
+        std::memcmp(buffer.data() + offset, data.data() + offset,
+                    kSectorSize) == 0 ||
+        std::memcmp(buffer.data() + offset, zeros.data(), kSectorSize) == 0)
+        << offset;
+  }
+}
+
+TEST_F(CrashVfsTest, StoreCrashRecovery) {
+  constexpr size_t kCommitCount = 12;
+  constexpr size_t kSeedCount = 16;
+
+  // Measure the number of I/O operations in a crash-free run.
+  {
+    UniquePtr<PoolImpl> pool(PoolImpl::Create(PoolOptionsForVfs()));
+    StoreImpl* store;
+    ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+        kFileName, StoreOptions(), &store));
+    ASSERT_EQ(Status::kSuccess, store->Close());
+    store->Release();
+  }
+  size_t start_operation = vfs_.operation_count();
+  size_t last_committed, last_attempted;
+  RunCommits(kCommitCount, &last_committed, &last_attempted);
+  ASSERT_EQ(kCommitCount, last_committed);
+  size_t operation_count = vfs_.operation_count() - start_operation;
+  ASSERT_EQ(Status::kSuccess, vfs_.DeleteFile(kFileName));
+  vfs_.DeleteFile(StoreImpl::LogFilePath(kFileName));
+
+  // Crash at every I/O operation of the run, with different sets of surviving
+  // unsynced writes.
+  size_t crash_count = 0;
+  for (size_t seed = 0; seed < kSeedCount; ++seed) {
+    rnd_.seed(static_cast<std::mt19937::result_type>(seed));
+    for (size_t crash_point = 0; crash_point < operation_count;
+         ++crash_point) {
+      SCOPED_TRACE(::testing::Message() << "seed " << seed << " crash point "
+                                        << crash_point);
+      {
+        UniquePtr<PoolImpl> pool(PoolImpl::Create(PoolOptionsForVfs()));
+        StoreImpl* store;
+        ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+            kFileName, StoreOptions(), &store));
+        ASSERT_EQ(Status::kSuccess, store->Close());
+        store->Release();
+      }
+
+      vfs_.SetCrashPoint(vfs_.operation_count() + crash_point);
+      RunCommits(kCommitCount, &last_committed, &last_attempted);
+      ASSERT_TRUE(vfs_.has_crashed());
+      vfs_.Recover(&rnd_);
+      ++crash_count;
+
+      CheckRecoveredStore(static_cast<uint8_t>(last_committed),
+                          static_cast<uint8_t>(last_attempted));
+      if (HasFatalFailure() || HasNonfatalFailure())
+        return;
+
+      ASSERT_EQ(Status::kSuccess, vfs_.DeleteFile(kFileName));
+      vfs_.DeleteFile(StoreImpl::LogFilePath(kFileName));
+    }
+  }
+  EXPECT_LE(1000U, crash_count);
+}
+
+TEST_F(CrashVfsTest, FailedHeaderWrite) {
+  CheckFailedCommit(1, false);
+}
+
+TEST_F(CrashVfsTest, FailedHeaderSync) {
+  CheckFailedCommit(0, false);
+}
+
+TEST_F(CrashVfsTest, FailedHeaderSyncThenCrash) {
+  CheckFailedCommit(0, true);
+}
+
+}  // namespace berrydb
@@ -4,7 +4,11 @@
 
 #include "./transaction_impl.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "berrydb/status.h"
+#include "./free_page_manager.h"
 #include "./page_pool.h"
 #include "./store_impl.h"
 
@@ -14,21 +18,103 @@ static_assert(std::is_standard_layout<TransactionImpl>::value,
     "TransactionImpl must be a standard layout type so its public API can be "
     "exposed cheaply");
 
+constexpr size_t TransactionImpl::kCachedTransactionCount;
+
+namespace {
+
+/** Closed transactions kept around for reuse by TransactionImpl::Create().
+ *
+ * The linked list nodes that connect open transactions to their store are
+ * not used by closed transactions, so they link the cached transactions.
+ */
+class TransactionCache {
+ public:
+  TransactionCache() = default;
+
+  ~TransactionCache() {
+    while (!transactions_.empty()) {
+      TransactionImpl* transaction = transactions_.front();
+      transactions_.pop_front();
+      transaction->~TransactionImpl();
+      Deallocate(transaction, sizeof(TransactionImpl));
+    }
+  }
+
+  /** Removes a cached transaction. Returns nullptr if the cache is empty. */
+  inline TransactionImpl* Pop() noexcept {
+    if (transactions_.empty())
+      return nullptr;
+    TransactionImpl* transaction = transactions_.front();
+    transactions_.pop_front();
+    return transaction;
+  }
+
+  /** Caches a closed transaction. Returns false if the cache is full. */
+  inline bool Push(TransactionImpl* transaction) noexcept {
+    DCHECK(transaction->IsClosed());
+    if (transactions_.size() >= TransactionImpl::kCachedTransactionCount)
+      return false;
+    transactions_.push_front(transaction);
+    return true;
+  }
+
+ private:
+  LinkedList<TransactionImpl> transactions_;
+};
+
+/** Each thread has its own cache, so the cache does not need locking. */
+thread_local TransactionCache transaction_cache;
+
+}  // anonymous namespace
+
 TransactionImpl* TransactionImpl::Create(StoreImpl* store) {
+  TransactionImpl* transaction = transaction_cache.Pop();
+  if (transaction != nullptr) {
+    transaction->Reuse(store);
+    return transaction;
+  }
+
   void* heap_block = Allocate(sizeof(TransactionImpl));
-  TransactionImpl* transaction = new (heap_block) TransactionImpl(store);
+  transaction = new (heap_block) TransactionImpl(store);
   DCHECK_EQ(heap_block, static_cast<void*>(transaction));
   return transaction;
 }
 
 void TransactionImpl::Release() {
+  if (!is_closed_)
+    Rollback();
+  if (transaction_cache.Push(this))
+    return;
+
   this->~TransactionImpl();
   void* heap_block = static_cast<void*>(this);
   Deallocate(heap_block, sizeof(TransactionImpl));
 }
 
+void TransactionImpl::Reuse(StoreImpl* store) {
+  DCHECK(store != nullptr);
+  DCHECK(is_closed_);
+  DCHECK(pool_pages_.empty());
+  DCHECK(page_versions_.empty());
+  DCHECK(shadow_pages_.empty());
+#if DCHECK_IS_ON()
+  DCHECK(!is_init_);
+#endif  // DCHECK_IS_ON()
+
+  store_ = store;
+  read_timestamp_ = store->last_commit_timestamp();
+  root_page_ = store->header()->root_page;
+  new_root_page_ = 0;
+  // clear() keeps the vector's memory around for the next transaction.
+  replaced_pages_.clear();
+  is_closed_ = false;
+  is_committed_ = false;
+  is_detached_.store(false, std::memory_order_relaxed);
+}
+
 TransactionImpl::TransactionImpl(StoreImpl* store)
-    : store_(store)
+    : store_(store), read_timestamp_(store->last_commit_timestamp()),
+      root_page_(store->header()->root_page)
 #if DCHECK_IS_ON()
     , is_init_(false)
 #endif  // DCHECK_IS_ON()
@@ -37,7 +123,7 @@ TransactionImpl::TransactionImpl(StoreImpl* store)
 }
 
 TransactionImpl::TransactionImpl(StoreImpl* store, bool is_init)
-    : store_(store)
+    : store_(store), read_timestamp_(0), root_page_(0)
 #if DCHECK_IS_ON()
     , is_init_(true)
 #endif  // DCHECK_IS_ON()
@@ -60,6 +146,169 @@ void TransactionImpl::DcheckPageBelongsToTransaction(Page* page) {
 }
 #endif  // DCHECK_IS_ON()
 
+Status TransactionImpl::SaveBeforeImage(Page* page) {
+  DCHECK(page != nullptr);
+  DCHECK(!page->IsUnpinned());
+  DCHECK(!is_closed_);
+#if DCHECK_IS_ON()
+  DCHECK(!is_init_);
+  DcheckPageBelongsToTransaction(page);
+#endif  // DCHECK_IS_ON()
+
+  PageVersion* newest_version = page->newest_version();
+  if (newest_version != nullptr) {
+    if (newest_version->transaction() == this)
+      return Status::kSuccess;
+
+    // Two concurrent transactions cannot modify the same page. The page's
+    // current data must also be in this transaction's snapshot, otherwise the
+    // change committed after the snapshot was taken would be overwritten.
+    if (newest_version->transaction() != nullptr ||
+        newest_version->superseded_at() > read_timestamp_) {
+      return Status::kConflict;
+    }
+  } else {
+    // The version chain holds a pin, so the page stays in the pool while
+    // transactions may need its before-images.
+    store_->page_pool()->PinStorePage(page);
+  }
+
+  PageVersion* version = PageVersion::Create(
+      page, this, store_->page_pool()->page_size());
+  version->LinkBefore(newest_version);
+  page->set_newest_version(version);
+  page_versions_.push_back(version);
+  return Status::kSuccess;
+}
+
+const uint8_t* TransactionImpl::SnapshotData(Page* page) noexcept {
+  DCHECK(page != nullptr);
+  DCHECK(!page->IsUnpinned());
+
+  const uint8_t* data = page->data();
+  PageVersion* version = page->newest_version();
+  if (version != nullptr && version->transaction() == this)
+    return data;
+
+  // Each version holds the data that was replaced at its superseded_at()
+  // timestamp, so the snapshot's data is in the oldest version that was
+  // replaced after the snapshot was taken.
+  while (version != nullptr && version->superseded_at() > read_timestamp_) {
+    data = version->data();
+    version = version->older();
+  }
+  return data;
+}
+
+void TransactionImpl::RestoreBeforeImages() {
+  PagePool* page_pool = store_->page_pool();
+  size_t page_size = page_pool->page_size();
+  while (!page_versions_.empty()) {
+    PageVersion* version = page_versions_.front();
+    page_versions_.pop_front();
+
+    Page* page = version->page();
+    DCHECK_EQ(version, page->newest_version());
+    // The page may have been written back since it was modified, so it must
+    // be dirty again for the restored content to reach the data file.
+    page->MarkDirty();
+    std::memcpy(page->data(), version->data(), page_size);
+    page->set_newest_version(version->older());
+    version->Unlink();
+    version->Release(page_size);
+    if (page->newest_version() == nullptr)
+      page_pool->UnpinStorePage(page);
+  }
+}
+
+void TransactionImpl::SetRootPage(size_t page_id) noexcept {
+  DCHECK(!is_closed_);
+  DCHECK(store_->IsDataPage(page_id));
+#if DCHECK_IS_ON()
+  DCHECK(!is_init_);
+#endif  // DCHECK_IS_ON()
+
+  new_root_page_ = page_id;
+}
+
+Status TransactionImpl::CopyOnWrite(Page* page, Page** result) {
+  DCHECK(page != nullptr);
+  DCHECK(!page->IsUnpinned());
+  DCHECK(result != nullptr);
+  DCHECK(!is_closed_);
+#if DCHECK_IS_ON()
+  DCHECK(!is_init_);
+  DcheckPageBelongsToTransaction(page);
+#endif  // DCHECK_IS_ON()
+
+  PagePool* page_pool = store_->page_pool();
+  size_t page_id = page->page_id();
+  if (std::find(shadow_pages_.begin(), shadow_pages_.end(), page_id) !=
+      shadow_pages_.end()) {
+    page_pool->PinStorePage(page);
+    *result = page;
+    return Status::kSuccess;
+  }
+
+  size_t shadow_page_id;
+  Status status = store_->free_page_manager()->AllocPage(&shadow_page_id);
+  if (status != Status::kSuccess)
+    return status;
+
+  Page* shadow_page;
+  status = page_pool->StorePage(
+      store_, shadow_page_id, PagePool::kIgnorePageData, &shadow_page);
+  if (status != Status::kSuccess) {
+    store_->free_page_manager()->FreePage(shadow_page_id);
+    return status;
+  }
+
+  // Other transactions may have modified the page in place since this
+  // transaction's snapshot was taken.
+  shadow_page->MarkDirty();
+  std::memcpy(shadow_page->data(), SnapshotData(page), page_pool->page_size());
+  shadow_pages_.push_back(shadow_page_id);
+  replaced_pages_.push_back(page_id);
+  *result = shadow_page;
+  return Status::kSuccess;
+}
+
+Status TransactionImpl::ReleaseShadowPages() {
+  // The shadow pages are not reachable from the committed root page, so they
+  // can be reused right away. A page that cannot be freed is leaked, which is
+  // safe, so the other pages are still freed.
+  FreePageManager* free_page_manager = store_->free_page_manager();
+  Status status = Status::kSuccess;
+  for (size_t page_id : shadow_pages_) {
+    Status free_status = free_page_manager->FreePage(page_id);
+    if (status == Status::kSuccess)
+      status = free_status;
+  }
+  shadow_pages_.clear();
+  replaced_pages_.clear();
+  new_root_page_ = 0;
+  return status;
+}
+
+Status TransactionImpl::WriteDirtyPages() {
+  std::vector<Page*, PlatformAllocator<Page*>> dirty_pages;
+  for (Page* page : pool_pages_) {
+    if (page->is_dirty())
+      dirty_pages.push_back(page);
+  }
+  std::sort(dirty_pages.begin(), dirty_pages.end(),
+      [](const Page* page1, const Page* page2) {
+        return page1->page_id() < page2->page_id();
+      });
+
+  Status status = store_->WritePages(dirty_pages.data(), dirty_pages.size());
+  if (status != Status::kSuccess)
+    return status;
+  for (Page* page : dirty_pages)
+    page->MarkDirty(false);
+  return Status::kSuccess;
+}
+
 Status TransactionImpl::Get(Space* space, string_view key, string_view* value) {
   if (is_closed_)
     return Status::kAlreadyClosed;
@@ -108,7 +357,9 @@ Status TransactionImpl::Close() {
     page_pool->UnpinUnassignedPage(page);
   }
 
+  arena_.Reset();
   store_->TransactionClosed(this);
+  is_detached_.store(true, std::memory_order_release);
   return Status::kSuccess;
 }
 
@@ -116,6 +367,53 @@ Status TransactionImpl::Commit() {
   if (is_closed_)
     return Status::kAlreadyClosed;
 
+  // Shadow pages are only reachable from the new root page. Committing them
+  // without one would retire pages that the old root page still points to.
+  DCHECK(shadow_pages_.empty() || new_root_page_ != 0);
+  if (!shadow_pages_.empty() && new_root_page_ == 0) {
+    Rollback();
+    return Status::kDataCorrupted;
+  }
+
+  if (new_root_page_ != 0) {
+    // The first committer wins. The new root page was derived from the root
+    // page seen by this transaction, so installing it would discard the
+    // changes committed by any transaction that swapped the root page since.
+    if (store_->header()->root_page != root_page_) {
+      Rollback();
+      return Status::kConflict;
+    }
+
+    // A failed commit may leave the shadow pages reachable from a header in
+    // the data file. CommitRootPage() keeps them from being freed in that case
+    // by clearing shadow_pages_.
+    bool store_failed;
+    Status status = store_->CommitRootPage(
+        new_root_page_, &shadow_pages_, &store_failed);
+    if (status != Status::kSuccess) {
+      Rollback();
+      // Closing the store rolls back its transactions, so it must happen after
+      // this transaction is closed.
+      if (store_failed)
+        store_->Close();
+      return status;
+    }
+    shadow_pages_.clear();
+  }
+
+  if (!page_versions_.empty() || !replaced_pages_.empty()) {
+    uint64_t commit_timestamp = store_->AssignCommitTimestamp();
+    while (!page_versions_.empty()) {
+      PageVersion* version = page_versions_.front();
+      page_versions_.pop_front();
+      version->MarkCommitted(commit_timestamp);
+      store_->VersionCommitted(version);
+    }
+    for (size_t page_id : replaced_pages_)
+      store_->PageRetired(page_id, commit_timestamp);
+    replaced_pages_.clear();
+  }
+
   is_committed_ = true;
   return Close();
 }
@@ -124,7 +422,10 @@ Status TransactionImpl::Rollback() {
   if (is_closed_)
     return Status::kAlreadyClosed;
 
-  return Close();
+  RestoreBeforeImages();
+  Status release_status = ReleaseShadowPages();
+  Status close_status = Close();
+  return (release_status != Status::kSuccess) ? release_status : close_status;
 }
 
 Status TransactionImpl::CreateSpace(
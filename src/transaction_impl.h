@@ -5,9 +5,15 @@
 #ifndef BERRYDB_TRANSACTION_IMPL_H_
 #define BERRYDB_TRANSACTION_IMPL_H_
 
+#include <atomic>
+#include <vector>
+
 #include "berrydb/transaction.h"
 #include "./page.h"
+#include "./page_version.h"
+#include "./util/arena.h"
 #include "./util/linked_list.h"
+#include "./util/platform_allocator.h"
 
 namespace berrydb {
 
@@ -23,6 +29,11 @@ class TransactionImpl;
  * resource cleanup purposes, each store has a linked list of all its live
  * transactinons. To reduce dynamic memory allocations, the linked list nodes
  * are embedded in the transaction objects.
+ *
+ * Released transactions are kept in a per-thread cache, and reused by the next
+ * Create() call on the same thread. A cached transaction keeps the memory
+ * allocated for its bookkeeping, such as the page ID vectors, so starting and
+ * finishing small transactions does not use the heap allocator.
  */
 class TransactionImpl {
  public:
@@ -33,9 +44,14 @@ class TransactionImpl {
    * Use Release() to destroy instances created by TransactionImpl::Create(). */
   ~TransactionImpl();
 
-  /** Create a TransactionImpl instance. */
+  /** Create a TransactionImpl instance.
+   *
+   * Reuses a transaction released on the same thread, if possible. */
   static TransactionImpl* Create(StoreImpl* store);
 
+  /** Maximum number of released transactions cached by each thread. */
+  static constexpr size_t kCachedTransactionCount = 64;
+
   /** Computes the internal representation for a pointer from the public API. */
   static inline TransactionImpl* FromApi(Transaction* api) noexcept {
     TransactionImpl* impl = reinterpret_cast<TransactionImpl*>(api);
@@ -56,6 +72,92 @@ class TransactionImpl {
   /** The store this transaction is running against. */
   inline StoreImpl* store() const noexcept { return store_; }
 
+  /** The commit timestamp of the snapshot seen by this transaction.
+   *
+   * The transaction sees the changes made by all the transactions that
+   * committed before it was created, and does not see any changes committed
+   * afterwards. */
+  inline uint64_t read_timestamp() const noexcept { return read_timestamp_; }
+
+  /** Preserves a page's data before this transaction modifies it.
+   *
+   * Must be called before the transaction's first change to a page, so that
+   * concurrent transactions with older snapshots can keep reading the page's
+   * committed content. Later calls for the same page are no-ops.
+   *
+   * The first transaction to modify a page wins. The caller must not modify
+   * the page if this fails.
+   *
+   * @param  page a pinned page pool entry assigned to this transaction's store
+   * @return      kSuccess, or kConflict if the page was modified by another
+   *              open transaction, or by a transaction that committed after
+   *              this transaction's snapshot was taken
+   */
+  Status SaveBeforeImage(Page* page);
+
+  /** The page data visible in this transaction's snapshot.
+   *
+   * This is the page pool entry's data, unless the page was modified by a
+   * transaction that committed after this transaction's snapshot was taken, or
+   * by a transaction that has not committed yet.
+   *
+   * @param  page a pinned page pool entry assigned to this transaction's store
+   * @return      the data that must be used to read the page; must not be
+   *              modified, and is only valid while the page is pinned
+   */
+  const uint8_t* SnapshotData(Page* page) noexcept;
+
+  /** The root catalog's root page, as seen by this transaction.
+   *
+   * This is the root page recorded in the store's header when the transaction
+   * was created, unless the transaction replaced it via SetRootPage(). */
+  inline size_t root_page() const noexcept {
+    return (new_root_page_ != 0) ? new_root_page_ : root_page_;
+  }
+
+  /** Scratch memory whose lifetime is bounded by this transaction.
+   *
+   * Blocks allocated from the arena, directly or via ArenaAllocator, are freed
+   * all at once when the transaction commits or rolls back. The arena's memory
+   * is kept for the next transaction when this transaction is cached by
+   * Release(), so small transactions do not go through the heap allocator. */
+  inline Arena* arena() noexcept { return &arena_; }
+
+  /** Replaces the root catalog's root page when this transaction commits.
+   *
+   * The new root page is usually a shadow page obtained from CopyOnWrite().
+   * Commit() rolls the transaction back and returns kConflict if another
+   * transaction replaced the root page after this transaction was created.
+   * Transactions that call CopyOnWrite() must call this before committing. */
+  void SetRootPage(size_t page_id) noexcept;
+
+  /** Obtains a private copy of a page, which this transaction can modify.
+   *
+   * This is the copy-on-write step of shadow paging. The page's data, as seen
+   * by this transaction's snapshot, is copied into a newly allocated page, and
+   * the transaction modifies the copy instead of the original page. The pages that point to the original page must be
+   * updated in turn, up to the root page, which is swapped in the store header
+   * when the transaction commits. The original page is returned to the free
+   * list after no open transaction's snapshot can read it.
+   *
+   * Pages that were already copied by this transaction are returned as is.
+   *
+   * @param  page   a pinned page pool entry assigned to this transaction's store
+   * @param  result receives the shadow page's pinned page pool entry; the
+   *                caller must unpin it, and mark it dirty when modifying it
+   * @return        most likely kSuccess, kPoolFull or kIoError
+   */
+  Status CopyOnWrite(Page* page, Page** result);
+
+  /** Writes the dirty pages assigned to this transaction to the data file.
+   *
+   * This is intended for store init transactions, which own the page pool
+   * entries caching the store's pages. The pages are written in page ID order,
+   * so the data file sees sequential writes whenever possible.
+   *
+   * @return most likely kSuccess or kIoError */
+  Status WriteDirtyPages();
+
 #if DCHECK_IS_ON()
   /** Number of pool pages assigned to this transaction. DCHECKs use only.
    *
@@ -111,6 +213,15 @@ class TransactionImpl {
     DCHECK(!is_committed_ || is_closed_);
     return is_closed_;
   }
+  /** True once Close() is done using the transaction's pool.
+   *
+   * Unlike the other state accessors, this may be called without holding the
+   * pool's lock. A thread that sees a detached transaction may use it without
+   * the pool's lock, even if the pool is released right afterwards. The
+   * committed state can be read right after the transaction is detached. */
+  inline bool IsDetached() const noexcept {
+    return is_detached_.load(std::memory_order_acquire);
+  }
   inline bool IsCommitted() const noexcept {
     DCHECK(!is_committed_ || is_closed_);
     return is_committed_;
@@ -126,9 +237,23 @@ class TransactionImpl {
   /** Use TransactionImpl::Create() to obtain TransactionImpl instances. */
   TransactionImpl(StoreImpl* store);
 
+  /** Prepares a cached transaction to run against a store.
+   *
+   * This resets the transaction to the state set up by the constructor, without
+   * releasing the memory held by its bookkeeping. */
+  void Reuse(StoreImpl* store);
+
   /** Common path of commit and abort. */
   Status Close();
 
+  /** Restores the before-images saved by this transaction. */
+  void RestoreBeforeImages();
+
+  /** Returns the pages allocated by CopyOnWrite() to the free page list.
+   *
+   * @return the first error reported by the free page list, or kSuccess */
+  Status ReleaseShadowPages();
+
 #if DCHECK_IS_ON()
   /** DCHECKs that the given page pool entry was assigned to this transaction.
    *
@@ -157,12 +282,42 @@ class TransactionImpl {
    */
   LinkedList<Page, Page::TransactionLinkedListBridge> pool_pages_;
 
-  /** The store this transaction runs against. */
-  StoreImpl* const store_;
+  /** The store this transaction runs against.
+   *
+   * The members that would be const are set again by Reuse(). */
+  StoreImpl* store_;
+
+  /** Before-images of the pages modified by this transaction. */
+  LinkedList<PageVersion> page_versions_;
+
+  /** See read_timestamp(). */
+  uint64_t read_timestamp_;
+
+  using PageIdVector = std::vector<size_t, PlatformAllocator<size_t>>;
+
+  /** Pages allocated by CopyOnWrite(). Freed if the transaction rolls back. */
+  PageIdVector shadow_pages_;
+
+  /** Pages copied by CopyOnWrite(). Retired if the transaction commits. */
+  PageIdVector replaced_pages_;
+
+  /** The root page in the store header when the transaction was created. */
+  size_t root_page_;
+
+  /** The root page set by SetRootPage(). 0 if the root page was not changed.
+   *
+   * Page 0 holds the store header, so it can never be a root page. */
+  size_t new_root_page_ = 0;
+
+  /** See arena(). */
+  Arena arena_;
 
   bool is_closed_ = false;
   bool is_committed_ = false;
 
+  /** See IsDetached(). */
+  std::atomic<bool> is_detached_{false};
+
 #if DCHECK_IS_ON()
   /** True if this is the store's init transaction. */
   bool is_init_;
@@ -0,0 +1,446 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./transaction_impl.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/status.h"
+#include "./free_page_manager.h"
+#include "./page_pool.h"
+#include "./pool_impl.h"
+#include "./store_impl.h"
+#include "./test/file_deleter.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+class TransactionImplTest : public ::testing::Test {
+ protected:
+  TransactionImplTest()
+      : data_file_deleter_(kStoreFileName),
+        log_file_deleter_(StoreImpl::LogFilePath(kStoreFileName)) { }
+
+  void SetUp() override {
+    PoolOptions options;
+    options.page_shift = kStorePageShift;
+    options.page_pool_size = 16;
+    pool_.reset(PoolImpl::Create(options));
+
+    StoreImpl* raw_store;
+    ASSERT_EQ(Status::kSuccess, pool_->OpenStore(
+        kStoreFileName, StoreOptions(), &raw_store));
+    store_.reset(raw_store);
+
+    ASSERT_EQ(Status::kSuccess, pool_->page_pool()->StorePage(
+        store_.get(), kPageId, PagePool::kFetchPageData, &page_));
+  }
+
+  void TearDown() override {
+    if (store_.get() != nullptr && !store_->IsClosed())
+      pool_->page_pool()->UnpinStorePage(page_);
+  }
+
+  TransactionImpl* CreateTransaction() {
+    TransactionImpl* transaction = nullptr;
+    EXPECT_EQ(Status::kSuccess, store_->CreateTransaction(&transaction));
+    return transaction;
+  }
+
+  /** Modifies the test page on behalf of a transaction. */
+  void WritePage(TransactionImpl* transaction, uint8_t value) {
+    ASSERT_EQ(Status::kSuccess, transaction->SaveBeforeImage(page_));
+    page_->MarkDirty();
+    std::memset(page_->data(), value, 1 << kStorePageShift);
+  }
+
+  /** Checks the test page's content in a transaction's snapshot. */
+  void CheckPage(TransactionImpl* transaction, uint8_t value) {
+    const uint8_t* data = transaction->SnapshotData(page_);
+    for (size_t i = 0; i < store_->usable_page_size(); ++i)
+      ASSERT_EQ(value, data[i]) << i;
+  }
+
+  const std::string kStoreFileName = "test_transaction_impl.berry";
+  constexpr static size_t kStorePageShift = 12;
+  constexpr static size_t kPageId = 2;
+
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+
+  UniquePtr<PoolImpl> pool_;
+  UniquePtr<StoreImpl> store_;
+  Page* page_;
+};
+
+constexpr size_t TransactionImplTest::kStorePageShift;
+constexpr size_t TransactionImplTest::kPageId;
+
+TEST_F(TransactionImplTest, ReadTimestamps) {
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  EXPECT_EQ(reader->read_timestamp(), writer->read_timestamp());
+
+  // Transactions that did not modify pages do not consume commit timestamps.
+  ASSERT_EQ(Status::kSuccess, reader->Commit());
+  EXPECT_EQ(writer->read_timestamp(), store_->last_commit_timestamp());
+
+  WritePage(writer.get(), 1);
+  ASSERT_EQ(Status::kSuccess, writer->Commit());
+  EXPECT_LT(writer->read_timestamp(), store_->last_commit_timestamp());
+
+  UniquePtr<TransactionImpl> transaction(CreateTransaction());
+  EXPECT_EQ(store_->last_commit_timestamp(), transaction->read_timestamp());
+}
+
+TEST_F(TransactionImplTest, ReleasedTransactionIsReused) {
+  TransactionImpl* transaction = CreateTransaction();
+  WritePage(transaction, 1);
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  transaction->Release();
+
+  // The reused transaction starts out like a new one.
+  UniquePtr<TransactionImpl> reused(CreateTransaction());
+  EXPECT_EQ(transaction, reused.get());
+  EXPECT_FALSE(reused->IsClosed());
+  EXPECT_FALSE(reused->IsCommitted());
+  EXPECT_EQ(store_->last_commit_timestamp(), reused->read_timestamp());
+  EXPECT_EQ(store_->header()->root_page, reused->root_page());
+  CheckPage(reused.get(), 1);
+
+  // Releasing an open transaction rolls it back before caching it.
+  WritePage(reused.get(), 2);
+  reused.reset();
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  EXPECT_EQ(transaction, reader.get());
+  CheckPage(reader.get(), 1);
+}
+
+TEST_F(TransactionImplTest, ArenaIsRecycledOnClose) {
+  TransactionImpl* transaction = CreateTransaction();
+  void* block = transaction->arena()->Allocate(64);
+  std::memset(transaction->arena()->Allocate(Arena::kChunkSize), 0,
+              Arena::kChunkSize);
+  EXPECT_LT(Arena::kChunkSize, transaction->arena()->chunk_bytes());
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  EXPECT_EQ(Arena::kChunkSize, transaction->arena()->chunk_bytes());
+  transaction->Release();
+
+  UniquePtr<TransactionImpl> reused(CreateTransaction());
+  ASSERT_EQ(transaction, reused.get());
+  EXPECT_EQ(block, reused->arena()->Allocate(64));
+}
+
+TEST_F(TransactionImplTest, SnapshotIsolation) {
+  UniquePtr<TransactionImpl> setup(CreateTransaction());
+  WritePage(setup.get(), 1);
+  ASSERT_EQ(Status::kSuccess, setup->Commit());
+
+  UniquePtr<TransactionImpl> old_reader(CreateTransaction());
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  WritePage(writer.get(), 2);
+  WritePage(writer.get(), 3);
+
+  // Uncommitted changes are only visible to the writer.
+  CheckPage(writer.get(), 3);
+  CheckPage(old_reader.get(), 1);
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  CheckPage(reader.get(), 1);
+
+  ASSERT_EQ(Status::kSuccess, writer->Commit());
+  CheckPage(old_reader.get(), 1);
+  CheckPage(reader.get(), 1);
+  UniquePtr<TransactionImpl> new_reader(CreateTransaction());
+  CheckPage(new_reader.get(), 3);
+
+  UniquePtr<TransactionImpl> writer2(CreateTransaction());
+  WritePage(writer2.get(), 4);
+  ASSERT_EQ(Status::kSuccess, writer2->Commit());
+  CheckPage(old_reader.get(), 1);
+  CheckPage(new_reader.get(), 3);
+  UniquePtr<TransactionImpl> newest_reader(CreateTransaction());
+  CheckPage(newest_reader.get(), 4);
+}
+
+TEST_F(TransactionImplTest, RollbackRestoresBeforeImage) {
+  UniquePtr<TransactionImpl> setup(CreateTransaction());
+  WritePage(setup.get(), 1);
+  ASSERT_EQ(Status::kSuccess, setup->Commit());
+
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  WritePage(writer.get(), 2);
+  ASSERT_EQ(Status::kSuccess, writer->Rollback());
+  EXPECT_EQ(1, page_->data()[0]);
+
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  CheckPage(reader.get(), 1);
+}
+
+TEST_F(TransactionImplTest, RollbackAfterWriteBackPersists) {
+  UniquePtr<TransactionImpl> setup(CreateTransaction());
+  WritePage(setup.get(), 1);
+  ASSERT_EQ(Status::kSuccess, setup->Commit());
+  ASSERT_EQ(Status::kSuccess,
+            pool_->page_pool()->WriteBackStorePage(store_.get(), kPageId));
+
+  // The uncommitted change reaches the data file before the rollback.
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  WritePage(writer.get(), 2);
+  ASSERT_EQ(Status::kSuccess,
+            pool_->page_pool()->WriteBackStorePage(store_.get(), kPageId));
+  EXPECT_FALSE(page_->is_dirty());
+  ASSERT_EQ(Status::kSuccess, writer->Rollback());
+  EXPECT_TRUE(page_->is_dirty());
+
+  pool_->page_pool()->UnpinStorePage(page_);
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  StoreImpl* raw_store;
+  ASSERT_EQ(Status::kSuccess, pool_->OpenStore(
+      kStoreFileName, StoreOptions(), &raw_store));
+  store_.reset(raw_store);
+  ASSERT_EQ(Status::kSuccess, pool_->page_pool()->StorePage(
+      store_.get(), kPageId, PagePool::kFetchPageData, &page_));
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  CheckPage(reader.get(), 1);
+}
+
+TEST_F(TransactionImplTest, VersionsPrunedWhenSnapshotsClose) {
+  PagePool* page_pool = pool_->page_pool();
+  EXPECT_EQ(1U, page_pool->pinned_pages());
+
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  WritePage(writer.get(), 1);
+  ASSERT_EQ(Status::kSuccess, writer->Commit());
+  writer.reset();
+
+  // The reader's snapshot needs the before-image.
+  ASSERT_TRUE(page_->newest_version() != nullptr);
+  EXPECT_EQ(1U, page_pool->pinned_pages());
+
+  reader.reset();
+  EXPECT_TRUE(page_->newest_version() == nullptr);
+
+  // The version chain's pin was released, so the test's pin is the only one.
+  pool_->page_pool()->UnpinStorePage(page_);
+  EXPECT_EQ(0U, page_pool->pinned_pages());
+  ASSERT_EQ(Status::kSuccess, pool_->page_pool()->StorePage(
+      store_.get(), kPageId, PagePool::kFetchPageData, &page_));
+}
+
+TEST_F(TransactionImplTest, StoreCloseReleasesVersions) {
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  WritePage(writer.get(), 1);
+  ASSERT_EQ(Status::kSuccess, writer->Commit());
+  UniquePtr<TransactionImpl> writer2(CreateTransaction());
+  WritePage(writer2.get(), 2);
+
+  pool_->page_pool()->UnpinStorePage(page_);
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+  EXPECT_TRUE(writer2->IsRolledBack());
+  EXPECT_EQ(0U, pool_->page_pool()->pinned_pages());
+}
+
+TEST_F(TransactionImplTest, ShadowPagingSwapsRoot) {
+  EXPECT_EQ(kPageId, store_->header()->root_page);
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  EXPECT_EQ(kPageId, writer->root_page());
+
+  Page* shadow_page;
+  ASSERT_EQ(Status::kSuccess, writer->CopyOnWrite(page_, &shadow_page));
+  size_t shadow_page_id = shadow_page->page_id();
+  EXPECT_NE(kPageId, shadow_page_id);
+  std::memset(shadow_page->data(), 1, pool_->page_pool()->page_size());
+
+  // Shadow pages are not copied again.
+  Page* same_page;
+  ASSERT_EQ(Status::kSuccess, writer->CopyOnWrite(shadow_page, &same_page));
+  EXPECT_EQ(shadow_page, same_page);
+  pool_->page_pool()->UnpinStorePage(same_page);
+  pool_->page_pool()->UnpinStorePage(shadow_page);
+
+  writer->SetRootPage(shadow_page_id);
+  EXPECT_EQ(shadow_page_id, writer->root_page());
+  EXPECT_EQ(kPageId, reader->root_page());
+  EXPECT_EQ(0, page_->data()[0]);
+
+  ASSERT_EQ(Status::kSuccess, writer->Commit());
+  EXPECT_EQ(shadow_page_id, store_->header()->root_page);
+  EXPECT_EQ(kPageId, reader->root_page());
+  UniquePtr<TransactionImpl> new_reader(CreateTransaction());
+  EXPECT_EQ(shadow_page_id, new_reader->root_page());
+
+  // The old root page is not reused while the old snapshot is open.
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(&page_id));
+  EXPECT_NE(kPageId, page_id);
+  ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->FreePage(page_id));
+
+  reader.reset();
+  ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(&page_id));
+  EXPECT_EQ(kPageId, page_id);
+}
+
+TEST_F(TransactionImplTest, ShadowPagingRootPersists) {
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  Page* shadow_page;
+  ASSERT_EQ(Status::kSuccess, writer->CopyOnWrite(page_, &shadow_page));
+  size_t shadow_page_id = shadow_page->page_id();
+  std::memset(shadow_page->data(), 1, pool_->page_pool()->page_size());
+  pool_->page_pool()->UnpinStorePage(shadow_page);
+  writer->SetRootPage(shadow_page_id);
+  ASSERT_EQ(Status::kSuccess, writer->Commit());
+
+  pool_->page_pool()->UnpinStorePage(page_);
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+
+  StoreImpl* raw_store;
+  ASSERT_EQ(Status::kSuccess, pool_->OpenStore(
+      kStoreFileName, StoreOptions(), &raw_store));
+  store_.reset(raw_store);
+  EXPECT_EQ(shadow_page_id, store_->header()->root_page);
+
+  ASSERT_EQ(Status::kSuccess, pool_->page_pool()->StorePage(
+      store_.get(), shadow_page_id, PagePool::kFetchPageData, &page_));
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  EXPECT_EQ(shadow_page_id, reader->root_page());
+  CheckPage(reader.get(), 1);
+}
+
+TEST_F(TransactionImplTest, ShadowCommitSkipsUncommittedPages) {
+  UniquePtr<TransactionImpl> setup(CreateTransaction());
+  WritePage(setup.get(), 1);
+  ASSERT_EQ(Status::kSuccess, setup->Commit());
+
+  // An in-place change that is still uncommitted when another transaction
+  // commits via shadow paging.
+  UniquePtr<TransactionImpl> in_place_writer(CreateTransaction());
+  WritePage(in_place_writer.get(), 2);
+
+  UniquePtr<TransactionImpl> shadow_writer(CreateTransaction());
+  Page* shadow_page;
+  ASSERT_EQ(Status::kSuccess, shadow_writer->CopyOnWrite(page_, &shadow_page));
+  std::memset(shadow_page->data(), 3, pool_->page_pool()->page_size());
+  shadow_writer->SetRootPage(shadow_page->page_id());
+  pool_->page_pool()->UnpinStorePage(shadow_page);
+  ASSERT_EQ(Status::kSuccess, shadow_writer->Commit());
+
+  // The shadow commit must not have written the uncommitted change.
+  std::FILE* data_file = std::fopen(kStoreFileName.c_str(), "rb");
+  ASSERT_TRUE(data_file != nullptr);
+  ASSERT_EQ(0, std::fseek(data_file, kPageId << kStorePageShift, SEEK_SET));
+  uint8_t page_byte = 0;
+  size_t read_count = std::fread(&page_byte, 1, 1, data_file);
+  std::fclose(data_file);
+  ASSERT_EQ(1U, read_count);
+  EXPECT_NE(2, page_byte);
+
+  ASSERT_EQ(Status::kSuccess, in_place_writer->Rollback());
+  EXPECT_EQ(1, page_->data()[0]);
+}
+
+TEST_F(TransactionImplTest, ShadowCopyUsesSnapshot) {
+  UniquePtr<TransactionImpl> setup(CreateTransaction());
+  WritePage(setup.get(), 1);
+  ASSERT_EQ(Status::kSuccess, setup->Commit());
+
+  UniquePtr<TransactionImpl> shadow_writer(CreateTransaction());
+  UniquePtr<TransactionImpl> in_place_writer(CreateTransaction());
+  WritePage(in_place_writer.get(), 2);
+
+  // The uncommitted in-place change is not in the shadow writer's snapshot.
+  Page* shadow_page;
+  ASSERT_EQ(Status::kSuccess, shadow_writer->CopyOnWrite(page_, &shadow_page));
+  for (size_t i = 0; i < store_->usable_page_size(); ++i)
+    ASSERT_EQ(1, shadow_page->data()[i]) << i;
+  pool_->page_pool()->UnpinStorePage(shadow_page);
+
+  ASSERT_EQ(Status::kSuccess, shadow_writer->Rollback());
+  ASSERT_EQ(Status::kSuccess, in_place_writer->Rollback());
+}
+
+TEST_F(TransactionImplTest, ShadowPagingRollbackFreesShadows) {
+  UniquePtr<TransactionImpl> writer(CreateTransaction());
+  Page* shadow_page;
+  ASSERT_EQ(Status::kSuccess, writer->CopyOnWrite(page_, &shadow_page));
+  size_t shadow_page_id = shadow_page->page_id();
+  pool_->page_pool()->UnpinStorePage(shadow_page);
+  writer->SetRootPage(shadow_page_id);
+  ASSERT_EQ(Status::kSuccess, writer->Rollback());
+  EXPECT_EQ(kPageId, store_->header()->root_page);
+
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(&page_id));
+  EXPECT_EQ(shadow_page_id, page_id);
+}
+
+TEST_F(TransactionImplTest, ShadowPagingFirstCommitterWins) {
+  UniquePtr<TransactionImpl> writer1(CreateTransaction());
+  UniquePtr<TransactionImpl> writer2(CreateTransaction());
+
+  // Both writers copy the root page, and swap in their own copy.
+  Page* shadow_page1;
+  ASSERT_EQ(Status::kSuccess, writer1->CopyOnWrite(page_, &shadow_page1));
+  size_t shadow_page_id1 = shadow_page1->page_id();
+  std::memset(shadow_page1->data(), 1, pool_->page_pool()->page_size());
+  pool_->page_pool()->UnpinStorePage(shadow_page1);
+  writer1->SetRootPage(shadow_page_id1);
+
+  Page* shadow_page2;
+  ASSERT_EQ(Status::kSuccess, writer2->CopyOnWrite(page_, &shadow_page2));
+  size_t shadow_page_id2 = shadow_page2->page_id();
+  std::memset(shadow_page2->data(), 2, pool_->page_pool()->page_size());
+  pool_->page_pool()->UnpinStorePage(shadow_page2);
+  writer2->SetRootPage(shadow_page_id2);
+
+  ASSERT_EQ(Status::kSuccess, writer1->Commit());
+  EXPECT_EQ(shadow_page_id1, store_->header()->root_page);
+
+  ASSERT_EQ(Status::kConflict, writer2->Commit());
+  EXPECT_TRUE(writer2->IsRolledBack());
+  EXPECT_EQ(shadow_page_id1, store_->header()->root_page);
+
+  // The losing writer's shadow page was freed by the rollback. The replaced
+  // root page was freed when the losing writer's snapshot was closed.
+  size_t page_id;
+  ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(&page_id));
+  EXPECT_EQ(kPageId, page_id);
+  ASSERT_EQ(Status::kSuccess, store_->free_page_manager()->AllocPage(&page_id));
+  EXPECT_EQ(shadow_page_id2, page_id);
+}
+
+TEST_F(TransactionImplTest, WriteWriteConflict) {
+  UniquePtr<TransactionImpl> writer1(CreateTransaction());
+  UniquePtr<TransactionImpl> writer2(CreateTransaction());
+  WritePage(writer1.get(), 1);
+
+  // The page has an uncommitted change.
+  EXPECT_EQ(Status::kConflict, writer2->SaveBeforeImage(page_));
+  CheckPage(writer1.get(), 1);
+  CheckPage(writer2.get(), 0);
+
+  // The change was committed after writer2's snapshot was taken.
+  ASSERT_EQ(Status::kSuccess, writer1->Commit());
+  EXPECT_EQ(Status::kConflict, writer2->SaveBeforeImage(page_));
+  ASSERT_EQ(Status::kSuccess, writer2->Rollback());
+  UniquePtr<TransactionImpl> reader(CreateTransaction());
+  CheckPage(reader.get(), 1);
+
+  // A transaction whose snapshot has the change can modify the page.
+  UniquePtr<TransactionImpl> writer3(CreateTransaction());
+  WritePage(writer3.get(), 3);
+  ASSERT_EQ(Status::kSuccess, writer3->Rollback());
+  CheckPage(reader.get(), 1);
+}
+
+}  // namespace berrydb
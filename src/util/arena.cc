@@ -0,0 +1,80 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./arena.h"
+
+#include <new>
+
+namespace berrydb {
+
+constexpr size_t Arena::kChunkSize;
+constexpr size_t Arena::kMaxChunkedBlockSize;
+constexpr size_t Arena::kChunkOverhead;
+
+Arena::~Arena() {
+  FreeChunks(chunks_);
+  FreeChunks(first_chunk_);
+}
+
+void Arena::Reset() noexcept {
+  FreeChunks(chunks_);
+  chunks_ = nullptr;
+
+  if (first_chunk_ == nullptr) {
+    // Only large blocks were allocated, so no chunk is kept.
+    next_ = 0;
+    limit_ = 0;
+    chunk_bytes_ = 0;
+    return;
+  }
+  DCHECK_EQ(first_chunk_->next, nullptr);
+  next_ = ChunkData(first_chunk_);
+  limit_ = reinterpret_cast<uintptr_t>(first_chunk_) + kChunkSize;
+  chunk_bytes_ = kChunkSize;
+}
+
+void* Arena::AllocateSlow(size_t size) {
+  if (size > kMaxChunkedBlockSize) {
+    // Large blocks get dedicated chunks. The current chunk stays in use, as it
+    // may still have plenty of room for small blocks.
+    Chunk* chunk = NewChunk(kChunkOverhead + size);
+    chunk->next = chunks_;
+    chunks_ = chunk;
+    return reinterpret_cast<void*>(ChunkData(chunk));
+  }
+
+  Chunk* chunk = NewChunk(kChunkSize);
+  if (first_chunk_ == nullptr) {
+    first_chunk_ = chunk;
+  } else {
+    chunk->next = chunks_;
+    chunks_ = chunk;
+  }
+
+  uintptr_t block = ChunkData(chunk);
+  next_ = block + size;
+  limit_ = reinterpret_cast<uintptr_t>(chunk) + kChunkSize;
+  return reinterpret_cast<void*>(block);
+}
+
+Arena::Chunk* Arena::NewChunk(size_t size) {
+  void* heap_block = berrydb::Allocate(size);
+  Chunk* chunk = new (heap_block) Chunk();
+  chunk->next = nullptr;
+  chunk->size = size;
+  chunk_bytes_ += size;
+  return chunk;
+}
+
+void Arena::FreeChunks(Chunk* chunk) noexcept {
+  while (chunk != nullptr) {
+    Chunk* next = chunk->next;
+    size_t size = chunk->size;
+    chunk->~Chunk();
+    Deallocate(static_cast<void*>(chunk), size);
+    chunk = next;
+  }
+}
+
+}  // namespace berrydb
@@ -0,0 +1,174 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_ARENA_H_
+#define BERRYDB_UTIL_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "berrydb/platform.h"
+
+namespace berrydb {
+
+/** Bump-pointer allocator for short-lived memory blocks.
+ *
+ * Memory is carved out of large chunks obtained from the platform allocator.
+ * Individual blocks are never freed. Instead, Reset() frees all the blocks at
+ * once. The first chunk is kept across Reset() calls, so an arena that is
+ * reused for many small workloads does not touch the platform allocator after
+ * warming up.
+ *
+ * Arenas are not thread-safe. Each arena is meant to be owned by an object that
+ * is only used by one thread at a time, such as a transaction.
+ */
+class Arena {
+ public:
+  /** The size of the chunks carved up into blocks. */
+  static constexpr size_t kChunkSize = 4096;
+
+  /** Blocks above this size get their own chunks, if they do not fit in the
+   * current chunk. This avoids abandoning a chunk with plenty of free space. */
+  static constexpr size_t kMaxChunkedBlockSize = kChunkSize / 4;
+
+  Arena() noexcept = default;
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /** Allocates a memory block that lives until the next Reset() call.
+   *
+   * @param  size      the block size, in bytes
+   * @param  alignment the block's alignment; must be a power of two no greater
+   *                   than alignof(std::max_align_t)
+   * @return           the allocated block
+   */
+  inline void* Allocate(
+      size_t size, size_t alignment = alignof(std::max_align_t)) {
+    DCHECK_EQ(alignment & (alignment - 1), 0U);
+    DCHECK_LE(alignment, alignof(std::max_align_t));
+
+    uintptr_t block = (next_ + alignment - 1) & ~(alignment - 1);
+    if (block < limit_ && size <= limit_ - block) {
+      next_ = block + size;
+      return reinterpret_cast<void*>(block);
+    }
+    return AllocateSlow(size);
+  }
+
+  /** Frees all the blocks allocated from this arena.
+   *
+   * Keeps the first chunk around, so this is O(1) if all the blocks allocated
+   * since the last Reset() call fit in one chunk. */
+  void Reset() noexcept;
+
+  /** Number of bytes obtained from the platform allocator. Used in tests. */
+  inline size_t chunk_bytes() const noexcept { return chunk_bytes_; }
+
+ private:
+  /** Header at the beginning of each chunk. */
+  struct Chunk {
+    /** The next chunk on the list of chunks freed by Reset(). */
+    Chunk* next;
+    /** The chunk size, including this header. */
+    size_t size;
+  };
+
+  /** The first byte in a chunk that can be used for blocks.
+   *
+   * The platform allocator only guarantees size_t alignment, so the header may
+   * be followed by some padding. */
+  static inline uintptr_t ChunkData(Chunk* chunk) noexcept {
+    return (reinterpret_cast<uintptr_t>(chunk) + sizeof(Chunk) +
+            alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+  }
+
+  /** Upper bound for the chunk bytes that cannot be used for blocks. */
+  static constexpr size_t kChunkOverhead =
+      sizeof(Chunk) + alignof(std::max_align_t) - alignof(size_t);
+
+  /** Allocate() path that needs a new chunk. */
+  void* AllocateSlow(size_t size);
+
+  /** Obtains a chunk from the platform allocator. */
+  Chunk* NewChunk(size_t size);
+
+  /** Returns a list of chunks to the platform allocator. */
+  void FreeChunks(Chunk* chunk) noexcept;
+
+  /** The first address available for the next block. */
+  uintptr_t next_ = 0;
+  /** The end of the chunk that blocks are currently carved out of. */
+  uintptr_t limit_ = 0;
+
+  /** The first chunk, which is kept around by Reset(). */
+  Chunk* first_chunk_ = nullptr;
+  /** The other chunks, which are freed by Reset(). */
+  Chunk* chunks_ = nullptr;
+
+  /** See chunk_bytes(). */
+  size_t chunk_bytes_ = 0;
+};
+
+/** STL allocator that carves memory blocks out of an Arena.
+ *
+ * This has the same interface as PlatformAllocator, so containers can be
+ * switched between the two allocators by changing their type arguments.
+ * Unlike PlatformAllocator, ArenaAllocator has state, so containers using it
+ * must be constructed with an allocator instance.
+ *
+ * deallocate() is a no-op, as the blocks are freed by Arena::Reset(). The
+ * containers using this allocator must not be used after the arena is reset.
+ *
+ * Example:
+ *    std::vector<size_t, ArenaAllocator<size_t>> ids(
+ *        ArenaAllocator<size_t>(transaction->arena()));
+ */
+template<typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+
+  // The types below are deprecated in C++17, but are still needed by the
+  // compilers that we need to support right now.
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  template <typename U> struct rebind { typedef ArenaAllocator<U> other; };
+
+  inline T* allocate(std::size_t count) {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "Arenas do not support over-aligned types");
+    return reinterpret_cast<T*>(arena->Allocate(sizeof(T) * count, alignof(T)));
+  }
+  inline void deallocate(T* data, std::size_t count) noexcept {
+    UNUSED(data);
+    UNUSED(count);
+  }
+
+  inline explicit ArenaAllocator(Arena* arena) noexcept : arena(arena) {
+    DCHECK(arena != nullptr);
+  }
+  inline ArenaAllocator(const ArenaAllocator& other) noexcept = default;
+  template<typename U>
+  inline ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+      : arena(other.arena) {}
+
+  /** The arena that memory blocks are carved out of. */
+  Arena* arena;
+};
+
+template<typename T, typename U> inline constexpr bool operator==(
+    const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept {
+  return lhs.arena == rhs.arena;
+}
+template<typename T, typename U> inline constexpr bool operator!=(
+    const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept {
+  return lhs.arena != rhs.arena;
+}
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_ARENA_H_
@@ -0,0 +1,101 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./arena.h"
+
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+TEST(ArenaTest, AllocatesAlignedBlocks) {
+  Arena arena;
+  EXPECT_EQ(0U, arena.chunk_bytes());
+
+  uint8_t* byte = reinterpret_cast<uint8_t*>(arena.Allocate(1, 1));
+  *byte = 42;
+  uint64_t* word = reinterpret_cast<uint64_t*>(
+      arena.Allocate(sizeof(uint64_t), alignof(uint64_t)));
+  EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(word) % alignof(uint64_t));
+  *word = 0x0123456789ABCDEF;
+  void* block = arena.Allocate(100);
+  EXPECT_EQ(0U,
+            reinterpret_cast<uintptr_t>(block) % alignof(std::max_align_t));
+  std::memset(block, 0xFF, 100);
+
+  EXPECT_EQ(42, *byte);
+  EXPECT_EQ(0x0123456789ABCDEFU, *word);
+  EXPECT_EQ(Arena::kChunkSize, arena.chunk_bytes());
+}
+
+TEST(ArenaTest, ResetKeepsFirstChunk) {
+  Arena arena;
+  void* first_block = arena.Allocate(16);
+  for (size_t i = 0; i < 2 * Arena::kChunkSize / 16; ++i)
+    std::memset(arena.Allocate(16), 0, 16);
+  void* large_block = arena.Allocate(Arena::kChunkSize * 2);
+  std::memset(large_block, 0, Arena::kChunkSize * 2);
+  EXPECT_LT(Arena::kChunkSize * 4, arena.chunk_bytes());
+
+  arena.Reset();
+  EXPECT_EQ(Arena::kChunkSize, arena.chunk_bytes());
+  EXPECT_EQ(first_block, arena.Allocate(16));
+  EXPECT_EQ(Arena::kChunkSize, arena.chunk_bytes());
+}
+
+TEST(ArenaTest, ResetWithOnlyLargeBlocks) {
+  Arena arena;
+  std::memset(arena.Allocate(Arena::kMaxChunkedBlockSize + 1), 0,
+              Arena::kMaxChunkedBlockSize + 1);
+  EXPECT_LT(0U, arena.chunk_bytes());
+
+  arena.Reset();
+  EXPECT_EQ(0U, arena.chunk_bytes());
+  std::memset(arena.Allocate(16), 0, 16);
+  EXPECT_EQ(Arena::kChunkSize, arena.chunk_bytes());
+}
+
+TEST(ArenaTest, LargeBlocksDoNotWasteChunk) {
+  Arena arena;
+  uint8_t* small_block = reinterpret_cast<uint8_t*>(arena.Allocate(16));
+  for (size_t i = 0; i < Arena::kChunkSize / 2 / 16; ++i)
+    small_block = reinterpret_cast<uint8_t*>(arena.Allocate(16));
+
+  // The large blocks do not fit in the chunk's remaining space.
+  for (size_t i = 0; i < 2; ++i) {
+    std::memset(arena.Allocate(Arena::kChunkSize / 2), 0,
+                Arena::kChunkSize / 2);
+  }
+
+  // The small blocks keep coming out of the first chunk.
+  uint8_t* next_block = reinterpret_cast<uint8_t*>(arena.Allocate(16));
+  EXPECT_EQ(small_block + 16, next_block);
+}
+
+TEST(ArenaTest, AllocatorWorksWithVector) {
+  Arena arena;
+  std::vector<size_t, ArenaAllocator<size_t>> vector(
+      (ArenaAllocator<size_t>(&arena)));
+  for (size_t i = 0; i < 1000; ++i)
+    vector.push_back(i);
+  for (size_t i = 0; i < 1000; ++i)
+    EXPECT_EQ(i, vector[i]);
+  EXPECT_LT(0U, arena.chunk_bytes());
+}
+
+TEST(ArenaTest, AllocatorEquality) {
+  Arena arena, other_arena;
+  ArenaAllocator<size_t> allocator(&arena);
+  ArenaAllocator<uint8_t> rebound(allocator);
+  ArenaAllocator<size_t> other_allocator(&other_arena);
+
+  EXPECT_TRUE(allocator == rebound);
+  EXPECT_FALSE(allocator != rebound);
+  EXPECT_FALSE(allocator == other_allocator);
+  EXPECT_TRUE(allocator != other_allocator);
+}
+
+}  // namespace berrydb
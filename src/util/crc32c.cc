@@ -0,0 +1,125 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./crc32c.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif  // defined(__SSE4_2__)
+
+#include <cstring>
+
+namespace berrydb {
+
+namespace {
+
+/** Reads 4 little-endian bytes from a buffer that may not be aligned.
+ *
+ * Compilers turn this into a single load on little-endian platforms. */
+inline uint32_t ReadUint32LE(const uint8_t* from) noexcept {
+  return static_cast<uint32_t>(from[0]) |
+         (static_cast<uint32_t>(from[1]) << 8) |
+         (static_cast<uint32_t>(from[2]) << 16) |
+         (static_cast<uint32_t>(from[3]) << 24);
+}
+
+#if defined(__SSE4_2__)
+
+/** CRC32C implementation using the SSE4.2 crc32 instruction.
+ *
+ * The instruction processes 8 bytes per cycle, so checksumming a page costs
+ * a small fraction of the time needed to read the page from disk. */
+inline uint32_t Crc32cExtendHardware(
+    uint32_t crc, const uint8_t* data, size_t size) noexcept {
+  const uint8_t* end = data + size;
+#if defined(__x86_64__) || defined(_M_X64)
+  uint64_t crc64 = ~crc;
+  for (; end - data >= 8; data += 8) {
+    // The SSE4.2 instructions are only available on little-endian CPUs.
+    uint64_t bytes;
+    std::memcpy(&bytes, data, 8);
+    crc64 = _mm_crc32_u64(crc64, bytes);
+  }
+  crc = static_cast<uint32_t>(crc64);
+#else  // defined(__x86_64__) || defined(_M_X64)
+  crc = ~crc;
+  for (; end - data >= 4; data += 4)
+    crc = _mm_crc32_u32(crc, ReadUint32LE(data));
+#endif  // defined(__x86_64__) || defined(_M_X64)
+  for (; data != end; ++data)
+    crc = _mm_crc32_u8(crc, *data);
+  return ~crc;
+}
+
+#else  // defined(__SSE4_2__)
+
+/** The Castagnoli polynomial, in reversed bit order. */
+constexpr uint32_t kCrc32cPolynomial = 0x82f63b78;
+
+/** Lookup tables for the slicing-by-8 CRC32C algorithm.
+ *
+ * Table 0 is the classic byte-at-a-time table. Table k maps a byte to its
+ * contribution to the CRC after k more zero bytes are processed, so 8 bytes
+ * can be processed with 8 independent table lookups.
+ */
+class Crc32cTables {
+ public:
+  Crc32cTables() noexcept {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+        crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPolynomial : 0);
+      entries_[0][i] = crc;
+    }
+    for (size_t table = 1; table < 8; ++table) {
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = entries_[table - 1][i];
+        entries_[table][i] = (crc >> 8) ^ entries_[0][crc & 0xff];
+      }
+    }
+  }
+
+  inline uint32_t Lookup(size_t table, uint32_t byte) const noexcept {
+    return entries_[table][byte & 0xff];
+  }
+
+ private:
+  uint32_t entries_[8][256];
+};
+
+/** CRC32C implementation that works on all platforms. */
+inline uint32_t Crc32cExtendSoftware(
+    uint32_t crc, const uint8_t* data, size_t size) noexcept {
+  // Function-level statics are initialized in a thread-safe manner, and do not
+  // add static initializers to the library.
+  static const Crc32cTables tables;
+
+  const uint8_t* end = data + size;
+  crc = ~crc;
+  for (; end - data >= 8; data += 8) {
+    uint32_t low = crc ^ ReadUint32LE(data);
+    uint32_t high = ReadUint32LE(data + 4);
+    crc = tables.Lookup(7, low) ^ tables.Lookup(6, low >> 8) ^
+          tables.Lookup(5, low >> 16) ^ tables.Lookup(4, low >> 24) ^
+          tables.Lookup(3, high) ^ tables.Lookup(2, high >> 8) ^
+          tables.Lookup(1, high >> 16) ^ tables.Lookup(0, high >> 24);
+  }
+  for (; data != end; ++data)
+    crc = tables.Lookup(0, crc ^ *data) ^ (crc >> 8);
+  return ~crc;
+}
+
+#endif  // defined(__SSE4_2__)
+
+}  // namespace
+
+uint32_t Crc32cExtend(uint32_t crc, const uint8_t* data, size_t size) noexcept {
+#if defined(__SSE4_2__)
+  return Crc32cExtendHardware(crc, data, size);
+#else  // defined(__SSE4_2__)
+  return Crc32cExtendSoftware(crc, data, size);
+#endif  // defined(__SSE4_2__)
+}
+
+}  // namespace berrydb
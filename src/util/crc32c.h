@@ -0,0 +1,34 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_CRC32C_H_
+#define BERRYDB_UTIL_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace berrydb {
+
+/** Extends a CRC32C checksum with the contents of a buffer.
+ *
+ * CRC32C uses the Castagnoli polynomial, which has better error detection
+ * properties than the CRC32 polynomial used by zlib, and is computed in
+ * hardware by modern CPUs.
+ *
+ * @param  crc  the checksum of the data preceding the buffer; 0 if the buffer
+ *              is at the beginning of the checksummed data
+ * @param  data the buffer whose contents will be added to the checksum
+ * @param  size the number of bytes in the buffer
+ * @return      the checksum of the preceding data followed by the buffer
+ */
+uint32_t Crc32cExtend(uint32_t crc, const uint8_t* data, size_t size) noexcept;
+
+/** Computes the CRC32C checksum of a buffer. */
+inline uint32_t Crc32c(const uint8_t* data, size_t size) noexcept {
+  return Crc32cExtend(0, data, size);
+}
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_CRC32C_H_
@@ -0,0 +1,64 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./crc32c.h"
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+TEST(Crc32cTest, StandardResults) {
+  // From rfc3720 section B.4.
+  uint8_t buffer[32];
+
+  std::memset(buffer, 0, sizeof(buffer));
+  EXPECT_EQ(0x8a9136aaU, Crc32c(buffer, sizeof(buffer)));
+
+  std::memset(buffer, 0xff, sizeof(buffer));
+  EXPECT_EQ(0x62a8ab43U, Crc32c(buffer, sizeof(buffer)));
+
+  for (size_t i = 0; i < 32; ++i)
+    buffer[i] = static_cast<uint8_t>(i);
+  EXPECT_EQ(0x46dd794eU, Crc32c(buffer, sizeof(buffer)));
+
+  for (size_t i = 0; i < 32; ++i)
+    buffer[i] = static_cast<uint8_t>(31 - i);
+  EXPECT_EQ(0x113fdb5cU, Crc32c(buffer, sizeof(buffer)));
+
+  const char* check = "123456789";
+  EXPECT_EQ(0xe3069283U, Crc32c(
+      reinterpret_cast<const uint8_t*>(check), std::strlen(check)));
+}
+
+TEST(Crc32cTest, Extend) {
+  uint8_t buffer[64];
+  for (size_t i = 0; i < sizeof(buffer); ++i)
+    buffer[i] = static_cast<uint8_t>(i * 7);
+
+  uint32_t crc = Crc32c(buffer, sizeof(buffer));
+  for (size_t split = 0; split <= sizeof(buffer); ++split) {
+    EXPECT_EQ(crc, Crc32cExtend(Crc32c(buffer, split), buffer + split,
+                                sizeof(buffer) - split)) << split;
+  }
+}
+
+TEST(Crc32cTest, DetectsBitFlips) {
+  uint8_t buffer[64];
+  for (size_t i = 0; i < sizeof(buffer); ++i)
+    buffer[i] = static_cast<uint8_t>(i * 13);
+  uint32_t crc = Crc32c(buffer, sizeof(buffer));
+
+  for (size_t i = 0; i < sizeof(buffer); ++i) {
+    for (size_t j = 0; j < 8; ++j) {
+      uint8_t mask = 1 << j;
+      buffer[i] ^= mask;
+      EXPECT_NE(crc, Crc32c(buffer, sizeof(buffer)));
+      buffer[i] ^= mask;
+    }
+  }
+}
+
+}  // namespace berrydb
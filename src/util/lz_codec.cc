@@ -0,0 +1,225 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./lz_codec.h"
+
+#include <cstring>
+
+namespace berrydb {
+
+namespace {
+
+/** Matches shorter than this are emitted as literals. */
+constexpr size_t kMinMatchSize = 4;
+
+/** Matches cannot be farther than this from the data they replace. */
+constexpr size_t kMaxMatchDistance = 0xffff;
+
+/** Base-2 log of the number of entries in the compressor's hash table. */
+constexpr size_t kHashShift = 12;
+
+/** Nibble value indicating that a length continues in the following bytes. */
+constexpr size_t kNibbleMax = 15;
+
+inline uint32_t Load4Bytes(const uint8_t* from) noexcept {
+  uint32_t value;
+  std::memcpy(&value, from, sizeof(value));
+  return value;
+}
+
+/** Maps 4 bytes of input to an entry in the compressor's hash table. */
+inline size_t HashBytes(uint32_t bytes) noexcept {
+  // Multiplicative hashing with the golden ratio constant.
+  return static_cast<size_t>((bytes * 2654435761U) >> (32 - kHashShift));
+}
+
+/** Appends data to a caller-supplied buffer, tracking overflows. */
+class OutputCursor {
+ public:
+  inline OutputCursor(uint8_t* output, size_t capacity) noexcept
+      : start_(output), next_(output), end_(output + capacity) {}
+
+  inline bool CanWrite(size_t size) const noexcept {
+    return static_cast<size_t>(end_ - next_) >= size;
+  }
+
+  /** Writes the continuation bytes for a length that did not fit a nibble. */
+  inline bool WriteLengthTail(size_t length) noexcept {
+    for (; length >= 255; length -= 255) {
+      if (!CanWrite(1))
+        return false;
+      *next_++ = 255;
+    }
+    if (!CanWrite(1))
+      return false;
+    *next_++ = static_cast<uint8_t>(length);
+    return true;
+  }
+
+  /** Writes a token. The match is skipped if match_size is 0. */
+  inline bool WriteToken(const uint8_t* literals, size_t literal_count,
+                         size_t match_distance, size_t match_size) noexcept {
+    size_t match_nibble_value = (match_size == 0) ? 0 :
+        match_size - kMinMatchSize;
+    size_t literal_nibble = (literal_count < kNibbleMax) ?
+        literal_count : kNibbleMax;
+    size_t match_nibble = (match_nibble_value < kNibbleMax) ?
+        match_nibble_value : kNibbleMax;
+
+    if (!CanWrite(1))
+      return false;
+    *next_++ = static_cast<uint8_t>((literal_nibble << 4) | match_nibble);
+    if (literal_nibble == kNibbleMax &&
+        !WriteLengthTail(literal_count - kNibbleMax)) {
+      return false;
+    }
+    if (!CanWrite(literal_count))
+      return false;
+    // Tokens without literals may get a null literals pointer, which memcpy()
+    // must not receive, even when copying nothing.
+    if (literal_count != 0) {
+      std::memcpy(next_, literals, literal_count);
+      next_ += literal_count;
+    }
+
+    if (match_size == 0)
+      return true;
+    if (!CanWrite(2))
+      return false;
+    *next_++ = static_cast<uint8_t>(match_distance);
+    *next_++ = static_cast<uint8_t>(match_distance >> 8);
+    if (match_nibble == kNibbleMax &&
+        !WriteLengthTail(match_nibble_value - kNibbleMax)) {
+      return false;
+    }
+    return true;
+  }
+
+  inline size_t size() const noexcept {
+    return static_cast<size_t>(next_ - start_);
+  }
+
+ private:
+  uint8_t* const start_;
+  uint8_t* next_;
+  uint8_t* const end_;
+};
+
+/** Reads a length's continuation bytes.
+ *
+ * @return false if the input ends before the length */
+inline bool ReadLengthTail(
+    const uint8_t** input, const uint8_t* input_end, size_t* length) noexcept {
+  while (true) {
+    if (*input == input_end)
+      return false;
+    uint8_t byte = *(*input)++;
+    *length += byte;
+    if (byte != 255)
+      return true;
+  }
+}
+
+}  // namespace
+
+size_t LzCompress(const uint8_t* input, size_t input_size, uint8_t* output,
+                  size_t output_capacity) noexcept {
+  // The table stores input positions. Stale or colliding entries are harmless,
+  // because candidate matches are verified before they are used.
+  uint32_t hash_table[1 << kHashShift];
+  std::memset(hash_table, 0, sizeof(hash_table));
+
+  OutputCursor cursor(output, output_capacity);
+  size_t literal_start = 0;
+  size_t position = 0;
+  while (position + kMinMatchSize <= input_size) {
+    uint32_t bytes = Load4Bytes(input + position);
+    size_t hash = HashBytes(bytes);
+    size_t candidate = hash_table[hash];
+    hash_table[hash] = static_cast<uint32_t>(position);
+
+    if (candidate >= position || position - candidate > kMaxMatchDistance ||
+        Load4Bytes(input + candidate) != bytes) {
+      ++position;
+      continue;
+    }
+
+    size_t match_size = kMinMatchSize;
+    while (position + match_size < input_size &&
+           input[candidate + match_size] == input[position + match_size]) {
+      ++match_size;
+    }
+    if (!cursor.WriteToken(input + literal_start, position - literal_start,
+                           position - candidate, match_size)) {
+      return 0;
+    }
+    position += match_size;
+    literal_start = position;
+  }
+
+  if (!cursor.WriteToken(input + literal_start, input_size - literal_start,
+                         0, 0)) {
+    return 0;
+  }
+  return cursor.size();
+}
+
+bool LzDecompress(const uint8_t* input, size_t input_size, uint8_t* output,
+                  size_t output_size) noexcept {
+  const uint8_t* input_end = input + input_size;
+  uint8_t* output_next = output;
+  uint8_t* output_end = output + output_size;
+
+  while (true) {
+    // The data must end with a token that only has literals.
+    if (input == input_end)
+      return false;
+    uint8_t token = *input++;
+
+    size_t literal_count = token >> 4;
+    if (literal_count == kNibbleMax &&
+        !ReadLengthTail(&input, input_end, &literal_count)) {
+      return false;
+    }
+    if (static_cast<size_t>(input_end - input) < literal_count ||
+        static_cast<size_t>(output_end - output_next) < literal_count) {
+      return false;
+    }
+    if (literal_count != 0) {
+      std::memcpy(output_next, input, literal_count);
+      input += literal_count;
+      output_next += literal_count;
+    }
+
+    // The last token does not have a match.
+    if (input == input_end)
+      break;
+
+    if (input_end - input < 2)
+      return false;
+    size_t match_distance = static_cast<size_t>(input[0]) |
+                            (static_cast<size_t>(input[1]) << 8);
+    input += 2;
+    size_t match_size = (token & 0x0f) + kMinMatchSize;
+    if ((token & 0x0f) == kNibbleMax &&
+        !ReadLengthTail(&input, input_end, &match_size)) {
+      return false;
+    }
+    if (match_distance == 0 ||
+        match_distance > static_cast<size_t>(output_next - output) ||
+        static_cast<size_t>(output_end - output_next) < match_size) {
+      return false;
+    }
+
+    // Matches may overlap the bytes they produce, so memcpy() cannot be used.
+    const uint8_t* match = output_next - match_distance;
+    for (size_t i = 0; i < match_size; ++i)
+      output_next[i] = match[i];
+    output_next += match_size;
+  }
+
+  return output_next == output_end;
+}
+
+}  // namespace berrydb
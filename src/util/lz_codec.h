@@ -0,0 +1,55 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_LZ_CODEC_H_
+#define BERRYDB_UTIL_LZ_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace berrydb {
+
+/** Compresses a buffer using a fast LZ77 codec.
+ *
+ * The codec is tuned for speed rather than density, in the spirit of LZ4. It
+ * only looks for matches with a hash table, and does not use entropy coding,
+ * so decompression is mostly memcpy().
+ *
+ * The compressed format is a sequence of tokens. Each token starts with a byte
+ * whose high nibble is the number of literal bytes that follow, and whose low
+ * nibble is the length of the match that follows the literals, minus 4. Nibble
+ * values of 15 are continued by bytes that are added to the value; a byte of
+ * 255 means that another continuation byte follows. The continuation bytes for
+ * the literal count precede the literals. The literals are followed by the
+ * match's 2-byte little-endian distance, and then by the continuation bytes
+ * for the match length. The last token only has literals.
+ *
+ * @param  input           the data to be compressed
+ * @param  input_size      number of bytes in the input buffer
+ * @param  output          receives the compressed data
+ * @param  output_capacity number of bytes available in the output buffer
+ * @return                 the size of the compressed data, or 0 if the
+ *                         compressed data does not fit in the output buffer
+ */
+size_t LzCompress(const uint8_t* input, size_t input_size, uint8_t* output,
+                  size_t output_capacity) noexcept;
+
+/** Decompresses data produced by LzCompress().
+ *
+ * The decompressor is safe to use on untrusted input. It never reads or writes
+ * outside the buffers it is given.
+ *
+ * @param  input       the compressed data
+ * @param  input_size  number of bytes in the compressed data
+ * @param  output      receives the decompressed data
+ * @param  output_size the exact size of the decompressed data
+ * @return             false if the compressed data is invalid, or does not
+ *                     decompress to exactly output_size bytes
+ */
+bool LzDecompress(const uint8_t* input, size_t input_size, uint8_t* output,
+                  size_t output_size) noexcept;
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_LZ_CODEC_H_
@@ -0,0 +1,121 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./lz_codec.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+class LzCodecTest : public ::testing::Test {
+ protected:
+  /** Compresses and decompresses data, and checks that nothing changed.
+   *
+   * @return the size of the compressed data */
+  size_t RoundTrip(const std::vector<uint8_t>& data) {
+    // The codec's worst-case expansion is one token per 15 literal bytes.
+    std::vector<uint8_t> compressed(data.size() + data.size() / 15 + 16);
+    size_t compressed_size = LzCompress(
+        data.data(), data.size(), compressed.data(), compressed.size());
+    EXPECT_NE(0U, compressed_size);
+
+    std::vector<uint8_t> decompressed(data.size() + 1, 0xCD);
+    EXPECT_TRUE(LzDecompress(compressed.data(), compressed_size,
+                             decompressed.data(), data.size()));
+    // An empty vector's data() may be null, which memcmp() must not receive.
+    if (!data.empty()) {
+      EXPECT_EQ(0, std::memcmp(
+          data.data(), decompressed.data(), data.size()));
+    }
+    EXPECT_EQ(0xCD, decompressed[data.size()]);
+    return compressed_size;
+  }
+
+  std::vector<uint8_t> RandomData(size_t size) {
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    for (size_t i = 0; i < size; ++i)
+      data.push_back(static_cast<uint8_t>(rnd_()));
+    return data;
+  }
+
+  /** Text-like data, built from a small vocabulary of words. */
+  std::vector<uint8_t> WordData(size_t size) {
+    static const char* kWords[] = {
+      "berry ", "store ", "page ", "pool ", "transaction ", "catalog ",
+      "space ", "key ", "value ", "commit ",
+    };
+    std::string text;
+    while (text.size() < size)
+      text += kWords[rnd_() % (sizeof(kWords) / sizeof(kWords[0]))];
+    return std::vector<uint8_t>(text.begin(), text.begin() + size);
+  }
+
+  std::mt19937 rnd_;
+};
+
+TEST_F(LzCodecTest, EmptyAndTinyInputs) {
+  for (size_t size = 0; size < 10; ++size)
+    RoundTrip(RandomData(size));
+}
+
+TEST_F(LzCodecTest, CompressibleData) {
+  std::vector<uint8_t> zeros(32768, 0);
+  EXPECT_GT(256U, RoundTrip(zeros));
+
+  std::vector<uint8_t> words = WordData(32768);
+  EXPECT_GT(words.size() / 2, RoundTrip(words));
+
+  // Long literal runs and long matches use continuation bytes.
+  std::vector<uint8_t> mixed = RandomData(1000);
+  mixed.insert(mixed.end(), 1000, 42);
+  std::vector<uint8_t> tail = RandomData(600);
+  mixed.insert(mixed.end(), tail.begin(), tail.end());
+  mixed.insert(mixed.end(), tail.begin(), tail.end());
+  RoundTrip(mixed);
+}
+
+TEST_F(LzCodecTest, IncompressibleData) {
+  std::vector<uint8_t> data = RandomData(4096);
+  EXPECT_LE(data.size(), RoundTrip(data));
+
+  std::vector<uint8_t> compressed(data.size() - 1);
+  EXPECT_EQ(0U, LzCompress(data.data(), data.size(), compressed.data(),
+                           compressed.size()));
+}
+
+TEST_F(LzCodecTest, RejectsInvalidInput) {
+  std::vector<uint8_t> data = WordData(4096);
+  std::vector<uint8_t> compressed(data.size() * 2);
+  size_t compressed_size = LzCompress(
+      data.data(), data.size(), compressed.data(), compressed.size());
+  ASSERT_NE(0U, compressed_size);
+
+  std::vector<uint8_t> output(data.size());
+  EXPECT_FALSE(LzDecompress(compressed.data(), compressed_size, output.data(),
+                            data.size() - 1));
+  EXPECT_FALSE(LzDecompress(compressed.data(), compressed_size, output.data(),
+                            data.size() + 1));
+  EXPECT_FALSE(LzDecompress(compressed.data(), compressed_size - 1,
+                            output.data(), data.size()));
+
+  // A match that reaches before the start of the output.
+  uint8_t bad_distance[] = { 0x10, 'a', 0x02, 0x00 };
+  EXPECT_FALSE(LzDecompress(bad_distance, sizeof(bad_distance), output.data(),
+                            5));
+
+  // Random garbage must not cause out-of-bounds accesses. This is most useful
+  // when running under sanitizers.
+  for (size_t i = 0; i < 1000; ++i) {
+    std::vector<uint8_t> garbage = RandomData(1 + rnd_() % 64);
+    LzDecompress(garbage.data(), garbage.size(), output.data(), output.size());
+  }
+}
+
+}  // namespace berrydb
@@ -0,0 +1,82 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./thread_pool.h"
+
+#include <new>
+
+namespace berrydb {
+
+ThreadPool* ThreadPool::Create(size_t thread_count) {
+  DCHECK_GT(thread_count, 0U);
+
+  void* heap_block = Allocate(sizeof(ThreadPool));
+  ThreadPool* pool = new (heap_block) ThreadPool(thread_count);
+  DCHECK_EQ(heap_block, static_cast<void*>(pool));
+  return pool;
+}
+
+ThreadPool::ThreadPool(size_t thread_count)
+    : threads_(static_cast<std::thread*>(
+          Allocate(sizeof(std::thread) * thread_count))),
+      thread_count_(thread_count) {
+  for (size_t i = 0; i < thread_count_; ++i)
+    new (&threads_[i]) std::thread(&ThreadPool::RunWorker, this);
+}
+
+ThreadPool::~ThreadPool() {
+  DCHECK(queue_head_ == nullptr);
+
+  for (size_t i = 0; i < thread_count_; ++i)
+    threads_[i].~thread();
+  Deallocate(static_cast<void*>(threads_), sizeof(std::thread) * thread_count_);
+}
+
+void ThreadPool::Release() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  task_queued_.notify_all();
+  for (size_t i = 0; i < thread_count_; ++i)
+    threads_[i].join();
+
+  this->~ThreadPool();
+  void* heap_block = static_cast<void*>(this);
+  Deallocate(heap_block, sizeof(ThreadPool));
+}
+
+void ThreadPool::Submit(Task* task) {
+  DCHECK(task->run != nullptr);
+  task->next = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DCHECK(!stopping_);
+    if (queue_head_ == nullptr)
+      queue_head_ = task;
+    else
+      queue_tail_->next = task;
+    queue_tail_ = task;
+  }
+  task_queued_.notify_one();
+}
+
+void ThreadPool::RunWorker() {
+  while (true) {
+    Task* task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (queue_head_ == nullptr) {
+        if (stopping_)
+          return;
+        task_queued_.wait(lock);
+      }
+      task = queue_head_;
+      queue_head_ = task->next;
+    }
+    task->run(task);
+  }
+}
+
+}  // namespace berrydb
@@ -0,0 +1,80 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_THREAD_POOL_H_
+#define BERRYDB_UTIL_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "berrydb/platform.h"
+
+namespace berrydb {
+
+/** Fixed set of worker threads that run tasks in submission order.
+ *
+ * Tasks are embedded in the structures describing the work, so submitting a
+ * task does not allocate memory. A task is not touched by the pool after its
+ * run function is called, so the function may free the task's memory.
+ */
+class ThreadPool {
+ public:
+  /** Work item queued in a thread pool. */
+  struct Task {
+    /** Called on a worker thread to perform the task. */
+    void (*run)(Task* task);
+    /** The next task in the pool's queue. Managed by the pool. */
+    Task* next;
+  };
+
+  /** Starts a pool of worker threads.
+   *
+   * @param  thread_count must be positive
+   * @return              the new thread pool
+   */
+  static ThreadPool* Create(size_t thread_count);
+
+  /** Runs the queued tasks, stops the worker threads and frees the pool. */
+  void Release();
+
+  /** Queues a task to be run by one of the worker threads.
+   *
+   * The task's memory must stay valid until its run function is called. */
+  void Submit(Task* task);
+
+  /** Number of worker threads. */
+  inline size_t thread_count() const noexcept { return thread_count_; }
+
+ private:
+  /** Use ThreadPool::Create() to obtain ThreadPool instances. */
+  explicit ThreadPool(size_t thread_count);
+  /** Use Release() to delete ThreadPool instances. */
+  ~ThreadPool();
+
+  /** The loop executed by each worker thread. */
+  void RunWorker();
+
+  /** Guards the queue and stopping_. */
+  std::mutex mutex_;
+  /** Signaled when a task is queued, and when the pool is stopping. */
+  std::condition_variable task_queued_;
+
+  /** The oldest queued task. Null if the queue is empty. */
+  Task* queue_head_ = nullptr;
+  /** The newest queued task. Only meaningful if the queue is not empty. */
+  Task* queue_tail_ = nullptr;
+
+  /** Set by Release(). The workers exit once the queue is empty. */
+  bool stopping_ = false;
+
+  /** The worker threads. The array's memory comes from Allocate(). */
+  std::thread* threads_;
+  /** See thread_count(). */
+  const size_t thread_count_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_THREAD_POOL_H_
@@ -0,0 +1,54 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./thread_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+namespace {
+
+struct CountingTask {
+  ThreadPool::Task task;  // Must be the first member.
+  std::atomic<size_t>* counter;
+  std::thread::id thread_id;
+
+  static void Run(ThreadPool::Task* task) {
+    CountingTask* counting_task = reinterpret_cast<CountingTask*>(task);
+    counting_task->thread_id = std::this_thread::get_id();
+    counting_task->counter->fetch_add(1);
+  }
+};
+
+}  // namespace
+
+TEST(ThreadPoolTest, ReleaseRunsQueuedTasks) {
+  std::atomic<size_t> counter(0);
+  std::vector<CountingTask> tasks(100);
+
+  ThreadPool* pool = ThreadPool::Create(3);
+  EXPECT_EQ(3U, pool->thread_count());
+  for (CountingTask& task : tasks) {
+    task.task.run = &CountingTask::Run;
+    task.counter = &counter;
+    pool->Submit(&task.task);
+  }
+  pool->Release();
+
+  EXPECT_EQ(100U, counter.load());
+  for (CountingTask& task : tasks)
+    EXPECT_NE(std::this_thread::get_id(), task.thread_id);
+}
+
+TEST(ThreadPoolTest, ReleaseWithoutTasks) {
+  ThreadPool* pool = ThreadPool::Create(2);
+  pool->Release();
+}
+
+}  // namespace berrydb
@@ -0,0 +1,146 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_VERSION_LOCK_H_
+#define BERRYDB_UTIL_VERSION_LOCK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "berrydb/platform.h"
+
+namespace berrydb {
+
+/** Latch that supports optimistic lock coupling.
+ *
+ * Readers do not write to the latch. Instead, a reader records the latch's
+ * version before reading the protected data, and validates that the version
+ * did not change after reading the data. If the validation fails, the data may
+ * have been modified while it was being read, so the reader must discard
+ * everything it read and restart. Writers acquire the latch exclusively, and
+ * bump the version when they release it.
+ *
+ * Tree traversals take advantage of this by validating a parent node's version
+ * after reading the child pointer, and again after optimistically locking the
+ * child. Readers never write to shared cache lines, so the root node does not
+ * become a contention hotspot, and read throughput scales with the number of
+ * cores.
+ *
+ * The version word uses the following layout:
+ * bit 0 - obsolete; set when the protected data is deleted, never cleared
+ * bit 1 - locked; set while a writer holds the latch
+ * bits 2-63 - counter, incremented each time a writer releases the latch
+ *
+ * The data protected by the latch may change while readers access it. Readers
+ * must not act on the data (for example, follow pointers) before validating
+ * the version they read it under. Optimistic readers must read the protected
+ * data with acquire loads, and writers must update it with release stores, so
+ * the version checks cannot be reordered with the data accesses. The latch
+ * does not use standalone fences, which ThreadSanitizer does not support.
+ */
+class VersionLock {
+ public:
+  inline VersionLock() noexcept : version_(0) {}
+
+  VersionLock(const VersionLock& other) = delete;
+  VersionLock& operator=(const VersionLock& other) = delete;
+
+  /** Starts an optimistic read of the protected data.
+   *
+   * @param  version receives the version that must be passed to Validate()
+   *                 after the protected data is read
+   * @return         false if the data is locked by a writer or obsolete, in
+   *                 which case the reader should restart
+   */
+  inline bool ReadLock(uint64_t* version) const noexcept {
+    DCHECK(version != nullptr);
+    uint64_t current_version = version_.load(std::memory_order_acquire);
+    *version = current_version;
+    return (current_version & (kLockedBit | kObsoleteBit)) == 0;
+  }
+
+  /** Checks that the protected data did not change during a read.
+   *
+   * @param  version obtained by a successful ReadLock() call
+   * @return         true if the data read since ReadLock() is consistent
+   */
+  inline bool Validate(uint64_t version) const noexcept {
+    // The protected data's acquire loads keep this load after them.
+    return version_.load(std::memory_order_acquire) == version;
+  }
+
+  /** Converts an optimistic read into exclusive access.
+   *
+   * @param  version obtained by a successful ReadLock() call
+   * @return         false if the data changed since ReadLock(), in which case
+   *                 the caller does not own the latch, and should restart
+   */
+  inline bool TryUpgrade(uint64_t version) noexcept {
+    DCHECK_EQ(version & (kLockedBit | kObsoleteBit), 0U);
+    return version_.compare_exchange_strong(
+        version, version + kLockedBit, std::memory_order_acquire);
+  }
+
+  /** Acquires exclusive access to the protected data.
+   *
+   * Spins while another writer holds the latch.
+   *
+   * @return false if the data is obsolete, in which case the caller does not
+   *         own the latch
+   */
+  inline bool WriteLock() noexcept {
+    while (true) {
+      uint64_t version;
+      if (ReadLock(&version)) {
+        if (TryUpgrade(version))
+          return true;
+      } else if ((version & kObsoleteBit) != 0) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  /** Releases exclusive access, publishing the writer's changes. */
+  inline void WriteUnlock() noexcept {
+    DCHECK(IsWriteLocked());
+    // Adding the locked bit clears it, and carries into the counter.
+    version_.fetch_add(kLockedBit, std::memory_order_release);
+  }
+
+  /** Releases exclusive access, and marks the protected data as deleted.
+   *
+   * Readers and writers that reach the data afterwards will restart, and are
+   * expected to find a different path to the data they need. */
+  inline void WriteUnlockObsolete() noexcept {
+    DCHECK(IsWriteLocked());
+    version_.fetch_add(kLockedBit | kObsoleteBit, std::memory_order_release);
+  }
+
+  /** Bumps the version, invalidating all ongoing optimistic reads.
+   *
+   * This is equivalent to a WriteLock() / WriteUnlock() pair, and is intended
+   * for code that replaces the protected data while it is known to have no
+   * writers, such as a page pool evicting a page. */
+  inline void Invalidate() noexcept {
+    DCHECK(!IsWriteLocked());
+    version_.fetch_add(kLockedBit * 2, std::memory_order_release);
+  }
+
+  /** True if a writer currently holds the latch. Intended for DCHECKs. */
+  inline bool IsWriteLocked() const noexcept {
+    return (version_.load(std::memory_order_relaxed) & kLockedBit) != 0;
+  }
+
+ private:
+  static constexpr uint64_t kObsoleteBit = 1;
+  static constexpr uint64_t kLockedBit = 2;
+
+  std::atomic<uint64_t> version_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_VERSION_LOCK_H_
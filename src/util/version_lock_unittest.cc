@@ -0,0 +1,129 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./version_lock.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+TEST(VersionLockTest, ReadValidate) {
+  VersionLock lock;
+  uint64_t version;
+  ASSERT_TRUE(lock.ReadLock(&version));
+  EXPECT_TRUE(lock.Validate(version));
+  EXPECT_FALSE(lock.IsWriteLocked());
+
+  uint64_t version2;
+  ASSERT_TRUE(lock.ReadLock(&version2));
+  EXPECT_EQ(version, version2);
+}
+
+TEST(VersionLockTest, WriteInvalidatesReads) {
+  VersionLock lock;
+  uint64_t version;
+  ASSERT_TRUE(lock.ReadLock(&version));
+
+  ASSERT_TRUE(lock.WriteLock());
+  EXPECT_TRUE(lock.IsWriteLocked());
+  EXPECT_FALSE(lock.Validate(version));
+  uint64_t locked_version;
+  EXPECT_FALSE(lock.ReadLock(&locked_version));
+
+  lock.WriteUnlock();
+  EXPECT_FALSE(lock.IsWriteLocked());
+  EXPECT_FALSE(lock.Validate(version));
+  uint64_t new_version;
+  ASSERT_TRUE(lock.ReadLock(&new_version));
+  EXPECT_NE(version, new_version);
+  EXPECT_TRUE(lock.Validate(new_version));
+}
+
+TEST(VersionLockTest, TryUpgrade) {
+  VersionLock lock;
+  uint64_t version;
+  ASSERT_TRUE(lock.ReadLock(&version));
+  uint64_t version2;
+  ASSERT_TRUE(lock.ReadLock(&version2));
+
+  ASSERT_TRUE(lock.TryUpgrade(version));
+  EXPECT_TRUE(lock.IsWriteLocked());
+  lock.WriteUnlock();
+
+  // The second reader's version is stale, so it cannot upgrade.
+  EXPECT_FALSE(lock.TryUpgrade(version2));
+  EXPECT_FALSE(lock.IsWriteLocked());
+}
+
+TEST(VersionLockTest, Invalidate) {
+  VersionLock lock;
+  uint64_t version;
+  ASSERT_TRUE(lock.ReadLock(&version));
+  lock.Invalidate();
+  EXPECT_FALSE(lock.Validate(version));
+  EXPECT_FALSE(lock.IsWriteLocked());
+  ASSERT_TRUE(lock.ReadLock(&version));
+}
+
+TEST(VersionLockTest, Obsolete) {
+  VersionLock lock;
+  uint64_t version;
+  ASSERT_TRUE(lock.ReadLock(&version));
+  ASSERT_TRUE(lock.WriteLock());
+  lock.WriteUnlockObsolete();
+
+  EXPECT_FALSE(lock.Validate(version));
+  EXPECT_FALSE(lock.ReadLock(&version));
+  EXPECT_FALSE(lock.WriteLock());
+}
+
+TEST(VersionLockTest, ConcurrentReadersSeeConsistentData) {
+  // The writers keep the two counters equal. Readers that validate their reads
+  // must never see different values.
+  VersionLock lock;
+  std::atomic<uint64_t> counter1(0), counter2(0);
+  constexpr size_t kWriterIterations = 1000;
+  std::atomic<size_t> running_writers(2);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 2; ++i) {
+    threads.emplace_back([&]() {
+      for (size_t j = 0; j < kWriterIterations; ++j) {
+        ASSERT_TRUE(lock.WriteLock());
+        uint64_t value = counter1.load(std::memory_order_relaxed) + 1;
+        counter1.store(value, std::memory_order_release);
+        std::this_thread::yield();
+        counter2.store(value, std::memory_order_release);
+        lock.WriteUnlock();
+      }
+      --running_writers;
+    });
+  }
+  for (size_t i = 0; i < 4; ++i) {
+    threads.emplace_back([&]() {
+      while (running_writers.load() != 0) {
+        std::this_thread::yield();
+        uint64_t version;
+        if (!lock.ReadLock(&version))
+          continue;
+        uint64_t value1 = counter1.load(std::memory_order_acquire);
+        uint64_t value2 = counter2.load(std::memory_order_acquire);
+        if (!lock.Validate(version))
+          continue;
+        ASSERT_EQ(value1, value2);
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(2 * kWriterIterations, counter1.load());
+  EXPECT_EQ(2 * kWriterIterations, counter2.load());
+}
+
+}  // namespace berrydb
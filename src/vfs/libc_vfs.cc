@@ -13,10 +13,36 @@
 //               nearby future.
 
 #include <cstdio>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define BERRYDB_LIBC_VFS_HAVE_MMAP 1
+#define BERRYDB_LIBC_VFS_HAVE_PREAD 1
+#endif  // defined(__unix__) || defined(__APPLE__)
+
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+#include <condition_variable>
+#include <new>
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+
+// io_uring is driven through raw system calls, so liburing is not needed.
+#if defined(BERRYDB_PLATFORM_USE_IO_URING) && defined(__linux__) && \
+    defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+#define BERRYDB_LIBC_VFS_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <cstring>
+#endif  // defined(BERRYDB_PLATFORM_USE_IO_URING) && defined(__linux__) &&
+        // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
 
 #include "berrydb/platform.h"
 #include "berrydb/status.h"
 #include "../util/platform_allocator.h"
+#include "../util/thread_pool.h"
 
 namespace berrydb {
 
@@ -108,6 +134,216 @@ Status SyncLibcFile(std::FILE* fp) {
   return (std::fflush(fp) == 0) ? Status::kSuccess : Status::kIoError;
 }
 
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+
+/** Number of threads that perform the asynchronous I/O of all libc files. */
+constexpr size_t kAsyncIoThreadCount = 4;
+
+/** The threads that perform the asynchronous I/O of all libc files.
+ *
+ * The threads are started when they are first needed, and are never stopped, so
+ * files can be used until the process exits. */
+ThreadPool* AsyncIoThreadPool() {
+  static ThreadPool* thread_pool = ThreadPool::Create(kAsyncIoThreadCount);
+  return thread_pool;
+}
+
+// Block files use positional reads and writes, so concurrent operations do not
+// race on the FILE's position. This is consistent with the FILE-based I/O
+// because block files are not buffered.
+
+Status PreadLibcFile(
+    std::FILE* fp, size_t offset, size_t byte_count, uint8_t* buffer) {
+  int fd = fileno(fp);
+  while (byte_count != 0) {
+    ssize_t result = pread(fd, buffer, byte_count, static_cast<off_t>(offset));
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return Status::kIoError;
+    buffer += result;
+    offset += result;
+    byte_count -= result;
+  }
+  return Status::kSuccess;
+}
+
+Status PwriteLibcFile(
+    std::FILE* fp, const uint8_t* buffer, size_t offset, size_t byte_count) {
+  int fd = fileno(fp);
+  while (byte_count != 0) {
+    ssize_t result = pwrite(
+        fd, buffer, byte_count, static_cast<off_t>(offset));
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return Status::kIoError;
+    buffer += result;
+    offset += result;
+    byte_count -= result;
+  }
+  return Status::kSuccess;
+}
+
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+
+#if defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+
+/** Number of operations that a file's io_uring can have in flight. */
+constexpr unsigned kIoUringEntryCount = 64;
+
+/** A Linux io_uring instance, driven through raw system calls.
+ *
+ * This only implements what LibcBlockAccessFile needs. The ring is not
+ * thread-safe, except for WaitForCompletion(), which can run concurrently with
+ * Submit(). */
+class IoUring {
+ public:
+  IoUring() = default;
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sq_ring_ != nullptr)
+      munmap(sq_ring_, sq_ring_size_);
+    if (cq_ring_ != nullptr)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sqes_ != nullptr)
+      munmap(sqes_, sqes_size_);
+    if (ring_fd_ >= 0)
+      close(ring_fd_);
+  }
+
+  /** Sets up the ring.
+   *
+   * @param  entry_count the desired capacity()
+   * @return             false if the kernel does not support io_uring, or
+   *                     predates IORING_OP_READ and IORING_OP_WRITE */
+  bool Initialize(unsigned entry_count) {
+    DCHECK_EQ(ring_fd_, -1);
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int ring_fd = static_cast<int>(
+        syscall(__NR_io_uring_setup, entry_count, &params));
+    if (ring_fd < 0)
+      return false;
+    ring_fd_ = ring_fd;
+    // IORING_OP_READ and IORING_OP_WRITE shipped in the same kernel release as
+    // this feature flag.
+    if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+      return false;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    sq_ring_ = MapRing(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    cq_ring_ = MapRing(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = MapRing(sqes_size_, IORING_OFF_SQES);
+    if (sq_ring_ == nullptr || cq_ring_ == nullptr || sqes_ == nullptr)
+      return false;
+
+    uint8_t* sq_ring = static_cast<uint8_t*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+    uint8_t* cq_ring = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+    // The completion queue is at least as large as the submission queue, so
+    // it cannot overflow while callers stay within the capacity.
+    capacity_ = params.sq_entries;
+    return true;
+  }
+
+  /** Number of operations that can be in flight. */
+  inline size_t capacity() const noexcept { return capacity_; }
+
+  /** Hands an operation to the kernel.
+   *
+   * The caller must keep fewer than capacity() operations in flight.
+   *
+   * @param  sqe the operation's submission queue entry
+   * @return     false if the kernel did not accept the operation */
+  bool Submit(const io_uring_sqe& sqe) {
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    static_cast<io_uring_sqe*>(sqes_)[index] = sqe;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    while (true) {
+      long result = syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0);
+      if (result == 1)
+        return true;
+      if (result < 0 && errno == EINTR)
+        continue;
+      // The entry must not be submitted by a later call.
+      if (__atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == tail)
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return false;
+    }
+  }
+
+  /** Blocks until the kernel posts at least one completion. */
+  void WaitForCompletion() {
+    while (syscall(__NR_io_uring_enter, ring_fd_, 0, 1,
+                   IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno == EINTR) {
+    }
+  }
+
+  /** Removes the oldest posted completion from the ring.
+   *
+   * @param  user_data populated with the operation's user_data
+   * @param  result    populated with the operation's result, which follows the
+   *                   conventions of the matching system call
+   * @return           false if no completion was posted */
+  bool PopCompletion(uint64_t* user_data, int32_t* result) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+      return false;
+
+    const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+    *user_data = cqe.user_data;
+    *result = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  void* MapRing(size_t size, uint64_t offset) {
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd_,
+                         static_cast<off_t>(offset));
+    return (mapping == MAP_FAILED) ? nullptr : mapping;
+  }
+
+  int ring_fd_ = -1;
+  size_t capacity_ = 0;
+
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  void* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+};
+
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+
 }  // anonymous namespace
 
 class LibcBlockAccessFile : public BlockAccessFile {
@@ -133,7 +369,12 @@ class LibcBlockAccessFile : public BlockAccessFile {
     DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
 #endif  // DCHECK_IS_ON()
 
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+    return PreadLibcFile(fp_, offset, byte_count, buffer);
+#else  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+    std::lock_guard<std::mutex> lock(position_mutex_);
     return ReadLibcFile(fp_, offset, byte_count, buffer);
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
   }
 
   Status Write(uint8_t* buffer, size_t offset, size_t byte_count) override {
@@ -142,7 +383,12 @@ class LibcBlockAccessFile : public BlockAccessFile {
     DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
 #endif  // DCHECK_IS_ON()
 
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+    return PwriteLibcFile(fp_, buffer, offset, byte_count);
+#else  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+    std::lock_guard<std::mutex> lock(position_mutex_);
     return WriteLibcFile(fp_, buffer, offset, byte_count);
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
   }
 
   Status Sync() override { return SyncLibcFile(fp_); }
@@ -154,6 +400,99 @@ class LibcBlockAccessFile : public BlockAccessFile {
     return Status::kSuccess;
   }
 
+  const uint8_t* MapForReading(size_t byte_count) override {
+    DCHECK(byte_count > 0);
+#if DCHECK_IS_ON()
+    DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
+#endif  // DCHECK_IS_ON()
+    DCHECK(mapping_ == nullptr);
+
+#if defined(BERRYDB_LIBC_VFS_HAVE_MMAP)
+    // The file is unbuffered, so writes reach the OS page cache right away. A
+    // shared mapping observes them.
+    void* mapping = mmap(nullptr, byte_count, PROT_READ, MAP_SHARED,
+                         fileno(fp_), 0);
+    if (mapping == MAP_FAILED)
+      return nullptr;
+    mapping_ = static_cast<const uint8_t*>(mapping);
+    mapping_size_ = byte_count;
+    return mapping_;
+#else  // defined(BERRYDB_LIBC_VFS_HAVE_MMAP)
+    UNUSED(byte_count);
+    return nullptr;
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_MMAP)
+  }
+
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+  void SubmitRead(size_t offset, size_t byte_count, uint8_t* buffer,
+                  BlockIoRequest* request) override {
+#if DCHECK_IS_ON()
+    DCHECK_EQ(offset & (block_size_ - 1), 0U);
+    DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
+#endif  // DCHECK_IS_ON()
+
+    request->type = BlockIoRequest::Type::kRead;
+    request->buffer = buffer;
+    request->offset = offset;
+    request->byte_count = byte_count;
+    StartAsyncIo(request);
+  }
+
+  void SubmitWrite(uint8_t* buffer, size_t offset, size_t byte_count,
+                   BlockIoRequest* request) override {
+#if DCHECK_IS_ON()
+    DCHECK_EQ(offset & (block_size_ - 1), 0U);
+    DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
+#endif  // DCHECK_IS_ON()
+
+    request->type = BlockIoRequest::Type::kWrite;
+    request->buffer = buffer;
+    request->offset = offset;
+    request->byte_count = byte_count;
+    StartAsyncIo(request);
+  }
+
+  void SubmitSync(BlockIoRequest* request) override {
+    request->type = BlockIoRequest::Type::kSync;
+    request->buffer = nullptr;
+    request->offset = 0;
+    request->byte_count = 0;
+    StartAsyncIo(request);
+  }
+
+  size_t PollCompletions(
+      BlockIoRequest** completed, size_t max_count, bool wait) override {
+    DCHECK_GT(max_count, 0U);
+
+    std::unique_lock<std::mutex> lock(async_mutex_);
+#if defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+    if (io_uring_state_ == IoUringState::kReady) {
+      ReapIoUring();
+      if (wait) {
+        while (completed_head_ == nullptr && in_flight_count_ != 0)
+          WaitForIoUring(&lock);
+      }
+    } else if (wait) {
+      while (completed_head_ == nullptr && in_flight_count_ != 0)
+        async_completed_.wait(lock);
+    }
+#else  // defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+    if (wait) {
+      while (completed_head_ == nullptr && in_flight_count_ != 0)
+        async_completed_.wait(lock);
+    }
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+
+    size_t count = 0;
+    while (count < max_count && completed_head_ != nullptr) {
+      completed[count] = completed_head_;
+      completed_head_ = completed_head_->next;
+      ++count;
+    }
+    return count;
+  }
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+
   Status Close() override {
     void* heap_block = reinterpret_cast<void*>(this);
     this->~LibcBlockAccessFile();
@@ -163,12 +502,222 @@ class LibcBlockAccessFile : public BlockAccessFile {
 
  protected:
   ~LibcBlockAccessFile() {
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+    DCHECK_EQ(in_flight_count_, 0U);
+    DCHECK(completed_head_ == nullptr);
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+#if defined(BERRYDB_LIBC_VFS_HAVE_MMAP)
+    if (mapping_ != nullptr)
+      munmap(const_cast<uint8_t*>(mapping_), mapping_size_);
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_MMAP)
     std::fclose(fp_);
   }
 
  private:
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+  /** An asynchronous I/O operation queued in AsyncIoThreadPool(). */
+  struct AsyncIoTask {
+    ThreadPool::Task task;  // Must be the first member.
+    LibcBlockAccessFile* file;
+    BlockIoRequest* request;
+  };
+
+  /** Starts a submitted request's operation.
+   *
+   * The operation goes to the file's io_uring when the build and the kernel
+   * support it, and is queued in AsyncIoThreadPool() otherwise. */
+  void StartAsyncIo(BlockIoRequest* request) {
+    {
+      std::unique_lock<std::mutex> lock(async_mutex_);
+#if defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+      if (io_uring_state_ == IoUringState::kUnknown) {
+        io_uring_state_ = io_uring_.Initialize(kIoUringEntryCount) ?
+            IoUringState::kReady : IoUringState::kUnavailable;
+      }
+      if (io_uring_state_ == IoUringState::kReady) {
+        StartIoUring(request, &lock);
+        return;
+      }
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+      ++in_flight_count_;
+    }
+
+    void* heap_block = Allocate(sizeof(AsyncIoTask));
+    AsyncIoTask* async_task = new (heap_block) AsyncIoTask();
+    async_task->task.run = &LibcBlockAccessFile::RunAsyncIo;
+    async_task->file = this;
+    async_task->request = request;
+    AsyncIoThreadPool()->Submit(&async_task->task);
+  }
+
+  /** Performs an asynchronous I/O operation, on a thread pool thread. */
+  static void RunAsyncIo(ThreadPool::Task* task) {
+    AsyncIoTask* async_task = reinterpret_cast<AsyncIoTask*>(task);
+    DCHECK_EQ(task, &async_task->task);
+    LibcBlockAccessFile* file = async_task->file;
+    BlockIoRequest* request = async_task->request;
+    Deallocate(async_task, sizeof(AsyncIoTask));
+
+    switch (request->type) {
+      case BlockIoRequest::Type::kRead:
+        request->status = PreadLibcFile(
+            file->fp_, request->offset, request->byte_count, request->buffer);
+        break;
+      case BlockIoRequest::Type::kWrite:
+        request->status = PwriteLibcFile(
+            file->fp_, request->buffer, request->offset, request->byte_count);
+        break;
+      case BlockIoRequest::Type::kSync:
+        request->status = SyncLibcFile(file->fp_);
+        break;
+    }
+
+    // The file may be closed as soon as the lock is released, so the condition
+    // variable is signaled while the lock is held.
+    std::lock_guard<std::mutex> lock(file->async_mutex_);
+    file->CompleteAsyncIo(request);
+  }
+
+  /** Moves an in-flight request to the completed list.
+   *
+   * The caller must hold async_mutex_. */
+  void CompleteAsyncIo(BlockIoRequest* request) {
+    DCHECK_NE(in_flight_count_, 0U);
+    request->next = nullptr;
+    if (completed_head_ == nullptr)
+      completed_head_ = request;
+    else
+      completed_tail_->next = request;
+    completed_tail_ = request;
+    --in_flight_count_;
+    async_completed_.notify_all();
+  }
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+
+#if defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+  /** Hands a submitted request's operation to the file's io_uring.
+   *
+   * @param lock holds async_mutex_; may be released while waiting for room in
+   *             the ring */
+  void StartIoUring(BlockIoRequest* request,
+                    std::unique_lock<std::mutex>* lock) {
+    DCHECK_LE(request->byte_count, static_cast<size_t>(0xFFFFFFFFU));
+
+    while (in_flight_count_ >= io_uring_.capacity())
+      WaitForIoUring(lock);
+    ++in_flight_count_;
+
+    io_uring_sqe sqe;
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.fd = fileno(fp_);
+    sqe.user_data = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(request));
+    switch (request->type) {
+      case BlockIoRequest::Type::kRead:
+        sqe.opcode = IORING_OP_READ;
+        break;
+      case BlockIoRequest::Type::kWrite:
+        sqe.opcode = IORING_OP_WRITE;
+        break;
+      case BlockIoRequest::Type::kSync:
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+    }
+    if (request->type != BlockIoRequest::Type::kSync) {
+      sqe.off = static_cast<uint64_t>(request->offset);
+      sqe.addr = static_cast<uint64_t>(
+          reinterpret_cast<uintptr_t>(request->buffer));
+      sqe.len = static_cast<uint32_t>(request->byte_count);
+    }
+
+    if (!io_uring_.Submit(sqe)) {
+      request->status = Status::kIoError;
+      CompleteAsyncIo(request);
+    }
+  }
+
+  /** Moves the operations completed by the io_uring to the completed list.
+   *
+   * The caller must hold async_mutex_. While a thread waits for the kernel in
+   * WaitForIoUring(), the completions are left for that thread, so its wait
+   * cannot miss the completion it is waiting for. */
+  void ReapIoUring() {
+    if (io_uring_waiting_)
+      return;
+
+    uint64_t user_data;
+    int32_t result;
+    while (io_uring_.PopCompletion(&user_data, &result)) {
+      BlockIoRequest* request = reinterpret_cast<BlockIoRequest*>(
+          static_cast<uintptr_t>(user_data));
+      // Block files do not see short reads or writes, except past the end of
+      // the file, which is an error, like in PreadLibcFile().
+      size_t expected_result = (request->type == BlockIoRequest::Type::kSync) ?
+          0 : request->byte_count;
+      request->status = (result >= 0 &&
+                         static_cast<size_t>(result) == expected_result) ?
+          Status::kSuccess : Status::kIoError;
+      CompleteAsyncIo(request);
+    }
+  }
+
+  /** Waits until the io_uring completes an operation.
+   *
+   * Only one thread waits for the kernel at a time. Other threads wait for it
+   * to move the completions to the completed list.
+   *
+   * @param lock holds async_mutex_; released while waiting */
+  void WaitForIoUring(std::unique_lock<std::mutex>* lock) {
+    if (io_uring_waiting_) {
+      async_completed_.wait(*lock);
+      return;
+    }
+
+    io_uring_waiting_ = true;
+    lock->unlock();
+    io_uring_.WaitForCompletion();
+    lock->lock();
+    io_uring_waiting_ = false;
+    ReapIoUring();
+    // Threads waiting for this thread must re-check their conditions, even if
+    // no operation completed.
+    async_completed_.notify_all();
+  }
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+
   std::FILE* fp_;
 
+  /** The mapping created by MapForReading(), or nullptr. */
+  const uint8_t* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+
+#if !defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+  /** Serializes Read() and Write(), which move the FILE's position. */
+  std::mutex position_mutex_;
+#endif  // !defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+
+#if defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+  /** Guards the asynchronous I/O state below. */
+  std::mutex async_mutex_;
+  /** Signaled when an asynchronous I/O operation completes. */
+  std::condition_variable async_completed_;
+  /** Requests whose operations completed, and were not yet polled. */
+  BlockIoRequest* completed_head_ = nullptr;
+  BlockIoRequest* completed_tail_ = nullptr;
+  /** Number of submitted operations that did not complete yet. */
+  size_t in_flight_count_ = 0;
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_PREAD)
+
+#if defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+  /** Whether asynchronous operations go to the file's io_uring. */
+  enum class IoUringState { kUnknown, kReady, kUnavailable };
+  IoUringState io_uring_state_ = IoUringState::kUnknown;
+  /** Set up when the first asynchronous operation is submitted. */
+  IoUring io_uring_;
+  /** True while a thread waits for the kernel in WaitForIoUring(). */
+  bool io_uring_waiting_ = false;
+#endif  // defined(BERRYDB_LIBC_VFS_HAVE_IO_URING)
+
 #if DCHECK_IS_ON()
   size_t block_size_;
 #endif  // DCHECK_IS_ON()
@@ -0,0 +1,632 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./memory_vfs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include "berrydb/status.h"
+
+namespace berrydb {
+
+constexpr size_t MemoryVfs::kBlockShift;
+
+namespace {
+
+constexpr size_t kBlockSize = static_cast<size_t>(1) << MemoryVfs::kBlockShift;
+
+}  // anonymous namespace
+
+/** The data of a file stored by MemoryVfs.
+ *
+ * A file outlives its entry in the VFS, if it is deleted while it is open.
+ */
+class MemoryFile {
+ public:
+  static MemoryFile* Create(MemoryVfs* vfs) {
+    void* heap_block = Allocate(sizeof(MemoryFile));
+    MemoryFile* file = new (heap_block) MemoryFile(vfs);
+    DCHECK_EQ(heap_block, static_cast<void*>(file));
+    return file;
+  }
+
+  void Release() {
+    DCHECK_EQ(open_count_, 0U);
+    this->~MemoryFile();
+    Deallocate(this, sizeof(MemoryFile));
+  }
+
+  inline MemoryVfs* vfs() const noexcept { return vfs_; }
+  inline size_t size() const noexcept { return size_; }
+  inline size_t open_count() const noexcept { return open_count_; }
+  inline bool is_deleted() const noexcept { return is_deleted_; }
+  inline bool is_locked() const noexcept { return is_locked_; }
+
+  inline void AddHandle() noexcept { ++open_count_; }
+  inline void RemoveHandle() noexcept {
+    DCHECK(open_count_ != 0);
+    --open_count_;
+  }
+  inline void MarkDeleted() noexcept { is_deleted_ = true; }
+  inline void SetLocked(bool is_locked) noexcept { is_locked_ = is_locked; }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) {
+    if (offset + byte_count > size_ || offset + byte_count < offset)
+      return Status::kIoError;
+
+    while (byte_count != 0) {
+      size_t block_offset = offset & (kBlockSize - 1);
+      size_t chunk_size = kBlockSize - block_offset;
+      if (chunk_size > byte_count)
+        chunk_size = byte_count;
+
+      const auto& it = blocks_.find(offset >> MemoryVfs::kBlockShift);
+      if (it == blocks_.end())
+        std::memset(buffer, 0, chunk_size);
+      else
+        std::memcpy(buffer, it->second + block_offset, chunk_size);
+
+      offset += chunk_size;
+      buffer += chunk_size;
+      byte_count -= chunk_size;
+    }
+    return Status::kSuccess;
+  }
+
+  Status Write(const uint8_t* buffer, size_t offset, size_t byte_count) {
+    if (offset + byte_count < offset)
+      return Status::kIoError;
+
+    if (!has_unsynced_writes_) {
+      has_unsynced_writes_ = true;
+      synced_size_ = size_;
+    }
+    if (offset + byte_count > size_)
+      size_ = offset + byte_count;
+
+    while (byte_count != 0) {
+      size_t block_index = offset >> MemoryVfs::kBlockShift;
+      size_t block_offset = offset & (kBlockSize - 1);
+      size_t chunk_size = kBlockSize - block_offset;
+      if (chunk_size > byte_count)
+        chunk_size = byte_count;
+
+      uint8_t* block = MutableBlock(block_index);
+      std::memcpy(block + block_offset, buffer, chunk_size);
+
+      offset += chunk_size;
+      buffer += chunk_size;
+      byte_count -= chunk_size;
+    }
+    return Status::kSuccess;
+  }
+
+  /** Makes all the data written to the file durable. */
+  void Sync() {
+    for (const auto& it : synced_blocks_) {
+      if (it.second != nullptr)
+        vfs_->ReleaseBlock(it.second);
+    }
+    synced_blocks_.clear();
+    has_unsynced_writes_ = false;
+  }
+
+  /** Drops the data that was written after the last Sync(). */
+  void RollBackToSync() {
+    for (const auto& it : synced_blocks_) {
+      const auto& block_it = blocks_.find(it.first);
+      DCHECK(block_it != blocks_.end());
+      vfs_->ReleaseBlock(block_it->second);
+      if (it.second == nullptr)
+        blocks_.erase(block_it);
+      else
+        block_it->second = it.second;
+    }
+    synced_blocks_.clear();
+    if (has_unsynced_writes_) {
+      size_ = synced_size_;
+      has_unsynced_writes_ = false;
+    }
+  }
+
+ private:
+  MemoryFile(MemoryVfs* vfs) : vfs_(vfs) { }
+
+  ~MemoryFile() {
+    RollBackToSync();
+    for (const auto& it : blocks_)
+      vfs_->ReleaseBlock(it.second);
+  }
+
+  /** Returns a block that can be written, allocating it if necessary.
+   *
+   * The block's synced content is saved before it is first modified. */
+  uint8_t* MutableBlock(size_t block_index) {
+    const auto& it = blocks_.find(block_index);
+    if (it == blocks_.end()) {
+      uint8_t* block = vfs_->AllocateBlock();
+      blocks_[block_index] = block;
+      // The block did not exist when the file was last synced.
+      if (synced_blocks_.count(block_index) == 0)
+        synced_blocks_[block_index] = nullptr;
+      return block;
+    }
+
+    if (synced_blocks_.count(block_index) == 0) {
+      uint8_t* synced_block = vfs_->AllocateBlock();
+      std::memcpy(synced_block, it->second, kBlockSize);
+      synced_blocks_[block_index] = synced_block;
+    }
+    return it->second;
+  }
+
+  using BlockMap = std::unordered_map<size_t, uint8_t*, SizeHasher,
+      std::equal_to<size_t>,
+      PlatformAllocator<std::pair<const size_t, uint8_t*>>>;
+
+  MemoryVfs* const vfs_;
+
+  /** The file's current data. */
+  BlockMap blocks_;
+
+  /** The synced content of the blocks modified after the last sync.
+   *
+   * nullptr values indicate blocks that did not exist at the last sync. */
+  BlockMap synced_blocks_;
+
+  size_t size_ = 0;
+  /** The file size at the last sync. Only valid if has_unsynced_writes_. */
+  size_t synced_size_ = 0;
+  bool has_unsynced_writes_ = false;
+
+  size_t open_count_ = 0;
+  bool is_deleted_ = false;
+  bool is_locked_ = false;
+};
+
+namespace {
+
+/** State shared by the two file handle implementations.
+ *
+ * The handle's methods take the VFS mutex while they use the file. Handles are
+ * created while the VFS mutex is held. */
+class MemoryFileHandle {
+ public:
+  MemoryFileHandle(MemoryFile* file)
+      : file_(file), crash_count_(file->vfs()->crash_count()) { }
+
+  /** False if the VFS simulated a crash after the file was opened.
+   *
+   * The caller must hold the VFS mutex. */
+  inline bool IsUsable() const noexcept {
+    return crash_count_ == file_->vfs()->crash_count();
+  }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) {
+    file_->vfs()->SimulateIoCost(byte_count);
+    std::lock_guard<std::mutex> lock(file_->vfs()->mutex());
+    if (!IsUsable())
+      return Status::kIoError;
+    return file_->Read(offset, byte_count, buffer);
+  }
+
+  Status Write(const uint8_t* buffer, size_t offset, size_t byte_count) {
+    file_->vfs()->SimulateIoCost(byte_count);
+    std::lock_guard<std::mutex> lock(file_->vfs()->mutex());
+    if (!IsUsable())
+      return Status::kIoError;
+    return file_->Write(buffer, offset, byte_count);
+  }
+
+  Status Sync() {
+    file_->vfs()->SimulateIoCost(0);
+    std::lock_guard<std::mutex> lock(file_->vfs()->mutex());
+    if (!IsUsable())
+      return Status::kIoError;
+    file_->Sync();
+    return Status::kSuccess;
+  }
+
+  Status Flush() {
+    std::lock_guard<std::mutex> lock(file_->vfs()->mutex());
+    // Writes are not buffered.
+    return IsUsable() ? Status::kSuccess : Status::kIoError;
+  }
+
+  /** Performs an asynchronous operation, without simulating its cost.
+   *
+   * @param  request         the operation to be performed
+   * @param  completion_time populated with the time when the operation's
+   *                         simulated cost elapses
+   * @return                 the operation's status */
+  Status PerformWithoutCost(
+      const BlockIoRequest& request,
+      std::chrono::steady_clock::time_point* completion_time) {
+    std::lock_guard<std::mutex> lock(file_->vfs()->mutex());
+    *completion_time =
+        file_->vfs()->SimulatedIoCompletionTime(request.byte_count);
+    if (!IsUsable())
+      return Status::kIoError;
+    switch (request.type) {
+      case BlockIoRequest::Type::kRead:
+        return file_->Read(request.offset, request.byte_count, request.buffer);
+      case BlockIoRequest::Type::kWrite:
+        return file_->Write(request.buffer, request.offset, request.byte_count);
+      case BlockIoRequest::Type::kSync:
+        break;
+    }
+    DCHECK(request.type == BlockIoRequest::Type::kSync);
+    file_->Sync();
+    return Status::kSuccess;
+  }
+
+  Status Lock() {
+    std::lock_guard<std::mutex> lock(file_->vfs()->mutex());
+    if (!IsUsable())
+      return Status::kIoError;
+    if (holds_lock_)
+      return Status::kSuccess;
+    if (file_->is_locked())
+      return Status::kAlreadyLocked;
+    file_->SetLocked(true);
+    holds_lock_ = true;
+    return Status::kSuccess;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(file_->vfs()->mutex());
+    if (holds_lock_)
+      file_->SetLocked(false);
+    file_->vfs()->FileClosed(file_);
+  }
+
+ private:
+  MemoryFile* const file_;
+  const size_t crash_count_;
+  bool holds_lock_ = false;
+};
+
+class MemoryBlockAccessFile : public BlockAccessFile {
+ public:
+  MemoryBlockAccessFile(MemoryFile* file, size_t block_shift)
+      : handle_(file)
+#if DCHECK_IS_ON()
+      , block_size_(static_cast<size_t>(1) << block_shift)
+#endif  // DCHECK_IS_ON()
+      {
+    UNUSED(block_shift);
+  }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) override {
+#if DCHECK_IS_ON()
+    DCHECK_EQ(offset & (block_size_ - 1), 0U);
+    DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
+#endif  // DCHECK_IS_ON()
+
+    return handle_.Read(offset, byte_count, buffer);
+  }
+
+  Status Write(uint8_t* buffer, size_t offset, size_t byte_count) override {
+#if DCHECK_IS_ON()
+    DCHECK_EQ(offset & (block_size_ - 1), 0U);
+    DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
+#endif  // DCHECK_IS_ON()
+
+    return handle_.Write(buffer, offset, byte_count);
+  }
+
+  Status Sync() override { return handle_.Sync(); }
+  Status Lock() override { return handle_.Lock(); }
+
+  void SubmitRead(size_t offset, size_t byte_count, uint8_t* buffer,
+                  BlockIoRequest* request) override {
+#if DCHECK_IS_ON()
+    DCHECK_EQ(offset & (block_size_ - 1), 0U);
+    DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
+#endif  // DCHECK_IS_ON()
+
+    request->type = BlockIoRequest::Type::kRead;
+    request->buffer = buffer;
+    request->offset = offset;
+    request->byte_count = byte_count;
+    StartAsyncIo(request);
+  }
+
+  void SubmitWrite(uint8_t* buffer, size_t offset, size_t byte_count,
+                   BlockIoRequest* request) override {
+#if DCHECK_IS_ON()
+    DCHECK_EQ(offset & (block_size_ - 1), 0U);
+    DCHECK_EQ(byte_count & (block_size_ - 1), 0U);
+#endif  // DCHECK_IS_ON()
+
+    request->type = BlockIoRequest::Type::kWrite;
+    request->buffer = buffer;
+    request->offset = offset;
+    request->byte_count = byte_count;
+    StartAsyncIo(request);
+  }
+
+  void SubmitSync(BlockIoRequest* request) override {
+    request->type = BlockIoRequest::Type::kSync;
+    request->buffer = nullptr;
+    request->offset = 0;
+    request->byte_count = 0;
+    StartAsyncIo(request);
+  }
+
+  size_t PollCompletions(
+      BlockIoRequest** completed, size_t max_count, bool wait) override {
+    DCHECK_GT(max_count, 0U);
+
+    std::unique_lock<std::mutex> lock(in_flight_mutex_);
+    if (in_flight_.empty())
+      return 0;
+    if (wait) {
+      // Only this method removes requests, so the front request stays in
+      // flight while the lock is released.
+      std::chrono::steady_clock::time_point completion_time =
+          in_flight_.front().first;
+      lock.unlock();
+      std::this_thread::sleep_until(completion_time);
+      lock.lock();
+    }
+
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    size_t count = 0;
+    while (count < max_count && !in_flight_.empty() &&
+           in_flight_.front().first <= now) {
+      completed[count] = in_flight_.front().second;
+      in_flight_.pop_front();
+      ++count;
+    }
+    return count;
+  }
+
+  Status Close() override {
+#if DCHECK_IS_ON()
+    {
+      std::lock_guard<std::mutex> lock(in_flight_mutex_);
+      DCHECK(in_flight_.empty());
+    }
+#endif  // DCHECK_IS_ON()
+    handle_.Close();
+    void* heap_block = reinterpret_cast<void*>(this);
+    this->~MemoryBlockAccessFile();
+    Deallocate(heap_block, sizeof(MemoryBlockAccessFile));
+    return Status::kSuccess;
+  }
+
+ protected:
+  ~MemoryBlockAccessFile() = default;
+
+ private:
+  /** Performs a submitted request's operation right away.
+   *
+   * The request is reported as completed once its simulated cost elapses. */
+  void StartAsyncIo(BlockIoRequest* request) {
+    std::chrono::steady_clock::time_point completion_time;
+    request->status = handle_.PerformWithoutCost(*request, &completion_time);
+    std::lock_guard<std::mutex> lock(in_flight_mutex_);
+    in_flight_.emplace_back(completion_time, request);
+  }
+
+  MemoryFileHandle handle_;
+
+  /** Guards in_flight_, so operations can be submitted while a thread polls. */
+  std::mutex in_flight_mutex_;
+
+  /** Requests whose simulated cost has not elapsed, by completion time.
+   *
+   * The simulated completion times grow with submission order, as long as the
+   * simulated I/O cost does not change. */
+  std::deque<
+      std::pair<std::chrono::steady_clock::time_point, BlockIoRequest*>,
+      PlatformAllocator<std::pair<std::chrono::steady_clock::time_point,
+                                  BlockIoRequest*>>> in_flight_;
+
+#if DCHECK_IS_ON()
+  size_t block_size_;
+#endif  // DCHECK_IS_ON()
+};
+
+class MemoryRandomAccessFile : public RandomAccessFile {
+ public:
+  MemoryRandomAccessFile(MemoryFile* file) : handle_(file) { }
+
+  Status Read(size_t offset, size_t byte_count, uint8_t* buffer) override {
+    return handle_.Read(offset, byte_count, buffer);
+  }
+
+  Status Write(
+      const uint8_t* buffer, size_t offset, size_t byte_count) override {
+    return handle_.Write(buffer, offset, byte_count);
+  }
+
+  Status Flush() override { return handle_.Flush(); }
+
+  Status Sync() override { return handle_.Sync(); }
+
+  Status Close() override {
+    handle_.Close();
+    void* heap_block = reinterpret_cast<void*>(this);
+    this->~MemoryRandomAccessFile();
+    Deallocate(heap_block, sizeof(MemoryRandomAccessFile));
+    return Status::kSuccess;
+  }
+
+ protected:
+  ~MemoryRandomAccessFile() = default;
+
+ private:
+  MemoryFileHandle handle_;
+};
+
+}  // anonymous namespace
+
+MemoryVfs* MemoryVfs::Create() {
+  void* heap_block = Allocate(sizeof(MemoryVfs));
+  MemoryVfs* vfs = new (heap_block) MemoryVfs();
+  DCHECK_EQ(heap_block, static_cast<void*>(vfs));
+  return vfs;
+}
+
+void MemoryVfs::Release() {
+  this->~MemoryVfs();
+  void* heap_block = static_cast<void*>(this);
+  Deallocate(heap_block, sizeof(MemoryVfs));
+}
+
+MemoryVfs::MemoryVfs() = default;
+
+MemoryVfs::~MemoryVfs() {
+  for (const auto& it : files_) {
+    MemoryFile* file = it.second;
+    DCHECK_EQ(file->open_count(), 0U);
+    file->Release();
+  }
+  DCHECK_EQ(stored_bytes_, 0U);
+}
+
+Status MemoryVfs::OpenForRandomAccess(
+    const std::string& file_path, bool create_if_missing, bool error_if_exists,
+    RandomAccessFile** result, size_t* file_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MemoryFile* file = OpenFile(file_path, create_if_missing, error_if_exists);
+  if (file == nullptr)
+    return Status::kIoError;
+
+  void* heap_block = Allocate(sizeof(MemoryRandomAccessFile));
+  MemoryRandomAccessFile* handle =
+      new (heap_block) MemoryRandomAccessFile(file);
+  DCHECK_EQ(heap_block, reinterpret_cast<void*>(handle));
+  *result = handle;
+  *file_size = file->size();
+  return Status::kSuccess;
+}
+
+Status MemoryVfs::OpenForBlockAccess(
+    const std::string& file_path, size_t block_shift, bool create_if_missing,
+    bool error_if_exists, BlockAccessFile** result, size_t* file_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MemoryFile* file = OpenFile(file_path, create_if_missing, error_if_exists);
+  if (file == nullptr)
+    return Status::kIoError;
+
+  void* heap_block = Allocate(sizeof(MemoryBlockAccessFile));
+  MemoryBlockAccessFile* handle =
+      new (heap_block) MemoryBlockAccessFile(file, block_shift);
+  DCHECK_EQ(heap_block, reinterpret_cast<void*>(handle));
+  *result = handle;
+  *file_size = file->size();
+  return Status::kSuccess;
+}
+
+Status MemoryVfs::DeleteFile(const std::string& file_path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto& it = files_.find(file_path);
+  if (it == files_.end())
+    return Status::kNotFound;
+
+  MemoryFile* file = it->second;
+  files_.erase(it);
+  // Open files keep their data until they are closed, like on POSIX systems.
+  if (file->open_count() == 0)
+    file->Release();
+  else
+    file->MarkDeleted();
+  return Status::kSuccess;
+}
+
+void MemoryVfs::SetSimulatedIoCost(
+    uint64_t latency_ns, uint64_t bytes_per_second) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  latency_ns_ = latency_ns;
+  bytes_per_second_ = bytes_per_second;
+}
+
+void MemoryVfs::SimulateCrash() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++crash_count_;
+  for (const auto& it : files_)
+    it.second->RollBackToSync();
+}
+
+void MemoryVfs::SimulateIoCost(size_t byte_count) {
+  uint64_t cost_ns;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cost_ns = latency_ns_;
+    if (bytes_per_second_ != 0) {
+      cost_ns += static_cast<uint64_t>(byte_count) * 1000000000ULL /
+                 bytes_per_second_;
+    }
+  }
+  if (cost_ns != 0)
+    std::this_thread::sleep_for(std::chrono::nanoseconds(cost_ns));
+}
+
+std::chrono::steady_clock::time_point MemoryVfs::SimulatedIoCompletionTime(
+    size_t byte_count) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  uint64_t transfer_ns = 0;
+  if (bytes_per_second_ != 0) {
+    transfer_ns = static_cast<uint64_t>(byte_count) * 1000000000ULL /
+                  bytes_per_second_;
+  }
+  transfers_done_ = std::max(now, transfers_done_) +
+                    std::chrono::nanoseconds(transfer_ns);
+  return transfers_done_ + std::chrono::nanoseconds(latency_ns_);
+}
+
+uint8_t* MemoryVfs::AllocateBlock() {
+  uint8_t* block = reinterpret_cast<uint8_t*>(Allocate(kBlockSize));
+  std::memset(block, 0, kBlockSize);
+  stored_bytes_ += kBlockSize;
+  return block;
+}
+
+void MemoryVfs::ReleaseBlock(uint8_t* block) {
+  DCHECK(block != nullptr);
+  DCHECK_LE(kBlockSize, stored_bytes_);
+  stored_bytes_ -= kBlockSize;
+  Deallocate(block, kBlockSize);
+}
+
+void MemoryVfs::FileClosed(MemoryFile* file) {
+  DCHECK(file != nullptr);
+  file->RemoveHandle();
+  if (file->is_deleted() && file->open_count() == 0)
+    file->Release();
+}
+
+MemoryFile* MemoryVfs::OpenFile(
+    const std::string& file_path, bool create_if_missing,
+    bool error_if_exists) {
+  DCHECK(!error_if_exists || create_if_missing);
+
+  MemoryFile* file;
+  const auto& it = files_.find(file_path);
+  if (it != files_.end()) {
+    if (error_if_exists)
+      return nullptr;
+    file = it->second;
+  } else {
+    if (!create_if_missing)
+      return nullptr;
+    file = MemoryFile::Create(this);
+    files_[file_path] = file;
+  }
+  file->AddHandle();
+  return file;
+}
+
+}  // namespace berrydb
@@ -0,0 +1,169 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_VFS_MEMORY_VFS_H_
+#define BERRYDB_VFS_MEMORY_VFS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "berrydb/platform.h"
+#include "berrydb/vfs.h"
+#include "../util/platform_allocator.h"
+
+namespace berrydb {
+
+class MemoryFile;
+
+/** Vfs implementation that keeps all files in memory.
+ *
+ * This VFS is intended for benchmarks, which should measure the engine's CPU
+ * costs without disk noise, for tests, and for stores whose data does not need
+ * to outlive the process.
+ *
+ * File data is stored sparsely, in blocks of 1 << kBlockShift bytes. Blocks
+ * that were never written take up no memory, and read as zeros.
+ *
+ * The VFS models durability. Data written to a file is not durable until the
+ * file is synced. SimulateCrash() models a power failure by rolling every file
+ * back to the data it had when it was last synced. To keep the memory overhead
+ * of this model low, the VFS only saves the synced content of the blocks that
+ * were modified after the last sync.
+ *
+ * The VFS can also simulate the cost of I/O, via SetSimulatedIoCost(). By
+ * default, I/O is free, so benchmarks are deterministic.
+ *
+ * The VFS is thread-safe, so it can back pools whose partitions run on
+ * different threads. Each file handle must only be used by one thread at a
+ * time. A MemoryVfs must outlive all the pools that use it.
+ */
+class MemoryVfs : public Vfs {
+ public:
+  /** Base-2 log of the size of the blocks used to store file data. */
+  static constexpr size_t kBlockShift = 12;
+
+  /** Creates a VFS with no files. */
+  static MemoryVfs* Create();
+
+  /** Destroys the VFS and all its files.
+   *
+   * All the files opened via this VFS must have been closed. */
+  void Release();
+
+  // Vfs API.
+  Status OpenForRandomAccess(
+      const std::string& file_path, bool create_if_missing,
+      bool error_if_exists, RandomAccessFile** result,
+      size_t* file_size) override;
+  Status OpenForBlockAccess(
+      const std::string& file_path, size_t block_shift,
+      bool create_if_missing, bool error_if_exists,
+      BlockAccessFile** result, size_t* file_size) override;
+  Status DeleteFile(const std::string& file_path) override;
+
+  /** Sets the simulated cost of each I/O operation.
+   *
+   * Reads and writes block the calling thread for the latency, plus the time
+   * needed to transfer the data at the given bandwidth. Syncs only incur the
+   * latency.
+   *
+   * Asynchronous operations do not block. They are reported as complete once
+   * their cost elapses. Operations in flight at the same time overlap their
+   * latencies, but share the bandwidth, like requests queued on an SSD.
+   *
+   * @param latency_ns      fixed cost of each I/O call, in nanoseconds
+   * @param bytes_per_second simulated bandwidth; 0 means infinite bandwidth
+   */
+  void SetSimulatedIoCost(uint64_t latency_ns, uint64_t bytes_per_second);
+
+  /** Simulates a power failure.
+   *
+   * All the files lose the writes that were not followed by a sync. The files
+   * that are open when the crash happens become unusable, and all their I/O
+   * calls fail with kIoError. The files can still be closed, and can be opened
+   * again to observe the data that survived the crash. */
+  void SimulateCrash();
+
+  /** Number of bytes of file data stored by the VFS.
+   *
+   * This counts the blocks that were written, including the saved synced
+   * content of blocks modified since the last sync. */
+  inline size_t stored_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stored_bytes_;
+  }
+
+  /** Guards the VFS state, including the data of all its files.
+   *
+   * This is intended for use by the VFS's files. The methods below that are
+   * intended for the files must be called while holding this mutex, unless
+   * stated otherwise. */
+  inline std::mutex& mutex() const noexcept { return mutex_; }
+
+  /** Number of times SimulateCrash() was called.
+   *
+   * This is intended for use by the VFS's files. */
+  inline size_t crash_count() const noexcept { return crash_count_; }
+
+  /** Blocks the calling thread to simulate the cost of an I/O operation.
+   *
+   * This is intended for use by the VFS's files. The caller must not hold
+   * mutex(), so other threads can perform I/O in the meantime. */
+  void SimulateIoCost(size_t byte_count);
+
+  /** The time when an asynchronous I/O operation started now completes.
+   *
+   * This is intended for use by the VFS's files. */
+  std::chrono::steady_clock::time_point SimulatedIoCompletionTime(
+      size_t byte_count);
+
+  /** Allocates a zero-filled storage block.
+   *
+   * This is intended for use by the VFS's files. */
+  uint8_t* AllocateBlock();
+
+  /** Releases a block obtained by AllocateBlock().
+   *
+   * This is intended for use by the VFS's files. */
+  void ReleaseBlock(uint8_t* block);
+
+  /** Called when a file opened via this VFS is closed. */
+  void FileClosed(MemoryFile* file);
+
+ private:
+  /** Use MemoryVfs::Create() to obtain MemoryVfs instances. */
+  MemoryVfs();
+  /** Use Release() to destroy MemoryVfs instances. */
+  ~MemoryVfs();
+
+  /** Finds, or creates, the file at the given path.
+   *
+   * @return a file with an open handle reserved for the caller, or nullptr */
+  MemoryFile* OpenFile(
+      const std::string& file_path, bool create_if_missing,
+      bool error_if_exists);
+
+  /** See mutex(). */
+  mutable std::mutex mutex_;
+
+  std::unordered_map<std::string, MemoryFile*, std::hash<std::string>,
+      std::equal_to<std::string>,
+      PlatformAllocator<std::pair<const std::string, MemoryFile*>>> files_;
+
+  uint64_t latency_ns_ = 0;
+  uint64_t bytes_per_second_ = 0;
+  /** The time when asynchronous I/O stops using the simulated bandwidth. */
+  std::chrono::steady_clock::time_point transfers_done_;
+  size_t stored_bytes_ = 0;
+  size_t crash_count_ = 0;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_VFS_MEMORY_VFS_H_
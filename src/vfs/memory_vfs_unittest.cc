@@ -0,0 +1,344 @@
+// Copyright 2017 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./memory_vfs.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/status.h"
+#include "../pool_impl.h"
+#include "../store_impl.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+class MemoryVfsTest : public ::testing::Test {
+ protected:
+  MemoryVfsTest() : vfs_(MemoryVfs::Create()) { }
+
+  std::vector<uint8_t> RandomBlocks(size_t block_count) {
+    std::vector<uint8_t> data;
+    data.reserve(block_count << kBlockShift);
+    for (size_t i = 0; i < (block_count << kBlockShift); ++i)
+      data.push_back(static_cast<uint8_t>(rnd_()));
+    return data;
+  }
+
+  const std::string kFileName = "test_memory_vfs.berry";
+  constexpr static size_t kBlockShift = 12;
+  constexpr static size_t kBlockSize = 1 << kBlockShift;
+
+  UniquePtr<MemoryVfs> vfs_;
+  std::mt19937 rnd_;
+};
+
+constexpr size_t MemoryVfsTest::kBlockShift;
+constexpr size_t MemoryVfsTest::kBlockSize;
+
+TEST_F(MemoryVfsTest, OpenOptions) {
+  BlockAccessFile* file = nullptr;
+  size_t file_size = 42;
+  EXPECT_NE(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, false, false, &file, &file_size));
+  EXPECT_EQ(nullptr, file);
+  EXPECT_EQ(42U, file_size);
+
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, true, &file, &file_size));
+  EXPECT_EQ(0U, file_size);
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  file = nullptr;
+  EXPECT_NE(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, true, &file, &file_size));
+  EXPECT_EQ(nullptr, file);
+
+  RandomAccessFile* random_file;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForRandomAccess(
+      kFileName, false, false, &random_file, &file_size));
+  EXPECT_EQ(Status::kSuccess, random_file->Close());
+
+  EXPECT_EQ(Status::kSuccess, vfs_->DeleteFile(kFileName));
+  EXPECT_EQ(Status::kNotFound, vfs_->DeleteFile(kFileName));
+  EXPECT_NE(Status::kSuccess, vfs_->OpenForRandomAccess(
+      kFileName, false, false, &random_file, &file_size));
+}
+
+TEST_F(MemoryVfsTest, SparseBlocks) {
+  BlockAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+
+  std::vector<uint8_t> data = RandomBlocks(2);
+  ASSERT_EQ(Status::kSuccess, file->Write(data.data(), 3 * kBlockSize,
+                                          data.size()));
+  // Only the written blocks take up memory.
+  EXPECT_EQ(2 * kBlockSize, vfs_->stored_bytes());
+
+  std::vector<uint8_t> buffer(5 * kBlockSize, 0xCD);
+  ASSERT_EQ(Status::kSuccess, file->Read(0, buffer.size(), buffer.data()));
+  for (size_t i = 0; i < 3 * kBlockSize; ++i)
+    ASSERT_EQ(0, buffer[i]) << i;
+  EXPECT_EQ(0, std::memcmp(data.data(), buffer.data() + 3 * kBlockSize,
+                           data.size()));
+
+  // Reads past the end of the file fail.
+  EXPECT_EQ(Status::kIoError, file->Read(4 * kBlockSize, 2 * kBlockSize,
+                                         buffer.data()));
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, false, false, &file, &file_size));
+  EXPECT_EQ(5 * kBlockSize, file_size);
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  EXPECT_EQ(Status::kSuccess, vfs_->DeleteFile(kFileName));
+  EXPECT_EQ(0U, vfs_->stored_bytes());
+}
+
+TEST_F(MemoryVfsTest, ConcurrentFiles) {
+  constexpr size_t kThreadCount = 4;
+  constexpr size_t kBlockCount = 64;
+  std::vector<uint8_t> data = RandomBlocks(kBlockCount);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([this, i, &data]() {
+      std::string file_name = kFileName + std::to_string(i);
+      BlockAccessFile* file;
+      size_t file_size;
+      ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+          file_name, kBlockShift, true, true, &file, &file_size));
+      for (size_t j = 0; j < kBlockCount; ++j) {
+        ASSERT_EQ(Status::kSuccess, file->Write(
+            &data[j << kBlockShift], j << kBlockShift, kBlockSize));
+        if (j % 8 == 7) {
+          ASSERT_EQ(Status::kSuccess, file->Sync());
+        }
+      }
+
+      std::vector<uint8_t> buffer(data.size());
+      ASSERT_EQ(Status::kSuccess,
+                file->Read(0, buffer.size(), buffer.data()));
+      EXPECT_EQ(data, buffer);
+      EXPECT_EQ(Status::kSuccess, file->Close());
+      EXPECT_EQ(Status::kSuccess, vfs_->DeleteFile(file_name));
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(0U, vfs_->stored_bytes());
+}
+
+TEST_F(MemoryVfsTest, UnalignedAccess) {
+  RandomAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForRandomAccess(
+      kFileName, true, false, &file, &file_size));
+
+  // The write straddles a block boundary.
+  const uint8_t data[] = "Hello world!";
+  ASSERT_EQ(Status::kSuccess, file->Write(data, kBlockSize - 5, sizeof(data)));
+  uint8_t buffer[sizeof(data)];
+  ASSERT_EQ(Status::kSuccess, file->Read(kBlockSize - 5, sizeof(data),
+                                         buffer));
+  EXPECT_EQ(0, std::memcmp(data, buffer, sizeof(data)));
+  EXPECT_EQ(Status::kSuccess, file->Flush());
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForRandomAccess(
+      kFileName, false, false, &file, &file_size));
+  EXPECT_EQ(kBlockSize - 5 + sizeof(data), file_size);
+  EXPECT_EQ(Status::kSuccess, file->Close());
+}
+
+TEST_F(MemoryVfsTest, AsyncIoOverlapsLatency) {
+  BlockAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+  std::vector<uint8_t> data = RandomBlocks(4);
+  ASSERT_EQ(Status::kSuccess, file->Write(data.data(), 0, 4 * kBlockSize));
+
+  // Four synchronous reads would take 200ms.
+  vfs_->SetSimulatedIoCost(50000000, 0);
+  std::vector<uint8_t> read_data(4 * kBlockSize);
+  BlockIoRequest requests[4];
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < 4; ++i) {
+    file->SubmitRead(i * kBlockSize, kBlockSize,
+                     read_data.data() + i * kBlockSize, &requests[i]);
+  }
+  BlockIoRequest* completed[4];
+  EXPECT_EQ(0U, file->PollCompletions(completed, 4, false));
+  size_t completed_count = 0;
+  while (completed_count < 4) {
+    size_t count = file->PollCompletions(
+        completed + completed_count, 4 - completed_count, true);
+    ASSERT_LT(0U, count);
+    completed_count += count;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_LE(std::chrono::milliseconds(50), elapsed);
+  EXPECT_GT(std::chrono::milliseconds(150), elapsed);
+
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(&requests[i], completed[i]);
+    EXPECT_EQ(Status::kSuccess, completed[i]->status);
+  }
+  EXPECT_EQ(data, read_data);
+  EXPECT_EQ(Status::kSuccess, file->Close());
+}
+
+TEST_F(MemoryVfsTest, AsyncIoAfterCrash) {
+  BlockAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+  std::vector<uint8_t> data = RandomBlocks(1);
+  vfs_->SimulateCrash();
+
+  BlockIoRequest request;
+  file->SubmitWrite(data.data(), 0, kBlockSize, &request);
+  BlockIoRequest* completed;
+  ASSERT_EQ(1U, file->PollCompletions(&completed, 1, true));
+  EXPECT_EQ(&request, completed);
+  EXPECT_EQ(Status::kIoError, request.status);
+  EXPECT_EQ(Status::kSuccess, file->Close());
+}
+
+TEST_F(MemoryVfsTest, CrashDropsUnsyncedWrites) {
+  BlockAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+
+  std::vector<uint8_t> synced_data = RandomBlocks(2);
+  ASSERT_EQ(Status::kSuccess, file->Write(synced_data.data(), 0,
+                                          synced_data.size()));
+  ASSERT_EQ(Status::kSuccess, file->Sync());
+
+  // Overwrite a synced block, and extend the file.
+  std::vector<uint8_t> unsynced_data = RandomBlocks(2);
+  ASSERT_EQ(Status::kSuccess, file->Write(unsynced_data.data(), kBlockSize,
+                                          unsynced_data.size()));
+  // Block 1's synced content is saved, and block 2 is new.
+  EXPECT_EQ(4 * kBlockSize, vfs_->stored_bytes());
+
+  vfs_->SimulateCrash();
+  EXPECT_EQ(2 * kBlockSize, vfs_->stored_bytes());
+
+  // Files that were open during the crash cannot be used.
+  std::vector<uint8_t> buffer(2 * kBlockSize);
+  EXPECT_EQ(Status::kIoError, file->Read(0, kBlockSize, buffer.data()));
+  EXPECT_EQ(Status::kIoError, file->Write(buffer.data(), 0, kBlockSize));
+  EXPECT_EQ(Status::kIoError, file->Sync());
+  EXPECT_EQ(Status::kSuccess, file->Close());
+
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, false, false, &file, &file_size));
+  EXPECT_EQ(2 * kBlockSize, file_size);
+  ASSERT_EQ(Status::kSuccess, file->Read(0, buffer.size(), buffer.data()));
+  EXPECT_EQ(synced_data, buffer);
+
+  // Synced writes survive crashes.
+  ASSERT_EQ(Status::kSuccess, file->Write(unsynced_data.data(), kBlockSize,
+                                          unsynced_data.size()));
+  ASSERT_EQ(Status::kSuccess, file->Sync());
+  EXPECT_EQ(3 * kBlockSize, vfs_->stored_bytes());
+  EXPECT_EQ(Status::kSuccess, file->Close());
+  vfs_->SimulateCrash();
+
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, false, false, &file, &file_size));
+  EXPECT_EQ(3 * kBlockSize, file_size);
+  ASSERT_EQ(Status::kSuccess, file->Read(kBlockSize, buffer.size(),
+                                         buffer.data()));
+  EXPECT_EQ(unsynced_data, buffer);
+  EXPECT_EQ(Status::kSuccess, file->Close());
+}
+
+TEST_F(MemoryVfsTest, DeleteOpenFile) {
+  BlockAccessFile* file;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+  std::vector<uint8_t> data = RandomBlocks(1);
+  ASSERT_EQ(Status::kSuccess, file->Write(data.data(), 0, data.size()));
+
+  // The file's data stays available to the open handle.
+  ASSERT_EQ(Status::kSuccess, vfs_->DeleteFile(kFileName));
+  std::vector<uint8_t> buffer(kBlockSize);
+  ASSERT_EQ(Status::kSuccess, file->Read(0, buffer.size(), buffer.data()));
+  EXPECT_EQ(data, buffer);
+
+  BlockAccessFile* new_file;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, true, &new_file, &file_size));
+  EXPECT_EQ(0U, file_size);
+  EXPECT_EQ(Status::kSuccess, new_file->Close());
+
+  EXPECT_EQ(Status::kSuccess, file->Close());
+  EXPECT_EQ(0U, vfs_->stored_bytes());
+}
+
+TEST_F(MemoryVfsTest, Lock) {
+  BlockAccessFile* file;
+  BlockAccessFile* file2;
+  size_t file_size;
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, true, false, &file, &file_size));
+  ASSERT_EQ(Status::kSuccess, vfs_->OpenForBlockAccess(
+      kFileName, kBlockShift, false, false, &file2, &file_size));
+
+  EXPECT_EQ(Status::kSuccess, file->Lock());
+  EXPECT_EQ(Status::kSuccess, file->Lock());
+  EXPECT_EQ(Status::kAlreadyLocked, file2->Lock());
+
+  // Closing a file releases its lock.
+  EXPECT_EQ(Status::kSuccess, file->Close());
+  EXPECT_EQ(Status::kSuccess, file2->Lock());
+  EXPECT_EQ(Status::kSuccess, file2->Close());
+}
+
+TEST_F(MemoryVfsTest, StoreCrash) {
+  PoolOptions options;
+  options.page_shift = 12;
+  options.page_pool_size = 16;
+  options.vfs = vfs_.get();
+  UniquePtr<PoolImpl> pool(PoolImpl::Create(options));
+
+  StoreImpl* store;
+  ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+      kFileName, StoreOptions(), &store));
+  ASSERT_EQ(Status::kSuccess, store->Close());
+  store->Release();
+
+  ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+      kFileName, StoreOptions(), &store));
+  EXPECT_TRUE(store->was_closed_cleanly());
+
+  // The store cannot record a clean shutdown after the crash.
+  vfs_->SimulateCrash();
+  EXPECT_NE(Status::kSuccess, store->Close());
+  store->Release();
+
+  ASSERT_EQ(Status::kSuccess, pool->OpenStore(
+      kFileName, StoreOptions(), &store));
+  EXPECT_FALSE(store->was_closed_cleanly());
+  ASSERT_EQ(Status::kSuccess, store->Close());
+  store->Release();
+}
+
+}  // namespace berrydb